@@ -26,6 +26,12 @@
 #cmakedefine BLAS_POST
 #cmakedefine LAPACK_POST
 #cmakedefine AVOID_COMPLEX_MPI
+#cmakedefine HYBRID
+#cmakedefine GEMM_BATCH
+#cmakedefine MAP_KERNELS
+#cmakedefine MIXED_PRECISION
+#cmakedefine RECURSIVE_HALVING
+#cmakedefine SIMD_SPECIAL_FUNCTIONS
 #cmakedefine MKL
 #cmakedefine ESSL
 #cmakedefine BGP
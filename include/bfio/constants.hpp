@@ -38,8 +38,18 @@ template<std::size_t x>
 struct Pow<x,0>
 { enum { val = (size_t)1 }; };
 
+// Identity<T>::Type is T, but naming a parameter's type through it keeps T
+// from being deduced from the corresponding argument
+template<typename T>
+struct Identity
+{ typedef T Type; };
+
 enum Direction { FORWARD, ADJOINT };
 
+// The precision in which weights are sent during each sum-scatter. They are
+// always summed in full precision.
+enum WireFormat { FULL_PRECISION_WIRE, SINGLE_PRECISION_WIRE, BFLOAT16_WIRE };
+
 } // bfio
 
 #endif // BFIO_CONSTANTS_HPP
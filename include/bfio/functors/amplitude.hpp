@@ -20,6 +20,7 @@
 
 #include <cstddef>
 #include <complex>
+#include <stdexcept>
 #include <vector>
 
 #include "bfio/structures/array.hpp"
@@ -54,6 +55,22 @@ public:
     ( const std::vector< Array<R,d>      >& x,
       const std::vector< Array<R,d>      >& p,
             std::vector< std::complex<R> >& results ) const;
+
+    // If the amplitude is a short sum of products, 
+    //   a(x,p) = sum_{r=0}^{rank-1} a_r(x) b_r(p),
+    // then a derived class may return its rank and override 
+    // BatchEvaluateFactors so that the factors can be applied as diagonal 
+    // scalings rather than evaluating the amplitude at every pair of points.
+    // The default rank of zero means that no factorization is available.
+    virtual std::size_t GetRank() const;
+
+    // Evaluates a_r(x_i) into xResults[r*x.size()+i] and b_r(p_k) into 
+    // pResults[r*p.size()+k]
+    virtual void BatchEvaluateFactors
+    ( const std::vector< Array<R,d>      >& x,
+      const std::vector< Array<R,d>      >& p,
+            std::vector< std::complex<R> >& xResults,
+            std::vector< std::complex<R> >& pResults ) const;
 };
 
 // Extend the default class and explicitly call it a unit amplitude functor.
@@ -74,6 +91,38 @@ public:
             std::vector< std::complex<R> >& results ) const;
 };
 
+// Calls the member functions of an amplitude functor without virtual 
+// dispatch when its concrete type is known at compile time (see the 
+// corresponding routines in phase.hpp)
+template<class AmplitudeT,typename R,std::size_t d>
+std::complex<R> EvaluateAmplitude
+( const AmplitudeT& amplitude, const Array<R,d>& x, const Array<R,d>& p );
+
+template<typename R,std::size_t d>
+std::complex<R> EvaluateAmplitude
+( const Amplitude<R,d>& amplitude, const Array<R,d>& x, const Array<R,d>& p );
+
+template<class AmplitudeT,typename R,std::size_t d>
+void BatchEvaluateAmplitude
+( const AmplitudeT& amplitude,
+  const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& results );
+
+template<typename R,std::size_t d>
+void BatchEvaluateAmplitude
+( const Amplitude<R,d>& amplitude,
+  const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& results );
+
+// Copies an amplitude functor, through Clone unless its concrete type is known
+template<class AmplitudeT>
+AmplitudeT* CopyAmplitude( const AmplitudeT& amplitude );
+
+template<typename R,std::size_t d>
+Amplitude<R,d>* CopyAmplitude( const Amplitude<R,d>& amplitude );
+
 // Implementations
 
 template<typename R,std::size_t d>
@@ -110,6 +159,22 @@ Amplitude<R,d>::BatchEvaluate
             results[i*p.size()+j] = (*this)(x[i],p[j]);
 }
 
+template<typename R,std::size_t d>
+inline std::size_t
+Amplitude<R,d>::GetRank() const
+{ return 0; }
+
+template<typename R,std::size_t d>
+inline void
+Amplitude<R,d>::BatchEvaluateFactors
+( const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& xResults,
+        std::vector< std::complex<R> >& pResults ) const
+{
+    throw std::logic_error("BatchEvaluateFactors was not overridden.");
+}
+
 template<typename R,std::size_t d>
 inline
 UnitAmplitude<R,d>::UnitAmplitude() 
@@ -140,6 +205,86 @@ UnitAmplitude<R,d>::BatchEvaluate
         results[i] = 1;
 }
 
+template<class AmplitudeT,typename R,std::size_t d>
+inline std::complex<R>
+EvaluateAmplitude
+( const AmplitudeT& amplitude, const Array<R,d>& x, const Array<R,d>& p )
+{ return amplitude.AmplitudeT::operator()( x, p ); }
+
+template<typename R,std::size_t d>
+inline std::complex<R>
+EvaluateAmplitude
+( const Amplitude<R,d>& amplitude, const Array<R,d>& x, const Array<R,d>& p )
+{ return amplitude( x, p ); }
+
+namespace functor_dispatch {
+
+template<class AmplitudeT,typename R,std::size_t d>
+inline void
+BatchEvaluateAmplitude
+( const AmplitudeT& amplitude,
+  const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& results,
+  void (Amplitude<R,d>::*)
+  ( const std::vector< Array<R,d>      >&,
+    const std::vector< Array<R,d>      >&,
+          std::vector< std::complex<R> >& ) const )
+{
+    const std::size_t nxPoints = x.size();
+    const std::size_t npPoints = p.size();
+    results.resize( nxPoints*npPoints );
+    for( std::size_t i=0; i<nxPoints; ++i )
+        for( std::size_t j=0; j<npPoints; ++j )
+            results[i*npPoints+j] = amplitude.AmplitudeT::operator()(x[i],p[j]);
+}
+
+template<class AmplitudeT,class OwnerT,typename R,std::size_t d>
+inline void
+BatchEvaluateAmplitude
+( const AmplitudeT& amplitude,
+  const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& results,
+  void (OwnerT::*)
+  ( const std::vector< Array<R,d>      >&,
+    const std::vector< Array<R,d>      >&,
+          std::vector< std::complex<R> >& ) const )
+{ amplitude.OwnerT::BatchEvaluate( x, p, results ); }
+
+} // functor_dispatch
+
+template<class AmplitudeT,typename R,std::size_t d>
+inline void
+BatchEvaluateAmplitude
+( const AmplitudeT& amplitude,
+  const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& results )
+{
+    functor_dispatch::BatchEvaluateAmplitude
+    ( amplitude, x, p, results, &AmplitudeT::BatchEvaluate );
+}
+
+template<typename R,std::size_t d>
+inline void
+BatchEvaluateAmplitude
+( const Amplitude<R,d>& amplitude,
+  const std::vector< Array<R,d>      >& x,
+  const std::vector< Array<R,d>      >& p,
+        std::vector< std::complex<R> >& results )
+{ amplitude.BatchEvaluate( x, p, results ); }
+
+template<class AmplitudeT>
+inline AmplitudeT*
+CopyAmplitude( const AmplitudeT& amplitude )
+{ return new AmplitudeT( amplitude ); }
+
+template<typename R,std::size_t d>
+inline Amplitude<R,d>*
+CopyAmplitude( const Amplitude<R,d>& amplitude )
+{ return amplitude.Clone(); }
+
 } // bfio
 
 #endif // BFIO_FUNCTORS_AMPLITUDE_HPP
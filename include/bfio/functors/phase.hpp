@@ -22,14 +22,40 @@
 #include <vector>
 
 #include "bfio/structures/array.hpp"
+#include "bfio/tools/special_functions.hpp"
 
 namespace bfio {
 
+// The precision in which the phase and amplitude functions of a transform 
+// over type R are evaluated. It is R unless MIXED_PRECISION is defined, in 
+// which case single-precision transforms evaluate their phases in double 
+// precision: the phases grow like 2 pi N, and so they must be reduced in 
+// double precision before their sines and cosines can be accurately formed 
+// in single precision.
+template<typename R>
+struct PhaseReal
+{ typedef R Type; };
+
+#ifdef MIXED_PRECISION
+template<>
+struct PhaseReal<float>
+{ typedef double Type; };
+#endif // MIXED_PRECISION
+
 // You will need to derive from this class and override the operator()
 template<typename R,std::size_t d>
 class Phase
 {
+    // If a derived class sets this variable to 'true', then the phase is 
+    // assumed to be a sum of one-dimensional terms, 
+    //   Phi(x,p) = sum_j phi_j(x_j,p_j),
+    // and its imaginary exponentials over tensor-product grids are formed
+    // from those of the terms.
+    bool _isSeparable;
+
 public:
+    Phase();
+    Phase( bool isSeparable );
     virtual ~Phase();
 
     virtual Phase<R,d>* Clone() const = 0;
@@ -45,10 +71,154 @@ public:
     ( const std::vector< Array<R,d> >& x,
       const std::vector< Array<R,d> >& p,
             std::vector< R          >& results ) const;
+
+    // Forms sin(Phi(x_i,p_j)) and cos(Phi(x_i,p_j)) in the same ordering as
+    // BatchEvaluate. The default evaluates the phases into the phiResults 
+    // scratch buffer and then calls SinCosBatch, but phase functions whose 
+    // imaginary exponentials have a closed form (e.g., the Fourier phases) 
+    // may override it to avoid forming the phases and most of the 
+    // transcendental calls, in which case phiResults may be ignored.
+    virtual void BatchEvaluateImagExp
+    ( const std::vector< Array<R,d> >& x,
+      const std::vector< Array<R,d> >& p,
+            std::vector< R          >& phiResults,
+            std::vector< R          >& sinResults,
+            std::vector< R          >& cosResults ) const;
+
+    bool IsSeparable() const;
+
+    // Evaluates phi_j(x_i,p_k) into results[i*p.size()+k] for a separable
+    // phase. Only the sum of the terms is significant, and the default forms
+    // them from operator() using
+    //   Phi(x,p) = sum_j [Phi(x_j e_j,p_j e_j) - (d-1)/d Phi(0,0)],
+    // so it should be overridden if the phase is not defined at such points.
+    virtual void BatchEvaluateTerm
+    ( std::size_t j,
+      const std::vector<R>& x,
+      const std::vector<R>& p,
+            std::vector<R>& results ) const;
 };
 
+// The kernels form their phase factors through this routine so that 
+// BatchEvaluateImagExp is used whenever the phases are evaluated in the 
+// precision of the transform.
+template<typename R,std::size_t d>
+void ImagExpBatch
+( const Phase<R,d>& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults );
+
+#ifdef MIXED_PRECISION
+// Otherwise the double-precision phases must be reduced before the 
+// single-precision sines and cosines are formed, so the hook is bypassed.
+template<std::size_t d>
+void ImagExpBatch
+( const Phase<double,d>& phase,
+  const std::vector< Array<double,d> >& x,
+  const std::vector< Array<double,d> >& p,
+        std::vector< double          >& phiResults,
+        std::vector< float           >& sinResults,
+        std::vector< float           >& cosResults );
+#endif // MIXED_PRECISION
+
+// When the concrete type of a phase functor is known at compile time (see the
+// ReducedFIO overloads which take it as a template argument), the following 
+// overloads call its member functions without virtual dispatch so that they 
+// may be inlined; the more specialized overloads for Phase<R,d> itself make 
+// the usual virtual calls. If PhaseT does not override BatchEvaluate or 
+// BatchEvaluateImagExp, the defaults are formed from its operator().
+template<class PhaseT,typename R,std::size_t d>
+R EvaluatePhase
+( const PhaseT& phase, const Array<R,d>& x, const Array<R,d>& p );
+
+template<typename R,std::size_t d>
+R EvaluatePhase
+( const Phase<R,d>& phase, const Array<R,d>& x, const Array<R,d>& p );
+
+template<class PhaseT,typename R,std::size_t d>
+void BatchEvaluatePhase
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& results );
+
+template<typename R,std::size_t d>
+void BatchEvaluatePhase
+( const Phase<R,d>& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& results );
+
+template<class PhaseT,typename R,std::size_t d>
+void ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults );
+
+#ifdef MIXED_PRECISION
+template<class PhaseT,std::size_t d>
+void ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<double,d> >& x,
+  const std::vector< Array<double,d> >& p,
+        std::vector< double          >& phiResults,
+        std::vector< float           >& sinResults,
+        std::vector< float           >& cosResults );
+#endif // MIXED_PRECISION
+
+// As above, but with a scratch buffer for the phases reduced by the 
+// mixed-precision overloads (see SinCosBatch), which is otherwise allocated
+// by every call; it is ignored when the phases are evaluated in the 
+// precision of the transform.
+template<class PhaseT,typename R,std::size_t d>
+void ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& reducedPhases,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults );
+
+#ifdef MIXED_PRECISION
+template<class PhaseT,std::size_t d>
+void ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<double,d> >& x,
+  const std::vector< Array<double,d> >& p,
+        std::vector< double          >& phiResults,
+        std::vector< float           >& reducedPhases,
+        std::vector< float           >& sinResults,
+        std::vector< float           >& cosResults );
+#endif // MIXED_PRECISION
+
+// Copies a phase functor, through Clone unless its concrete type is known
+template<class PhaseT>
+PhaseT* CopyPhase( const PhaseT& phase );
+
+template<typename R,std::size_t d>
+Phase<R,d>* CopyPhase( const Phase<R,d>& phase );
+
 // Implementations
 
+template<typename R,std::size_t d>
+inline
+Phase<R,d>::Phase() 
+: _isSeparable(false)
+{ }
+
+template<typename R,std::size_t d>
+inline
+Phase<R,d>::Phase( bool isSeparable ) 
+: _isSeparable(isSeparable)
+{ }
+
 template<typename R,std::size_t d>
 inline
 Phase<R,d>::~Phase() 
@@ -67,6 +237,259 @@ Phase<R,d>::BatchEvaluate
             results[i*p.size()+j] = (*this)(x[i],p[j]);
 }
 
+template<typename R,std::size_t d>
+void 
+Phase<R,d>::BatchEvaluateImagExp
+( const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults ) const
+{
+    BatchEvaluate( x, p, phiResults );
+    SinCosBatch( phiResults, sinResults, cosResults );
+}
+
+template<typename R,std::size_t d>
+inline bool
+Phase<R,d>::IsSeparable() const
+{ return _isSeparable; }
+
+template<typename R,std::size_t d>
+void
+Phase<R,d>::BatchEvaluateTerm
+( std::size_t j,
+  const std::vector<R>& x,
+  const std::vector<R>& p,
+        std::vector<R>& results ) const
+{
+    const Array<R,d> zero( 0 );
+    std::vector< Array<R,d> > xPoints( x.size(), zero );
+    std::vector< Array<R,d> > pPoints( p.size(), zero );
+    for( std::size_t i=0; i<x.size(); ++i )
+        xPoints[i][j] = x[i];
+    for( std::size_t k=0; k<p.size(); ++k )
+        pPoints[k][j] = p[k];
+    BatchEvaluate( xPoints, pPoints, results );
+
+    const R offset = (d-1)*(*this)(zero,zero)/d;
+    for( std::size_t i=0; i<results.size(); ++i )
+        results[i] -= offset;
+}
+
+template<typename R,std::size_t d>
+inline void 
+ImagExpBatch
+( const Phase<R,d>& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults )
+{ phase.BatchEvaluateImagExp( x, p, phiResults, sinResults, cosResults ); }
+
+#ifdef MIXED_PRECISION
+template<std::size_t d>
+inline void 
+ImagExpBatch
+( const Phase<double,d>& phase,
+  const std::vector< Array<double,d> >& x,
+  const std::vector< Array<double,d> >& p,
+        std::vector< double          >& phiResults,
+        std::vector< float           >& sinResults,
+        std::vector< float           >& cosResults )
+{
+    BatchEvaluatePhase( phase, x, p, phiResults );
+    SinCosBatch( phiResults, sinResults, cosResults );
+}
+#endif // MIXED_PRECISION
+
+template<class PhaseT,typename R,std::size_t d>
+inline R
+EvaluatePhase
+( const PhaseT& phase, const Array<R,d>& x, const Array<R,d>& p )
+{ return phase.PhaseT::operator()( x, p ); }
+
+template<typename R,std::size_t d>
+inline R
+EvaluatePhase
+( const Phase<R,d>& phase, const Array<R,d>& x, const Array<R,d>& p )
+{ return phase( x, p ); }
+
+namespace functor_dispatch {
+
+// The member function pointers are only used to determine which class 
+// provides the member function, PhaseT or Phase<R,d>
+
+template<class PhaseT,typename R,std::size_t d>
+inline void
+BatchEvaluatePhase
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& results,
+  void (Phase<R,d>::*)
+  ( const std::vector< Array<R,d> >&,
+    const std::vector< Array<R,d> >&,
+          std::vector< R          >& ) const )
+{
+    const std::size_t nxPoints = x.size();
+    const std::size_t npPoints = p.size();
+    results.resize( nxPoints*npPoints );
+    if( results.empty() )
+        return;
+    R* RESTRICT resultsBuffer = &results[0];
+    for( std::size_t i=0; i<nxPoints; ++i )
+        for( std::size_t j=0; j<npPoints; ++j )
+            resultsBuffer[i*npPoints+j] = phase.PhaseT::operator()(x[i],p[j]);
+}
+
+template<class PhaseT,class OwnerT,typename R,std::size_t d>
+inline void
+BatchEvaluatePhase
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& results,
+  void (OwnerT::*)
+  ( const std::vector< Array<R,d> >&,
+    const std::vector< Array<R,d> >&,
+          std::vector< R          >& ) const )
+{ phase.OwnerT::BatchEvaluate( x, p, results ); }
+
+template<class PhaseT,typename R,std::size_t d>
+inline void
+ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults,
+  void (Phase<R,d>::*)
+  ( const std::vector< Array<R,d> >&,
+    const std::vector< Array<R,d> >&,
+          std::vector< R          >&,
+          std::vector< R          >&,
+          std::vector< R          >& ) const )
+{
+    bfio::BatchEvaluatePhase( phase, x, p, phiResults );
+    SinCosBatch( phiResults, sinResults, cosResults );
+}
+
+template<class PhaseT,class OwnerT,typename R,std::size_t d>
+inline void
+ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults,
+  void (OwnerT::*)
+  ( const std::vector< Array<R,d> >&,
+    const std::vector< Array<R,d> >&,
+          std::vector< R          >&,
+          std::vector< R          >&,
+          std::vector< R          >& ) const )
+{
+    phase.OwnerT::BatchEvaluateImagExp
+    ( x, p, phiResults, sinResults, cosResults );
+}
+
+} // functor_dispatch
+
+template<class PhaseT,typename R,std::size_t d>
+inline void
+BatchEvaluatePhase
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& results )
+{
+    functor_dispatch::BatchEvaluatePhase
+    ( phase, x, p, results, &PhaseT::BatchEvaluate );
+}
+
+template<typename R,std::size_t d>
+inline void
+BatchEvaluatePhase
+( const Phase<R,d>& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& results )
+{ phase.BatchEvaluate( x, p, results ); }
+
+template<class PhaseT,typename R,std::size_t d>
+inline void
+ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults )
+{
+    functor_dispatch::ImagExpBatch
+    ( phase, x, p, phiResults, sinResults, cosResults, 
+      &PhaseT::BatchEvaluateImagExp );
+}
+
+#ifdef MIXED_PRECISION
+template<class PhaseT,std::size_t d>
+inline void
+ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<double,d> >& x,
+  const std::vector< Array<double,d> >& p,
+        std::vector< double          >& phiResults,
+        std::vector< float           >& sinResults,
+        std::vector< float           >& cosResults )
+{
+    BatchEvaluatePhase( phase, x, p, phiResults );
+    SinCosBatch( phiResults, sinResults, cosResults );
+}
+#endif // MIXED_PRECISION
+
+template<class PhaseT,typename R,std::size_t d>
+inline void
+ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<R,d> >& x,
+  const std::vector< Array<R,d> >& p,
+        std::vector< R          >& phiResults,
+        std::vector< R          >& reducedPhases,
+        std::vector< R          >& sinResults,
+        std::vector< R          >& cosResults )
+{ ImagExpBatch( phase, x, p, phiResults, sinResults, cosResults ); }
+
+#ifdef MIXED_PRECISION
+template<class PhaseT,std::size_t d>
+inline void
+ImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<double,d> >& x,
+  const std::vector< Array<double,d> >& p,
+        std::vector< double          >& phiResults,
+        std::vector< float           >& reducedPhases,
+        std::vector< float           >& sinResults,
+        std::vector< float           >& cosResults )
+{
+    BatchEvaluatePhase( phase, x, p, phiResults );
+    SinCosBatch( phiResults, reducedPhases, sinResults, cosResults );
+}
+#endif // MIXED_PRECISION
+
+template<class PhaseT>
+inline PhaseT*
+CopyPhase( const PhaseT& phase )
+{ return new PhaseT( phase ); }
+
+template<typename R,std::size_t d>
+inline Phase<R,d>*
+CopyPhase( const Phase<R,d>& phase )
+{ return phase.Clone(); }
+
 } // bfio
 
 #endif // BFIO_FUNCTORS_PHASE_HPP
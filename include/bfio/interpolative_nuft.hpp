@@ -97,6 +97,10 @@ InterpolativeNUFT
 
     const Direction direction = context.GetDirection();
     const R SignedTwoPi = ( direction==FORWARD ? -TwoPi : TwoPi );
+#ifndef RELEASE
+    if( !plan.IsGenerated() )
+        throw std::logic_error("The plan must be generated before use");
+#endif
 
     // Extract our communicator and its size
     MPI_Comm comm = plan.GetComm();
@@ -147,6 +151,10 @@ InterpolativeNUFT
     ( context, plan, sourceBox, targetBox, mySourceBox, 
       log2LocalSourceBoxes, log2LocalSourceBoxesPerDim, mySources, 
       weightGridList );
+    // The members of our team only hold the check potentials of their own
+    // sources, so sum them into the share which we backtransform
+    plan.SumTeamShares
+    ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
     interpolative_nuft::initializeCheckPotentialsTimer.Stop();
     interpolative_nuft::formEquivalentSourcesTimer.Start();
@@ -156,6 +164,8 @@ InterpolativeNUFT
       log2LocalSourceBoxes, log2LocalTargetBoxes, 
       log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim, 
       weightGridList );
+    plan.GatherTeamShares
+    ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
     interpolative_nuft::formEquivalentSourcesTimer.Stop();
 #endif
@@ -183,73 +193,111 @@ InterpolativeNUFT
             log2LocalSourceBoxes -= d;
             log2LocalTargetBoxes += d;
 
-            // Loop over boxes in target domain. 
+            // Loop over the groups of interactions between a parent target 
+            // box and the children of a source box. Since the source indices
+            // are stored digit-reversed, the 2^d children of the source box
+            // occupy exactly the slots that the interactions of the 2^d 
+            // children of the target box with the source box will, and so 
+            // each group can be updated in place once its new weights have 
+            // all been formed. Only our team member's share of the new 
+            // interactions is formed.
+            const std::size_t numChildren = 1u<<d;
+            const std::size_t numLocalSourceBoxes = 1u<<log2LocalSourceBoxes;
+            std::size_t shareBegin, shareEnd;
+            plan.TeamShare
+            ( weightGridList.Length(), shareBegin, shareEnd );
             std::vector<R> prescalingArguments( q );
-            Array<std::vector<R>,d> realPrescalings;
-            Array<std::vector<R>,d> imagPrescalings;
-            for( std::size_t j=0; j<d; ++j )
-            {
-                realPrescalings[j].resize(q);
-                imagPrescalings[j].resize(q);
-            }
+            std::vector< Array<std::vector<R>,d> > 
+                realPrescalings( numChildren ), imagPrescalings( numChildren );
+            std::vector< Array<R,d> > x0As( numChildren );
+            WeightGridList<R,d,q> groupWeightGridList( numChildren );
             const std::vector<R>& chebyshevNodes = context.GetChebyshevNodes();
-            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-            WeightGridList<R,d,q> oldWeightGridList( weightGridList );
-            for( std::size_t targetIndex=0; 
-                 targetIndex<(1u<<log2LocalTargetBoxes); 
-                 ++targetIndex, AWalker.Walk() )
+            for( std::size_t parentTargetIndex=0; 
+                 parentTargetIndex<(1u<<(log2LocalTargetBoxes-d)); 
+                 ++parentTargetIndex )
             {
-                const Array<std::size_t,d> A = AWalker.State();
+                for( std::size_t a=0; a<numChildren; ++a )
+                {
+                    const Array<std::size_t,d> A = 
+                        UnflattenConstrainedHTreeIndex
+                        ( (parentTargetIndex<<d)+a, 
+                          log2LocalTargetBoxesPerDim );
 
-                // Compute coordinates and center of this target box
-                Array<R,d> x0A;
-                for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+                    // Compute coordinates and center of this target box
+                    Array<R,d>& x0A = x0As[a];
+                    for( std::size_t j=0; j<d; ++j )
+                        x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
 
-                // Store the prescaling factors for forming the check potentials
-                for( std::size_t j=0; j<d; ++j )
-                {
-                    for( std::size_t t=0; t<q; ++t )
-                        prescalingArguments[t] = 
-                            SignedTwoPi*x0A[j]*chebyshevNodes[t]*wB[j]/2;
-                    SinCosBatch
-                    ( prescalingArguments, 
-                      imagPrescalings[j], realPrescalings[j] );
+                    // Store the prescaling factors for forming the check 
+                    // potentials
+                    for( std::size_t j=0; j<d; ++j )
+                    {
+                        for( std::size_t t=0; t<q; ++t )
+                            prescalingArguments[t] = 
+                                SignedTwoPi*x0A[j]*chebyshevNodes[t]*wB[j]/2;
+                        SinCosBatch
+                        ( prescalingArguments, 
+                          imagPrescalings[a][j], realPrescalings[a][j] );
+                    }
                 }
 
                 // Loop over the B boxes in source domain
-                ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
-                for( std::size_t sourceIndex=0; 
-                     sourceIndex<(1u<<log2LocalSourceBoxes); 
-                     ++sourceIndex, BWalker.Walk() )
+                for( std::size_t reversedSourceIndex=0; 
+                     reversedSourceIndex<numLocalSourceBoxes; 
+                     ++reversedSourceIndex )
                 {
-                    const Array<std::size_t,d> B = BWalker.State();
+                    const std::size_t sourceIndex = 
+                        UnreverseConstrainedHTreeIndex<d>
+                        ( reversedSourceIndex, log2LocalSourceBoxes );
+                    const Array<std::size_t,d> B = 
+                        UnflattenConstrainedHTreeIndex
+                        ( sourceIndex, log2LocalSourceBoxesPerDim );
 
                     // Compute coordinates and center of this source box
                     Array<R,d> p0B;
                     for( std::size_t j=0; j<d; ++j )
                         p0B[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
 
-                    // We are storing the interaction pairs source-major
-                    const std::size_t interactionIndex = 
-                        sourceIndex + (targetIndex<<log2LocalSourceBoxes);
-
-                    // Grab the interaction offset for the parent of target box 
-                    // i interacting with the children of source box k
-                    const std::size_t parentInteractionOffset = 
-                        ((targetIndex>>d)<<(log2LocalSourceBoxes+d)) + 
-                        (sourceIndex<<d);
+                    // The interactions of the group (both old and new) are 
+                    // numLocalSourceBoxes apart
+                    const std::size_t groupOffset = 
+                        (parentTargetIndex<<(log2LocalSourceBoxes+d)) + 
+                        reversedSourceIndex;
 
 #ifdef TIMING
 		    interpolative_nuft::formCheckPotentialsTimer.Start();
 #endif
-                    interpolative_nuft::FormCheckPotentials
-                    ( context, plan, level, realPrescalings, imagPrescalings,
-                      x0A, p0B, wA, wB, parentInteractionOffset,
-                      oldWeightGridList, weightGridList[interactionIndex] );
+                    for( std::size_t a=0; a<numChildren; ++a )
+                    {
+                        const std::size_t interaction = 
+                            groupOffset + a*numLocalSourceBoxes;
+                        if( interaction < shareBegin || 
+                            interaction >= shareEnd )
+                            continue;
+                        interpolative_nuft::FormCheckPotentials
+                        ( context, plan, level, 
+                          realPrescalings[a], imagPrescalings[a],
+                          x0As[a], p0B, wA, wB, 
+                          groupOffset, numLocalSourceBoxes, weightGridList, 
+                          groupWeightGridList[a] );
+                    }
 #ifdef TIMING
 		    interpolative_nuft::formCheckPotentialsTimer.Stop();
 #endif
+
+                    // Overwrite the old weights of the group with the new ones
+                    for( std::size_t a=0; a<numChildren; ++a )
+                    {
+                        const std::size_t interaction = 
+                            groupOffset + a*numLocalSourceBoxes;
+                        if( interaction < shareBegin || 
+                            interaction >= shareEnd )
+                            continue;
+                        std::memcpy
+                        ( weightGridList[interaction].Buffer(), 
+                          groupWeightGridList[a].Buffer(), 
+                          2*q_to_d*sizeof(R) );
+                    }
                 }
             }
 #ifdef TIMING
@@ -261,6 +309,8 @@ InterpolativeNUFT
               log2LocalSourceBoxes, log2LocalTargetBoxes,
               log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim,
               weightGridList );
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
 	    interpolative_nuft::formEquivalentSourcesTimer.Stop();
 #endif
@@ -268,7 +318,6 @@ InterpolativeNUFT
         else 
         {
             const std::size_t log2NumMergingProcesses = d-log2LocalSourceBoxes;
-            const std::size_t numMergingProcesses = 1u<<log2NumMergingProcesses;
 
             log2LocalSourceBoxes = 0; 
             for( std::size_t j=0; j<d; ++j )
@@ -298,7 +347,9 @@ InterpolativeNUFT
                 p0B[j] = mySourceBox.offsets[j] + wB[j]/2;
 
             // Form the partial weights by looping over the boxes in the  
-            // target domain.
+            // target domain. The boxes are visited in chunks, and the 
+            // summation of each chunk's weights is started as soon as they 
+            // are formed so that it may overlap with forming the next.
             std::vector<R> prescalingArguments( q );
             Array<std::vector<R>,d> realPrescalings;
             Array<std::vector<R>,d> imagPrescalings;
@@ -308,108 +359,67 @@ InterpolativeNUFT
                 imagPrescalings[j].resize(q);
             }
             const std::vector<R>& chebyshevNodes = context.GetChebyshevNodes();
-            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-            WeightGridList<R,d,q> partialWeightGridList
-            ( 1<<log2LocalTargetBoxes );
-            for( std::size_t targetIndex=0; 
-                 targetIndex<(1u<<log2LocalTargetBoxes); 
-                 ++targetIndex, AWalker.Walk() )
+            SumScatterPipeline<R,d,q> pipeline
+            ( plan, level, log2NumMergingProcesses, log2LocalTargetBoxes );
+            for( std::size_t chunk=0; chunk<pipeline.NumChunks(); ++chunk )
             {
-                const Array<std::size_t,d> A = AWalker.State();
-
-                // Compute coordinates and center of this target box
-                Array<R,d> x0A;
-                for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
-
-                // Store the prescaling factors for forming the check potentials
-                for( std::size_t j=0; j<d; ++j )
+                for( std::size_t i=0; i<pipeline.ChunkSize(); ++i )
                 {
-                    for( std::size_t t=0; t<q; ++t )
-                        prescalingArguments[t] =
-                            SignedTwoPi*x0A[j]*chebyshevNodes[t]*wB[j]/2;
-                    SinCosBatch
-                    ( prescalingArguments, 
-                      imagPrescalings[j], realPrescalings[j] );
-                }
+                    const std::size_t targetIndex = 
+                        pipeline.TargetIndex( chunk, i );
+                    const Array<std::size_t,d> A = 
+                        UnflattenConstrainedHTreeIndex
+                        ( targetIndex, log2LocalTargetBoxesPerDim );
+
+                    // Compute coordinates and center of this target box
+                    Array<R,d> x0A;
+                    for( std::size_t j=0; j<d; ++j )
+                        x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+
+                    // Store the prescaling factors for forming the check 
+                    // potentials
+                    for( std::size_t j=0; j<d; ++j )
+                    {
+                        for( std::size_t t=0; t<q; ++t )
+                            prescalingArguments[t] =
+                                SignedTwoPi*x0A[j]*chebyshevNodes[t]*wB[j]/2;
+                        SinCosBatch
+                        ( prescalingArguments, 
+                          imagPrescalings[j], realPrescalings[j] );
+                    }
 
-                // Compute the interaction offset of A's parent interacting 
-                // with the remaining local source boxes
-                const std::size_t parentInteractionOffset = 
-                    ((targetIndex>>d)<<(d-log2NumMergingProcesses));
+                    // Compute the interaction offset of A's parent 
+                    // interacting with the remaining local source boxes. 
+                    // There are fewer than 2^d of them, so their indices 
+                    // are not reversed.
+                    const std::size_t parentInteractionOffset = 
+                        ((targetIndex>>d)<<(d-log2NumMergingProcesses));
 
 #ifdef TIMING
-		interpolative_nuft::formCheckPotentialsTimer.Start();
+                    interpolative_nuft::formCheckPotentialsTimer.Start();
+#endif
+                    interpolative_nuft::FormCheckPotentials
+                    ( context, plan, level, realPrescalings, imagPrescalings,
+                      x0A, p0B, wA, wB, parentInteractionOffset, 1,
+                      weightGridList, pipeline.PartialWeights( chunk, i ) );
+#ifdef TIMING
+                    interpolative_nuft::formCheckPotentialsTimer.Stop();
+#endif
+                }
+#ifdef TIMING
+                interpolative_nuft::sumScatterTimer.Start();
 #endif
-                interpolative_nuft::FormCheckPotentials
-                ( context, plan, level, realPrescalings, imagPrescalings,
-                  x0A, p0B, wA, wB, parentInteractionOffset,
-                  weightGridList, partialWeightGridList[targetIndex] );
+                pipeline.Scatter( chunk );
 #ifdef TIMING
-		interpolative_nuft::formCheckPotentialsTimer.Stop();
+                interpolative_nuft::sumScatterTimer.Stop();
 #endif
             }
 
-            // Scatter the summation of the weights
+            // Wait for the summation of the weights
 #ifdef TIMING
             interpolative_nuft::sumScatterTimer.Start();
 #endif
-            std::vector<int> recvCounts( numMergingProcesses );
-            for( std::size_t j=0; j<numMergingProcesses; ++j )
-                recvCounts[j] = 2*weightGridList.Length()*q_to_d;
-            // Currently two types of planned communication are supported, as 
-            // they are the only required types for transforming and inverting 
-            // the transform:
-            //  1) partitions of dimensions 0 -> c
-            //  2) partitions of dimensions c -> d-1
-            // Both 1 and 2 include partitioning 0 -> d-1, but, in general, 
-            // the second category never requires packing.
-            const std::size_t log2SubclusterSize = 
-                plan.GetLog2SubclusterSize( level );
-            if( log2SubclusterSize == 0 )
-            {
-                MPI_Comm clusterComm = plan.GetClusterComm( level );
-                SumScatter    
-                ( partialWeightGridList.Buffer(), weightGridList.Buffer(),
-                  &recvCounts[0], clusterComm );
-            }
-            else
-            {
-                const std::size_t log2NumSubclusters = 
-                    log2NumMergingProcesses-log2SubclusterSize;
-                const std::size_t numSubclusters = 1u<<log2NumSubclusters;
-                const std::size_t subclusterSize = 1u<<log2SubclusterSize;
-
-                const std::size_t recvSize = recvCounts[0];
-                const std::size_t sendSize = recvSize*numMergingProcesses;
-                const std::size_t numChunksPerProcess = subclusterSize;
-                const std::size_t chunkSize = recvSize / numChunksPerProcess;
-                const R* partialBuffer = partialWeightGridList.Buffer();
-                std::vector<R> sendBuffer( sendSize );
-                for( std::size_t sc=0; sc<numSubclusters; ++sc )
-                {
-                    R* subclusterSendBuffer = 
-                        &sendBuffer[sc*subclusterSize*recvSize];
-                    const R* subclusterPartialBuffer = 
-                        &partialBuffer[sc*subclusterSize*recvSize];
-                    for( std::size_t p=0; p<subclusterSize; ++p )
-                    {
-                        R* processSend = &subclusterSendBuffer[p*recvSize];
-                        for( std::size_t c=0; c<numChunksPerProcess; ++c )
-                        {
-                            std::memcpy 
-                            ( &processSend[c*chunkSize],
-                              &subclusterPartialBuffer
-                              [(p+c*subclusterSize)*chunkSize],
-                              chunkSize*sizeof(R) );
-                        }
-                    }
-                }
-                MPI_Comm clusterComm = plan.GetClusterComm( level );
-                SumScatter
-                ( &sendBuffer[0], weightGridList.Buffer(), 
-                  &recvCounts[0], clusterComm );
-            }
+            pipeline.Finish( weightGridList );
 #ifdef TIMING
             interpolative_nuft::sumScatterTimer.Stop();
 #endif
@@ -442,6 +452,8 @@ InterpolativeNUFT
               log2LocalSourceBoxes, log2LocalTargetBoxes,
               log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim,
               weightGridList );
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
 	    interpolative_nuft::formEquivalentSourcesTimer.Stop();
 #endif
@@ -28,6 +28,7 @@
 #include "bfio/structures/weight_grid.hpp"
 #include "bfio/structures/weight_grid_list.hpp"
 
+#include "bfio/tools/map_kernels.hpp"
 #include "bfio/tools/special_functions.hpp"
 
 #include "bfio/interpolative_nuft/context.hpp"
@@ -49,8 +50,9 @@ FormCheckPotentials
   const Array<R,1>& wA,
   const Array<R,1>& wB,
   const std::size_t parentInteractionOffset,
+  const std::size_t childInteractionStride,
   const WeightGridList<R,1,q>& oldWeightGridList,
-        WeightGrid<R,1,q>& weightGrid )
+        WeightGridView<R,1,q> weightGrid )
 {
     const std::size_t d = 1;
     std::memset( weightGrid.Buffer(), 0, 2*q*sizeof(R) );
@@ -73,9 +75,10 @@ FormCheckPotentials
          cLocal<(1u<<(1-log2NumMergingProcesses));
          ++cLocal )
     {
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
+        const std::size_t interactionIndex = 
+            parentInteractionOffset + cLocal*childInteractionStride;
         const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
-        const WeightGrid<R,d,q>& oldWeightGrid = 
+        const ConstWeightGridView<R,d,q> oldWeightGrid = 
             oldWeightGridList[interactionIndex];
 
         // Find the center of child c
@@ -158,220 +161,7 @@ FormCheckPotentials
     }
 }
 
-// 2d specialization
-template<typename R,std::size_t q>
-void
-FormCheckPotentials
-( const interpolative_nuft::Context<R,2,q>& context,
-  const Plan<2>& plan,
-  const std::size_t level,
-  const Array<std::vector<R>,2>& realPrescalings,
-  const Array<std::vector<R>,2>& imagPrescalings,
-  const Array<R,2>& x0A,
-  const Array<R,2>& p0B,
-  const Array<R,2>& wA,
-  const Array<R,2>& wB,
-  const std::size_t parentInteractionOffset,
-  const WeightGridList<R,2,q>& oldWeightGridList,
-        WeightGrid<R,2,q>& weightGrid )
-{
-    const std::size_t d = 2;
-    const std::size_t q_to_d = q*q;
-    std::memset( weightGrid.Buffer(), 0, 2*q_to_d*sizeof(R) );
-
-    const Direction direction = context.GetDirection();
-    const R SignedTwoPi = ( direction==FORWARD ? -TwoPi : TwoPi );
-
-    const std::size_t log2NumMergingProcesses = 
-        plan.GetLog2NumMergingProcesses( level );
-    const std::vector<R>& chebyshevNodes = context.GetChebyshevNodes();
-
-    std::vector<R> realTempWeights0( q_to_d );
-    std::vector<R> imagTempWeights0( q_to_d );
-    std::vector<R> realTempWeights1( q_to_d );
-    std::vector<R> imagTempWeights1( q_to_d );
-    std::vector<R> postscalingArguments( q );
-    std::vector<R> realPostscalings( q );
-    std::vector<R> imagPostscalings( q );
-    for( std::size_t cLocal=0; 
-         cLocal<(1u<<(2-log2NumMergingProcesses));
-         ++cLocal )
-    {
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
-        const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
-        const WeightGrid<R,d,q>& oldWeightGrid = 
-            oldWeightGridList[interactionIndex];
-
-        // Find the center of child c
-        Array<R,d> p0Bc;
-        for( std::size_t j=0; j<d; ++j )
-            p0Bc[j] = p0B[j] + ( (c>>j)&1 ? wB[j]/4 : -wB[j]/4 );
-
-        //--------------------------------------------------------------------//
-        // Transform the first dimension                                      //
-        //--------------------------------------------------------------------//
-        // Prescale
-        {
-            R* realWriteBuffer = &realTempWeights0[0];
-            R* imagWriteBuffer = &imagTempWeights0[0];
-            const R* realReadBuffer = oldWeightGrid.RealBuffer();
-            const R* imagReadBuffer = oldWeightGrid.ImagBuffer();
-            const R* realScalingBuffer = &realPrescalings[0][0];
-            const R* imagScalingBuffer = &imagPrescalings[0][0];
-            for( std::size_t t=0; t<q; ++t )
-            {
-                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                {
-                    const R realWeight = realReadBuffer[t*q+tPrime];
-                    const R imagWeight = imagReadBuffer[t*q+tPrime];
-                    const R realScaling = realScalingBuffer[tPrime];
-                    const R imagScaling = imagScalingBuffer[tPrime];
-                    realWriteBuffer[t*q+tPrime] = 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    imagWriteBuffer[t*q+tPrime] = 
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
-        }
-        // Apply forward map
-        {
-            const std::vector<R>& realForwardMap = 
-                context.GetRealForwardMap( 0 );
-            const std::vector<R>& imagForwardMap = 
-                context.GetImagForwardMap( 0 );
-            // Form the real part
-            Gemm
-            ( 'N', 'N', q, q, q,
-              (R)1, &realForwardMap[0], q,
-                    &realTempWeights0[0], q,
-              (R)0, &realTempWeights1[0], q );
-            Gemm
-            ( 'N', 'N', q, q, q,
-              (R)-1, &imagForwardMap[0], q,
-                     &imagTempWeights0[0], q,
-              (R)+1, &realTempWeights1[0], q );
-            // Form the imaginary part
-            Gemm
-            ( 'N', 'N', q, q, q,
-              (R)1, &realForwardMap[0], q,
-                    &imagTempWeights0[0], q,
-              (R)0, &imagTempWeights1[0], q );
-            Gemm
-            ( 'N', 'N', q, q, q,
-              (R)1, &imagForwardMap[0], q,
-                    &realTempWeights0[0], q,
-              (R)1, &imagTempWeights1[0], q );
-        }
-        // Postscale
-        for( std::size_t t=0; t<q; ++t )
-            postscalingArguments[t] = 
-                SignedTwoPi*(x0A[0]+chebyshevNodes[t]*wA[0])*p0Bc[0];
-        SinCosBatch( postscalingArguments, imagPostscalings, realPostscalings );
-        {
-            R* realBuffer = &realTempWeights1[0];
-            R* imagBuffer = &imagTempWeights1[0];
-            const R* realScalingBuffer = &realPostscalings[0];
-            const R* imagScalingBuffer = &imagPostscalings[0];
-            for( std::size_t t=0; t<q; ++t )
-            {
-                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                {
-                    const R realWeight = realBuffer[t*q+tPrime];
-                    const R imagWeight = imagBuffer[t*q+tPrime];
-                    const R realScaling = realScalingBuffer[tPrime];
-                    const R imagScaling = imagScalingBuffer[tPrime];
-                    realBuffer[t*q+tPrime] = 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    imagBuffer[t*q+tPrime] = 
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
-        }
-
-        //--------------------------------------------------------------------//
-        // Transform the second dimension                                     //
-        //--------------------------------------------------------------------//
-        // Prescale
-        {
-            R* realBuffer = &realTempWeights1[0];
-            R* imagBuffer = &imagTempWeights1[0];
-            const R* realScalingBuffer = &realPrescalings[1][0];
-            const R* imagScalingBuffer = &imagPrescalings[1][0];
-            for( std::size_t w=0; w<q; ++w )
-            {
-                for( std::size_t t=0; t<q; ++t )
-                {
-                    const R realWeight = realBuffer[w+t*q];
-                    const R imagWeight = imagBuffer[w+t*q];
-                    const R realScaling = realScalingBuffer[t];
-                    const R imagScaling = imagScalingBuffer[t];
-                    realBuffer[w+t*q] = 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    imagBuffer[w+t*q] = 
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
-        }
-        // Apply forward map
-        {
-            const std::vector<R>& realForwardMap = 
-                context.GetRealForwardMap( 1 );
-            const std::vector<R>& imagForwardMap = 
-                context.GetImagForwardMap( 1 );
-            // Form the real part
-            Gemm
-            ( 'N', 'T', q, q, q,
-              (R)1, &realTempWeights1[0], q,
-                    &realForwardMap[0], q,
-              (R)0, &realTempWeights0[0], q );
-            Gemm
-            ( 'N', 'T', q, q, q,
-              (R)-1, &imagTempWeights1[0], q,
-                     &imagForwardMap[0], q,
-              (R)+1, &realTempWeights0[0], q );
-            // Form the imaginary part
-            Gemm
-            ( 'N', 'T', q, q, q,
-              (R)1, &imagTempWeights1[0], q,
-                    &realForwardMap[0], q,
-              (R)0, &imagTempWeights0[0], q );
-            Gemm
-            ( 'N', 'T', q, q, q,
-              (R)1, &realTempWeights1[0], q,
-                    &imagForwardMap[0], q,
-              (R)1, &imagTempWeights0[0], q );
-        }
-        // Postscale
-        for( std::size_t t=0; t<q; ++t )
-            postscalingArguments[t] = 
-                SignedTwoPi*(x0A[1]+chebyshevNodes[t]*wA[1])*p0Bc[1];
-        SinCosBatch( postscalingArguments, imagPostscalings, realPostscalings );
-        {
-            R* realWriteBuffer = weightGrid.RealBuffer();
-            R* imagWriteBuffer = weightGrid.ImagBuffer();
-            const R* realReadBuffer = &realTempWeights0[0];
-            const R* imagReadBuffer = &imagTempWeights0[0];
-            const R* realScalingBuffer = &realPostscalings[0];
-            const R* imagScalingBuffer = &imagPostscalings[0];
-            for( std::size_t w=0; w<q; ++w )
-            {
-                for( std::size_t t=0; t<q; ++t )
-                {
-                    const R realWeight = realReadBuffer[w+t*q];
-                    const R imagWeight = imagReadBuffer[w+t*q];
-                    const R realScaling = realScalingBuffer[t];
-                    const R imagScaling = imagScalingBuffer[t];
-                    realWriteBuffer[w+t*q] += 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    imagWriteBuffer[w+t*q] += 
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
-        }
-    }
-}
-
-// Fallback for 3d and above
+// Fallback for 2d and above
 template<typename R,std::size_t d,std::size_t q>
 void
 FormCheckPotentials
@@ -385,8 +175,9 @@ FormCheckPotentials
   const Array<R,d>& wA,
   const Array<R,d>& wB,
   const std::size_t parentInteractionOffset,
+  const std::size_t childInteractionStride,
   const WeightGridList<R,d,q>& oldWeightGridList,
-        WeightGrid<R,d,q>& weightGrid )
+        WeightGridView<R,d,q> weightGrid )
 {
     const std::size_t q_to_d = Pow<q,d>::val;
     std::memset( weightGrid.Buffer(), 0, 2*q_to_d*sizeof(R) );
@@ -396,303 +187,139 @@ FormCheckPotentials
 
     const std::size_t log2NumMergingProcesses = 
         plan.GetLog2NumMergingProcesses( level );
+    const std::size_t numLocalChildren = 1u<<(d-log2NumMergingProcesses);
     const std::vector<R>& chebyshevNodes = context.GetChebyshevNodes();
 
-    std::vector<R> realTempWeights0( q_to_d );
-    std::vector<R> imagTempWeights0( q_to_d );
-    std::vector<R> realTempWeights1( q_to_d );
-    std::vector<R> imagTempWeights1( q_to_d );
-    std::vector<R> postscalingArguments( q );
-    std::vector<R> realPostscalings( q );
-    std::vector<R> imagPostscalings( q );
-    for( std::size_t cLocal=0;
-         cLocal<(1u<<(d-log2NumMergingProcesses));
-         ++cLocal )
+    // Find the centers of the children
+    std::vector< Array<R,d> > p0Bcs( numLocalChildren );
+    for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
     {
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
         const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
-        const WeightGrid<R,d,q>& oldWeightGrid = 
-            oldWeightGridList[interactionIndex];
-
-        // Find the center of child c
-        Array<R,d> p0Bc;
         for( std::size_t j=0; j<d; ++j )
-            p0Bc[j] = p0B[j] + ( (c>>j)&1 ? wB[j]/4 : -wB[j]/4 );
+            p0Bcs[cLocal][j] = p0B[j] + ( (c>>j)&1 ? wB[j]/4 : -wB[j]/4 );
+    }
 
-        //--------------------------------------------------------------------//
-        // Transform the first dimension                                      //
-        //--------------------------------------------------------------------//
-        // Prescale
-        {
-            R* realWriteBuffer = &realTempWeights0[0];
-            R* imagWriteBuffer = &imagTempWeights0[0];
-            const R* realReadBuffer = oldWeightGrid.RealBuffer();
-            const R* imagReadBuffer = oldWeightGrid.ImagBuffer();
-            const R* realScalingBuffer = &realPrescalings[0][0];
-            const R* imagScalingBuffer = &imagPrescalings[0][0];
-            for( std::size_t t=0; t<Pow<q,d-1>::val; ++t )
-            {
-                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                {
-                    const R realWeight = realReadBuffer[t*q+tPrime];
-                    const R imagWeight = imagReadBuffer[t*q+tPrime];
-                    const R realScaling = realScalingBuffer[tPrime];
-                    const R imagScaling = imagScalingBuffer[tPrime];
-                    realWriteBuffer[t*q+tPrime] = 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    imagWriteBuffer[t*q+tPrime] = 
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
-        }
-        // Apply forward map
-        {
-            const std::vector<R>& realForwardMap = 
-                context.GetRealForwardMap( 0 );
-            const std::vector<R>& imagForwardMap = 
-                context.GetImagForwardMap( 0 );
-            // Form the real part
-            Gemm
-            ( 'N', 'N', q, Pow<q,d-1>::val, q,
-              (R)1, &realForwardMap[0], q,
-                    &realTempWeights0[0], q,
-              (R)0, &realTempWeights1[0], q );
-            Gemm
-            ( 'N', 'N', q, Pow<q,d-1>::val, q,
-              (R)-1, &imagForwardMap[0], q,
-                     &imagTempWeights0[0], q,
-              (R)+1, &realTempWeights1[0], q );
-            // Form the imaginary part
-            Gemm
-            ( 'N', 'N', q, Pow<q,d-1>::val, q,
-              (R)1, &realForwardMap[0], q,
-                    &imagTempWeights0[0], q,
-              (R)0, &imagTempWeights1[0], q );
-            Gemm
-            ( 'N', 'N', q, Pow<q,d-1>::val, q,
-              (R)1, &imagForwardMap[0], q,
-                    &realTempWeights0[0], q,
-              (R)1, &imagTempWeights1[0], q );
-        }
-        // Postscale
-        for( std::size_t t=0; t<q; ++t )
-            postscalingArguments[t] = 
-                SignedTwoPi*(x0A[0]+chebyshevNodes[t]*wA[0])*p0Bc[0];
-        SinCosBatch( postscalingArguments, imagPostscalings, realPostscalings );
-        {
-            R* realBuffer = &realTempWeights1[0];
-            R* imagBuffer = &imagTempWeights1[0];
-            const R* realScalingBuffer = &realPostscalings[0];
-            const R* imagScalingBuffer = &imagPostscalings[0];
-            for( std::size_t t=0; t<Pow<q,d-1>::val; ++t )
-            {
-                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                {
-                    const R realWeight = realBuffer[t*q+tPrime];
-                    const R imagWeight = imagBuffer[t*q+tPrime];
-                    const R realScaling = realScalingBuffer[tPrime];
-                    const R imagScaling = imagScalingBuffer[tPrime];
-                    realBuffer[t*q+tPrime] = 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    imagBuffer[t*q+tPrime] = 
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
-        }
+    // The weights of the children are kept contiguous so that each forward
+    // map can be applied to all of them at once. Since the maps are complex,
+    // we separately form the products with their real and imaginary parts 
+    // and combine them during the postscaling.
+    std::vector<R> weights( numLocalChildren*2*q_to_d );
+    std::vector<R> realMapProducts( numLocalChildren*2*q_to_d );
+    std::vector<R> imagMapProducts( numLocalChildren*2*q_to_d );
+    std::vector<R> postscalingArguments( q );
+    std::vector<R> realPostscalings( q );
+    std::vector<R> imagPostscalings( q );
+    std::size_t q_to_j = 1;
+    for( std::size_t j=0; j<d; ++j )
+    {
+        const std::size_t numSlicesPerChild = 2*q_to_d/(q_to_j*q);
 
-        //--------------------------------------------------------------------//
-        // Transform the second dimension                                     //
-        //--------------------------------------------------------------------//
         // Prescale
-        for( std::size_t p=0; p<Pow<q,d-2>::val; ++p )
+        for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
         {
-            const std::size_t offset = p*q*q; 
-            R* offsetRealBuffer = &realTempWeights1[offset];
-            R* offsetImagBuffer = &imagTempWeights1[offset];
-            const R* realScalingBuffer = &realPrescalings[1][0];
-            const R* imagScalingBuffer = &imagPrescalings[1][0];
-            for( std::size_t w=0; w<q; ++w )
+            const std::size_t interactionIndex = 
+                parentInteractionOffset + cLocal*childInteractionStride;
+            const R* readBuffer = 
+                ( j==0 ? oldWeightGridList[interactionIndex].Buffer()
+                       : &weights[cLocal*2*q_to_d] );
+            R* writeBuffer = &weights[cLocal*2*q_to_d];
+            const R* realScalingBuffer = &realPrescalings[j][0];
+            const R* imagScalingBuffer = &imagPrescalings[j][0];
+            for( std::size_t p=0; p<numSlicesPerChild/2; ++p )
             {
+                const std::size_t offset = p*q_to_j*q;
                 for( std::size_t t=0; t<q; ++t )
                 {
-                    const R realWeight = offsetRealBuffer[w+t*q];
-                    const R imagWeight = offsetImagBuffer[w+t*q];
                     const R realScaling = realScalingBuffer[t];
                     const R imagScaling = imagScalingBuffer[t];
-                    offsetRealBuffer[w+t*q] = 
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    offsetImagBuffer[w+t*q] = 
-                        imagWeight*realScaling + realWeight*imagScaling;
+                    for( std::size_t w=0; w<q_to_j; ++w )
+                    {
+                        const std::size_t i = offset+t*q_to_j+w;
+                        const R realWeight = readBuffer[i];
+                        const R imagWeight = readBuffer[i+q_to_d];
+                        writeBuffer[i] = 
+                            realWeight*realScaling - imagWeight*imagScaling;
+                        writeBuffer[i+q_to_d] = 
+                            imagWeight*realScaling + realWeight*imagScaling;
+                    }
                 }
             }
         }
+
         // Apply forward map
+        const std::vector<R>& realForwardMap = context.GetRealForwardMap( j );
+        const std::vector<R>& imagForwardMap = context.GetImagForwardMap( j );
+        if( j == 0 )
         {
-            const std::vector<R>& realForwardMap = 
-                context.GetRealForwardMap( 1 );
-            const std::vector<R>& imagForwardMap = 
-                context.GetImagForwardMap( 1 );
-            for( std::size_t w=0; w<Pow<q,d-2>::val; ++w )
-            {
-                // Form the real part
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &realTempWeights1[w*q*q], q,
-                        &realForwardMap[0], q,
-                  (R)0, &realTempWeights0[w*q*q], q );
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)-1, &imagTempWeights1[w*q*q], q,
-                         &imagForwardMap[0], q,
-                  (R)+1, &realTempWeights0[w*q*q], q );
-                // Form the imaginary part
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &imagTempWeights1[w*q*q], q,
-                        &realForwardMap[0], q,
-                  (R)0, &imagTempWeights0[w*q*q], q );
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &realTempWeights1[w*q*q], q,
-                        &imagForwardMap[0], q,
-                  (R)1, &imagTempWeights0[w*q*q], q );
-            }
+            const std::size_t numColumns = 
+                numLocalChildren*2*Pow<q,d-1>::val;
+            MapColumns<R,q>
+            ( 'N', numColumns, &realForwardMap[0], 
+              &weights[0], (R)0, &realMapProducts[0] );
+            MapColumns<R,q>
+            ( 'N', numColumns, &imagForwardMap[0], 
+              &weights[0], (R)0, &imagMapProducts[0] );
         }
-        // Postscale
-        for( std::size_t t=0; t<q; ++t )
-            postscalingArguments[t] =
-                SignedTwoPi*(x0A[1]+chebyshevNodes[t]*wA[1])*p0Bc[1];
-        SinCosBatch( postscalingArguments, imagPostscalings, realPostscalings );
-        for( std::size_t p=0; p<Pow<q,d-2>::val; ++p )
+        else
         {
-            const std::size_t offset = p*q*q;
-            R* offsetRealBuffer = &realTempWeights0[offset];
-            R* offsetImagBuffer = &imagTempWeights0[offset];
-            const R* realScalingBuffer = &realPostscalings[0];
-            const R* imagScalingBuffer = &imagPostscalings[0];
-            for( std::size_t w=0; w<q; ++w )
-            {
-                for( std::size_t t=0; t<q; ++t )
-                {
-                    const R realWeight = offsetRealBuffer[w+t*q];
-                    const R imagWeight = offsetImagBuffer[w+t*q];
-                    const R realScaling = realScalingBuffer[t];
-                    const R imagScaling = imagScalingBuffer[t];
-                    offsetRealBuffer[w+t*q] =
-                        realWeight*realScaling - imagWeight*imagScaling;
-                    offsetImagBuffer[w+t*q] =
-                        imagWeight*realScaling + realWeight*imagScaling;
-                }
-            }
+            const std::size_t numSlices = numLocalChildren*numSlicesPerChild;
+            MapRows<R,q>
+            ( 'T', q_to_j, numSlices, &realForwardMap[0], 
+              &weights[0], (R)0, &realMapProducts[0] );
+            MapRows<R,q>
+            ( 'T', q_to_j, numSlices, &imagForwardMap[0],
+              &weights[0], (R)0, &imagMapProducts[0] );
         }
-        
-        //--------------------------------------------------------------------//
-        // Transform the remaining dimension                                  //
-        //--------------------------------------------------------------------//
-        std::size_t q_to_j = q*q;
-        for( std::size_t j=2; j<d; ++j )
-        {
-            const std::size_t stride = q_to_j;
-
-            R* realWriteBuffer = 
-                ( j==d-1 ? weightGrid.RealBuffer()
-                         : ( j&1 ? &realTempWeights0[0] 
-                                 : &realTempWeights1[0] ) );
-            R* imagWriteBuffer = 
-                ( j==d-1 ? weightGrid.ImagBuffer()
-                         : ( j&1 ? &imagTempWeights0[0]
-                                 : &imagTempWeights1[0] ) );
-            R* realReadBuffer = 
-                ( j&1 ? &realTempWeights1[0] : &realTempWeights0[0] );
-            R* imagReadBuffer = 
-                ( j&1 ? &imagTempWeights1[0] : &imagTempWeights0[0] );
-
-            const std::vector<R>& realForwardMap = 
-                context.GetRealForwardMap( j );
-            const std::vector<R>& imagForwardMap = 
-                context.GetImagForwardMap( j );
-            const R* realForwardBuffer = &realForwardMap[0];
-            const R* imagForwardBuffer = &imagForwardMap[0];
-
-            if( j != d-1 )
-            {
-                std::memset( realWriteBuffer, 0, q_to_d*sizeof(R) );
-                std::memset( imagWriteBuffer, 0, q_to_d*sizeof(R) );
-            }
 
-            // Prescale, apply the forward map, and then postscale
-            std::vector<R> realTempWeightStrip( q );
-            std::vector<R> imagTempWeightStrip( q );
+        // Form the complex products and postscale
+        for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
+        {
             for( std::size_t t=0; t<q; ++t )
                 postscalingArguments[t] = 
-                    SignedTwoPi*(x0A[j]+chebyshevNodes[t]*wA[j])*p0Bc[j];
+                    SignedTwoPi*(x0A[j]+chebyshevNodes[t]*wA[j])*
+                    p0Bcs[cLocal][j];
             SinCosBatch
             ( postscalingArguments, imagPostscalings, realPostscalings );
-            for( std::size_t p=0; p<q_to_d/(q_to_j*q); ++p )        
+
+            const R* realProductBuffer = &realMapProducts[cLocal*2*q_to_d];
+            const R* imagProductBuffer = &imagMapProducts[cLocal*2*q_to_d];
+            R* writeBuffer = 
+                ( j==d-1 ? weightGrid.Buffer() : &weights[cLocal*2*q_to_d] );
+            const R* realScalingBuffer = &realPostscalings[0];
+            const R* imagScalingBuffer = &imagPostscalings[0];
+            for( std::size_t p=0; p<numSlicesPerChild/2; ++p )
             {
-                const std::size_t offset = p*(q_to_j*q);
-                R* offsetRealReadBuffer = &realReadBuffer[offset];
-                R* offsetImagReadBuffer = &imagReadBuffer[offset];
-                R* offsetRealWriteBuffer = &realWriteBuffer[offset];
-                R* offsetImagWriteBuffer = &imagWriteBuffer[offset];
-                const R* realPrescalingBuffer = &realPrescalings[j][0];
-                const R* imagPrescalingBuffer = &imagPrescalings[j][0];
-                const R* realPostscalingBuffer = &realPostscalings[0];
-                const R* imagPostscalingBuffer = &imagPostscalings[0];
-                for( std::size_t w=0; w<q_to_j; ++w )
+                const std::size_t offset = p*q_to_j*q;
+                for( std::size_t t=0; t<q; ++t )
                 {
-                    // Prescale
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        const R realWeight = offsetRealReadBuffer[w+t*stride];
-                        const R imagWeight = offsetImagReadBuffer[w+t*stride];
-                        const R realScaling = realPrescalingBuffer[t];
-                        const R imagScaling = imagPrescalingBuffer[t];
-                        realTempWeightStrip[t] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagTempWeightStrip[t] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                    // Transform
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        offsetRealReadBuffer[w+t*stride] = 0;
-                        offsetImagReadBuffer[w+t*stride] = 0;
-                        for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                        {
-                            offsetRealReadBuffer[w+t*stride] +=
-                                realForwardBuffer[t+tPrime*q] * 
-                                realTempWeightStrip[tPrime];
-                            offsetRealReadBuffer[w+t*stride] -=
-                                imagForwardBuffer[t+tPrime*q] *
-                                imagTempWeightStrip[tPrime];
-
-                            offsetImagReadBuffer[w+t*stride] +=
-                                imagForwardBuffer[t+tPrime*q] *
-                                realTempWeightStrip[tPrime];
-                            offsetImagReadBuffer[w+t*stride] +=
-                                realForwardBuffer[t+tPrime*q] *
-                                imagTempWeightStrip[tPrime];
-                        }
-                    }
-                    // Postscale
-                    for( std::size_t t=0; t<q; ++t )
+                    const R realScaling = realScalingBuffer[t];
+                    const R imagScaling = imagScalingBuffer[t];
+                    for( std::size_t w=0; w<q_to_j; ++w )
                     {
+                        const std::size_t i = offset+t*q_to_j+w;
                         const R realWeight = 
-                            offsetRealReadBuffer[w+t*stride];
+                            realProductBuffer[i] - imagProductBuffer[i+q_to_d];
                         const R imagWeight = 
-                            offsetImagReadBuffer[w+t*stride];
-                        const R realScaling = realPostscalingBuffer[t];
-                        const R imagScaling = imagPostscalingBuffer[t];
-                        offsetRealWriteBuffer[w+t*stride] +=
+                            imagProductBuffer[i] + realProductBuffer[i+q_to_d];
+                        const R realScaled = 
                             realWeight*realScaling - imagWeight*imagScaling;
-                        offsetImagWriteBuffer[w+t*stride] +=
+                        const R imagScaled = 
                             imagWeight*realScaling + realWeight*imagScaling;
+                        if( j == d-1 )
+                        {
+                            writeBuffer[i] += realScaled;
+                            writeBuffer[i+q_to_d] += imagScaled;
+                        }
+                        else
+                        {
+                            writeBuffer[i] = realScaled;
+                            writeBuffer[i+q_to_d] = imagScaled;
+                        }
                     }
                 }
             }
-            q_to_j *= q;
         }
+        q_to_j *= q;
     }
 }
 
@@ -700,4 +327,3 @@ FormCheckPotentials
 } // bfio
 
 #endif // BFIO_INTERPOLATIVE_NUFT_FORM_CHECK_POTENTIALS_HPP
-
@@ -18,6 +18,7 @@
 #ifndef BFIO_INTERPOLATIVE_NUFT_FORM_EQUIVALENT_SOURCES_HPP
 #define BFIO_INTERPOLATIVE_NUFT_FORM_EQUIVALENT_SOURCES_HPP 1
 
+#include <algorithm>
 #include <cstddef>
 #include <vector>
 
@@ -30,7 +31,9 @@
 #include "bfio/structures/weight_grid_list.hpp"
 
 #include "bfio/tools/flatten_constrained_htree_index.hpp"
+#include "bfio/tools/map_kernels.hpp"
 #include "bfio/tools/mpi.hpp"
+#include "bfio/tools/reverse_constrained_htree_index.hpp"
 #include "bfio/tools/special_functions.hpp"
 
 #include "bfio/interpolative_nuft/context.hpp"
@@ -74,6 +77,9 @@ FormEquivalentSources
     std::vector<R> imagPrescalings( q );
     std::vector<R> realPostscalings( q );
     std::vector<R> imagPostscalings( q );
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare
+    ( 1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes), shareBegin, shareEnd );
     ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
     for( std::size_t targetIndex=0;
          targetIndex<(1u<<log2LocalTargetBoxes);
@@ -102,8 +108,12 @@ FormEquivalentSources
         {
             const Array<std::size_t,d> B = BWalker.State();
             const std::size_t interactionIndex = 
-                sourceIndex + (targetIndex<<log2LocalSourceBoxes);
-            WeightGrid<R,d,q>& weightGrid = weightGridList[interactionIndex];
+                ReverseConstrainedHTreeIndex<d>
+                ( sourceIndex, log2LocalSourceBoxes ) + 
+                (targetIndex<<log2LocalSourceBoxes);
+            if( interactionIndex < shareBegin || interactionIndex >= shareEnd )
+                continue;
+            WeightGridView<R,d,q> weightGrid = weightGridList[interactionIndex];
 
             // Translate the local integer coordinates into the source center
             Array<R,d> p0;
@@ -187,254 +197,7 @@ FormEquivalentSources
     }
 }
 
-// 2d specialization
-template<typename R,std::size_t q>
-void
-FormEquivalentSources
-( const interpolative_nuft::Context<R,2,q>& context,
-  const Plan<2>& plan,
-  const Box<R,2>& mySourceBox,
-  const Box<R,2>& myTargetBox,
-  const std::size_t log2LocalSourceBoxes,
-  const std::size_t log2LocalTargetBoxes,
-  const Array<std::size_t,2>& log2LocalSourceBoxesPerDim,
-  const Array<std::size_t,2>& log2LocalTargetBoxesPerDim,
-        WeightGridList<R,2,q>& weightGridList )
-{
-    const std::size_t d = 2;
-    const std::size_t q_to_d = Pow<q,d>::val;
-    const std::vector<R>& chebyshevNodes = context.GetChebyshevNodes();
-    const std::vector< Array<R,d> >& chebyshevGrid = context.GetChebyshevGrid();
-
-    const Direction direction = context.GetDirection();
-    const R SignedTwoPi = ( direction==FORWARD ? -TwoPi : TwoPi );
-
-    // Store the widths of the source and target boxes
-    Array<R,d> wA;
-    for( std::size_t j=0; j<d; ++j )
-        wA[j] = myTargetBox.widths[j] / (1<<log2LocalTargetBoxesPerDim[j]);
-    Array<R,d> wB;
-    for( std::size_t j=0; j<d; ++j )
-        wB[j] = mySourceBox.widths[j] / (1<<log2LocalSourceBoxesPerDim[j]);
-
-    // Iterate over the box pairs, applying M^-1 using the tensor product 
-    // structure
-    std::vector<R> realTempWeights( q_to_d );
-    std::vector<R> imagTempWeights( q_to_d );
-    std::vector<R> scalingArguments( q );
-    std::vector<R> realPrescalings( q );
-    std::vector<R> imagPrescalings( q );
-    Array<std::vector<R>,d> realPostscalings;
-    Array<std::vector<R>,d> imagPostscalings;
-    for( std::size_t j=0; j<d; ++j )
-    {
-        realPostscalings[j].resize(q);
-        imagPostscalings[j].resize(q);
-    }
-    ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-    for( std::size_t targetIndex=0;
-         targetIndex<(1u<<log2LocalTargetBoxes);
-         ++targetIndex, AWalker.Walk() )
-    {
-        const Array<std::size_t,d> A = AWalker.State();
-
-        // Translate the local integer coordinates into the target center
-        Array<R,d> x0;
-        for( std::size_t j=0; j<d; ++j )
-            x0[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
-
-        // Store the chebyshev grid on A
-        std::vector< Array<R,d> > xPoints( q_to_d );
-        for( std::size_t t=0; t<q_to_d; ++t )
-            for( std::size_t j=0; j<d; ++j )
-                xPoints[t][j] = x0[j] + chebyshevGrid[t][j]*wA[j];
-
-        // Store the postscalings for all interactions with A
-        for( std::size_t j=0; j<d; ++j )
-        {
-            for( std::size_t t=0; t<q; ++t )
-                scalingArguments[t] = -SignedTwoPi*x0[j]*chebyshevNodes[t]*wB[j];
-            SinCosBatch
-            ( scalingArguments, imagPostscalings[j], realPostscalings[j] );
-        }
-
-        ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
-        for( std::size_t sourceIndex=0;
-             sourceIndex<(1u<<log2LocalSourceBoxes);
-             ++sourceIndex, BWalker.Walk() )
-        {
-            const Array<std::size_t,d> B = BWalker.State();
-            const std::size_t interactionIndex = 
-                sourceIndex + (targetIndex<<log2LocalSourceBoxes);
-            WeightGrid<R,d,q>& weightGrid = weightGridList[interactionIndex];
-
-            // Translate the local integer coordinates into the source center
-            Array<R,d> p0;
-            for( std::size_t j=0; j<d; ++j )
-                p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
-
-            //----------------------------------------------------------------//
-            // Solve against the first dimension                              //
-            //----------------------------------------------------------------//
-            // Prescale
-            for( std::size_t t=0; t<q; ++t )
-                scalingArguments[t] = 
-                    -SignedTwoPi*(x0[0]+chebyshevNodes[t]*wA[0])*p0[0];
-            SinCosBatch( scalingArguments, imagPrescalings, realPrescalings );
-            {
-                R* realBuffer = weightGrid.RealBuffer();
-                R* imagBuffer = weightGrid.ImagBuffer();
-                const R* realScalingBuffer = &realPrescalings[0];
-                const R* imagScalingBuffer = &imagPrescalings[0];
-                for( std::size_t t=0; t<q; ++t )
-                {
-                    for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                    {
-                        const R realWeight = realBuffer[t*q+tPrime];
-                        const R imagWeight = imagBuffer[t*q+tPrime];
-                        const R realScaling = realScalingBuffer[tPrime];
-                        const R imagScaling = imagScalingBuffer[tPrime];
-                        realBuffer[t*q+tPrime] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagBuffer[t*q+tPrime] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
-            }
-            // Transform with the inverse
-            {
-                const std::vector<R>& realInverseMap = 
-                    context.GetRealInverseMap( 0 );
-                const std::vector<R>& imagInverseMap = 
-                    context.GetImagInverseMap( 0 );
-                // Form the real part
-                Gemm
-                ( 'N', 'N', q, q, q,
-                  (R)1, &realInverseMap[0], q,
-                        weightGrid.RealBuffer(), q,
-                  (R)0, &realTempWeights[0], q );
-                Gemm
-                ( 'N', 'N', q, q, q,
-                  (R)-1, &imagInverseMap[0], q,
-                         weightGrid.ImagBuffer(), q,
-                  (R)+1, &realTempWeights[0], q );
-                // Form the imaginary part
-                Gemm
-                ( 'N', 'N', q, q, q,
-                  (R)1, &realInverseMap[0], q,
-                        weightGrid.ImagBuffer(), q,
-                  (R)0, &imagTempWeights[0], q );
-                Gemm
-                ( 'N', 'N', q, q, q,
-                 (R)1, &imagInverseMap[0], q,
-                       weightGrid.RealBuffer(), q,
-                 (R)1, &imagTempWeights[0], q );
-            }
-            // Post scale
-            {
-                R* realBuffer = &realTempWeights[0];
-                R* imagBuffer = &imagTempWeights[0];
-                const R* realScalingBuffer = &realPostscalings[0][0];
-                const R* imagScalingBuffer = &imagPostscalings[0][0];
-                for( std::size_t t=0; t<q; ++t )
-                {
-                    for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                    {
-                        const R realWeight = realBuffer[t*q+tPrime];
-                        const R imagWeight = imagBuffer[t*q+tPrime];
-                        const R realScaling = realScalingBuffer[tPrime];
-                        const R imagScaling = imagScalingBuffer[tPrime];
-                        realBuffer[t*q+tPrime] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagBuffer[t*q+tPrime] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
-            }
-
-            //----------------------------------------------------------------//
-            // Solve against the second dimension                             //
-            //----------------------------------------------------------------//
-            // Prescale
-            for( std::size_t t=0; t<q; ++t )
-                scalingArguments[t] = 
-                    -SignedTwoPi*(x0[1]+chebyshevNodes[t]*wA[1])*p0[1];
-            SinCosBatch( scalingArguments, imagPrescalings, realPrescalings );
-            {
-                R* realBuffer = &realTempWeights[0];
-                R* imagBuffer = &imagTempWeights[0];
-                const R* realScalingBuffer = &realPrescalings[0];
-                const R* imagScalingBuffer = &imagPrescalings[0];
-                for( std::size_t w=0; w<q; ++w )
-                {
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        const R realWeight = realBuffer[w+t*q];
-                        const R imagWeight = imagBuffer[w+t*q];
-                        const R realScaling = realScalingBuffer[t];
-                        const R imagScaling = imagScalingBuffer[t];
-                        realBuffer[w+t*q] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagBuffer[w+t*q] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
-            }
-            // Transform with the inverse
-            {
-                const std::vector<R>& realInverseMap = 
-                    context.GetRealInverseMap( 1 );
-                const std::vector<R>& imagInverseMap = 
-                    context.GetImagInverseMap( 1 );
-                // Form the real part
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &realTempWeights[0], q,
-                        &realInverseMap[0], q,
-                  (R)0, weightGrid.RealBuffer(), q );
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)-1, &imagTempWeights[0], q,
-                         &imagInverseMap[0], q,
-                  (R)+1, weightGrid.RealBuffer(), q );
-                // Form the imaginary part
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &imagTempWeights[0], q,
-                        &realInverseMap[0], q,
-                  (R)0, weightGrid.ImagBuffer(), q );
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &realTempWeights[0], q,
-                        &imagInverseMap[0], q,
-                  (R)1, weightGrid.ImagBuffer(), q );
-            }
-            // Postscale
-            {
-                R* realBuffer = weightGrid.RealBuffer();
-                R* imagBuffer = weightGrid.ImagBuffer();
-                const R* realScalingBuffer = &realPostscalings[1][0];
-                const R* imagScalingBuffer = &imagPostscalings[1][0];
-                for( std::size_t w=0; w<q; ++w )
-                {
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        const R realWeight = realBuffer[w+t*q];
-                        const R imagWeight = imagBuffer[w+t*q];
-                        const R realScaling = realScalingBuffer[t];
-                        const R imagScaling = imagScalingBuffer[t];
-                        realBuffer[w+t*q] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagBuffer[w+t*q] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
-            }
-        }
-    }
-}
-
-// Fallback for 3d and above
+// Fallback for 2d and above
 template<typename R,std::size_t d,std::size_t q>
 void
 FormEquivalentSources
@@ -449,8 +212,8 @@ FormEquivalentSources
         WeightGridList<R,d,q>& weightGridList )
 {
     const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numLocalSourceBoxes = 1u<<log2LocalSourceBoxes;
     const std::vector<R>& chebyshevNodes = context.GetChebyshevNodes();
-    const std::vector< Array<R,d> >& chebyshevGrid = context.GetChebyshevGrid();
 
     const Direction direction = context.GetDirection();
     const R SignedTwoPi = ( direction==FORWARD ? -TwoPi : TwoPi );
@@ -458,32 +221,62 @@ FormEquivalentSources
     // Store the widths of the source and target boxes
     Array<R,d> wA;
     for( std::size_t j=0; j<d; ++j )
-        wA[j] = myTargetBox.widths[j] / (1<<log2LocalTargetBoxesPerDim[j]);;
+        wA[j] = myTargetBox.widths[j] / (1<<log2LocalTargetBoxesPerDim[j]);
     Array<R,d> wB;
     for( std::size_t j=0; j<d; ++j )
         wB[j] = mySourceBox.widths[j] / (1<<log2LocalSourceBoxesPerDim[j]);
 
-    // Iterate over the box pairs, applying M^-1 using the tensor product 
-    // structure
+    // Store the centers of the source boxes in the order that their 
+    // interactions are stored in
+    std::vector< Array<R,d> > p0s( numLocalSourceBoxes );
+    ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
+    for( std::size_t sourceIndex=0; 
+         sourceIndex<numLocalSourceBoxes; 
+         ++sourceIndex, BWalker.Walk() )
+    {
+        const Array<std::size_t,d> B = BWalker.State();
+        Array<R,d>& p0 = 
+            p0s[ReverseConstrainedHTreeIndex<d>
+                ( sourceIndex, log2LocalSourceBoxes )];
+        for( std::size_t j=0; j<d; ++j )
+            p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
+    }
+
+    // Iterate over the target boxes, applying M^-1 to all of the interactions
+    // with each of them at once using the tensor product structure. The 
+    // weight grids of a target box's interactions are contiguous, so each 
+    // inverse map can be applied to all of them at once. Since the maps are 
+    // complex, we separately form the products with their real and imaginary 
+    // parts and combine them while postscaling. Only the interactions in 
+    // our team member's share are transformed, and the caller gathers the 
+    // shares.
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare
+    ( numLocalSourceBoxes<<log2LocalTargetBoxes, shareBegin, shareEnd );
     std::vector<R> scalingArguments( q );
     std::vector<R> realPrescalings( q );
     std::vector<R> imagPrescalings( q );
-    Array<std::vector<R>,d> realPostscalings;
-    Array<std::vector<R>,d> imagPostscalings;
-    for( std::size_t j=0; j<d; ++j )
-    {
-        realPostscalings[j].resize(q);
-        imagPostscalings[j].resize(q);
-    }
-    std::vector<R> realTempWeights0( q_to_d );
-    std::vector<R> imagTempWeights0( q_to_d );
-    std::vector<R> realTempWeights1( q_to_d );
-    std::vector<R> imagTempWeights1( q_to_d );
+    std::vector<R> realPostscalings( q );
+    std::vector<R> imagPostscalings( q );
+    std::vector<R> realMapProducts( numLocalSourceBoxes*2*q_to_d );
+    std::vector<R> imagMapProducts( numLocalSourceBoxes*2*q_to_d );
     ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
     for( std::size_t targetIndex=0;
          targetIndex<(1u<<log2LocalTargetBoxes);
          ++targetIndex, AWalker.Walk() )
     {
+        // The interactions of A in our share form a contiguous range
+        const std::size_t firstInteraction = 
+            targetIndex<<log2LocalSourceBoxes;
+        const std::size_t interactionBegin = 
+            std::max( shareBegin, firstInteraction );
+        const std::size_t interactionEnd = 
+            std::min( shareEnd, firstInteraction+numLocalSourceBoxes );
+        if( interactionEnd <= interactionBegin )
+            continue;
+        const std::size_t numSources = interactionEnd - interactionBegin;
+        const Array<R,d>* sourceP0s = &p0s[interactionBegin-firstInteraction];
+
         const Array<std::size_t,d> A = AWalker.State();
 
         // Translate the local integer coordinates into the target center
@@ -491,304 +284,127 @@ FormEquivalentSources
         for( std::size_t j=0; j<d; ++j )
             x0[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
 
-        // Store the chebyshev grid on A
-        std::vector< Array<R,d> > xPoints( q_to_d );
-        for( std::size_t t=0; t<q_to_d; ++t )
-            for( std::size_t j=0; j<d; ++j )
-                xPoints[t][j] = x0[j] + chebyshevGrid[t][j]*wA[j];
-
-        // Store the postscalings for all interactions with A
+        R* weights = weightGridList[interactionBegin].Buffer();
+        std::size_t q_to_j = 1;
         for( std::size_t j=0; j<d; ++j )
         {
-            for( std::size_t t=0; t<q; ++t )
-                scalingArguments[t] = -SignedTwoPi*x0[j]*chebyshevNodes[t]*wB[j];
-            SinCosBatch
-            ( scalingArguments, imagPostscalings[j], realPostscalings[j] );
-        }
-
-        ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
-        for( std::size_t sourceIndex=0;
-             sourceIndex<(1u<<log2LocalSourceBoxes);
-             ++sourceIndex, BWalker.Walk() )
-        {
-            const Array<std::size_t,d> B = BWalker.State();
-            const std::size_t interactionIndex = 
-                sourceIndex + (targetIndex<<log2LocalSourceBoxes);
-            WeightGrid<R,d,q>& weightGrid = weightGridList[interactionIndex];
-
-            // Translate the local integer coordinates into the source center
-            Array<R,d> p0;
-            for( std::size_t j=0; j<d; ++j )
-                p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
+            const std::size_t numSlicesPerGrid = 2*q_to_d/(q_to_j*q);
 
             //----------------------------------------------------------------//
-            // Solve against the first dimension                              //
+            // Prescale                                                       //
             //----------------------------------------------------------------//
-            // Prescale
-            for( std::size_t t=0; t<q; ++t )
-                scalingArguments[t] = 
-                    -SignedTwoPi*(x0[0]+chebyshevNodes[t]*wA[0])*p0[0];
-            SinCosBatch( scalingArguments, imagPrescalings, realPrescalings );
+            for( std::size_t sourceIndex=0; 
+                 sourceIndex<numSources; 
+                 ++sourceIndex )
             {
-                R* realBuffer = weightGrid.RealBuffer();
-                R* imagBuffer = weightGrid.ImagBuffer();
-                const R* realScalingBuffer = &realPrescalings[0];
-                const R* imagScalingBuffer = &imagPrescalings[0];
-                for( std::size_t t=0; t<Pow<q,d-1>::val; ++t )
-                {
-                    for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                    {
-                        const R realWeight = realBuffer[t*q+tPrime];
-                        const R imagWeight = imagBuffer[t*q+tPrime];
-                        const R realScaling = realScalingBuffer[tPrime];
-                        const R imagScaling = imagScalingBuffer[tPrime];
-                        realBuffer[t*q+tPrime] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagBuffer[t*q+tPrime] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
-            }
-            // Transform with the inverse
-            {
-                const std::vector<R>& realInverseMap = 
-                    context.GetRealInverseMap( 0 );
-                const std::vector<R>& imagInverseMap = 
-                    context.GetImagInverseMap( 0 );
-                // Form the real part
-                Gemm
-                ( 'N', 'N', q, Pow<q,d-1>::val, q,
-                  (R)1, &realInverseMap[0], q,
-                        weightGrid.RealBuffer(), q,
-                  (R)0, &realTempWeights0[0], q );
-                Gemm
-                ( 'N', 'N', q, Pow<q,d-1>::val, q,
-                  (R)-1, &imagInverseMap[0], q,
-                         weightGrid.ImagBuffer(), q,
-                  (R)+1, &realTempWeights0[0], q );
-                // Form the imaginary part
-                Gemm
-                ( 'N', 'N', q, Pow<q,d-1>::val, q,
-                  (R)1, &realInverseMap[0], q,
-                        weightGrid.ImagBuffer(), q,
-                  (R)0, &imagTempWeights0[0], q );
-                Gemm
-                ( 'N', 'N', q, Pow<q,d-1>::val, q,
-                 (R)1, &imagInverseMap[0], q,
-                       weightGrid.RealBuffer(), q,
-                 (R)1, &imagTempWeights0[0], q );
-            }
-            // Post scale
-            {
-                R* realBuffer = &realTempWeights0[0];
-                R* imagBuffer = &imagTempWeights0[0];
-                const R* realScalingBuffer = &realPostscalings[0][0];
-                const R* imagScalingBuffer = &imagPostscalings[0][0];
-                for( std::size_t t=0; t<Pow<q,d-1>::val; ++t )
-                {
-                    for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                    {
-                        const R realWeight = realBuffer[t*q+tPrime];
-                        const R imagWeight = imagBuffer[t*q+tPrime];
-                        const R realScaling = realScalingBuffer[tPrime];
-                        const R imagScaling = imagScalingBuffer[tPrime];
-                        realBuffer[t*q+tPrime] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        imagBuffer[t*q+tPrime] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
-            }
+                for( std::size_t t=0; t<q; ++t )
+                    scalingArguments[t] = 
+                        -SignedTwoPi*(x0[j]+chebyshevNodes[t]*wA[j])*
+                        sourceP0s[sourceIndex][j];
+                SinCosBatch
+                ( scalingArguments, imagPrescalings, realPrescalings );
 
-            //----------------------------------------------------------------//
-            // Solve against the second dimension                             //
-            //----------------------------------------------------------------//
-            // Prescale
-            for( std::size_t t=0; t<q; ++t )
-                scalingArguments[t] = 
-                    -SignedTwoPi*(x0[1]+chebyshevNodes[t]*wA[1])*p0[1];
-            SinCosBatch( scalingArguments, imagPrescalings, realPrescalings );
-            for( std::size_t p=0; p<Pow<q,d-2>::val; ++p )
-            {
-                const std::size_t offset = p*q*q;
-                R* offsetRealBuffer = &realTempWeights0[offset];
-                R* offsetImagBuffer = &imagTempWeights0[offset];
+                R* buffer = &weights[sourceIndex*2*q_to_d];
                 const R* realScalingBuffer = &realPrescalings[0];
                 const R* imagScalingBuffer = &imagPrescalings[0];
-                for( std::size_t w=0; w<q; ++w )
+                for( std::size_t p=0; p<numSlicesPerGrid/2; ++p )
                 {
+                    const std::size_t offset = p*q_to_j*q;
                     for( std::size_t t=0; t<q; ++t )
                     {
-                        const R realWeight = offsetRealBuffer[w+t*q];
-                        const R imagWeight = offsetImagBuffer[w+t*q];
                         const R realScaling = realScalingBuffer[t];
                         const R imagScaling = imagScalingBuffer[t];
-                        offsetRealBuffer[w+t*q] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        offsetImagBuffer[w+t*q] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
+                        for( std::size_t w=0; w<q_to_j; ++w )
+                        {
+                            const std::size_t i = offset+t*q_to_j+w;
+                            const R realWeight = buffer[i];
+                            const R imagWeight = buffer[i+q_to_d];
+                            buffer[i] = 
+                                realWeight*realScaling - 
+                                imagWeight*imagScaling;
+                            buffer[i+q_to_d] = 
+                                imagWeight*realScaling + 
+                                realWeight*imagScaling;
+                        }
                     }
                 }
             }
-            // Transform with the inverse
-            {
-                const std::vector<R>& realInverseMap = 
-                    context.GetRealInverseMap( 1 );
-                const std::vector<R>& imagInverseMap = 
-                    context.GetImagInverseMap( 1 );
-                for( std::size_t w=0; w<Pow<q,d-2>::val; ++w )
-                {
-                    // Form the real part
-                    Gemm
-                    ( 'N', 'T', q, q, q,
-                      (R)1, &realTempWeights0[w*q*q], q,
-                            &realInverseMap[0], q,
-                      (R)0, &realTempWeights1[w*q*q], q );
-                    Gemm
-                    ( 'N', 'T', q, q, q,
-                      (R)-1, &imagTempWeights0[w*q*q], q,
-                             &imagInverseMap[0], q,
-                      (R)+1, &realTempWeights1[w*q*q], q );
 
-                    // Form the imaginary part
-                    Gemm
-                    ( 'N', 'T', q, q, q,
-                      (R)1, &imagTempWeights0[w*q*q], q,
-                            &realInverseMap[0], q,
-                      (R)0, &imagTempWeights1[w*q*q], q );
-                    Gemm
-                    ( 'N', 'T', q, q, q,
-                      (R)1, &realTempWeights0[w*q*q], q,
-                            &imagInverseMap[0], q,
-                      (R)1, &imagTempWeights1[w*q*q], q );
-                }
+            //----------------------------------------------------------------//
+            // Transform with the inverse                                     //
+            //----------------------------------------------------------------//
+            const std::vector<R>& realInverseMap = 
+                context.GetRealInverseMap( j );
+            const std::vector<R>& imagInverseMap = 
+                context.GetImagInverseMap( j );
+            if( j == 0 )
+            {
+                const std::size_t numColumns = 
+                    numSources*2*Pow<q,d-1>::val;
+                MapColumns<R,q>
+                ( 'N', numColumns, &realInverseMap[0], 
+                  weights, (R)0, &realMapProducts[0] );
+                MapColumns<R,q>
+                ( 'N', numColumns, &imagInverseMap[0], 
+                  weights, (R)0, &imagMapProducts[0] );
             }
-            // Postscale
-            for( std::size_t p=0; p<Pow<q,d-2>::val; ++p )
+            else
             {
-                const std::size_t offset = p*q*q;
-                R* offsetRealBuffer = &realTempWeights1[offset];
-                R* offsetImagBuffer = &imagTempWeights1[offset];
-                const R* realScalingBuffer = &realPostscalings[1][0];
-                const R* imagScalingBuffer = &imagPostscalings[1][0];
-                for( std::size_t w=0; w<q; ++w )
-                {
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        const R realWeight = offsetRealBuffer[w+t*q];
-                        const R imagWeight = offsetImagBuffer[w+t*q];
-                        const R realScaling = realScalingBuffer[t];
-                        const R imagScaling = imagScalingBuffer[t];
-                        offsetRealBuffer[w+t*q] = 
-                            realWeight*realScaling - imagWeight*imagScaling;
-                        offsetImagBuffer[w+t*q] = 
-                            imagWeight*realScaling + realWeight*imagScaling;
-                    }
-                }
+                const std::size_t numSlices = 
+                    numSources*numSlicesPerGrid;
+                MapRows<R,q>
+                ( 'T', q_to_j, numSlices, &realInverseMap[0], 
+                  weights, (R)0, &realMapProducts[0] );
+                MapRows<R,q>
+                ( 'T', q_to_j, numSlices, &imagInverseMap[0],
+                  weights, (R)0, &imagMapProducts[0] );
             }
 
             //----------------------------------------------------------------//
-            // Solve against the remaining dimensions                         //
+            // Form the complex products and postscale                        //
             //----------------------------------------------------------------//
-            std::size_t q_to_j = q*q;
-            for( std::size_t j=2; j<d; ++j )
+            for( std::size_t t=0; t<q; ++t )
+                scalingArguments[t] = -SignedTwoPi*x0[j]*chebyshevNodes[t]*wB[j];
+            SinCosBatch( scalingArguments, imagPostscalings, realPostscalings );
             {
-                const std::size_t stride = q_to_j;
-
-                R* realWriteBuffer = 
-                    ( j==d-1 ? weightGrid.RealBuffer()
-                             : ( j&1 ? &realTempWeights1[0]
-                                     : &realTempWeights0[0] ) );
-                R* imagWriteBuffer = 
-                    ( j==d-1 ? weightGrid.ImagBuffer()
-                             : ( j&1 ? &imagTempWeights1[0]
-                                     : &imagTempWeights0[0] ) );
-                R* realReadBuffer = 
-                    ( j&1 ? &realTempWeights0[0] : &realTempWeights1[0] );
-                R* imagReadBuffer = 
-                    ( j&1 ? &imagTempWeights0[0] : &imagTempWeights1[0] );
-
-                const std::vector<R>& realInverseMap = 
-                    context.GetRealInverseMap( j );
-                const std::vector<R>& imagInverseMap = 
-                    context.GetImagInverseMap( j );
-                const R* realInverseBuffer = &realInverseMap[0];
-                const R* imagInverseBuffer = &imagInverseMap[0];
-
-                std::memset( realWriteBuffer, 0, q_to_d*sizeof(R) );
-                std::memset( imagWriteBuffer, 0, q_to_d*sizeof(R) );
-
-                // Prescale, transform, and postscale
-                for( std::size_t t=0; t<q; ++t )
-                    scalingArguments[t] = 
-                        -SignedTwoPi*(x0[j]+chebyshevNodes[t]*wA[j])*p0[j];
-                SinCosBatch
-                ( scalingArguments, imagPrescalings, realPrescalings );
-                for( std::size_t p=0; p<q_to_d/(q_to_j*q); ++p )
+                const R* realScalingBuffer = &realPostscalings[0];
+                const R* imagScalingBuffer = &imagPostscalings[0];
+                for( std::size_t sourceIndex=0;
+                     sourceIndex<numSources;
+                     ++sourceIndex )
                 {
-                    const std::size_t offset = p*(q_to_j*q);
-                    R* offsetRealReadBuffer = &realReadBuffer[offset];
-                    R* offsetImagReadBuffer = &imagReadBuffer[offset];
-                    R* offsetRealWriteBuffer = &realWriteBuffer[offset];
-                    R* offsetImagWriteBuffer = &imagWriteBuffer[offset];
-                    const R* realPrescalingBuffer = &realPrescalings[0];
-                    const R* imagPrescalingBuffer = &imagPrescalings[0];
-                    const R* realPostscalingBuffer = &realPostscalings[j][0];
-                    const R* imagPostscalingBuffer = &imagPostscalings[j][0];
-                    for( std::size_t w=0; w<q_to_j; ++w )
+                    const std::size_t gridOffset = sourceIndex*2*q_to_d;
+                    const R* realProductBuffer = &realMapProducts[gridOffset];
+                    const R* imagProductBuffer = &imagMapProducts[gridOffset];
+                    R* buffer = &weights[gridOffset];
+                    for( std::size_t p=0; p<numSlicesPerGrid/2; ++p )
                     {
-                        // Prescale
+                        const std::size_t offset = p*q_to_j*q;
                         for( std::size_t t=0; t<q; ++t )
                         {
-                            const R realWeight = 
-                                offsetRealReadBuffer[w+t*stride];
-                            const R imagWeight = 
-                                offsetImagReadBuffer[w+t*stride];
-                            const R realScaling = realPrescalingBuffer[t];
-                            const R imagScaling = imagPrescalingBuffer[t];
-                            offsetRealReadBuffer[w+t*stride] = 
-                                realWeight*realScaling - imagWeight*imagScaling;
-                            offsetImagReadBuffer[w+t*stride] = 
-                                imagWeight*realScaling + realWeight*imagScaling;
-                        }
-                        // Transform
-                        for( std::size_t t=0; t<q; ++t )
-                        {
-                            for( std::size_t tPrime=0; tPrime<q; ++tPrime )
+                            const R realScaling = realScalingBuffer[t];
+                            const R imagScaling = imagScalingBuffer[t];
+                            for( std::size_t w=0; w<q_to_j; ++w )
                             {
-                                offsetRealWriteBuffer[w+t*stride] +=
-                                    realInverseBuffer[t+tPrime*q] * 
-                                    offsetRealReadBuffer[w+tPrime*stride];
-                                offsetRealWriteBuffer[w+t*stride] -=
-                                    imagInverseBuffer[t+tPrime*q] *
-                                    offsetImagReadBuffer[w+tPrime*stride];
-
-                                offsetImagWriteBuffer[w+t*stride] +=
-                                    imagInverseBuffer[t+tPrime*q] *
-                                    offsetRealReadBuffer[w+tPrime*stride];
-                                offsetImagWriteBuffer[w+t*stride] +=
-                                    realInverseBuffer[t+tPrime*q] *
-                                    offsetImagReadBuffer[w+tPrime*stride];
+                                const std::size_t i = offset+t*q_to_j+w;
+                                const R realWeight = 
+                                    realProductBuffer[i] - 
+                                    imagProductBuffer[i+q_to_d];
+                                const R imagWeight = 
+                                    imagProductBuffer[i] + 
+                                    realProductBuffer[i+q_to_d];
+                                buffer[i] = 
+                                    realWeight*realScaling - 
+                                    imagWeight*imagScaling;
+                                buffer[i+q_to_d] = 
+                                    imagWeight*realScaling + 
+                                    realWeight*imagScaling;
                             }
                         }
-                        // Postscale
-                        for( std::size_t t=0; t<q; ++t )
-                        {
-                            const R realWeight = 
-                                offsetRealWriteBuffer[w+t*stride];
-                            const R imagWeight = 
-                                offsetImagWriteBuffer[w+t*stride];
-                            const R realScaling = realPostscalingBuffer[t];
-                            const R imagScaling = imagPostscalingBuffer[t];
-                            offsetRealWriteBuffer[w+t*stride] = 
-                                realWeight*realScaling - imagWeight*imagScaling;
-                            offsetImagWriteBuffer[w+t*stride] = 
-                                imagWeight*realScaling + realWeight*imagScaling;
-                        }
                     }
                 }
-                q_to_j *= q;
             }
+            q_to_j *= q;
         }
     }
 }
@@ -796,5 +412,4 @@ FormEquivalentSources
 } // interpolative_nuft
 } // bfio
 
-#endif // BFIO_INTERPOLATIVE_NUFT_FORM_EQUIVALENT_SOURCES_HPP 
-
+#endif // BFIO_INTERPOLATIVE_NUFT_FORM_EQUIVALENT_SOURCES_HPP
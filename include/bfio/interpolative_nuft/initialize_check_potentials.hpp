@@ -32,6 +32,7 @@
 #include "bfio/tools/blas.hpp"
 #include "bfio/tools/flatten_constrained_htree_index.hpp"
 #include "bfio/tools/mpi.hpp"
+#include "bfio/tools/reverse_constrained_htree_index.hpp"
 #include "bfio/tools/special_functions.hpp"
 
 #include "bfio/interpolative_nuft/context.hpp"
@@ -118,9 +119,12 @@ InitializeCheckPotentials
             }
         }
 
-        // Flatten and store the integer coordinates of B
+        // Flatten the integer coordinates of B and store the reversed 
+        // index, which is where the weights of B are kept
         flattenedSourceBoxIndices[s] = 
-            FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim );
+            ReverseConstrainedHTreeIndex<d>
+            ( FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim ),
+              log2LocalSourceBoxes );
     }
 
     // Batch evaluate the dot products and multiply by +-TwoPi
@@ -244,9 +248,12 @@ InitializeCheckPotentials
             }
         }
 
-        // Flatten and store the integer coordinates of B
+        // Flatten the integer coordinates of B and store the reversed 
+        // index, which is where the weights of B are kept
         flattenedSourceBoxIndices[s] = 
-            FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim );
+            ReverseConstrainedHTreeIndex<d>
+            ( FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim ),
+              log2LocalSourceBoxes );
     }
 
     // Batch evaluate the dot products and multiply by +-TwoPi
@@ -368,9 +375,12 @@ InitializeCheckPotentials
             }
         }
 
-        // Flatten and store the integer coordinates of B
+        // Flatten the integer coordinates of B and store the reversed 
+        // index, which is where the weights of B are kept
         flattenedSourceBoxIndices[s] = 
-            FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim );
+            ReverseConstrainedHTreeIndex<d>
+            ( FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim ),
+              log2LocalSourceBoxes );
     }
 
     // Batch evaluate the dot products and multiply by +-TwoPi
@@ -82,6 +82,7 @@ PrintTimings()
 #include "bfio/rfio/initialize_weights.hpp"
 #include "bfio/rfio/source_weight_recursion.hpp"
 #include "bfio/rfio/target_weight_recursion.hpp"
+#include "bfio/rfio/workspace.hpp"
 
 #include "bfio/lagrangian_nuft/switch_to_target_interp.hpp"
 
@@ -101,6 +102,7 @@ LagrangianNUFT
     lagrangian_nuft::timer.Start();
 #endif
     typedef std::complex<R> C;
+    typedef typename PhaseReal<R>::Type P;
     const std::size_t q_to_d = Pow<q,d>::val;
     const rfio::Context<R,d,q>& rfioContext = 
         nuftContext.GetReducedFIOContext();
@@ -109,12 +111,13 @@ LagrangianNUFT
     // We could potentially have the plan direction be different
     // (e.g., Forward direction with Adjoint FT phase function)
     const Direction direction = nuftContext.GetDirection();
-    const lagrangian_nuft::ForwardFTPhase<R,d> forwardPhase;
-    const lagrangian_nuft::AdjointFTPhase<R,d> adjointPhase;
-    const lagrangian_nuft::FTPhase<R,d>& phase = 
+    const lagrangian_nuft::ForwardFTPhase<P,d> forwardPhase;
+    const lagrangian_nuft::AdjointFTPhase<P,d> adjointPhase;
+    const Phase<P,d>& phase = 
         ( direction==FORWARD ? 
-          (const lagrangian_nuft::FTPhase<R,d>&)forwardPhase :
-          (const lagrangian_nuft::FTPhase<R,d>&)adjointPhase );
+          (const lagrangian_nuft::FTPhase<P,d>&)forwardPhase :
+          (const lagrangian_nuft::FTPhase<P,d>&)adjointPhase );
+    const std::vector<const Phase<P,d>*> phases( 1, &phase );
 
     // Extract our communicator and its size
     MPI_Comm comm = plan.GetComm();
@@ -145,34 +148,77 @@ LagrangianNUFT
     Box<R,d> myTargetBox;
     myTargetBox = targetBox;
 
-    // Compute the number of leaf-level boxes in the source domain that 
-    // our process is responsible for initializing the weights in. 
+    const std::size_t bootstrapSkip = plan.GetBootstrapSkip();
+
+    // Compute the number of source and target boxes that our process is 
+    // responsible for initializing weights in, merging our source box with
+    // those of our bootstrap cluster if necessary (see rfio::transform)
     std::size_t log2LocalSourceBoxes = 0;
     std::size_t log2LocalTargetBoxes = 0;
     Array<std::size_t,d> log2LocalSourceBoxesPerDim;
-    Array<std::size_t,d> log2LocalTargetBoxesPerDim(0);
+    Array<std::size_t,d> log2LocalTargetBoxesPerDim;
     for( std::size_t j=0; j<d; ++j )
     {
         log2LocalSourceBoxesPerDim[j] = log2N-log2SourceBoxesPerDim[j];
+        log2LocalTargetBoxesPerDim[j] = bootstrapSkip;
+    }
+    const std::vector<std::size_t>& bootstrapSourceDimsToMerge = 
+        plan.GetBootstrapSourceDimsToMerge();
+    for( std::size_t i=0; i<bootstrapSourceDimsToMerge.size(); ++i )
+    {
+        const std::size_t j = bootstrapSourceDimsToMerge[i];
+        if( mySourceBoxCoords[j] & 1 )
+            mySourceBox.offsets[j] -= mySourceBox.widths[j];
+        mySourceBoxCoords[j] >>= 1;
+        mySourceBox.widths[j] *= 2;
+        ++log2LocalSourceBoxesPerDim[j];
+    }
+    const std::vector<std::size_t>& bootstrapTargetDimsToCut = 
+        plan.GetBootstrapTargetDimsToCut();
+    const std::vector<bool>& bootstrapRightSideOfCut = 
+        plan.GetBootstrapRightSideOfCut();
+    for( std::size_t i=0; i<bootstrapTargetDimsToCut.size(); ++i )
+    {
+        const std::size_t j = bootstrapTargetDimsToCut[i];
+        myTargetBox.widths[j] *= 0.5;
+        myTargetBoxCoords[j] *= 2;
+        if( bootstrapRightSideOfCut[i] )
+        {
+            myTargetBoxCoords[j] |= 1;
+            myTargetBox.offsets[j] += myTargetBox.widths[j];
+        }
+        --log2LocalTargetBoxesPerDim[j];
+    }
+    for( std::size_t j=0; j<d; ++j )
+    {
+        log2LocalSourceBoxesPerDim[j] -= bootstrapSkip;
         log2LocalSourceBoxes += log2LocalSourceBoxesPerDim[j];
+        log2LocalTargetBoxes += log2LocalTargetBoxesPerDim[j];
     }
 
     // Initialize the weights using Lagrangian interpolation on the 
     // smooth component of the kernel.
-    WeightGridList<R,d,q> weightGridList( 1<<log2LocalSourceBoxes );
+    WeightGridList<R,d,q> weightGridList
+    ( 1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes) );
 #ifdef TIMING
     lagrangian_nuft::initializeWeightsTimer.Start();
 #endif
     rfio::InitializeWeights
-    ( rfioContext, plan, phase, sourceBox, targetBox, mySourceBox, 
-      log2LocalSourceBoxes, log2LocalSourceBoxesPerDim, mySources, 
+    ( rfioContext, plan, phases, sourceBox, targetBox, mySourceBox, 
+      myTargetBox, log2LocalSourceBoxes, log2LocalTargetBoxes,
+      log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim, mySources, 
       weightGridList );
+    plan.GatherTeamShares
+    ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
     lagrangian_nuft::initializeWeightsTimer.Stop();
 #endif
 
+    // Allocate the scratch space for the recursions once
+    rfio::Workspace<R,d,q> workspace;
+
     // Start the main recursion loop
-    if( log2N == 0 || log2N == 1 )
+    if( bootstrapSkip == log2N/2 )
     {
 #ifdef TIMING
 	lagrangian_nuft::switchToTargetInterpTimer.Start();
@@ -182,11 +228,13 @@ LagrangianNUFT
           myTargetBox, log2LocalSourceBoxes, log2LocalTargetBoxes,
           log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim,
           weightGridList );
+        plan.GatherTeamShares
+        ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
 	lagrangian_nuft::switchToTargetInterpTimer.Stop();
 #endif
     }
-    for( std::size_t level=1; level<=log2N; ++level )
+    for( std::size_t level=bootstrapSkip+1; level<=log2N; ++level )
     {
         // Compute the width of the nodes at this level
         Array<R,d> wA;
@@ -208,42 +256,58 @@ LagrangianNUFT
             log2LocalSourceBoxes -= d;
             log2LocalTargetBoxes += d;
 
-            // Loop over boxes in target domain. 
-            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-            WeightGridList<R,d,q> oldWeightGridList( weightGridList );
-            for( std::size_t targetIndex=0; 
-                 targetIndex<(1u<<log2LocalTargetBoxes); 
-                 ++targetIndex, AWalker.Walk() )
+            // Loop over the groups of interactions between a parent target 
+            // box and the children of a source box. Each group is updated in 
+            // place, and only our team member's share of the new 
+            // interactions is formed (see rfio::transform).
+            const std::size_t numLocalSourceBoxes = 1u<<log2LocalSourceBoxes;
+            const std::size_t numGroups = 
+                1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes-d);
+            const std::size_t numInteractions = numGroups<<d;
+            std::size_t shareBegin, shareEnd;
+            plan.TeamShare( numInteractions, shareBegin, shareEnd );
+            WeightGridList<R,d,q>& groupWeightGridList = 
+                workspace.groupWeightGridList;
+            for( std::size_t group=0; group<numGroups; ++group )
             {
-                const Array<std::size_t,d> A = AWalker.State();
-
-                // Compute coordinates and center of this target box
-                Array<R,d> x0A;
+                const std::size_t parentTargetIndex = 
+                    group >> log2LocalSourceBoxes;
+                const std::size_t reversedSourceIndex = 
+                    group & (numLocalSourceBoxes-1);
+                const std::size_t sourceIndex = 
+                    UnreverseConstrainedHTreeIndex<d>
+                    ( reversedSourceIndex, log2LocalSourceBoxes );
+                const Array<std::size_t,d> B = 
+                    UnflattenConstrainedHTreeIndex
+                    ( sourceIndex, log2LocalSourceBoxesPerDim );
+
+                // Compute coordinates and center of this source box
+                Array<R,d> p0B;
                 for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+                    p0B[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
 
-                // Loop over the B boxes in source domain
-                ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
-                for( std::size_t sourceIndex=0; 
-                     sourceIndex<(1u<<log2LocalSourceBoxes); 
-                     ++sourceIndex, BWalker.Walk() )
-                {
-                    const Array<std::size_t,d> B = BWalker.State();
+                // The interactions of the group (both old and new) are 
+                // numLocalSourceBoxes apart
+                const std::size_t groupOffset = 
+                    (parentTargetIndex<<(log2LocalSourceBoxes+d)) + 
+                    reversedSourceIndex;
 
-                    // Compute coordinates and center of this source box
-                    Array<R,d> p0B;
+                // Loop over the children of the parent target box
+                for( std::size_t a=0; a<(1u<<d); ++a )
+                {
+                    const std::size_t interaction = 
+                        groupOffset + a*numLocalSourceBoxes;
+                    if( interaction < shareBegin || interaction >= shareEnd )
+                        continue;
+                    const std::size_t targetIndex = (parentTargetIndex<<d) + a;
+                    const Array<std::size_t,d> A = 
+                        UnflattenConstrainedHTreeIndex
+                        ( targetIndex, log2LocalTargetBoxesPerDim );
+
+                    // Compute coordinates and center of this target box
+                    Array<R,d> x0A;
                     for( std::size_t j=0; j<d; ++j )
-                        p0B[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
-
-                    // We are storing the interaction pairs source-major
-                    const std::size_t interactionIndex = 
-                        sourceIndex + (targetIndex<<log2LocalSourceBoxes);
-
-                    // Grab the interaction offset for the parent of target box 
-                    // i interacting with the children of source box k
-                    const std::size_t parentInteractionOffset = 
-                        ((targetIndex>>d)<<(log2LocalSourceBoxes+d)) + 
-                        (sourceIndex<<d);
+                        x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
 
                     if( level <= log2N/2 )
                     {
@@ -251,9 +315,9 @@ LagrangianNUFT
 			lagrangian_nuft::sourceWeightRecursionTimer.Start();
 #endif
                         rfio::SourceWeightRecursion
-                        ( rfioContext, plan, phase, level, x0A, p0B, wB,
-                          parentInteractionOffset, oldWeightGridList,
-                          weightGridList[interactionIndex] );
+                        ( rfioContext, plan, phases, level, x0A, p0B, wB,
+                          groupOffset, numLocalSourceBoxes, weightGridList,
+                          groupWeightGridList[a], workspace );
 #ifdef TIMING
 			lagrangian_nuft::sourceWeightRecursionTimer.Stop();
 #endif
@@ -276,21 +340,40 @@ LagrangianNUFT
 			lagrangian_nuft::targetWeightRecursionTimer.Start();
 #endif
                         rfio::TargetWeightRecursion
-                        ( rfioContext, plan, phase, level,
+                        ( rfioContext, plan, phases, level,
                           ARelativeToAp, x0A, x0Ap, p0B, wA, wB,
-                          parentInteractionOffset, oldWeightGridList, 
-                          weightGridList[interactionIndex] );
+                          groupOffset, numLocalSourceBoxes, weightGridList, 
+                          groupWeightGridList[a], workspace );
 #ifdef TIMING
 			lagrangian_nuft::targetWeightRecursionTimer.Stop();
 #endif
                     }
                 }
+
+                // Overwrite the old weights of the group with the new ones
+                for( std::size_t a=0; a<(1u<<d); ++a )
+                {
+                    const std::size_t interaction = 
+                        groupOffset + a*numLocalSourceBoxes;
+                    if( interaction < shareBegin || interaction >= shareEnd )
+                        continue;
+                    std::memcpy
+                    ( weightGridList[interaction].Buffer(), 
+                      groupWeightGridList[a].Buffer(), 2*q_to_d*sizeof(R) );
+                }
             }
+#ifdef TIMING
+            lagrangian_nuft::sumScatterTimer.Start();
+#endif
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), numInteractions, 2*q_to_d );
+#ifdef TIMING
+            lagrangian_nuft::sumScatterTimer.Stop();
+#endif
         }
         else 
         {
             const std::size_t log2NumMergingProcesses = d-log2LocalSourceBoxes;
-            const std::size_t numMergingProcesses = 1u<<log2NumMergingProcesses;
 
             log2LocalSourceBoxes = 0; 
             for( std::size_t j=0; j<d; ++j )
@@ -320,125 +403,88 @@ LagrangianNUFT
                 p0B[j] = mySourceBox.offsets[j] + 0.5*wB[j];
 
             // Form the partial weights by looping over the boxes in the  
-            // target domain.
-            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-            WeightGridList<R,d,q> partialWeightGridList
-            ( 1<<log2LocalTargetBoxes );
-            for( std::size_t targetIndex=0; 
-                 targetIndex<(1u<<log2LocalTargetBoxes); 
-                 ++targetIndex, AWalker.Walk() )
+            // target domain. The boxes are visited in chunks, and the 
+            // summation of each chunk's weights is started as soon as they 
+            // are formed so that it may overlap with forming the next.
+            SumScatterPipeline<R,d,q> pipeline
+            ( plan, level, log2NumMergingProcesses, log2LocalTargetBoxes );
+            for( std::size_t chunk=0; chunk<pipeline.NumChunks(); ++chunk )
             {
-                const Array<std::size_t,d> A = AWalker.State();
-
-                // Compute coordinates and center of this target box
-                Array<R,d> x0A;
-                for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
-
-                // Compute the interaction offset of A's parent interacting 
-                // with the remaining local source boxes
-                const std::size_t parentInteractionOffset = 
-                    ((targetIndex>>d)<<(d-log2NumMergingProcesses));
-                if( level <= log2N/2 )
+                for( std::size_t i=0; i<pipeline.ChunkSize(); ++i )
                 {
+                    const std::size_t targetIndex = 
+                        pipeline.TargetIndex( chunk, i );
+                    const Array<std::size_t,d> A = 
+                        UnflattenConstrainedHTreeIndex
+                        ( targetIndex, log2LocalTargetBoxesPerDim );
+
+                    // Compute coordinates and center of this target box
+                    Array<R,d> x0A;
+                    for( std::size_t j=0; j<d; ++j )
+                        x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+
+                    // Compute the interaction offset of A's parent 
+                    // interacting with the remaining local source boxes. 
+                    // There are fewer than 2^d of them, so their indices 
+                    // are not reversed.
+                    const std::size_t parentInteractionOffset = 
+                        ((targetIndex>>d)<<(d-log2NumMergingProcesses));
+                    if( level <= log2N/2 )
+                    {
 #ifdef TIMING
-		    lagrangian_nuft::sourceWeightRecursionTimer.Start();
+                        lagrangian_nuft::sourceWeightRecursionTimer.Start();
 #endif
-                    rfio::SourceWeightRecursion
-                    ( rfioContext, plan, phase, level, x0A, p0B, wB,
-                      parentInteractionOffset, weightGridList,
-                      partialWeightGridList[targetIndex] );
+                        rfio::SourceWeightRecursion
+                        ( rfioContext, plan, phases, level, x0A, p0B, wB,
+                          parentInteractionOffset, 1, weightGridList,
+                          pipeline.PartialWeights( chunk, i ), workspace );
 #ifdef TIMING
-		    lagrangian_nuft::sourceWeightRecursionTimer.Stop();
+                        lagrangian_nuft::sourceWeightRecursionTimer.Stop();
 #endif
-                }
-                else
-                {
-                    Array<R,d> x0Ap;
-                    Array<std::size_t,d> globalA;
-                    std::size_t ARelativeToAp = 0;
-                    for( std::size_t j=0; j<d; ++j )
-                    {
-                        globalA[j] = 
-                            (myTargetBoxCoords[j]<<
-                             log2LocalTargetBoxesPerDim[j])+A[j];
-                        x0Ap[j] = targetBox.offsets[j] + (globalA[j]|1)*wA[j];
-                        ARelativeToAp |= (globalA[j]&1)<<j;
                     }
+                    else
+                    {
+                        Array<R,d> x0Ap;
+                        Array<std::size_t,d> globalA;
+                        std::size_t ARelativeToAp = 0;
+                        for( std::size_t j=0; j<d; ++j )
+                        {
+                            globalA[j] = 
+                                (myTargetBoxCoords[j]<<
+                                 log2LocalTargetBoxesPerDim[j])+A[j];
+                            x0Ap[j] = 
+                                targetBox.offsets[j] + (globalA[j]|1)*wA[j];
+                            ARelativeToAp |= (globalA[j]&1)<<j;
+                        }
 #ifdef TIMING
-		    lagrangian_nuft::targetWeightRecursionTimer.Start();
+                        lagrangian_nuft::targetWeightRecursionTimer.Start();
 #endif
-                    rfio::TargetWeightRecursion
-                    ( rfioContext, plan, phase, level,
-                      ARelativeToAp, x0A, x0Ap, p0B, wA, wB,
-                      parentInteractionOffset, weightGridList, 
-                      partialWeightGridList[targetIndex] );
+                        rfio::TargetWeightRecursion
+                        ( rfioContext, plan, phases, level,
+                          ARelativeToAp, x0A, x0Ap, p0B, wA, wB,
+                          parentInteractionOffset, 1, weightGridList, 
+                          pipeline.PartialWeights( chunk, i ), workspace );
 #ifdef TIMING
-		    lagrangian_nuft::targetWeightRecursionTimer.Stop();
+                        lagrangian_nuft::targetWeightRecursionTimer.Stop();
 #endif
+                    }
                 }
+#ifdef TIMING
+                lagrangian_nuft::sumScatterTimer.Start();
+#endif
+                pipeline.Scatter( chunk );
+#ifdef TIMING
+                lagrangian_nuft::sumScatterTimer.Stop();
+#endif
             }
 
-            // Scatter the summation of the weights
+            // Wait for the summation of the weights
 #ifdef TIMING
             lagrangian_nuft::sumScatterTimer.Start();
 #endif
-            std::vector<int> recvCounts( numMergingProcesses );
-            for( std::size_t j=0; j<numMergingProcesses; ++j )
-                recvCounts[j] = 2*weightGridList.Length()*q_to_d;
-            // Currently two types of planned communication are supported, as 
-            // they are the only required types for transforming and inverting 
-            // the transform:
-            //  1) partitions of dimensions 0 -> c
-            //  2) partitions of dimensions c -> d-1
-            // Both 1 and 2 include partitioning 0 -> d-1, but, in general, 
-            // the second category never requires packing.
-            const std::size_t log2SubclusterSize = 
-                plan.GetLog2SubclusterSize( level );
-            if( log2SubclusterSize == 0 )
-            {
-                MPI_Comm clusterComm = plan.GetClusterComm( level );
-                SumScatter    
-                ( partialWeightGridList.Buffer(), weightGridList.Buffer(),
-                  &recvCounts[0], clusterComm );
-            }
-            else
-            {
-                const std::size_t log2NumSubclusters = 
-                    log2NumMergingProcesses-log2SubclusterSize;
-                const std::size_t numSubclusters = 1u<<log2NumSubclusters;
-                const std::size_t subclusterSize = 1u<<log2SubclusterSize;
-
-                const std::size_t recvSize = recvCounts[0];
-                const std::size_t sendSize = recvSize*numMergingProcesses;
-                const std::size_t numChunksPerProcess = subclusterSize;
-                const std::size_t chunkSize = recvSize / numChunksPerProcess;
-                const R* partialBuffer = partialWeightGridList.Buffer();
-                std::vector<R> sendBuffer( sendSize );
-                for( std::size_t sc=0; sc<numSubclusters; ++sc )
-                {
-                    R* subclusterSendBuffer = 
-                        &sendBuffer[sc*subclusterSize*recvSize];
-                    const R* subclusterPartialBuffer = 
-                        &partialBuffer[sc*subclusterSize*recvSize];
-                    for( std::size_t p=0; p<subclusterSize; ++p )
-                    {
-                        R* processSend = &subclusterSendBuffer[p*recvSize];
-                        for( std::size_t c=0; c<numChunksPerProcess; ++c )
-                        {
-                            std::memcpy 
-                            ( &processSend[c*chunkSize],
-                              &subclusterPartialBuffer
-                              [(p+c*subclusterSize)*chunkSize],
-                              chunkSize*sizeof(R) );
-                        }
-                    }
-                }
-                MPI_Comm clusterComm = plan.GetClusterComm( level );
-                SumScatter
-                ( &sendBuffer[0], weightGridList.Buffer(), 
-                  &recvCounts[0], clusterComm );
-            }
+            pipeline.Finish( weightGridList );
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
             lagrangian_nuft::sumScatterTimer.Stop();
 #endif
@@ -471,6 +517,8 @@ LagrangianNUFT
               myTargetBox, log2LocalSourceBoxes, log2LocalTargetBoxes,
               log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim,
               weightGridList );
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), weightGridList.Length(), 2*q_to_d );
 #ifdef TIMING
 	    lagrangian_nuft::switchToTargetInterpTimer.Stop();
 #endif
@@ -18,7 +18,13 @@
 #ifndef BFIO_LAGRANGIAN_NUFT_FT_PHASES_HPP
 #define BFIO_LAGRANGIAN_NUFT_FT_PHASES_HPP 1
 
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "bfio/constants.hpp"
 #include "bfio/functors/phase.hpp"
+#include "bfio/rfio/tensor_imag_exp_batch.hpp"
 
 namespace bfio {
 
@@ -28,7 +34,11 @@ namespace lagrangian_nuft {
 // lagrangian_nuft PotentialField in terms of Fourier phase functions
 template<typename R,std::size_t d>
 class FTPhase : public Phase<R,d>
-{ };
+{
+public:
+    // The Fourier phases are sums of the terms +-2 pi x_j p_j
+    FTPhase();
+};
 
 template<typename R,std::size_t d>
 class ForwardFTPhase : public FTPhase<R,d>
@@ -49,6 +59,22 @@ public:
     ( const std::vector< bfio::Array<R,d> >& xPoints,
       const std::vector< bfio::Array<R,d> >& pPoints,
             std::vector< R                >& results ) const;
+
+    // The imaginary exponentials factor over the dimensions
+    virtual void
+    BatchEvaluateImagExp
+    ( const std::vector< bfio::Array<R,d> >& xPoints,
+      const std::vector< bfio::Array<R,d> >& pPoints,
+            std::vector< R                >& phiResults,
+            std::vector< R                >& sinResults,
+            std::vector< R                >& cosResults ) const;
+
+    virtual void
+    BatchEvaluateTerm
+    ( std::size_t j,
+      const std::vector<R>& x,
+      const std::vector<R>& p,
+            std::vector<R>& results ) const;
 };
 
 template<typename R,std::size_t d>
@@ -70,12 +96,75 @@ public:
     ( const std::vector< bfio::Array<R,d> >& xPoints,
       const std::vector< bfio::Array<R,d> >& pPoints,
             std::vector< R                >& results ) const;
+
+    // The imaginary exponentials factor over the dimensions
+    virtual void
+    BatchEvaluateImagExp
+    ( const std::vector< bfio::Array<R,d> >& xPoints,
+      const std::vector< bfio::Array<R,d> >& pPoints,
+            std::vector< R                >& phiResults,
+            std::vector< R                >& sinResults,
+            std::vector< R                >& cosResults ) const;
+
+    virtual void
+    BatchEvaluateTerm
+    ( std::size_t j,
+      const std::vector<R>& x,
+      const std::vector<R>& p,
+            std::vector<R>& results ) const;
 };
 
+// The Fourier phases are sums of the terms +-2 pi x_j p_j, and the point sets
+// formed by the butterfly are tensor products of a handful of distinct 
+// coordinates in each dimension, so their imaginary exponentials are formed 
+// from tables of those of the terms (see rfio::SeparableImagExpBatch). 
+// Returns false, without forming any results, if there are too few pairs or
+// too many distinct coordinates for this to pay off.
+template<typename R,std::size_t d>
+bool
+FTImagExpBatch
+( const FTPhase<R,d>& phase,
+  const std::vector< bfio::Array<R,d> >& xPoints,
+  const std::vector< bfio::Array<R,d> >& pPoints,
+        std::vector< R                >& phiResults,
+        std::vector< R                >& sinResults,
+        std::vector< R                >& cosResults );
+
 } // lagrangian_nuft
 
 // Implementations
 
+namespace lagrangian_nuft {
+
+template<typename R,std::size_t d>
+inline bool
+FTImagExpBatch
+( const FTPhase<R,d>& phase,
+  const std::vector< bfio::Array<R,d> >& xPoints,
+  const std::vector< bfio::Array<R,d> >& pPoints,
+        std::vector< R                >& phiResults,
+        std::vector< R                >& sinResults,
+        std::vector< R                >& cosResults )
+{
+    // Below this size, evaluating the phases and their sines and cosines
+    // directly is at least as fast
+    const std::size_t minPairs = 4096;
+    const std::size_t maxCoords = 16;
+    if( xPoints.size()*pPoints.size() < minPairs )
+        return false;
+
+    rfio::ImagExpBuffers<R,R> buffers;
+    return rfio::SeparableImagExpBatch<maxCoords>
+    ( phase, xPoints, pPoints, phiResults, sinResults, cosResults, buffers );
+}
+
+} // lagrangian_nuft
+
+template<typename R,std::size_t d>
+lagrangian_nuft::FTPhase<R,d>::FTPhase()
+: Phase<R,d>(true)
+{ }
+
 template<typename R,std::size_t d>
 lagrangian_nuft::ForwardFTPhase<R,d>::ForwardFTPhase()
 { }
@@ -178,6 +267,76 @@ lagrangian_nuft::AdjointFTPhase<R,d>::BatchEvaluate
     }
 }
 
+template<typename R,std::size_t d>
+void
+lagrangian_nuft::ForwardFTPhase<R,d>::BatchEvaluateImagExp
+( const std::vector< bfio::Array<R,d> >& xPoints,
+  const std::vector< bfio::Array<R,d> >& pPoints,
+        std::vector< R                >& phiResults,
+        std::vector< R                >& sinResults,
+        std::vector< R                >& cosResults ) const
+{
+    if( !FTImagExpBatch
+        ( *this, xPoints, pPoints, phiResults, sinResults, cosResults ) )
+        Phase<R,d>::BatchEvaluateImagExp
+        ( xPoints, pPoints, phiResults, sinResults, cosResults );
+}
+
+template<typename R,std::size_t d>
+void
+lagrangian_nuft::AdjointFTPhase<R,d>::BatchEvaluateImagExp
+( const std::vector< bfio::Array<R,d> >& xPoints,
+  const std::vector< bfio::Array<R,d> >& pPoints,
+        std::vector< R                >& phiResults,
+        std::vector< R                >& sinResults,
+        std::vector< R                >& cosResults ) const
+{
+    if( !FTImagExpBatch
+        ( *this, xPoints, pPoints, phiResults, sinResults, cosResults ) )
+        Phase<R,d>::BatchEvaluateImagExp
+        ( xPoints, pPoints, phiResults, sinResults, cosResults );
+}
+
+template<typename R,std::size_t d>
+void
+lagrangian_nuft::ForwardFTPhase<R,d>::BatchEvaluateTerm
+( std::size_t j,
+  const std::vector<R>& x,
+  const std::vector<R>& p,
+        std::vector<R>& results ) const
+{
+    const std::size_t nxPoints = x.size();
+    const std::size_t npPoints = p.size();
+    results.resize( nxPoints*npPoints );
+    R* RESTRICT resultsBuffer = &results[0];
+    for( std::size_t i=0; i<nxPoints; ++i )
+    {
+        const R alpha = -TwoPi*x[i];
+        for( std::size_t k=0; k<npPoints; ++k )
+            resultsBuffer[i*npPoints+k] = alpha*p[k];
+    }
+}
+
+template<typename R,std::size_t d>
+void
+lagrangian_nuft::AdjointFTPhase<R,d>::BatchEvaluateTerm
+( std::size_t j,
+  const std::vector<R>& x,
+  const std::vector<R>& p,
+        std::vector<R>& results ) const
+{
+    const std::size_t nxPoints = x.size();
+    const std::size_t npPoints = p.size();
+    results.resize( nxPoints*npPoints );
+    R* RESTRICT resultsBuffer = &results[0];
+    for( std::size_t i=0; i<nxPoints; ++i )
+    {
+        const R alpha = TwoPi*x[i];
+        for( std::size_t k=0; k<npPoints; ++k )
+            resultsBuffer[i*npPoints+k] = alpha*p[k];
+    }
+}
+
 } // bfio
 
 #endif // BFIO_LAGRANGIAN_NUFT_FT_PHASES_HPP
@@ -27,6 +27,8 @@ namespace lagrangian_nuft {
 template<typename R,std::size_t d,std::size_t q>
 class PotentialField
 {
+    typedef typename PhaseReal<R>::Type P;
+
     const lagrangian_nuft::Context<R,d,q>& _nuftContext;
     const rfio::PotentialField<R,d,q> _rfioPotential;
 
@@ -42,8 +44,8 @@ public:
     // This is the point of the potential field
     std::complex<R> Evaluate( const Array<R,d>& x ) const;
 
-    const Amplitude<R,d>& GetAmplitude() const;
-    const Phase<R,d>& GetPhase() const;
+    const Amplitude<P,d>& GetAmplitude() const;
+    const Phase<P,d>& GetPhase() const;
     const Box<R,d>& GetMyTargetBox() const;
     std::size_t GetNumSubboxes() const;
     const Array<R,d>& GetSubboxWidths() const;
@@ -91,10 +93,10 @@ lagrangian_nuft::PotentialField<R,d,q>::PotentialField
 : _nuftContext(nuftContext), 
   _rfioPotential
   ( nuftContext.GetReducedFIOContext(),
-    UnitAmplitude<R,d>(),
+    UnitAmplitude<P,d>(),
     ( nuftContext.GetDirection()==FORWARD ? 
-      (const FTPhase<R,d>&)lagrangian_nuft::ForwardFTPhase<R,d>() : 
-      (const FTPhase<R,d>&)lagrangian_nuft::AdjointFTPhase<R,d>() ),
+      (const FTPhase<P,d>&)lagrangian_nuft::ForwardFTPhase<P,d>() : 
+      (const FTPhase<P,d>&)lagrangian_nuft::AdjointFTPhase<P,d>() ),
     sourceBox,
     targetBox,
     myTargetBoxCoords,
@@ -108,12 +110,12 @@ lagrangian_nuft::PotentialField<R,d,q>::Evaluate( const Array<R,d>& x ) const
 { return _rfioPotential.Evaluate( x ); }
 
 template<typename R,std::size_t d,std::size_t q>
-inline const Amplitude<R,d>&
+inline const Amplitude<typename PhaseReal<R>::Type,d>&
 lagrangian_nuft::PotentialField<R,d,q>::GetAmplitude() const
 { return _rfioPotential.GetAmplitude(); }
 
 template<typename R,std::size_t d,std::size_t q>
-inline const Phase<R,d>&
+inline const Phase<typename PhaseReal<R>::Type,d>&
 lagrangian_nuft::PotentialField<R,d,q>::GetPhase() const
 { return _rfioPotential.GetPhase(); }
 
@@ -29,6 +29,8 @@
 #include "bfio/structures/weight_grid.hpp"
 #include "bfio/structures/weight_grid_list.hpp"
 
+#include "bfio/tools/reverse_constrained_htree_index.hpp"
+
 #include "bfio/lagrangian_nuft/context.hpp"
 
 namespace bfio {
@@ -92,6 +94,12 @@ SwitchToTargetInterp
     std::vector<R> realTempWeights( q );
     std::vector<R> imagTempWeights( q );
 
+    // Only the interactions in our team member's share are switched, and 
+    // the caller gathers the shares
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare
+    ( 1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes), shareBegin, shareEnd );
+
     const std::vector<R>& chebyshevNodes = rfioContext.GetChebyshevNodes();
     ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
     for( std::size_t i=0; i<(1u<<log2LocalTargetBoxes); ++i, AWalker.Walk() )
@@ -133,7 +141,11 @@ SwitchToTargetInterp
                   imagFixedSourceEvals[k][0], realFixedSourceEvals[k][0] );
             }
 
-            const std::size_t key = k+(i<<log2LocalSourceBoxes);
+            const std::size_t key = 
+                ReverseConstrainedHTreeIndex<d>( k, log2LocalSourceBoxes ) + 
+                (i<<log2LocalSourceBoxes);
+            if( key < shareBegin || key >= shareEnd )
+                continue;
             std::memcpy
             ( &realOldWeights, weightGridList[key].RealBuffer(), q*sizeof(R) );
             std::memcpy
@@ -277,6 +289,12 @@ SwitchToTargetInterp
     std::vector<R> realTempWeights( q_to_d );
     std::vector<R> imagTempWeights( q_to_d );
 
+    // Only the interactions in our team member's share are switched, and 
+    // the caller gathers the shares
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare
+    ( 1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes), shareBegin, shareEnd );
+
     const std::vector<R>& chebyshevNodes = rfioContext.GetChebyshevNodes();
     ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
     for( std::size_t i=0; i<(1u<<log2LocalTargetBoxes); ++i, AWalker.Walk() )
@@ -327,7 +345,11 @@ SwitchToTargetInterp
                 }
             }
 
-            const std::size_t key = k+(i<<log2LocalSourceBoxes);
+            const std::size_t key = 
+                ReverseConstrainedHTreeIndex<d>( k, log2LocalSourceBoxes ) + 
+                (i<<log2LocalSourceBoxes);
+            if( key < shareBegin || key >= shareEnd )
+                continue;
             std::memcpy
             ( &realOldWeights[0], weightGridList[key].RealBuffer(), 
               q_to_d*sizeof(R) );
@@ -538,6 +560,12 @@ SwitchToTargetInterp
     std::vector<R> realTempWeights( q_to_d );
     std::vector<R> imagTempWeights( q_to_d );
 
+    // Only the interactions in our team member's share are switched, and 
+    // the caller gathers the shares
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare
+    ( 1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes), shareBegin, shareEnd );
+
     const std::vector<R>& chebyshevNodes = rfioContext.GetChebyshevNodes();
     ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
     for( std::size_t i=0; i<(1u<<log2LocalTargetBoxes); ++i, AWalker.Walk() )
@@ -587,7 +615,11 @@ SwitchToTargetInterp
                 }
             }
 
-            const std::size_t key = k+(i<<log2LocalSourceBoxes);
+            const std::size_t key = 
+                ReverseConstrainedHTreeIndex<d>( k, log2LocalSourceBoxes ) + 
+                (i<<log2LocalSourceBoxes);
+            if( key < shareBegin || key >= shareEnd )
+                continue;
             std::memcpy
             ( &realOldWeights[0], weightGridList[key].RealBuffer(), 
               q_to_d*sizeof(R) );
@@ -18,6 +18,7 @@
 #ifndef BFIO_RFIO_HPP
 #define BFIO_RFIO_HPP 1
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -76,26 +77,42 @@ PrintTimings()
 #endif
 
 #include "bfio/rfio/context.hpp"
+#include "bfio/rfio/phase_factor_store.hpp"
 #include "bfio/rfio/potential_field.hpp"
 
 #include "bfio/rfio/initialize_weights.hpp"
 #include "bfio/rfio/source_weight_recursion.hpp"
 #include "bfio/rfio/switch_to_target_interp.hpp"
 #include "bfio/rfio/target_weight_recursion.hpp"
+#include "bfio/rfio/workspace.hpp"
 
 namespace bfio {
 namespace rfio {
 
-template<typename R,std::size_t d,std::size_t q>
-std::auto_ptr< const rfio::PotentialField<R,d,q> >
+// Applies the transforms with each of the K amplitudes and phases to numRHS 
+// sets of sources at once. mySources holds numRHS consecutive sets of the 
+// same length, which must share their positions and differ only in their 
+// magnitudes, and the potential field of phase k and set r is returned in 
+// potentialFields[k*numRHS+r]. The sources are binned, the tree is walked, 
+// and the weights are communicated once for all of them: the phase factors
+// of each stage are formed once per phase and shared by all of the 
+// right-hand sides, the Chebyshev interpolation is applied to every weight 
+// grid at once, and each level performs a single sum-scatter. The caller is
+// responsible for deleting the potential fields.
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+void
 transform
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Amplitude<R,d>& amplitude,
-  const Phase<R,d>& phase,
+  const std::vector<const AmplitudeT*>& amplitudes,
+  const std::vector<const PhaseT*>& phases,
   const Box<R,d>& sourceBox,
   const Box<R,d>& targetBox,
-  const std::vector< Source<R,d> >& mySources )
+  const std::vector< Source<R,d> >& mySources,
+  std::size_t numRHS,
+  std::vector< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>* >& 
+  potentialFields,
+        rfio::PhaseFactorStore<R>* store=0 )
 {
 #ifdef TIMING
     rfio::ResetTimers();
@@ -103,6 +120,14 @@ transform
 #endif
     typedef std::complex<R> C;
     const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numPhases = phases.size();
+    const std::size_t numGrids = numPhases*numRHS;
+#ifndef RELEASE
+    if( !plan.IsGenerated() )
+        throw std::logic_error("The plan must be generated before use");
+    if( amplitudes.size() != numPhases )
+        throw std::logic_error("There must be one amplitude per phase");
+#endif
 
     // Extract our communicator and its size
     MPI_Comm comm = plan.GetComm();
@@ -136,50 +161,85 @@ transform
     const std::size_t bootstrapSkip = plan.GetBootstrapSkip();
 
     // Compute the number of source and target boxes that our process is 
-    // responsible for initializing weights in
-    std::size_t log2WeightGridSize = 0;
+    // responsible for initializing weights in. If we do not own enough 
+    // source boxes to bootstrap on our own, then we merge our source box 
+    // with those of our bootstrap cluster and cut the target domain between
+    // its members.
     std::size_t log2LocalSourceBoxes = 0;
     std::size_t log2LocalTargetBoxes = 0;
     Array<std::size_t,d> log2LocalSourceBoxesPerDim;
-    Array<std::size_t,d> log2LocalTargetBoxesPerDim(0);
+    Array<std::size_t,d> log2LocalTargetBoxesPerDim;
     for( std::size_t j=0; j<d; ++j )
     {
-        if( log2N-log2SourceBoxesPerDim[j] >= bootstrapSkip )
-            log2LocalSourceBoxesPerDim[j] = 
-                (log2N-log2SourceBoxesPerDim[j]) - bootstrapSkip;
-        else
-            log2LocalSourceBoxesPerDim[j] = 0;
+        log2LocalSourceBoxesPerDim[j] = log2N-log2SourceBoxesPerDim[j];
         log2LocalTargetBoxesPerDim[j] = bootstrapSkip;
+    }
+    const std::vector<std::size_t>& bootstrapSourceDimsToMerge = 
+        plan.GetBootstrapSourceDimsToMerge();
+    for( std::size_t i=0; i<bootstrapSourceDimsToMerge.size(); ++i )
+    {
+        const std::size_t j = bootstrapSourceDimsToMerge[i];
+        if( mySourceBoxCoords[j] & 1 )
+            mySourceBox.offsets[j] -= mySourceBox.widths[j];
+        mySourceBoxCoords[j] >>= 1;
+        mySourceBox.widths[j] *= 2;
+        ++log2LocalSourceBoxesPerDim[j];
+    }
+    const std::vector<std::size_t>& bootstrapTargetDimsToCut = 
+        plan.GetBootstrapTargetDimsToCut();
+    const std::vector<bool>& bootstrapRightSideOfCut = 
+        plan.GetBootstrapRightSideOfCut();
+    for( std::size_t i=0; i<bootstrapTargetDimsToCut.size(); ++i )
+    {
+        const std::size_t j = bootstrapTargetDimsToCut[i];
+        myTargetBox.widths[j] *= 0.5;
+        myTargetBoxCoords[j] *= 2;
+        if( bootstrapRightSideOfCut[i] )
+        {
+            myTargetBoxCoords[j] |= 1;
+            myTargetBox.offsets[j] += myTargetBox.widths[j];
+        }
+        --log2LocalTargetBoxesPerDim[j];
+    }
+    for( std::size_t j=0; j<d; ++j )
+    {
+        log2LocalSourceBoxesPerDim[j] -= bootstrapSkip;
         log2LocalSourceBoxes += log2LocalSourceBoxesPerDim[j];
         log2LocalTargetBoxes += log2LocalTargetBoxesPerDim[j];
-        log2WeightGridSize += log2N-log2SourceBoxesPerDim[j];
     }
 
     // Initialize the weights using Lagrangian interpolation on the 
-    // smooth component of the kernel.
-    WeightGridList<R,d,q> weightGridList( 1u<<log2WeightGridSize );
+    // smooth component of the kernel. The interaction of target box A with
+    // source box B is stored at index 
+    //
+    //   ReverseConstrainedHTreeIndex(B) + (A << log2LocalSourceBoxes),
+    //
+    // so that each level of the recursion may be performed in place. Each
+    // interaction owns the numPhases*numRHS consecutive weight grids of 
+    // every phase and right-hand side, ordered phase-major.
+    WeightGridList<R,d,q> weightGridList
+    ( (1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes))*numGrids );
 #ifdef TIMING
     rfio::initializeWeightsTimer.Start();
 #endif
     rfio::InitializeWeights
-    ( context, plan, phase, sourceBox, targetBox, mySourceBox, 
-      log2LocalSourceBoxes, log2LocalSourceBoxesPerDim, mySources, 
-      weightGridList );
+    ( context, plan, phases, sourceBox, targetBox, mySourceBox, myTargetBox,
+      log2LocalSourceBoxes, log2LocalTargetBoxes,
+      log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim, 
+      mySources, weightGridList, numRHS, store );
+    plan.GatherTeamShares
+    ( weightGridList.Buffer(), weightGridList.Length()/numGrids, 
+      2*q_to_d*numGrids );
 #ifdef TIMING
     rfio::initializeWeightsTimer.Stop();
 #endif
 
-    // Now cut the target domain if necessary
-    for( std::size_t j=0; j<d; ++j )
-    {
-        if( log2LocalSourceBoxesPerDim[j] == 0 )
-        {
-            log2LocalTargetBoxesPerDim[j] -= 
-                bootstrapSkip - (log2N-log2SourceBoxesPerDim[j]);
-            log2LocalTargetBoxes -=
-                bootstrapSkip - (log2N-log2SourceBoxesPerDim[j]);
-        }
-    }
+    // Allocate the scratch space for the recursions once, one per thread
+    std::vector< rfio::Workspace<R,d,q> > workspaces
+    ( MaxThreads(), rfio::Workspace<R,d,q>( numRHS, numPhases ) );
+    const bool recordFactors = ( store != 0 && store->Recording() );
+    for( std::size_t t=0; t<workspaces.size(); ++t )
+        workspaces[t].recordFactors = recordFactors;
 
     // Start the main recursion loop
     if( bootstrapSkip == log2N/2 )
@@ -188,10 +248,13 @@ transform
 	rfio::switchToTargetInterpTimer.Start();
 #endif
         rfio::SwitchToTargetInterp
-        ( context, plan, amplitude, phase, sourceBox, targetBox, mySourceBox, 
-          myTargetBox, log2LocalSourceBoxes, log2LocalTargetBoxes,
+        ( context, plan, amplitudes, phases, sourceBox, targetBox, 
+          mySourceBox, myTargetBox, log2LocalSourceBoxes, log2LocalTargetBoxes,
           log2LocalSourceBoxesPerDim, log2LocalTargetBoxesPerDim,
-          weightGridList );
+          weightGridList, numRHS, store );
+        plan.GatherTeamShares
+        ( weightGridList.Buffer(), weightGridList.Length()/numGrids, 
+          2*q_to_d*numGrids );
 #ifdef TIMING
 	rfio::switchToTargetInterpTimer.Stop();
 #endif
@@ -207,6 +270,12 @@ transform
             wB[j] = sourceBox.widths[j] / (1<<(log2N-level));
         }
 
+        // The phase factors of each call of the recursions at this level
+        // (one per new interaction, or per target box if we must merge)
+        // occupy consecutive blocks of the level's stored segment, if any
+        const std::size_t numCallFactors = 
+            numPhases*rfio::NumRecursionFactors<q>( plan, level );
+
         if( log2LocalSourceBoxes >= d )
         {
             // Refine target domain and coursen the source domain
@@ -218,55 +287,93 @@ transform
             log2LocalSourceBoxes -= d;
             log2LocalTargetBoxes += d;
 
-            // Loop over boxes in target domain. 
-            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-            WeightGridList<R,d,q> oldWeightGridList( weightGridList );
-            for( std::size_t targetIndex=0; 
-                 targetIndex<(1u<<log2LocalTargetBoxes); 
-                 ++targetIndex, AWalker.Walk() )
+            // Loop over the groups of interactions between a parent target 
+            // box and the children of a source box. Since the source indices
+            // are stored digit-reversed, the 2^d children of the source box
+            // occupy exactly the slots that the interactions of the 2^d 
+            // children of the target box with the source box will, and so 
+            // each group can be updated in place once its new weights have 
+            // all been formed. Each thread is handed a contiguous range of 
+            // groups and writes only to their interactions.
+            //
+            // Only the new interactions in our team member's share are 
+            // formed, and the shares are then gathered.
+            const std::size_t numLocalSourceBoxes = 1u<<log2LocalSourceBoxes;
+            const std::size_t numGroups = 
+                1u<<(log2LocalSourceBoxes+log2LocalTargetBoxes-d);
+            const std::size_t numInteractions = numGroups<<d;
+            std::size_t shareBegin, shareEnd;
+            plan.TeamShare( numInteractions, shareBegin, shareEnd );
+            std::size_t numStoredCalls = 0;
+            R* levelFactors = 
+                ( store != 0 ? 
+                  store->NextSegment
+                  ( shareEnd-shareBegin, numCallFactors, numStoredCalls ) 
+                  : 0 );
+#ifdef TIMING
+            if( level <= log2N/2 )
+                rfio::sourceWeightRecursionTimer.Start();
+            else
+                rfio::targetWeightRecursionTimer.Start();
+#endif
+#ifdef HYBRID
+#pragma omp parallel for schedule(static)
+#endif
+            for( std::size_t group=0; group<numGroups; ++group )
             {
-                const Array<std::size_t,d> A = AWalker.State();
-
-                // Compute coordinates and center of this target box
-                Array<R,d> x0A;
+                rfio::Workspace<R,d,q>& workspace = workspaces[ThreadNum()];
+                WeightGridList<R,d,q>& groupWeightGridList = 
+                    workspace.groupWeightGridList;
+
+                const std::size_t parentTargetIndex = 
+                    group >> log2LocalSourceBoxes;
+                const std::size_t reversedSourceIndex = 
+                    group & (numLocalSourceBoxes-1);
+                const std::size_t sourceIndex = 
+                    UnreverseConstrainedHTreeIndex<d>
+                    ( reversedSourceIndex, log2LocalSourceBoxes );
+                const Array<std::size_t,d> B = 
+                    UnflattenConstrainedHTreeIndex
+                    ( sourceIndex, log2LocalSourceBoxesPerDim );
+
+                // Compute coordinates and center of this source box
+                Array<R,d> p0B;
                 for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+                    p0B[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
 
-                // Loop over the B boxes in source domain
-                ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
-                for( std::size_t sourceIndex=0; 
-                     sourceIndex<(1u<<log2LocalSourceBoxes); 
-                     ++sourceIndex, BWalker.Walk() )
-                {
-                    const Array<std::size_t,d> B = BWalker.State();
+                // The interactions of the group (both old and new) are 
+                // numLocalSourceBoxes apart
+                const std::size_t groupOffset = 
+                    (parentTargetIndex<<(log2LocalSourceBoxes+d)) + 
+                    reversedSourceIndex;
 
-                    // Compute coordinates and center of this source box
-                    Array<R,d> p0B;
+                // Loop over the children of the parent target box
+                for( std::size_t a=0; a<(1u<<d); ++a )
+                {
+                    const std::size_t interaction = 
+                        groupOffset + a*numLocalSourceBoxes;
+                    if( interaction < shareBegin || interaction >= shareEnd )
+                        continue;
+                    const std::size_t targetIndex = (parentTargetIndex<<d) + a;
+                    workspace.storedFactors = 
+                        ( interaction-shareBegin < numStoredCalls ? 
+                          levelFactors + 
+                          (interaction-shareBegin)*numCallFactors : 0 );
+                    const Array<std::size_t,d> A = 
+                        UnflattenConstrainedHTreeIndex
+                        ( targetIndex, log2LocalTargetBoxesPerDim );
+
+                    // Compute coordinates and center of this target box
+                    Array<R,d> x0A;
                     for( std::size_t j=0; j<d; ++j )
-                        p0B[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
-
-                    // We are storing the interaction pairs source-major
-                    const std::size_t interactionIndex = 
-                        sourceIndex + (targetIndex<<log2LocalSourceBoxes);
-
-                    // Grab the interaction offset for the parent of target box 
-                    // i interacting with the children of source box k
-                    const std::size_t parentInteractionOffset = 
-                        ((targetIndex>>d)<<(log2LocalSourceBoxes+d)) + 
-                        (sourceIndex<<d);
+                        x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
 
                     if( level <= log2N/2 )
                     {
-#ifdef TIMING
-			rfio::sourceWeightRecursionTimer.Start();
-#endif
                         rfio::SourceWeightRecursion
-                        ( context, plan, phase, level, x0A, p0B, wB, 
-                          parentInteractionOffset, oldWeightGridList,
-                          weightGridList[interactionIndex] );
-#ifdef TIMING
-			rfio::sourceWeightRecursionTimer.Stop();
-#endif
+                        ( context, plan, phases, level, x0A, p0B, wB, 
+                          groupOffset, numLocalSourceBoxes, weightGridList,
+                          groupWeightGridList[a*numGrids], workspace );
                     }
                     else
                     {
@@ -282,25 +389,39 @@ transform
                                       (globalA[j]|1)*wA[j];
                             ARelativeToAp |= (globalA[j]&1)<<j;
                         }
-#ifdef TIMING
-			rfio::targetWeightRecursionTimer.Start();
-#endif
                         rfio::TargetWeightRecursion
-                        ( context, plan, phase, level,
+                        ( context, plan, phases, level,
                           ARelativeToAp, x0A, x0Ap, p0B, wA, wB,
-                          parentInteractionOffset, oldWeightGridList, 
-                          weightGridList[interactionIndex] );
-#ifdef TIMING
-			rfio::targetWeightRecursionTimer.Stop();
-#endif
+                          groupOffset, numLocalSourceBoxes, weightGridList, 
+                          groupWeightGridList[a*numGrids], workspace );
                     }
                 }
+
+                // Overwrite the old weights of the group with the new ones
+                for( std::size_t a=0; a<(1u<<d); ++a )
+                {
+                    const std::size_t interaction = 
+                        groupOffset + a*numLocalSourceBoxes;
+                    if( interaction < shareBegin || interaction >= shareEnd )
+                        continue;
+                    std::memcpy
+                    ( weightGridList[interaction*numGrids].Buffer(),
+                      groupWeightGridList[a*numGrids].Buffer(), 
+                      2*q_to_d*numGrids*sizeof(R) );
+                }
             }
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), numInteractions, 2*q_to_d*numGrids );
+#ifdef TIMING
+            if( level <= log2N/2 )
+                rfio::sourceWeightRecursionTimer.Stop();
+            else
+                rfio::targetWeightRecursionTimer.Stop();
+#endif
         }
         else 
         {
             const std::size_t log2NumMergingProcesses = d-log2LocalSourceBoxes;
-            const std::size_t numMergingProcesses = 1u<<log2NumMergingProcesses;
 
             log2LocalSourceBoxes = 0; 
             for( std::size_t j=0; j<d; ++j )
@@ -330,125 +451,103 @@ transform
                 p0B[j] = mySourceBox.offsets[j] + 0.5*wB[j];
 
             // Form the partial weights by looping over the boxes in the  
-            // target domain.
-            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-            WeightGridList<R,d,q> partialWeightGridList
-            ( 1<<log2LocalTargetBoxes );
-            for( std::size_t targetIndex=0; 
-                 targetIndex<(1u<<log2LocalTargetBoxes); 
-                 ++targetIndex, AWalker.Walk() )
+            // target domain. The boxes are visited in chunks, and the 
+            // summation of each chunk's weights is started as soon as they 
+            // are formed so that it may overlap with forming the next.
+            SumScatterPipeline<R,d,q> pipeline
+            ( plan, level, log2NumMergingProcesses, log2LocalTargetBoxes,
+              numGrids );
+            std::size_t numStoredCalls = 0;
+            R* levelFactors = 
+                ( store != 0 ? 
+                  store->NextSegment
+                  ( pipeline.NumChunks()*pipeline.ChunkSize(), numCallFactors,
+                    numStoredCalls ) : 0 );
+            for( std::size_t chunk=0; chunk<pipeline.NumChunks(); ++chunk )
             {
-                const Array<std::size_t,d> A = AWalker.State();
-
-                // Compute coordinates and center of this target box
-                Array<R,d> x0A;
-                for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
-
-                // Compute the interaction offset of A's parent interacting 
-                // with the remaining local source boxes
-                const std::size_t parentInteractionOffset = 
-                    ((targetIndex>>d)<<(d-log2NumMergingProcesses));
-                if( level <= log2N/2 )
-                {
 #ifdef TIMING
-		    rfio::sourceWeightRecursionTimer.Start();
+                if( level <= log2N/2 )
+                    rfio::sourceWeightRecursionTimer.Start();
+                else
+                    rfio::targetWeightRecursionTimer.Start();
 #endif
-                    rfio::SourceWeightRecursion
-                    ( context, plan, phase, level, x0A, p0B, wB,
-                      parentInteractionOffset, weightGridList,
-                      partialWeightGridList[targetIndex] );
-#ifdef TIMING
-		    rfio::sourceWeightRecursionTimer.Stop();
+#ifdef HYBRID
+#pragma omp parallel for schedule(static)
 #endif
-                }
-                else
+                for( std::size_t i=0; i<pipeline.ChunkSize(); ++i )
                 {
-                    Array<R,d> x0Ap;
-                    Array<std::size_t,d> globalA;
-                    std::size_t ARelativeToAp = 0;
+                    const std::size_t targetIndex = 
+                        pipeline.TargetIndex( chunk, i );
+                    const Array<std::size_t,d> A = 
+                        UnflattenConstrainedHTreeIndex
+                        ( targetIndex, log2LocalTargetBoxesPerDim );
+
+                    // Compute coordinates and center of this target box
+                    Array<R,d> x0A;
                     for( std::size_t j=0; j<d; ++j )
+                        x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+
+                    // Compute the interaction offset of A's parent 
+                    // interacting with the remaining local source boxes. 
+                    // There are fewer than 2^d of them, so their indices 
+                    // are not reversed.
+                    const std::size_t parentInteractionOffset = 
+                        ((targetIndex>>d)<<(d-log2NumMergingProcesses));
+                    rfio::Workspace<R,d,q>& workspace = 
+                        workspaces[ThreadNum()];
+                    const std::size_t call = chunk*pipeline.ChunkSize() + i;
+                    workspace.storedFactors = 
+                        ( call < numStoredCalls ? 
+                          levelFactors + call*numCallFactors : 0 );
+                    if( level <= log2N/2 )
                     {
-                        globalA[j] = 
-                            (myTargetBoxCoords[j]<<
-                             log2LocalTargetBoxesPerDim[j])+A[j];
-                        x0Ap[j] = targetBox.offsets[j] + (globalA[j]|1)*wA[j];
-                        ARelativeToAp |= (globalA[j]&1)<<j;
+                        rfio::SourceWeightRecursion
+                        ( context, plan, phases, level, x0A, p0B, wB,
+                          parentInteractionOffset, 1, weightGridList,
+                          pipeline.PartialWeights( chunk, i ), workspace );
+                    }
+                    else
+                    {
+                        Array<R,d> x0Ap;
+                        Array<std::size_t,d> globalA;
+                        std::size_t ARelativeToAp = 0;
+                        for( std::size_t j=0; j<d; ++j )
+                        {
+                            globalA[j] = 
+                                (myTargetBoxCoords[j]<<
+                                 log2LocalTargetBoxesPerDim[j])+A[j];
+                            x0Ap[j] = 
+                                targetBox.offsets[j] + (globalA[j]|1)*wA[j];
+                            ARelativeToAp |= (globalA[j]&1)<<j;
+                        }
+                        rfio::TargetWeightRecursion
+                        ( context, plan, phases, level,
+                          ARelativeToAp, x0A, x0Ap, p0B, wA, wB,
+                          parentInteractionOffset, 1, weightGridList, 
+                          pipeline.PartialWeights( chunk, i ), workspace );
                     }
+                }
 #ifdef TIMING
-		    rfio::targetWeightRecursionTimer.Start();
+                if( level <= log2N/2 )
+                    rfio::sourceWeightRecursionTimer.Stop();
+                else
+                    rfio::targetWeightRecursionTimer.Stop();
+                rfio::sumScatterTimer.Start();
 #endif
-                    rfio::TargetWeightRecursion
-                    ( context, plan, phase, level,
-                      ARelativeToAp, x0A, x0Ap, p0B, wA, wB,
-                      parentInteractionOffset, weightGridList, 
-                      partialWeightGridList[targetIndex] );
+                pipeline.Scatter( chunk );
 #ifdef TIMING
-		    rfio::targetWeightRecursionTimer.Stop();
+                rfio::sumScatterTimer.Stop();
 #endif
-                }
             }
 
-            // Scatter the summation of the weights
+            // Wait for the summation of the weights
 #ifdef TIMING
             rfio::sumScatterTimer.Start();
 #endif
-            std::vector<int> recvCounts( numMergingProcesses );
-            for( std::size_t j=0; j<numMergingProcesses; ++j )
-                recvCounts[j] = 2*weightGridList.Length()*q_to_d;
-            // Currently two types of planned communication are supported, as 
-            // they are the only required types for transforming and inverting 
-            // the transform:
-            //  1) partitions of dimensions 0 -> c
-            //  2) partitions of dimensions c -> d-1
-            // Both 1 and 2 include partitioning 0 -> d-1, but, in general, 
-            // the second category never requires packing.
-            const std::size_t log2SubclusterSize = 
-                plan.GetLog2SubclusterSize( level );
-            if( log2SubclusterSize == 0 )
-            {
-                MPI_Comm clusterComm = plan.GetClusterComm( level );
-                SumScatter    
-                ( partialWeightGridList.Buffer(), weightGridList.Buffer(),
-                  &recvCounts[0], clusterComm );
-            }
-            else
-            {
-                const std::size_t log2NumSubclusters = 
-                    log2NumMergingProcesses-log2SubclusterSize;
-                const std::size_t numSubclusters = 1u<<log2NumSubclusters;
-                const std::size_t subclusterSize = 1u<<log2SubclusterSize;
-
-                const std::size_t recvSize = recvCounts[0];
-                const std::size_t sendSize = recvSize*numMergingProcesses;
-                const std::size_t numChunksPerProcess = subclusterSize;
-                const std::size_t chunkSize = recvSize / numChunksPerProcess;
-                const R* partialBuffer = partialWeightGridList.Buffer();
-                std::vector<R> sendBuffer( sendSize );
-                for( std::size_t sc=0; sc<numSubclusters; ++sc )
-                {
-                    R* subclusterSendBuffer = 
-                        &sendBuffer[sc*subclusterSize*recvSize];
-                    const R* subclusterPartialBuffer = 
-                        &partialBuffer[sc*subclusterSize*recvSize];
-                    for( std::size_t p=0; p<subclusterSize; ++p )
-                    {
-                        R* processSend = &subclusterSendBuffer[p*recvSize];
-                        for( std::size_t c=0; c<numChunksPerProcess; ++c )
-                        {
-                            std::memcpy 
-                            ( &processSend[c*chunkSize],
-                              &subclusterPartialBuffer
-                              [(p+c*subclusterSize)*chunkSize],
-                              chunkSize*sizeof(R) );
-                        }
-                    }
-                }
-                MPI_Comm clusterComm = plan.GetClusterComm( level );
-                SumScatter
-                ( &sendBuffer[0], weightGridList.Buffer(), 
-                  &recvCounts[0], clusterComm );
-            }
+            pipeline.Finish( weightGridList );
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), weightGridList.Length()/numGrids, 
+              2*q_to_d*numGrids );
 #ifdef TIMING
             rfio::sumScatterTimer.Stop();
 #endif
@@ -477,29 +576,75 @@ transform
 	    rfio::switchToTargetInterpTimer.Start();
 #endif
             rfio::SwitchToTargetInterp
-            ( context, plan, amplitude, phase, sourceBox, targetBox, 
+            ( context, plan, amplitudes, phases, sourceBox, targetBox, 
               mySourceBox, myTargetBox, log2LocalSourceBoxes, 
               log2LocalTargetBoxes, log2LocalSourceBoxesPerDim, 
-              log2LocalTargetBoxesPerDim, weightGridList );
+              log2LocalTargetBoxesPerDim, weightGridList, numRHS, store );
+            plan.GatherTeamShares
+            ( weightGridList.Buffer(), weightGridList.Length()/numGrids, 
+              2*q_to_d*numGrids );
 #ifdef TIMING
 	    rfio::switchToTargetInterpTimer.Stop();
 #endif
         }
     }
 
-    // Construct the FIO PotentialField
-    std::auto_ptr< const rfio::PotentialField<R,d,q> > 
-    potentialField( 
-        new rfio::PotentialField<R,d,q>
-        ( context, amplitude, phase, sourceBox, myTargetBox, 
-          myTargetBoxCoords, log2LocalTargetBoxesPerDim, weightGridList )
-    );
+    // Construct the FIO PotentialFields
+    potentialFields.resize( numGrids );
+    for( std::size_t grid=0; grid<numGrids; ++grid )
+        potentialFields[grid] = 
+            new rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>
+            ( context, *amplitudes[grid/numRHS], *phases[grid/numRHS], 
+              sourceBox, myTargetBox, myTargetBoxCoords, 
+              log2LocalTargetBoxesPerDim, weightGridList, numGrids, grid );
 
 #ifdef TIMING
     rfio::timer.Stop();
     rfio::alreadyTimed = true;
 #endif
-    return potentialField;
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+void
+transform
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const AmplitudeT& amplitude,
+  const PhaseT& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources,
+  std::size_t numRHS,
+  std::vector< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>* >& 
+  potentialFields,
+        rfio::PhaseFactorStore<R>* store=0 )
+{
+    const std::vector<const AmplitudeT*> amplitudes( 1, &amplitude );
+    const std::vector<const PhaseT*> phases( 1, &phase );
+    transform
+    ( context, plan, amplitudes, phases, sourceBox, targetBox, mySources,
+      numRHS, potentialFields, store );
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT> >
+transform
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const AmplitudeT& amplitude,
+  const PhaseT& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources,
+        rfio::PhaseFactorStore<R>* store=0 )
+{
+    std::vector< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>* > 
+    potentialFields;
+    transform
+    ( context, plan, amplitude, phase, sourceBox, targetBox, mySources, 
+      1, potentialFields, store );
+    return std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT> >
+    ( potentialFields[0] );
 }
 
 } // rfio
@@ -509,8 +654,8 @@ std::auto_ptr< const rfio::PotentialField<R,d,q> >
 ReducedFIO
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Amplitude<R,d>& amplitude,
-  const Phase<R,d>& phase,
+  const Amplitude<typename PhaseReal<R>::Type,d>& amplitude,
+  const Phase<typename PhaseReal<R>::Type,d>& phase,
   const Box<R,d>& sourceBox,
   const Box<R,d>& targetBox,
   const std::vector< Source<R,d> >& mySources )
@@ -524,18 +669,271 @@ std::auto_ptr< const rfio::PotentialField<R,d,q> >
 ReducedFIO
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Phase<R,d>& phase,
+  const Phase<typename PhaseReal<R>::Type,d>& phase,
   const Box<R,d>& sourceBox,
   const Box<R,d>& targetBox,
   const std::vector< Source<R,d> >& mySources )
 {
-    UnitAmplitude<R,d> unitAmp;
+    typedef typename PhaseReal<R>::Type P;
+    UnitAmplitude<P,d> unitAmp;
     std::auto_ptr< const rfio::PotentialField<R,d,q> > u = 
     rfio::transform
-    ( context, plan, unitAmp, phase, sourceBox, targetBox, mySources );
+    ( context, plan, (const Amplitude<P,d>&)unitAmp, phase, 
+      sourceBox, targetBox, mySources );
+    return u;
+}
+
+// The following two overloads apply the transform to numRHS sets of sources
+// at once (see rfio::transform); the caller must delete the potential fields
+template<typename R,std::size_t d,std::size_t q>
+void
+ReducedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const Amplitude<typename PhaseReal<R>::Type,d>& amplitude,
+  const Phase<typename PhaseReal<R>::Type,d>& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources,
+  std::size_t numRHS,
+  std::vector< const rfio::PotentialField<R,d,q>* >& potentialFields )
+{
+    rfio::transform
+    ( context, plan, amplitude, phase, sourceBox, targetBox, mySources, 
+      numRHS, potentialFields );
+}
+
+template<typename R,std::size_t d,std::size_t q>
+void
+ReducedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const Phase<typename PhaseReal<R>::Type,d>& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources,
+  std::size_t numRHS,
+  std::vector< const rfio::PotentialField<R,d,q>* >& potentialFields )
+{
+    typedef typename PhaseReal<R>::Type P;
+    UnitAmplitude<P,d> unitAmp;
+    rfio::transform
+    ( context, plan, (const Amplitude<P,d>&)unitAmp, phase, 
+      sourceBox, targetBox, mySources, numRHS, potentialFields );
+}
+
+// The following two overloads apply the transform with each of a list of 
+// phases (and amplitudes) to the same sources at once, returning the 
+// potential field of the k'th phase in potentialFields[k] (see 
+// rfio::transform); the caller must delete the potential fields
+template<typename R,std::size_t d,std::size_t q>
+void
+ReducedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const std::vector<const Amplitude<typename PhaseReal<R>::Type,d>*>& 
+  amplitudes,
+  const std::vector<const Phase<typename PhaseReal<R>::Type,d>*>& phases,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources,
+  std::vector< const rfio::PotentialField<R,d,q>* >& potentialFields )
+{
+    rfio::transform
+    ( context, plan, amplitudes, phases, sourceBox, targetBox, mySources, 
+      1, potentialFields );
+}
+
+template<typename R,std::size_t d,std::size_t q>
+void
+ReducedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const std::vector<const Phase<typename PhaseReal<R>::Type,d>*>& phases,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources,
+  std::vector< const rfio::PotentialField<R,d,q>* >& potentialFields )
+{
+    typedef typename PhaseReal<R>::Type P;
+    UnitAmplitude<P,d> unitAmp;
+    const std::vector<const Amplitude<P,d>*> amplitudes
+    ( phases.size(), (const Amplitude<P,d>*)&unitAmp );
+    rfio::transform
+    ( context, plan, amplitudes, phases, sourceBox, targetBox, mySources, 
+      1, potentialFields );
+}
+
+// The following overloads take the concrete types of the phase and amplitude
+// functors as explicit template arguments, e.g., 
+//
+//   ReducedFIO<MyPhase,MyAmplitude>
+//   ( context, plan, amplitude, phase, sourceBox, targetBox, mySources );
+//
+// so that the transform calls their (possibly inlined) member functions
+// directly rather than through the virtual interfaces of Phase and Amplitude.
+// The functors must be of exactly the given types.
+template<class PhaseT,class AmplitudeT,typename R,std::size_t d,std::size_t q>
+std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT> >
+ReducedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const typename Identity<AmplitudeT>::Type& amplitude,
+  const typename Identity<PhaseT>::Type& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources )
+{
+    return rfio::transform
+    ( context, plan, amplitude, phase, sourceBox, targetBox, mySources );
+}
+
+template<class PhaseT,typename R,std::size_t d,std::size_t q>
+std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT> >
+ReducedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const typename Identity<PhaseT>::Type& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  const std::vector< Source<R,d> >& mySources )
+{
+    typedef typename PhaseReal<R>::Type P;
+    UnitAmplitude<P,d> unitAmp;
+    std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT> > u = 
+    rfio::transform
+    ( context, plan, (const Amplitude<P,d>&)unitAmp, phase, 
+      sourceBox, targetBox, mySources );
     return u;
 }
 
+// Applies the transform repeatedly for a fixed amplitude, phase, pair of 
+// boxes, plan, and set of source positions, e.g.,
+//
+//   PrecomputedFIO<float,d,q> A
+//   ( context, plan, phase, sourceBox, targetBox, memoryBudget );
+//   for( ... )
+//   {
+//       u = A.Apply( mySources );
+//       ...
+//   }
+//
+// The first application stores its phase factors, in order, until the
+// memory budget (in bytes) is exhausted, and later applications reuse them,
+// so that the stored stages reduce to complex multiply-adds and Gemms. Only 
+// the magnitudes of the sources may change between applications; their 
+// positions and order must not.
+template<typename R,std::size_t d,std::size_t q,
+         class PhaseT=Phase<typename PhaseReal<R>::Type,d>,
+         class AmplitudeT=Amplitude<typename PhaseReal<R>::Type,d> >
+class PrecomputedFIO
+{
+    typedef typename PhaseReal<R>::Type P;
+
+    UnitAmplitude<P,d> _unitAmplitude;
+    const rfio::Context<R,d,q>& _context;
+    const Plan<d>& _plan;
+    const AmplitudeT& _amplitude;
+    const PhaseT& _phase;
+    const Box<R,d> _sourceBox;
+    const Box<R,d> _targetBox;
+    rfio::PhaseFactorStore<R> _store;
+
+public:
+    PrecomputedFIO
+    ( const rfio::Context<R,d,q>& context,
+      const Plan<d>& plan,
+      const AmplitudeT& amplitude,
+      const PhaseT& phase,
+      const Box<R,d>& sourceBox,
+      const Box<R,d>& targetBox,
+      std::size_t memoryBudget );
+
+    // Only for the default (virtual) amplitude type
+    PrecomputedFIO
+    ( const rfio::Context<R,d,q>& context,
+      const Plan<d>& plan,
+      const PhaseT& phase,
+      const Box<R,d>& sourceBox,
+      const Box<R,d>& targetBox,
+      std::size_t memoryBudget );
+
+    std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT> >
+    Apply( const std::vector< Source<R,d> >& mySources );
+
+    // Applies the transform to numRHS sets of sources at once (see 
+    // rfio::transform); the caller must delete the potential fields
+    void Apply
+    ( const std::vector< Source<R,d> >& mySources, 
+      std::size_t numRHS,
+      std::vector< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>* >& 
+      potentialFields );
+
+    // The number of bytes of stored phase factors
+    std::size_t StoredSize() const;
+};
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline
+PrecomputedFIO<R,d,q,PhaseT,AmplitudeT>::PrecomputedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const AmplitudeT& amplitude,
+  const PhaseT& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  std::size_t memoryBudget )
+: _context(context), _plan(plan), _amplitude(amplitude), _phase(phase),
+  _sourceBox(sourceBox), _targetBox(targetBox), _store(memoryBudget)
+{ }
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline
+PrecomputedFIO<R,d,q,PhaseT,AmplitudeT>::PrecomputedFIO
+( const rfio::Context<R,d,q>& context,
+  const Plan<d>& plan,
+  const PhaseT& phase,
+  const Box<R,d>& sourceBox,
+  const Box<R,d>& targetBox,
+  std::size_t memoryBudget )
+: _context(context), _plan(plan), _amplitude(_unitAmplitude), _phase(phase),
+  _sourceBox(sourceBox), _targetBox(targetBox), _store(memoryBudget)
+{ }
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT> >
+PrecomputedFIO<R,d,q,PhaseT,AmplitudeT>::Apply
+( const std::vector< Source<R,d> >& mySources )
+{
+    _store.Begin();
+    std::auto_ptr< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT> > u =
+    rfio::transform
+    ( _context, _plan, _amplitude, _phase, _sourceBox, _targetBox, 
+      mySources, &_store );
+    _store.End();
+    return u;
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline void
+PrecomputedFIO<R,d,q,PhaseT,AmplitudeT>::Apply
+( const std::vector< Source<R,d> >& mySources, 
+  std::size_t numRHS,
+  std::vector< const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>* >& 
+  potentialFields )
+{
+    _store.Begin();
+    rfio::transform
+    ( _context, _plan, _amplitude, _phase, _sourceBox, _targetBox, 
+      mySources, numRHS, potentialFields, &_store );
+    _store.End();
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline std::size_t
+PrecomputedFIO<R,d,q,PhaseT,AmplitudeT>::StoredSize() const
+{ return _store.Size(); }
+
 } // bfio
 
 #endif // BFIO_RFIO_HPP
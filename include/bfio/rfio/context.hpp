@@ -30,6 +30,7 @@ template<typename R,std::size_t d,std::size_t q>
 class Context
 {
     std::vector<R> _chebyshevNodes;
+    std::vector<R> _barycentricWeights;
     std::vector<R> _leftChebyshevMap;
     std::vector<R> _rightChebyshevMap;
     std::vector< Array<std::size_t,d> > _chebyshevIndices;
@@ -37,6 +38,7 @@ class Context
     std::vector< Array<R,          d> > _sourceChildGrids;
 
     void GenerateChebyshevNodes();
+    void GenerateBarycentricWeights();
     void GenerateChebyshevIndices();
     void GenerateChebyshevGrid();
     void GenerateChebyshevMaps();
@@ -56,6 +58,17 @@ public:
       const std::vector< Array<R,d> >& p,
             std::vector< R          >& results ) const;
 
+    // Evaluate all q of the 1d Lagrangian basis functions at point p in 
+    // [-1/2,+1/2] using the barycentric formula
+    void Lagrange1dBatch( R p, R* results ) const;
+
+    // Evaluate all q^d Lagrangian basis functions at each of the points p as 
+    // tensor products of the 1d basis functions. The results for point i are
+    // stored contiguously, in results[i*q^d+t].
+    void LagrangeBatch
+    ( const std::vector< Array<R,d> >& p,
+            std::vector< R          >& results ) const;
+
     const std::vector<R>&
     GetChebyshevNodes() const;
 
@@ -86,6 +99,20 @@ rfio::Context<R,d,q>::GenerateChebyshevNodes()
         _chebyshevNodes[t] = 0.5*cos(static_cast<R>(t*Pi/(q-1)));
 }
 
+template<typename R,std::size_t d,std::size_t q>
+void 
+rfio::Context<R,d,q>::GenerateBarycentricWeights()
+{
+    for( std::size_t i=0; i<q; ++i )
+    {
+        R product = static_cast<R>(1);
+        for( std::size_t k=0; k<q; ++k )
+            if( i != k )
+                product *= _chebyshevNodes[i] - _chebyshevNodes[k];
+        _barycentricWeights[i] = static_cast<R>(1) / product;
+    }
+}
+
 template<typename R,std::size_t d,std::size_t q>
 void 
 rfio::Context<R,d,q>::GenerateChebyshevIndices()
@@ -162,6 +189,7 @@ rfio::Context<R,d,q>::GenerateChildGrids()
 template<typename R,std::size_t d,std::size_t q>
 rfio::Context<R,d,q>::Context() 
 : _chebyshevNodes( q ),
+  _barycentricWeights( q ),
   _leftChebyshevMap( q*q ),
   _rightChebyshevMap( q*q ),
   _chebyshevIndices( Pow<q,d>::val ), 
@@ -169,6 +197,7 @@ rfio::Context<R,d,q>::Context()
   _sourceChildGrids( Pow<q,d>::val<<d )
 {
     GenerateChebyshevNodes();
+    GenerateBarycentricWeights();
     GenerateChebyshevIndices();
     GenerateChebyshevGrid();
     GenerateChebyshevMaps();
@@ -254,6 +283,74 @@ rfio::Context<R,d,q>::LagrangeBatch
     }
 }
 
+template<typename R,std::size_t d,std::size_t q>
+void
+rfio::Context<R,d,q>::Lagrange1dBatch
+( R p, R* RESTRICT results ) const
+{
+    const R* RESTRICT chebyshevNodeBuffer = &_chebyshevNodes[0];
+    const R* RESTRICT barycentricWeightBuffer = &_barycentricWeights[0];
+
+    // The barycentric formula breaks down exactly at the nodes, where the 
+    // basis functions are simply Kronecker deltas
+    for( std::size_t i=0; i<q; ++i )
+    {
+        if( p == chebyshevNodeBuffer[i] )
+        {
+            for( std::size_t k=0; k<q; ++k )
+                results[k] = 0;
+            results[i] = 1;
+            return;
+        }
+    }
+
+    R sum = 0;
+    for( std::size_t i=0; i<q; ++i )
+    {
+        results[i] = barycentricWeightBuffer[i] / (p-chebyshevNodeBuffer[i]);
+        sum += results[i];
+    }
+    const R inverseSum = static_cast<R>(1) / sum;
+    for( std::size_t i=0; i<q; ++i )
+        results[i] *= inverseSum;
+}
+
+template<typename R,std::size_t d,std::size_t q>
+void
+rfio::Context<R,d,q>::LagrangeBatch
+( const std::vector< Array<R,d> >& p, 
+        std::vector< R          >& results ) const
+{
+    const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numPoints = p.size();
+    results.resize( numPoints*q_to_d );
+
+    Array<R,d*q> lagrange1d;
+    for( std::size_t r=0; r<numPoints; ++r )
+    {
+        for( std::size_t j=0; j<d; ++j )
+            Lagrange1dBatch( p[r][j], &lagrange1d[j*q] );
+
+        // Form the tensor product one dimension at a time, expanding the 
+        // q^j products of the first j dimensions into q^(j+1) products
+        R* RESTRICT resultsBuffer = &results[r*q_to_d];
+        for( std::size_t i=0; i<q; ++i )
+            resultsBuffer[i] = lagrange1d[i];
+        std::size_t q_to_j = q;
+        for( std::size_t j=1; j<d; ++j )
+        {
+            for( std::size_t i=q; i>0; --i )
+            {
+                const R value = lagrange1d[j*q+(i-1)];
+                R* block = &resultsBuffer[(i-1)*q_to_j];
+                for( std::size_t k=0; k<q_to_j; ++k )
+                    block[k] = value*resultsBuffer[k];
+            }
+            q_to_j *= q;
+        }
+    }
+}
+
 template<typename R,std::size_t d,std::size_t q>
 inline const std::vector<R>&
 rfio::Context<R,d,q>::GetChebyshevNodes() const
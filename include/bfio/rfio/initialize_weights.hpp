@@ -18,7 +18,11 @@
 #ifndef BFIO_RFIO_INITIALIZE_WEIGHTS_HPP
 #define BFIO_RFIO_INITIALIZE_WEIGHTS_HPP 1
 
+#include <algorithm>
+#include <complex>
 #include <cstddef>
+#include <cstring>
+#include <memory>
 #include <vector>
 
 #include "bfio/constants.hpp"
@@ -29,281 +33,500 @@
 #include "bfio/structures/plan.hpp"
 #include "bfio/structures/weight_grid_list.hpp"
 
+#include "bfio/tools/blas.hpp"
 #include "bfio/tools/flatten_constrained_htree_index.hpp"
 #include "bfio/tools/mpi.hpp"
+#include "bfio/tools/reverse_constrained_htree_index.hpp"
 #include "bfio/tools/special_functions.hpp"
+#include "bfio/tools/threads.hpp"
+#include "bfio/tools/wire_format.hpp"
+#include "bfio/tools/unflatten_constrained_htree_index.hpp"
 
 #include "bfio/functors/phase.hpp"
 
 #include "bfio/rfio/context.hpp"
+#include "bfio/rfio/phase_factor_store.hpp"
+#include "bfio/rfio/tensor_imag_exp_batch.hpp"
+#include "bfio/rfio/workspace.hpp"
 
 namespace bfio {
 namespace rfio {
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT>
 void
 InitializeWeights
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Phase<R,d>& phase,
+  const std::vector<const PhaseT*>& phases,
   const Box<R,d>& sourceBox,
   const Box<R,d>& targetBox,
   const Box<R,d>& mySourceBox,
+  const Box<R,d>& myTargetBox,
   const std::size_t log2LocalSourceBoxes,
+  const std::size_t log2LocalTargetBoxes,
   const Array<std::size_t,d>& log2LocalSourceBoxesPerDim,
+  const Array<std::size_t,d>& log2LocalTargetBoxesPerDim,
   const std::vector< Source<R,d> >& mySources,
-        WeightGridList<R,d,q>& weightGridList )
+        WeightGridList<R,d,q>& weightGridList,
+  const std::size_t numRHS=1,
+        PhaseFactorStore<R>* store=0 )
 {
+    typedef typename PhaseReal<R>::Type P;
     const std::size_t N = plan.GetN();
     const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numPhases = phases.size();
+    const std::size_t numGrids = numPhases*numRHS;
 
 #ifdef TIMING
     Timer computeTimer;
     Timer setToPotentialTimer;
-    Timer preprocessTimer;
-    Timer lagrangeTimer;
-    Timer axpyTimer;
+    Timer sumScatterTimer;
 #endif // TIMING
 
-    MPI_Comm comm = plan.GetComm();
-    int rank;
-    MPI_Comm_rank( comm, &rank );
-
     const std::size_t bootstrapSkip = plan.GetBootstrapSkip();
     MPI_Comm bootstrapComm = plan.GetBootstrapClusterComm();
     int numMergingProcesses;
     MPI_Comm_size( bootstrapComm, &numMergingProcesses );
 
-    if( numMergingProcesses == 1 )
+    // Compute the source box widths
+    Array<R,d> wB;
+    for( std::size_t j=0; j<d; ++j )
+        wB[j] = sourceBox.widths[j] / (N>>bootstrapSkip);
+
+    // Compute the target box widths
+    Array<R,d> wA;
+    for( std::size_t j=0; j<d; ++j )
+        wA[j] = targetBox.widths[j] / (1u<<bootstrapSkip);
+
+    // Compute the centers of the target boxes that our sources must be 
+    // interpolated onto. If our bootstrap cluster is nontrivial, then we 
+    // must form the partial weights for the target boxes of each process in
+    // the cluster (in the order of their cluster ranks) so that they may be 
+    // summed and scattered. Otherwise these are just our own target boxes.
+    const std::size_t numLocalTargetBoxes = 1u<<log2LocalTargetBoxes;
+    std::vector< Array<P,d> > x0As( numMergingProcesses*numLocalTargetBoxes );
     {
-        // Compute the source box widths
-        Array<R,d> wB;
-        for( std::size_t j=0; j<d; ++j )
-            wB[j] = sourceBox.widths[j] / (N>>bootstrapSkip);
+        const std::vector<std::size_t>& targetDimsToCut = 
+            plan.GetBootstrapTargetDimsToCut();
+        const std::vector<bool>& rightSideOfCut = 
+            plan.GetBootstrapRightSideOfCut();
+        const std::size_t numCuts = targetDimsToCut.size();
+
+        // Gather which side of each cut the processes in our cluster are on
+        std::vector<int> cutBits( numMergingProcesses, 0 );
+        if( numMergingProcesses > 1 )
+        {
+            int myCutBits = 0;
+            for( std::size_t i=0; i<numCuts; ++i )
+                if( rightSideOfCut[i] )
+                    myCutBits |= 1<<i;
+            MPI_Allgather
+            ( &myCutBits, 1, MPI_INT, &cutBits[0], 1, MPI_INT, 
+              bootstrapComm );
+        }
 
-        // Compute the target box widths
-        Array<R,d> wA;
-        for( std::size_t j=0; j<d; ++j )
-            wA[j] = targetBox.widths[j] / (1u<<bootstrapSkip);
+        for( int c=0; c<numMergingProcesses; ++c )
+        {
+            Array<std::size_t,d> targetBoxCoords(0);
+            for( std::size_t i=0; i<numCuts; ++i )
+            {
+                const std::size_t j = targetDimsToCut[i];
+                targetBoxCoords[j] = 
+                    (targetBoxCoords[j]<<1) | ((cutBits[c]>>i)&1);
+            }
 
-        // Compute the unscaled weights for each local box by looping over 
-        // our sources and sorting them into the appropriate local box one 
-        // at a time. We throw an error if a source is outside of our source
-        // box.
-        std::vector<R> phiResults;
-        std::vector<R> sinResults;
-        std::vector<R> cosResults;
-        const std::size_t numSources = mySources.size();
-        std::vector< Array<R,d> > pPoints( numSources );
-        std::vector< Array<R,d> > pRefPoints( numSources );
-        std::vector<std::size_t> flattenedSourceBoxIndices( numSources );
+            ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
+            for( std::size_t targetIndex=0; 
+                 targetIndex<numLocalTargetBoxes;
+                 ++targetIndex, AWalker.Walk() )
+            {
+                const Array<std::size_t,d> A = AWalker.State();
+                Array<P,d>& x0A = x0As[c*numLocalTargetBoxes+targetIndex];
+                for( std::size_t j=0; j<d; ++j )
+                    x0A[j] = targetBox.offsets[j] + 
+                             (((targetBoxCoords[j]<<
+                                log2LocalTargetBoxesPerDim[j])+A[j])+0.5)*wA[j];
+            }
+        }
+    }
+
+    // With multiple right-hand sides, mySources holds numRHS consecutive 
+    // sets of sources which differ only in their magnitudes
+    const std::size_t numSources = mySources.size()/numRHS;
+#ifndef RELEASE
+    if( numSources*numRHS != mySources.size() )
+        throw std::logic_error
+        ("The sources must be split evenly between the right-hand sides");
+    for( std::size_t rhs=1; rhs<numRHS; ++rhs )
         for( std::size_t s=0; s<numSources; ++s )
+            for( std::size_t j=0; j<d; ++j )
+                if( mySources[rhs*numSources+s].p[j] != mySources[s].p[j] )
+                    throw std::logic_error
+                    ("Each right-hand side must share the source positions");
+#endif
+
+    // Compute the unscaled weights for each local box by looping over 
+    // our sources and sorting them into the appropriate local box one 
+    // at a time. We throw an error if a source is outside of our source
+    // box.
+    const std::size_t numLocalSourceBoxes = 1u<<log2LocalSourceBoxes;
+    std::vector< Array<R,d> > pRefPoints( numSources );
+    std::vector<std::size_t> flattenedSourceBoxIndices( numSources );
+    std::vector<std::size_t> sourceBoxOffsets( numLocalSourceBoxes+1, 0 );
+    for( std::size_t s=0; s<numSources; ++s )
+    {
+        const Array<R,d>& p = mySources[s].p;
+
+        // Determine which local box we're in (if any)
+        Array<std::size_t,d> B;
+        for( std::size_t j=0; j<d; ++j )
         {
-            const Array<R,d>& p = mySources[s].p;
-            pPoints[s] = p;
+            R leftBound = mySourceBox.offsets[j];
+            R rightBound = leftBound + mySourceBox.widths[j];
+            if( p[j] < leftBound || p[j] >= rightBound )
+            {
+                std::ostringstream msg;
+                msg << "Source " << s << " was at " << p[j]
+                    << " in dimension " << j 
+                    << ", but our source box in this "
+                    << "dim. is [" << leftBound << "," << rightBound 
+                    << ").";
+                throw std::runtime_error( msg.str() );
+            }
 
-            // Determine which local box we're in (if any)
-            Array<std::size_t,d> B;
-            for( std::size_t j=0; j<d; ++j )
+            // We must be in the box, so bitwise determine the coord. index
+            B[j] = 0;
+            for( std::size_t k=log2LocalSourceBoxesPerDim[j];
+                 k>0; --k )
             {
-                R leftBound = mySourceBox.offsets[j];
-                R rightBound = leftBound + mySourceBox.widths[j];
-                if( p[j] < leftBound || p[j] >= rightBound )
+                const R middle = (rightBound+leftBound)/2.;
+                if( p[j] < middle )
                 {
-                    std::ostringstream msg;
-                    msg << "Source " << s << " was at " << p[j]
-                        << " in dimension " << j 
-                        << ", but our source box in this "
-                        << "dim. is [" << leftBound << "," << rightBound 
-                        << ").";
-                    throw std::runtime_error( msg.str() );
+                    // implicitly setting bit k-1 of B[j] to 0
+                    rightBound = middle;
                 }
-
-                // We must be in the box, so bitwise determine the coord. index
-                B[j] = 0;
-                for( std::size_t k=log2LocalSourceBoxesPerDim[j];
-                     k>0; --k )
+                else
                 {
-                    const R middle = (rightBound+leftBound)/2.;
-                    if( p[j] < middle )
-                    {
-                        // implicitly setting bit k-1 of B[j] to 0
-                        rightBound = middle;
-                    }
-                    else
-                    {
-                        B[j] |= (1<<(k-1));
-                        leftBound = middle;
-                    }
+                    B[j] |= (1<<(k-1));
+                    leftBound = middle;
                 }
             }
+        }
 
-            // Translate the local integer coordinates into the source center.
-            Array<R,d> p0;
-            for( std::size_t j=0; j<d; ++j )
-                p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
+        // Translate the local integer coordinates into the source center.
+        Array<R,d> p0;
+        for( std::size_t j=0; j<d; ++j )
+            p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
 
-            // In order to add this point's contribution to the unscaled weights
-            // of B we will evaluate the Lagrangian polynomial on the reference 
-            // grid, so we need to map p to it first.
-            for( std::size_t j=0; j<d; ++j )
-                pRefPoints[s][j] = (p[j]-p0[j])/wB[j];
-    
-            // Flatten the integer coordinates of B
-            flattenedSourceBoxIndices[s] = 
-                FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim );
-        }
+        // In order to add this point's contribution to the unscaled weights
+        // of B we will evaluate the Lagrangian polynomial on the reference 
+        // grid, so we need to map p to it first.
+        for( std::size_t j=0; j<d; ++j )
+            pRefPoints[s][j] = (p[j]-p0[j])/wB[j];
+
+        // Flatten the integer coordinates of B and reverse the result to 
+        // find where its interactions are stored
+        flattenedSourceBoxIndices[s] = 
+            ReverseConstrainedHTreeIndex<d>
+            ( FlattenConstrainedHTreeIndex( B, log2LocalSourceBoxesPerDim ),
+              log2LocalSourceBoxes );
+        ++sourceBoxOffsets[flattenedSourceBoxIndices[s]+1];
+    }
 
-        // Set all of the weights to zero
-        std::memset
-        ( weightGridList.Buffer(), 0, 
-          weightGridList.Length()*2*q_to_d*sizeof(R) );
+    // Sort the sources by their local box so that each box's sources are 
+    // contiguous
+    for( std::size_t b=0; b<numLocalSourceBoxes; ++b )
+        sourceBoxOffsets[b+1] += sourceBoxOffsets[b];
+    std::vector<std::size_t> sortedSources( numSources );
+    {
+        std::vector<std::size_t> nextOffsets
+        ( sourceBoxOffsets.begin(), sourceBoxOffsets.end()-1 );
+        for( std::size_t s=0; s<numSources; ++s )
+            sortedSources[nextOffsets[flattenedSourceBoxIndices[s]]++] = s;
+    }
+
+    // Without a bootstrap cluster we may accumulate directly into our 
+    // weights, but otherwise we need room for the whole cluster's targets
+    std::auto_ptr< WeightGridList<R,d,q> > partialWeightGridList;
+    if( numMergingProcesses > 1 )
+        partialWeightGridList.reset
+        ( new WeightGridList<R,d,q>
+              ( numMergingProcesses*weightGridList.Length() ) );
+    WeightGridList<R,d,q>& unscaledWeightGridList = 
+        ( numMergingProcesses > 1 ? *partialWeightGridList : weightGridList );
+
+    // Set all of the weights to zero
+    std::memset
+    ( unscaledWeightGridList.Buffer(), 0, 
+      unscaledWeightGridList.Length()*2*q_to_d*sizeof(R) );
 
 #ifdef TIMING
-        computeTimer.Start();
+    computeTimer.Start();
 #endif // TIMING
-        // Set all of the weights to the potentials in the target boxes. 
-        // We take care to avoid redundant Lagrangian interpolation; it was 
-        // previously the bottleneck.
+    // Set all of the weights to the potentials in the target boxes. 
+    //
+    // The phase factors, beta_s^A = exp(i Phi(x0(A),p_s)) f_s, do not depend
+    // upon the Lagrangian basis function, so they are formed once for each
+    // block of sources in a box and then applied to all q^d basis functions
+    // at once with a pair of real Gemms:
+    //
+    //   delta^{AB}_t += sum_{s in B} L_t(p_s) beta_s^A.
+    //
+    // Since the interactions are stored source-major, the weights of box B 
+    // with consecutive target boxes are a fixed stride apart, and so the 
+    // Gemms can write directly into the weight grid list. The basis 
+    // functions are shared by every phase, and the phase factors of each 
+    // phase by every right-hand side, which only forms its own beta's.
 #ifdef TIMING
-        setToPotentialTimer.Start();
+    setToPotentialTimer.Start();
 #endif // TIMING
-        for( std::size_t t=0; t<q_to_d; ++t )
+    const std::size_t numTargets = x0As.size();
+    const std::size_t maxBlockSize = 
+        std::max( (std::size_t)1, (std::size_t)(1u<<16)/numTargets );
+    const int ldc = 2*q_to_d*numLocalSourceBoxes*numGrids;
+    const bool recordFactors = ( store != 0 && store->Recording() );
+    // Each source of each phase forms 2*numTargets factors
+    std::size_t numStoredSources = 0;
+    R* storedBetaFactors = 
+        ( store != 0 ? 
+          store->NextSegment
+          ( numSources*numPhases, 2*numTargets, numStoredSources ) : 0 );
+#ifdef HYBRID
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for( std::size_t b=0; b<numLocalSourceBoxes; ++b )
+    {
+        std::vector<P> phiResults;
+        std::vector<R> sinResults;
+        std::vector<R> cosResults;
+        std::vector<R> lagrangeBlock;
+        std::vector<R> realBeta;
+        std::vector<R> imagBeta;
+        std::vector< Array<P,d> > pPoints;
+        std::vector< Array<R,d> > pRefBlock;
+        R* realWeights = unscaledWeightGridList.Buffer() + b*2*q_to_d*numGrids;
+        for( std::size_t sBegin=sourceBoxOffsets[b]; 
+             sBegin<sourceBoxOffsets[b+1]; sBegin+=maxBlockSize )
         {
-            std::vector<R> lagrangeResults;
-#ifdef TIMING
-            lagrangeTimer.Start();
-#endif // TIMING
-            context.LagrangeBatch( t, pRefPoints, lagrangeResults );
-#ifdef TIMING
-            lagrangeTimer.Stop();
-#endif // TIMING
-
-            HTreeWalker<d> AWalker;
-            for( std::size_t targetIndex=0;
-                 targetIndex<(1u<<(d*bootstrapSkip));
-                 ++targetIndex, AWalker.Walk() )
+            const std::size_t sEnd = 
+                std::min( sBegin+maxBlockSize, sourceBoxOffsets[b+1] );
+            const std::size_t blockSize = sEnd-sBegin;
+            pPoints.resize( blockSize );
+            pRefBlock.resize( blockSize );
+            for( std::size_t s=0; s<blockSize; ++s )
             {
-                const Array<std::size_t,d> A = AWalker.State();
-
-                // Compute the center of the target box
-                Array<R,d> x0A;
-                for( std::size_t j=0; j<d; ++j )
-                    x0A[j] = targetBox.offsets[j] + (A[j]+0.5)*wA[j];
+                pPoints[s] = mySources[sortedSources[sBegin+s]].p;
+                pRefBlock[s] = pRefPoints[sortedSources[sBegin+s]];
+            }
 
-                const std::vector< Array<R,d> > xPoint( 1, x0A );
+            // Form the q^d x blockSize matrix of Lagrangian basis functions
+            context.LagrangeBatch( pRefBlock, lagrangeBlock );
 
-#ifdef TIMING
-                preprocessTimer.Start();
-#endif // TIMING
-                phase.BatchEvaluate( xPoint, pPoints, phiResults );
-                SinCosBatch( phiResults, sinResults, cosResults );
-#ifdef TIMING
-                preprocessTimer.Stop();
-#endif // TIMING
+            const std::size_t blockFactors = blockSize*numTargets;
+            realBeta.resize( blockFactors );
+            imagBeta.resize( blockFactors );
+            for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
+            {
+                // Form the blockSize x numTargets matrices of phase factors, 
+                // unless they were stored by a previous application
+                R* storedBlockFactors = 
+                    ( phaseIndex*numSources+sEnd <= numStoredSources ? 
+                      storedBetaFactors + 
+                      2*(phaseIndex*numSources+sBegin)*numTargets : 0 );
+                const R* sinFactors;
+                const R* cosFactors;
+                if( storedBlockFactors != 0 && !recordFactors )
+                {
+                    sinFactors = storedBlockFactors;
+                    cosFactors = storedBlockFactors + blockFactors;
+                }
+                else
+                {
+                    ImagExpBatch
+                    ( *phases[phaseIndex], x0As, pPoints, 
+                      phiResults, sinResults, cosResults );
+                    sinFactors = &sinResults[0];
+                    cosFactors = &cosResults[0];
+                    if( storedBlockFactors != 0 )
+                    {
+                        std::memcpy
+                        ( storedBlockFactors, sinFactors, 
+                          blockFactors*sizeof(R) );
+                        std::memcpy
+                        ( storedBlockFactors+blockFactors, cosFactors, 
+                          blockFactors*sizeof(R) );
+                    }
+                }
 
+                for( std::size_t rhs=0; rhs<numRHS; ++rhs )
                 {
-                    std::vector<R> realBeta( numSources );
-                    std::vector<R> imagBeta( numSources );
+                    const Source<R,d>* rhsSources = 
+                        &mySources[rhs*numSources];
                     R* RESTRICT realBetaBuffer = &realBeta[0];
                     R* RESTRICT imagBetaBuffer = &imagBeta[0];
-                    const R* RESTRICT cosBuffer = &cosResults[0];
-                    const R* RESTRICT sinBuffer = &sinResults[0];
-                    for( std::size_t s=0; s<numSources; ++s )
+                    const R* RESTRICT cosBuffer = cosFactors;
+                    const R* RESTRICT sinBuffer = sinFactors;
+                    for( std::size_t s=0; s<blockSize; ++s )
                     {
-                        const R realPhase = cosBuffer[s];
-                        const R imagPhase = sinBuffer[s];
-                        const R realMagnitude = real(mySources[s].magnitude);
-                        const R imagMagnitude = imag(mySources[s].magnitude);
-                        realBetaBuffer[s] = 
-                            realPhase*realMagnitude-imagPhase*imagMagnitude;
-                        imagBetaBuffer[s] = 
-                            imagPhase*realMagnitude+realPhase*imagMagnitude;
+                        const std::complex<R> magnitude = 
+                            rhsSources[sortedSources[sBegin+s]].magnitude;
+                        const R realMagnitude = real(magnitude);
+                        const R imagMagnitude = imag(magnitude);
+                        for( std::size_t i=0; i<numTargets; ++i )
+                        {
+                            const std::size_t k = i*blockSize+s;
+                            const R realPhase = cosBuffer[k];
+                            const R imagPhase = sinBuffer[k];
+                            realBetaBuffer[k] = realPhase*realMagnitude - 
+                                                imagPhase*imagMagnitude;
+                            imagBetaBuffer[k] = imagPhase*realMagnitude + 
+                                                realPhase*imagMagnitude;
+                        }
                     }
 
+                    const std::size_t grid = phaseIndex*numRHS + rhs;
+                    R* gridRealWeights = realWeights + grid*2*q_to_d;
+                    R* gridImagWeights = gridRealWeights + q_to_d;
+                    Gemm
+                    ( 'N', 'N', q_to_d, numTargets, blockSize,
+                      (R)1, &lagrangeBlock[0], q_to_d,
+                            &realBeta[0], blockSize,
+                      (R)1, gridRealWeights, ldc );
+                    Gemm
+                    ( 'N', 'N', q_to_d, numTargets, blockSize,
+                      (R)1, &lagrangeBlock[0], q_to_d,
+                            &imagBeta[0], blockSize,
+                      (R)1, gridImagWeights, ldc );
+                }
+            }
+        }
+    }
 #ifdef TIMING
-                    axpyTimer.Start();
+    setToPotentialTimer.Stop();
 #endif // TIMING
-                    const R* RESTRICT lagrangeBuffer = &lagrangeResults[0];
-                    for( std::size_t s=0; s<numSources; ++s )
-                    {
-                        const std::size_t sourceIndex = 
-                            flattenedSourceBoxIndices[s];
-                        const std::size_t interactionIndex = 
-                            sourceIndex + 
-                            (targetIndex<<log2LocalSourceBoxes);
-                        weightGridList[interactionIndex].RealWeight(t) += 
-                            realBetaBuffer[s]*lagrangeBuffer[s];
-                        weightGridList[interactionIndex].ImagWeight(t) +=
-                            imagBetaBuffer[s]*lagrangeBuffer[s];
-                    }
+
+    // Sum the partial weights over the bootstrap cluster and scatter them
+    // so that each process is left with the unscaled weights of its targets
+    if( numMergingProcesses > 1 )
+    {
 #ifdef TIMING
-                    axpyTimer.Stop();
+        sumScatterTimer.Start();
 #endif // TIMING
-                }
-            }
-        }
+        std::vector<int> recvCounts
+        ( numMergingProcesses, 2*weightGridList.Length()*q_to_d );
+        WireSumScatter
+        ( plan.GetWireFormat(), partialWeightGridList->Buffer(), 
+          weightGridList.Buffer(), &recvCounts[0], bootstrapComm );
 #ifdef TIMING
-        setToPotentialTimer.Stop();
+        sumScatterTimer.Stop();
 #endif // TIMING
+    }
 
-        HTreeWalker<d> AWalker;
-        for( std::size_t targetIndex=0;
-             targetIndex<(1u<<(d*bootstrapSkip));
-             ++targetIndex, AWalker.Walk() )
-        {
-            const Array<std::size_t,d> A = AWalker.State();
+    // The members of our team hold the contributions of their own sources,
+    // so sum them into the share of the interactions which we scale (the 
+    // caller gathers the shares)
+    const std::size_t numInteractions = 
+        numLocalTargetBoxes*numLocalSourceBoxes;
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare( numInteractions, shareBegin, shareEnd );
+#ifdef TIMING
+    sumScatterTimer.Start();
+#endif // TIMING
+    plan.SumTeamShares
+    ( weightGridList.Buffer(), numInteractions, 2*q_to_d*numGrids );
+#ifdef TIMING
+    sumScatterTimer.Stop();
+#endif // TIMING
 
-            // Compute the center of the target box
-            Array<R,d> x0A;
+    // Scale the weights of each interaction by the phase factors at the 
+    // Chebyshev points of its source box. Each thread has its own workspace,
+    // and the factors of each interaction in our share have their own place
+    // in the store.
+    const std::size_t numInteractionFactors = 2*q_to_d*numPhases;
+    std::size_t numStoredInteractions = 0;
+    R* storedScalingFactors = 
+        ( store != 0 ? 
+          store->NextSegment
+          ( shareEnd-shareBegin, numInteractionFactors, 
+            numStoredInteractions ) : 0 );
+    std::vector< rfio::Workspace<R,d,q> > workspaces( MaxThreads() );
+    for( std::size_t t=0; t<workspaces.size(); ++t )
+        workspaces[t].recordFactors = recordFactors;
+    const std::vector< Array<R,d> >& chebyshevGrid = context.GetChebyshevGrid();
+#ifdef HYBRID
+#pragma omp parallel for schedule(static)
+#endif
+    for( std::size_t targetIndex=0;
+         targetIndex<numLocalTargetBoxes;
+         ++targetIndex )
+    {
+        rfio::Workspace<R,d,q>& workspace = workspaces[ThreadNum()];
+        std::vector< Array<P,d> >& xPoint = workspace.xPoints;
+        std::vector< Array<P,d> >& chebyshevPoints = workspace.pPoints;
+        const R* sinFactors;
+        const R* cosFactors;
+
+        const Array<std::size_t,d> A = 
+            UnflattenConstrainedHTreeIndex
+            ( targetIndex, log2LocalTargetBoxesPerDim );
+
+        // Compute the center of the target box
+        xPoint.resize( 1 );
+        for( std::size_t j=0; j<d; ++j )
+            xPoint[0][j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
+        chebyshevPoints.resize( q_to_d );
+
+        // Loop over all of the boxes to compute the {p_t^B} and prefactors
+        // for each delta weight {delta_t^AB}
+        ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
+        for( std::size_t sourceIndex=0; 
+             sourceIndex<(1u<<log2LocalSourceBoxes); 
+             ++sourceIndex, BWalker.Walk() ) 
+        {
+            const std::size_t interactionIndex = 
+                ReverseConstrainedHTreeIndex<d>
+                ( sourceIndex, log2LocalSourceBoxes ) + 
+                (targetIndex<<log2LocalSourceBoxes);
+            if( interactionIndex < shareBegin || interactionIndex >= shareEnd )
+                continue;
+            workspace.storedFactors = 
+                ( interactionIndex-shareBegin < numStoredInteractions ? 
+                  storedScalingFactors + 
+                  (interactionIndex-shareBegin)*numInteractionFactors : 0 );
+
+            const Array<std::size_t,d> B = BWalker.State();
+
+            // Translate the local coordinates into the source center 
+            Array<R,d> p0;
             for( std::size_t j=0; j<d; ++j )
-                x0A[j] = targetBox.offsets[j] + (A[j]+0.5)*wA[j];
-
-            const std::vector< Array<R,d> > xPoint( 1, x0A );
-
-            // Loop over all of the boxes to compute the {p_t^B} and prefactors
-            // for each delta weight {delta_t^AB}
-            std::vector< Array<R,d> > chebyshevPoints( q_to_d );
-            const std::vector< Array<R,d> >& chebyshevGrid = 
-                context.GetChebyshevGrid();
-            ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
-            for( std::size_t sourceIndex=0; 
-                 sourceIndex<(1u<<log2LocalSourceBoxes); 
-                 ++sourceIndex, BWalker.Walk() ) 
-            {
-                const Array<std::size_t,d> B = BWalker.State();
-
-                // Translate the local coordinates into the source center 
-                Array<R,d> p0;
-                for( std::size_t j=0; j<d; ++j )
-                    p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
-
-                const std::size_t interactionIndex = 
-                    sourceIndex + (targetIndex<<log2LocalSourceBoxes);
+                p0[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
 
-                WeightGrid<R,d,q>& weightGrid = 
-                    weightGridList[interactionIndex];
-    
-                // Compute the prefactors given this p0 and multiply it by 
-                // the corresponding weights
-                {
-                    R* RESTRICT chebyshevPointsBuffer = &chebyshevPoints[0][0];
-                    const R* RESTRICT p0Buffer = &p0[0];
-                    const R* RESTRICT wBBuffer = &wB[0];
-                    const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
-                    for( std::size_t t=0; t<q_to_d; ++t )
-                        for( std::size_t j=0; j<d; ++j )
-                            chebyshevPointsBuffer[t*d+j] = 
-                                p0Buffer[j] + 
-                                wBBuffer[j]*chebyshevBuffer[t*d+j];
-                }
-                phase.BatchEvaluate( xPoint, chebyshevPoints, phiResults );
-                SinCosBatch( phiResults, sinResults, cosResults );
+            // Compute the prefactors given this p0 and multiply it by 
+            // the corresponding weights
+            {
+                P* RESTRICT chebyshevPointsBuffer = &chebyshevPoints[0][0];
+                const R* RESTRICT p0Buffer = &p0[0];
+                const R* RESTRICT wBBuffer = &wB[0];
+                const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
+                for( std::size_t t=0; t<q_to_d; ++t )
+                    for( std::size_t j=0; j<d; ++j )
+                        chebyshevPointsBuffer[t*d+j] = 
+                            p0Buffer[j] + wBBuffer[j]*chebyshevBuffer[t*d+j];
+            }
+            for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
+            {
+                StoredImagExpBatch<q>
+                ( *phases[phaseIndex], xPoint, chebyshevPoints, workspace, 
+                  sinFactors, cosFactors );
+                for( std::size_t grid=phaseIndex*numRHS; 
+                     grid<(phaseIndex+1)*numRHS; ++grid )
                 {
+                    WeightGridView<R,d,q> weightGrid = 
+                        weightGridList[interactionIndex*numGrids+grid];
                     R* RESTRICT realBuffer = weightGrid.RealBuffer();
                     R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-                    const R* RESTRICT cosBuffer = &cosResults[0];
-                    const R* RESTRICT sinBuffer = &sinResults[0];
+                    const R* RESTRICT cosBuffer = cosFactors;
+                    const R* RESTRICT sinBuffer = sinFactors;
                     for( std::size_t t=0; t<q_to_d; ++t )
                     {
                         const R realPhase = cosBuffer[t];
@@ -318,14 +541,10 @@ InitializeWeights
                 }
             }
         }
+    }
 #ifdef TIMING
-        computeTimer.Stop();
+    computeTimer.Stop();
 #endif // TIMING
-    }
-    else
-    {
-        throw std::runtime_error("Parallel bootstrapping not yet supported.");
-    }
 }
 
 } // rfio
@@ -0,0 +1,141 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_RFIO_PHASE_FACTOR_STORE_HPP
+#define BFIO_RFIO_PHASE_FACTOR_STORE_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace bfio {
+namespace rfio {
+
+// Holds the phase factors formed by one application of the transform so
+// that later applications with the same phase, boxes, plan, and source
+// positions may reuse them. Each stage of the transform (the initialization
+// of the weights, each level of the recursion, and the switch) requests one
+// segment, in the same order every time, for the factors of its calls. 
+// During the first application the segments are allocated, in order, from 
+// the memory budget: a stage which does not fit in what is left of it 
+// receives a segment for as many of its leading calls as do, and the 
+// stages fill their segments. Afterwards, those calls read their factors 
+// from the segments, while the remaining calls evaluate the phase as usual.
+template<typename R>
+class PhaseFactorStore
+{
+    const std::size_t _maxSize;
+    std::size_t _size;
+    bool _recorded;
+    bool _applying;
+    std::size_t _nextSegment;
+    std::vector< std::vector<R> > _segments;
+    std::vector<std::size_t> _segmentCalls;
+
+public:
+    // The budget is in bytes
+    PhaseFactorStore( std::size_t memoryBudget );
+
+    void Begin();
+    void End();
+
+    bool Recording() const;
+
+    // Returns the segment of the next stage, which makes numCalls calls that
+    // each form callSize entries, and sets numStoredCalls to the number of 
+    // leading calls whose factors are held in it, one after another. The 
+    // segment is zero if there are none.
+    R* NextSegment
+    ( std::size_t numCalls, std::size_t callSize, 
+      std::size_t& numStoredCalls );
+
+    // The number of bytes of phase factors stored
+    std::size_t Size() const;
+};
+
+// Implementations
+
+template<typename R>
+inline
+PhaseFactorStore<R>::PhaseFactorStore( std::size_t memoryBudget )
+: _maxSize(memoryBudget/sizeof(R)), _size(0), _recorded(false),
+  _applying(false), _nextSegment(0)
+{ }
+
+template<typename R>
+inline void
+PhaseFactorStore<R>::Begin()
+{
+#ifndef RELEASE
+    if( _applying )
+        throw std::logic_error("Cannot nest applications of a store");
+#endif
+    _applying = true;
+    _nextSegment = 0;
+}
+
+template<typename R>
+inline void
+PhaseFactorStore<R>::End()
+{
+    _applying = false;
+    _recorded = true;
+}
+
+template<typename R>
+inline bool
+PhaseFactorStore<R>::Recording() const
+{ return !_recorded; }
+
+template<typename R>
+R*
+PhaseFactorStore<R>::NextSegment
+( std::size_t numCalls, std::size_t callSize, std::size_t& numStoredCalls )
+{
+    if( !_recorded )
+    {
+        const std::size_t numFittingCalls = 
+            ( callSize == 0 ? 0 : (_maxSize-_size)/callSize );
+        const std::size_t numSegmentCalls = 
+            std::min( numCalls, numFittingCalls );
+        _segments.push_back( std::vector<R>( numSegmentCalls*callSize ) );
+        _segmentCalls.push_back( numSegmentCalls );
+        _size += numSegmentCalls*callSize;
+    }
+#ifndef RELEASE
+    if( _nextSegment >= _segments.size() ||
+        _segmentCalls[_nextSegment] > numCalls ||
+        _segments[_nextSegment].size() != 
+        _segmentCalls[_nextSegment]*callSize )
+        throw std::logic_error
+        ("The transform changed since its phase factors were stored");
+#endif
+    numStoredCalls = _segmentCalls[_nextSegment];
+    std::vector<R>& segment = _segments[_nextSegment++];
+    return ( segment.empty() ? 0 : &segment[0] );
+}
+
+template<typename R>
+inline std::size_t
+PhaseFactorStore<R>::Size() const
+{ return _size*sizeof(R); }
+
+} // rfio
+} // bfio
+
+#endif // BFIO_RFIO_PHASE_FACTOR_STORE_HPP
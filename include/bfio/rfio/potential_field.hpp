@@ -18,6 +18,7 @@
 #ifndef BFIO_RFIO_POTENTIAL_FIELD_HPP
 #define BFIO_RFIO_POTENTIAL_FIELD_HPP 1
 
+#include <algorithm>
 #include <stdexcept>
 #include <complex>
 #include <fstream>
@@ -34,17 +35,26 @@
 
 #include "bfio/functors/amplitude.hpp"
 #include "bfio/functors/phase.hpp"
+#include "bfio/tools/blas.hpp"
 #include "bfio/tools/special_functions.hpp"
 
 namespace bfio {
 
 namespace rfio {
-template<typename R,std::size_t d,std::size_t q>
+
+// PhaseT and AmplitudeT are the concrete types of the phase and amplitude 
+// functors; when they are left as Phase and Amplitude, the functors are 
+// called through their virtual interfaces
+template<typename R,std::size_t d,std::size_t q,
+         class PhaseT=Phase<typename PhaseReal<R>::Type,d>,
+         class AmplitudeT=Amplitude<typename PhaseReal<R>::Type,d> >
 class PotentialField
 {
+    typedef typename PhaseReal<R>::Type P;
+
     const rfio::Context<R,d,q>& _context;
-    const Amplitude<R,d>* _amplitude;
-    const Phase<R,d>* _phase;
+    const AmplitudeT* _amplitude;
+    const PhaseT* _phase;
     const Box<R,d> _sourceBox;
     const Box<R,d> _myTargetBox;
     const Array<std::size_t,d> _myTargetBoxCoords;
@@ -56,23 +66,48 @@ class PotentialField
     std::vector< LRP<R,d,q> > _LRPs;
 
 public:
+    // If the weight grid list holds numGrids consecutive grids per target 
+    // box (one per phase and right-hand side), the field is formed from the
+    // grid'th of them
     PotentialField
     ( const rfio::Context<R,d,q>& context,
-      const Amplitude<R,d>& amplitude,
-      const Phase<R,d>& phase,
+      const AmplitudeT& amplitude,
+      const PhaseT& phase,
       const Box<R,d>& sourceBox,
       const Box<R,d>& myTargetBox,
       const Array<std::size_t,d>& myTargetBoxCoords,
       const Array<std::size_t,d>& log2TargetSubboxesPerDim,
-      const WeightGridList<R,d,q>& weightGridList );
+      const WeightGridList<R,d,q>& weightGridList,
+      std::size_t numGrids=1,
+      std::size_t grid=0 );
 
     ~PotentialField();
 
     std::complex<R> Evaluate( const Array<R,d>& x ) const;
-    // TODO: BatchEvaluate? SafeEvaluate?
 
-    const Amplitude<R,d>& GetAmplitude() const;
-    const Phase<R,d>& GetPhase() const;
+    // Evaluate the potential at each of the points in x, which are grouped
+    // by their owning low-rank potential so that the Lagrangian basis can be
+    // applied to each group with a single Gemm
+    void BatchEvaluate
+    ( const std::vector< Array<R,d> >& x, 
+            std::vector< std::complex<R> >& results ) const;
+
+    // Evaluate the potential on the regular grid of points
+    //   x_j = myTargetBox.offsets[j] + i_j wA[j]/numSamplesPerBoxDim,
+    // for 0 <= i_j < numSamplesPerBoxDim 2^log2SubboxesPerDim[j], where the 
+    // sample i is stored in results[sum_j i_j strides[j]]
+    void EvaluateOnGrid
+    ( std::size_t numSamplesPerBoxDim,
+      std::complex<R>* results,
+      const Array<std::size_t,d>& strides ) const;
+
+    // Same as above, but with the samples stored lexographically
+    void EvaluateOnGrid
+    ( std::size_t numSamplesPerBoxDim,
+      std::vector< std::complex<R> >& results ) const;
+
+    const AmplitudeT& GetAmplitude() const;
+    const PhaseT& GetPhase() const;
     const Box<R,d>& GetMyTargetBox() const;
     std::size_t GetNumSubboxes() const;
     const Array<R,d>& GetSubboxWidths() const;
@@ -81,26 +116,26 @@ public:
     const Array<std::size_t,d>& GetLog2SubboxesUpToDim() const;
 };
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 void PrintErrorEstimates
 ( MPI_Comm comm,
-  const PotentialField<R,d,q>& u,
+  const PotentialField<R,d,q,PhaseT,AmplitudeT>& u,
   const std::vector< Source<R,d> >& globalSources );
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 void WriteVtkXmlPImageData
 ( MPI_Comm comm, 
   const std::size_t N,
   const Box<R,d>& targetBox,
-  const PotentialField<R,d,q>& u,
+  const PotentialField<R,d,q,PhaseT,AmplitudeT>& u,
   const std::string& basename );
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 void WriteVtkXmlPImageData
 ( MPI_Comm comm, 
   const std::size_t N,
   const Box<R,d>& targetBox,
-  const PotentialField<R,d,q>& u,
+  const PotentialField<R,d,q,PhaseT,AmplitudeT>& u,
   const std::string& basename,
   const std::vector< Source<R,d> >& globalSources );
 
@@ -108,17 +143,20 @@ void WriteVtkXmlPImageData
 
 // Implementations
 
-template<typename R,std::size_t d,std::size_t q>
-rfio::PotentialField<R,d,q>::PotentialField
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::PotentialField
 ( const rfio::Context<R,d,q>& context,
-  const Amplitude<R,d>& amplitude,
-  const Phase<R,d>& phase,
+  const AmplitudeT& amplitude,
+  const PhaseT& phase,
   const Box<R,d>& sourceBox,
   const Box<R,d>& myTargetBox,
   const Array<std::size_t,d>& myTargetBoxCoords,
   const Array<std::size_t,d>& log2TargetSubboxesPerDim,
-  const WeightGridList<R,d,q>& weightGridList )
-: _context(context), _amplitude(amplitude.Clone()), _phase(phase.Clone()), 
+  const WeightGridList<R,d,q>& weightGridList,
+  std::size_t numGrids,
+  std::size_t grid )
+: _context(context), _amplitude(CopyAmplitude(amplitude)), 
+  _phase(CopyPhase(phase)), 
   _sourceBox(sourceBox), _myTargetBox(myTargetBox),
   _myTargetBoxCoords(myTargetBoxCoords),
   _log2TargetSubboxesPerDim(log2TargetSubboxesPerDim)
@@ -161,20 +199,61 @@ rfio::PotentialField<R,d,q>::PotentialField
         // Now fill the k'th LRP index
         for( std::size_t j=0; j<d; ++j )
             _LRPs[k].x0[j] = myTargetBox.offsets[j] + (A[j]+0.5)*_wA[j];
-        _LRPs[k].weightGrid = weightGridList[targetIndex];
+        _LRPs[k].weightGrid = weightGridList[targetIndex*numGrids+grid];
+    }
+
+    // Absorb the phase at the Chebyshev points of each box, 
+    // exp(-i Phi(x_t(A),p0)), into the weights so that evaluation only 
+    // requires interpolation and a single phase evaluation per point
+    const std::size_t q_to_d = Pow<q,d>::val;
+    const std::vector< Array<R,d> >& chebyshevGrid = 
+        _context.GetChebyshevGrid();
+    const std::vector< Array<P,d> > pPoint( 1, _p0 );
+#ifdef HYBRID
+#pragma omp parallel for schedule(static)
+#endif
+    for( std::size_t k=0; k<_LRPs.size(); ++k )
+    {
+        LRP<R,d,q>& lrp = _LRPs[k];
+
+        std::vector< Array<P,d> > xPoints( q_to_d );
+        for( std::size_t t=0; t<q_to_d; ++t )
+            for( std::size_t j=0; j<d; ++j )
+                xPoints[t][j] = lrp.x0[j] + _wA[j]*chebyshevGrid[t][j];
+
+        std::vector<P> phiResults;
+        std::vector<R> sinResults;
+        std::vector<R> cosResults;
+        ImagExpBatch
+        ( *_phase, xPoints, pPoint, phiResults, sinResults, cosResults );
+
+        R* RESTRICT realBuffer = lrp.weightGrid.RealBuffer();
+        R* RESTRICT imagBuffer = lrp.weightGrid.ImagBuffer();
+        const R* RESTRICT cosBuffer = &cosResults[0];
+        const R* RESTRICT sinBuffer = &sinResults[0];
+        for( std::size_t t=0; t<q_to_d; ++t )
+        {
+            const R realPhase = cosBuffer[t];
+            const R imagPhase = -sinBuffer[t];
+            const R realWeight = realBuffer[t];
+            const R imagWeight = imagBuffer[t];
+            realBuffer[t] = realPhase*realWeight - imagPhase*imagWeight;
+            imagBuffer[t] = imagPhase*realWeight + realPhase*imagWeight;
+        }
     }
 }
 
-template<typename R,std::size_t d,std::size_t q>
-rfio::PotentialField<R,d,q>::~PotentialField()
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::~PotentialField()
 {
     delete _amplitude;
     delete _phase;
 }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 std::complex<R>
-rfio::PotentialField<R,d,q>::Evaluate( const Array<R,d>& x ) const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::Evaluate
+( const Array<R,d>& x ) const
 {
     typedef std::complex<R> C;
 
@@ -201,80 +280,308 @@ rfio::PotentialField<R,d,q>::Evaluate( const Array<R,d>& x ) const
 
     // Convert x to the reference domain of [-1/2,+1/2]^d for box k
     const LRP<R,d,q>& lrp = _LRPs[k];
-    Array<R,d> xRef;
+    std::vector< Array<R,d> > xRef( 1 );
     for( std::size_t j=0; j<d; ++j )
-        xRef[j] = (x[j]-lrp.x0[j])/_wA[j];
+        xRef[0][j] = (x[j]-lrp.x0[j])/_wA[j];
 
-    const std::vector< Array<R,d> >& chebyshevGrid = 
-        _context.GetChebyshevGrid();
+    std::vector<R> lagrangeResults;
+    _context.LagrangeBatch( xRef, lagrangeResults );
     R realValue = 0;
     R imagValue = 0;
     for( std::size_t t=0; t<Pow<q,d>::val; ++t )
     {
-        // Construct the t'th translated Chebyshev gridpoint
-        Array<R,d> xt;
-        for( std::size_t j=0; j<d; ++j )
-            xt[j] = lrp.x0[j] + _wA[j]*chebyshevGrid[t][j];
-
-        const C beta = ImagExp<R>( -_phase->operator()(xt,_p0) );
-        const R lambda = _context.Lagrange(t,xRef);
-        const R realWeight = lrp.weightGrid.RealWeight(t);
-        const R imagWeight = lrp.weightGrid.ImagWeight(t);
-        realValue += lambda*
-            (realWeight*std::real(beta)-imagWeight*std::imag(beta));
-        imagValue += lambda*
-            (imagWeight*std::real(beta)+realWeight*std::imag(beta));
+        const R lambda = lagrangeResults[t];
+        realValue += lambda*lrp.weightGrid.RealWeight(t);
+        imagValue += lambda*lrp.weightGrid.ImagWeight(t);
     }
-    const C beta = ImagExp<R>( _phase->operator()(x,_p0) );
+    const Array<P,d> xP( x ), p0( _p0 );
+    const C beta( ImagExp<P>( EvaluatePhase( *_phase, xP, p0 ) ) );
     const R realPotential = realValue*std::real(beta)-imagValue*std::imag(beta);
     const R imagPotential = imagValue*std::real(beta)+realValue*std::imag(beta);
     return C( realPotential, imagPotential );
 }
 
-template<typename R,std::size_t d,std::size_t q>
-inline const Amplitude<R,d>&
-rfio::PotentialField<R,d,q>::GetAmplitude() const
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+void
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::BatchEvaluate
+( const std::vector< Array<R,d> >& x,
+        std::vector< std::complex<R> >& results ) const
+{
+    typedef std::complex<R> C;
+    const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numPoints = x.size();
+    const std::size_t numLRPs = _LRPs.size();
+    results.resize( numPoints );
+    if( numPoints == 0 )
+        return;
+
+    // Sort the points by the lexographic position of their owning LRP
+    std::vector<std::size_t> owningLRPs( numPoints );
+    std::vector<std::size_t> LRPOffsets( numLRPs+1, 0 );
+    for( std::size_t i=0; i<numPoints; ++i )
+    {
+        std::size_t k = 0;
+        for( std::size_t j=0; j<d; ++j )
+        {
+#ifndef RELEASE
+            if( x[i][j] < _myTargetBox.offsets[j] || 
+                x[i][j] > _myTargetBox.offsets[j]+_myTargetBox.widths[j] )
+            {
+                throw std::runtime_error
+                      ( "Tried to evaluate outside of potential range." );
+            }
+#endif
+            std::size_t owningIndex = static_cast<std::size_t>
+                ((x[i][j]-_myTargetBox.offsets[j])/_wA[j]);
+            owningIndex = std::min
+                ( owningIndex, 
+                  ((std::size_t)1<<_log2TargetSubboxesPerDim[j])-1 );
+            k += owningIndex << _log2TargetSubboxesUpToDim[j];
+        }
+        owningLRPs[i] = k;
+        ++LRPOffsets[k+1];
+    }
+    for( std::size_t k=0; k<numLRPs; ++k )
+        LRPOffsets[k+1] += LRPOffsets[k];
+    std::vector<std::size_t> sortedPoints( numPoints );
+    {
+        std::vector<std::size_t> nextOffsets
+        ( LRPOffsets.begin(), LRPOffsets.end()-1 );
+        for( std::size_t i=0; i<numPoints; ++i )
+            sortedPoints[nextOffsets[owningLRPs[i]]++] = i;
+    }
+
+    // Evaluate exp(i Phi(x,p0)) for every point at once
+    std::vector<P> phiResults;
+    std::vector<R> sinResults;
+    std::vector<R> cosResults;
+    {
+        const std::vector< Array<P,d> > xPoints( x.begin(), x.end() );
+        const std::vector< Array<P,d> > pPoint( 1, _p0 );
+        ImagExpBatch
+        ( *_phase, xPoints, pPoint, phiResults, sinResults, cosResults );
+    }
+
+#ifdef HYBRID
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for( std::size_t k=0; k<numLRPs; ++k )
+    {
+        const std::size_t numLocalPoints = LRPOffsets[k+1]-LRPOffsets[k];
+        if( numLocalPoints == 0 )
+            continue;
+        const LRP<R,d,q>& lrp = _LRPs[k];
+        const std::size_t* RESTRICT localPoints = 
+            &sortedPoints[LRPOffsets[k]];
+
+        // Convert the points to the reference domain of box k
+        std::vector< Array<R,d> > xRefs( numLocalPoints );
+        for( std::size_t i=0; i<numLocalPoints; ++i )
+            for( std::size_t j=0; j<d; ++j )
+                xRefs[i][j] = (x[localPoints[i]][j]-lrp.x0[j])/_wA[j];
+
+        // Since the real and imaginary weights are stored contiguously, they 
+        // form a q^d x 2 matrix which we can interpolate with one Gemm
+        std::vector<R> lagrangeResults;
+        std::vector<R> values( 2*numLocalPoints );
+        _context.LagrangeBatch( xRefs, lagrangeResults );
+        Gemm
+        ( 'T', 'N', numLocalPoints, 2, q_to_d,
+          (R)1, &lagrangeResults[0], q_to_d,
+                lrp.weightGrid.Buffer(), q_to_d,
+          (R)0, &values[0], numLocalPoints );
+
+        const R* RESTRICT realValues = &values[0];
+        const R* RESTRICT imagValues = &values[numLocalPoints];
+        const R* RESTRICT cosBuffer = &cosResults[0];
+        const R* RESTRICT sinBuffer = &sinResults[0];
+        C* RESTRICT resultsBuffer = &results[0];
+        for( std::size_t i=0; i<numLocalPoints; ++i )
+        {
+            const std::size_t r = localPoints[i];
+            const R realPhase = cosBuffer[r];
+            const R imagPhase = sinBuffer[r];
+            resultsBuffer[r] = 
+                C( realValues[i]*realPhase - imagValues[i]*imagPhase,
+                   imagValues[i]*realPhase + realValues[i]*imagPhase );
+        }
+    }
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+void
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::EvaluateOnGrid
+( std::size_t numSamplesPerBoxDim,
+  std::complex<R>* results,
+  const Array<std::size_t,d>& strides ) const
+{
+    typedef std::complex<R> C;
+    const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numLRPs = _LRPs.size();
+    const std::size_t ns = numSamplesPerBoxDim;
+    std::size_t ns_to_d = 1;
+    for( std::size_t j=0; j<d; ++j )
+        ns_to_d *= ns;
+
+    // Every box places its samples at the same points of its reference 
+    // domain, so a single ns x q matrix of 1d Lagrangian basis functions
+    // interpolates each dimension of every box
+    std::vector<R> lagrangeMap( ns*q );
+    {
+        std::vector<R> lagrange1d( q );
+        for( std::size_t i=0; i<ns; ++i )
+        {
+            _context.Lagrange1dBatch
+            ( static_cast<R>(i)/ns-static_cast<R>(0.5), &lagrange1d[0] );
+            for( std::size_t k=0; k<q; ++k )
+                lagrangeMap[k*ns+i] = lagrange1d[k];
+        }
+    }
+
+    const std::vector< Array<P,d> > pPoint( 1, _p0 );
+#ifdef HYBRID
+#pragma omp parallel for schedule(static)
+#endif
+    for( std::size_t k=0; k<numLRPs; ++k )
+    {
+        const LRP<R,d,q>& lrp = _LRPs[k];
+
+        // Recover the coordinates of this box from its lexographic position
+        Array<std::size_t,d> A;
+        for( std::size_t j=0; j<d; ++j )
+            A[j] = (k>>_log2TargetSubboxesUpToDim[j]) & 
+                   ((1u<<_log2TargetSubboxesPerDim[j])-1);
+
+        // Interpolate one dimension at a time. After interpolating the first
+        // j dimensions, the real and imaginary parts are stored as 
+        // 2 q^(d-j) contiguous ns^j x q matrices, so each subsequent 
+        // dimension is a series of Gemms against the transposed map.
+        std::vector<R> buffer( 2*ns_to_d*std::max(q_to_d/q,(std::size_t)1) );
+        std::vector<R> nextBuffer( buffer.size() );
+        Gemm
+        ( 'N', 'N', ns, 2*q_to_d/q, q, 
+          (R)1, &lagrangeMap[0], ns, 
+                lrp.weightGrid.Buffer(), q,
+          (R)0, &buffer[0], ns );
+        std::size_t ns_to_j = ns;
+        std::size_t numSlices = 2*q_to_d/q;
+        for( std::size_t j=1; j<d; ++j )
+        {
+            numSlices /= q;
+            for( std::size_t w=0; w<numSlices; ++w )
+            {
+                Gemm
+                ( 'N', 'T', ns_to_j, ns, q,
+                  (R)1, &buffer[w*ns_to_j*q], ns_to_j,
+                        &lagrangeMap[0], ns,
+                  (R)0, &nextBuffer[w*ns_to_j*ns], ns_to_j );
+            }
+            buffer.swap( nextBuffer );
+            ns_to_j *= ns;
+        }
+
+        // Apply exp(i Phi(x,p0)) to each sample and store it
+        std::vector< Array<P,d> > xPoints( ns_to_d );
+        for( std::size_t i=0; i<ns_to_d; ++i )
+        {
+            std::size_t iRemainder = i;
+            for( std::size_t j=0; j<d; ++j )
+            {
+                const std::size_t iLocal = iRemainder % ns;
+                iRemainder /= ns;
+                xPoints[i][j] = _myTargetBox.offsets[j] + 
+                                (A[j]*ns+iLocal)*_wA[j]/ns;
+            }
+        }
+        std::vector<P> phiResults;
+        std::vector<R> sinResults;
+        std::vector<R> cosResults;
+        ImagExpBatch
+        ( *_phase, xPoints, pPoint, phiResults, sinResults, cosResults );
+
+        const R* RESTRICT realValues = &buffer[0];
+        const R* RESTRICT imagValues = &buffer[ns_to_d];
+        const R* RESTRICT cosBuffer = &cosResults[0];
+        const R* RESTRICT sinBuffer = &sinResults[0];
+        for( std::size_t i=0; i<ns_to_d; ++i )
+        {
+            std::size_t iRemainder = i;
+            std::size_t offset = 0;
+            for( std::size_t j=0; j<d; ++j )
+            {
+                offset += (A[j]*ns+(iRemainder%ns))*strides[j];
+                iRemainder /= ns;
+            }
+            const R realPhase = cosBuffer[i];
+            const R imagPhase = sinBuffer[i];
+            results[offset] = 
+                C( realValues[i]*realPhase - imagValues[i]*imagPhase,
+                   imagValues[i]*realPhase + realValues[i]*imagPhase );
+        }
+    }
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+void
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::EvaluateOnGrid
+( std::size_t numSamplesPerBoxDim,
+  std::vector< std::complex<R> >& results ) const
+{
+    Array<std::size_t,d> strides;
+    std::size_t numSamples = 1;
+    for( std::size_t j=0; j<d; ++j )
+    {
+        strides[j] = numSamples;
+        numSamples *= numSamplesPerBoxDim<<_log2TargetSubboxesPerDim[j];
+    }
+    results.resize( numSamples );
+    EvaluateOnGrid( numSamplesPerBoxDim, &results[0], strides );
+}
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline const AmplitudeT&
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetAmplitude() const
 { return *_amplitude; }
 
-template<typename R,std::size_t d,std::size_t q>
-inline const Phase<R,d>&
-rfio::PotentialField<R,d,q>::GetPhase() const
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
+inline const PhaseT&
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetPhase() const
 { return *_phase; }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline const Box<R,d>&
-rfio::PotentialField<R,d,q>::GetMyTargetBox() const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetMyTargetBox() const
 { return _myTargetBox; }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline std::size_t
-rfio::PotentialField<R,d,q>::GetNumSubboxes() const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetNumSubboxes() const
 { return _LRPs.size(); }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline const Array<R,d>&
-rfio::PotentialField<R,d,q>::GetSubboxWidths() const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetSubboxWidths() const
 { return _wA; }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline const Array<std::size_t,d>&
-rfio::PotentialField<R,d,q>::GetMyTargetBoxCoords() const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetMyTargetBoxCoords() const
 { return _myTargetBoxCoords; }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline const Array<std::size_t,d>&
-rfio::PotentialField<R,d,q>::GetLog2SubboxesPerDim() const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetLog2SubboxesPerDim() const
 { return _log2TargetSubboxesPerDim; }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline const Array<std::size_t,d>&
-rfio::PotentialField<R,d,q>::GetLog2SubboxesUpToDim() const
+rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>::GetLog2SubboxesUpToDim() const
 { return _log2TargetSubboxesUpToDim; }
 
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 void rfio::PrintErrorEstimates
 ( MPI_Comm comm,
-  const PotentialField<R,d,q>& u,
+  const PotentialField<R,d,q,PhaseT,AmplitudeT>& u,
   const std::vector< Source<R,d> >& globalSources )
 {
     const std::size_t numAccuracyTestsPerBox = 10;
@@ -282,8 +589,9 @@ void rfio::PrintErrorEstimates
     int rank;
     MPI_Comm_rank( comm, &rank );
 
-    const Amplitude<R,d>& amplitude = u.GetAmplitude();
-    const Phase<R,d>& phase = u.GetPhase();
+    typedef typename PhaseReal<R>::Type P;
+    const AmplitudeT& amplitude = u.GetAmplitude();
+    const PhaseT& phase = u.GetPhase();
     const Box<R,d>& myTargetBox = u.GetMyTargetBox();
     const std::size_t numSubboxes = u.GetNumSubboxes();
     const std::size_t numTests = numSubboxes*numAccuracyTestsPerBox;
@@ -304,26 +612,32 @@ void rfio::PrintErrorEstimates
     const std::size_t numSources = globalSources.size();
     for( std::size_t m=0; m<numSources; ++m )
         L1Sources += abs(globalSources[m].magnitude);
+    // Compute random points in our process's target box and evaluate our
+    // potential field at them
+    std::vector< Array<R,d> > xPoints( numTests );
+    for( std::size_t k=0; k<numTests; ++k )
+        for( std::size_t j=0; j<d; ++j )
+            xPoints[k][j] = myTargetBox.offsets[j] +
+                            Uniform<R>()*myTargetBox.widths[j];
+    std::vector< std::complex<R> > approxResults;
+    u.BatchEvaluate( xPoints, approxResults );
+
     double myL2ErrorSquared = 0.;
     double myL2TruthSquared = 0.;
     double myLinfError = 0.;
     for( std::size_t k=0; k<numTests; ++k )
     {
-        // Compute a random point in our process's target box
-        Array<R,d> x;
-        for( std::size_t j=0; j<d; ++j )
-            x[j] = myTargetBox.offsets[j] +
-                   Uniform<R>()*myTargetBox.widths[j];
-
-        // Evaluate our potential field at x and compare against truth
-        std::complex<R> approx = u.Evaluate( x );
+        // Compare our potential field at x against the truth
+        const Array<P,d> x( xPoints[k] );
+        std::complex<R> approx = approxResults[k];
         std::complex<R> truth(0.,0.);
         for( std::size_t m=0; m<numSources; ++m )
         {
-            std::complex<R> beta =
-                amplitude( x, globalSources[m].p ) *
-                ImagExp( phase(x,globalSources[m].p) );
-            truth += beta * globalSources[m].magnitude;
+            const Array<P,d> p( globalSources[m].p );
+            std::complex<P> beta =
+                EvaluateAmplitude( amplitude, x, p ) *
+                ImagExp( EvaluatePhase( phase, x, p ) );
+            truth += std::complex<R>(beta) * globalSources[m].magnitude;
         }
         double absError = std::abs(approx-truth);
         double absTruth = std::abs(truth);
@@ -359,13 +673,13 @@ void rfio::PrintErrorEstimates
 }
 
 // Just write out the real and imag components of the approximation
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline void
 rfio::WriteVtkXmlPImageData
 ( MPI_Comm comm,
   const std::size_t N,
   const Box<R,d>& targetBox,
-  const rfio::PotentialField<R,d,q>& u,
+  const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>& u,
   const std::string& basename )
 {
     using namespace std;
@@ -379,8 +693,6 @@ rfio::WriteVtkXmlPImageData
 
     if( d <= 3 )
     {
-        const Box<R,d>& myTargetBox = u.GetMyTargetBox();
-        const Array<R,d>& wA = u.GetSubboxWidths();
         const Array<size_t,d>& log2SubboxesPerDim = u.GetLog2SubboxesPerDim();
         const size_t numSubboxes = u.GetNumSubboxes();
         const size_t numSamples = numSamplesPerBox*numSubboxes;
@@ -508,30 +820,11 @@ rfio::WriteVtkXmlPImageData
         realFile << os.str();
         imagFile << os.str();
         os.clear(); os.str("");
-        Array<size_t,d> numSamplesUpToDim;
-        for( size_t j=0; j<d; ++j )
-        {
-            numSamplesUpToDim[j] = 1;
-            for( size_t i=0; i<j; ++i )
-            {
-                numSamplesUpToDim[j] *=
-                    numSamplesPerBoxDim << log2SubboxesPerDim[i];
-            }
-        }
+        vector< complex<R> > approxResults;
+        u.EvaluateOnGrid( numSamplesPerBoxDim, approxResults );
         for( size_t k=0; k<numSamples; ++k )
         {
-            // Extract our indices in each dimension
-            Array<size_t,d> coords;
-            for( size_t j=0; j<d; ++j )
-                coords[j] = (k/numSamplesUpToDim[j]) %
-                            (numSamplesPerBoxDim<<log2SubboxesPerDim[j]);
-
-            // Compute the location of our sample
-            Array<R,d> x;
-            for( size_t j=0; j<d; ++j )
-                x[j] = myTargetBox.offsets[j] +
-                       coords[j]*wA[j]/numSamplesPerBoxDim;
-            complex<R> approx = u.Evaluate( x );
+            const complex<R> approx = approxResults[k];
             realFile << (float)real(approx) << " ";
             imagFile << (float)imag(approx) << " ";
             if( k % numSamplesPerBox == 0 )
@@ -561,13 +854,13 @@ rfio::WriteVtkXmlPImageData
 
 // Write out the real and imag components of the truth, the approximation,
 // and the error.
-template<typename R,std::size_t d,std::size_t q>
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 inline void
 rfio::WriteVtkXmlPImageData
 ( MPI_Comm comm,
   const std::size_t N,
   const Box<R,d>& targetBox,
-  const rfio::PotentialField<R,d,q>& u,
+  const rfio::PotentialField<R,d,q,PhaseT,AmplitudeT>& u,
   const std::string& basename,
   const std::vector< Source<R,d> >& globalSources )
 {
@@ -576,8 +869,9 @@ rfio::WriteVtkXmlPImageData
     const std::size_t numSamplesPerBoxDim = 4;
     const std::size_t numSamplesPerBox = Pow<numSamplesPerBoxDim,d>::val;
 
-    const Amplitude<R,d>& amplitude = u.GetAmplitude();
-    const Phase<R,d>& phase = u.GetPhase();
+    typedef typename PhaseReal<R>::Type P;
+    const AmplitudeT& amplitude = u.GetAmplitude();
+    const PhaseT& phase = u.GetPhase();
 
     int rank, numProcesses;
     MPI_Comm_rank( comm, &rank );
@@ -783,6 +1077,8 @@ rfio::WriteVtkXmlPImageData
             }
         }
         const std::size_t numSources = globalSources.size();
+        vector< complex<R> > approxResults;
+        u.EvaluateOnGrid( numSamplesPerBoxDim, approxResults );
         for( size_t k=0; k<numSamples; ++k )
         {
             // Extract our indices in each dimension
@@ -797,17 +1093,19 @@ rfio::WriteVtkXmlPImageData
                 x[j] = myTargetBox.offsets[j] +
                        coords[j]*wA[j]/numSamplesPerBoxDim;
 
-            // Compute the approximation
-            complex<R> approx = u.Evaluate( x );
+            // Grab the approximation
+            const complex<R> approx = approxResults[k];
 
             // Compute the 'exact' answer
             complex<R> truth(0,0);
+            const Array<P,d> xP( x );
             for( std::size_t m=0; m<numSources; ++m )
             {
-                complex<R> beta = 
-                    ImagExp<R>( phase(x,globalSources[m].p) );
-                truth += amplitude(x,globalSources[m].p)*
-                         beta*globalSources[m].magnitude;
+                const Array<P,d> p( globalSources[m].p );
+                complex<P> beta = 
+                    EvaluateAmplitude( amplitude, xP, p )*
+                    ImagExp<P>( EvaluatePhase( phase, xP, p ) );
+                truth += complex<R>(beta)*globalSources[m].magnitude;
             }
             const complex<R> error = approx-truth;
 
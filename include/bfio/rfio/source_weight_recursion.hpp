@@ -30,40 +30,55 @@
 
 #include "bfio/functors/phase.hpp"
 
+#include "bfio/tools/map_kernels.hpp"
 #include "bfio/tools/special_functions.hpp"
 
 #include "bfio/rfio/context.hpp"
+#include "bfio/rfio/tensor_imag_exp_batch.hpp"
+#include "bfio/rfio/workspace.hpp"
 
 namespace bfio {
 namespace rfio {
 
+// Each interaction owns the weight grids of every phase in 'phases' and of
+// every right-hand side (see Workspace), and they are all updated at once.
+
 // 1d specialization
-template<typename R,std::size_t q>
+template<typename R,std::size_t q,class PhaseT>
 void
 SourceWeightRecursion
 ( const rfio::Context<R,1,q>& context,
   const Plan<1>& plan,
-  const Phase<R,1>& phase,
+  const std::vector<const PhaseT*>& phases,
   const std::size_t level,
   const Array<R,1>& x0A,
   const Array<R,1>& p0B,
   const Array<R,1>& wB,
   const std::size_t parentInteractionOffset,
+  const std::size_t childInteractionStride,
   const WeightGridList<R,1,q>& oldWeightGridList,
-        WeightGrid<R,1,q>& weightGrid )
+        WeightGridView<R,1,q> weightGrid,
+        rfio::Workspace<R,1,q>& workspace )
 {
-    std::memset( weightGrid.Buffer(), 0, 2*q*sizeof(R) );
+    typedef typename PhaseReal<R>::Type P;
+    const std::size_t numPhases = phases.size();
+    const std::size_t numRHS = workspace.numRHS;
+    const std::size_t numGrids = numPhases*numRHS;
+
+    std::memset( weightGrid.Buffer(), 0, 2*q*numGrids*sizeof(R) );
 
     const std::size_t log2NumMergingProcesses = 
         plan.GetLog2NumMergingProcesses( level );
     const std::vector<R>& leftMap = context.GetLeftChebyshevMap();
     const std::vector<R>& rightMap = context.GetRightChebyshevMap();
 
-    std::vector<R> phiResults;
-    std::vector<R> sinResults;
-    std::vector<R> cosResults;
-    std::vector< Array<R,1> > xPoint( 1, x0A );
-    std::vector< Array<R,1> > pPoints( q );
+    const R* sinFactors;
+    const R* cosFactors;
+    std::vector< Array<P,1> >& xPoint = workspace.xPoints;
+    std::vector< Array<P,1> >& pPoints = workspace.pPoints;
+    xPoint.resize( 1 );
+    xPoint[0] = x0A;
+    pPoints.resize( q );
     const std::vector< Array<R,1> >& sourceChildGrids = 
         context.GetSourceChildGrids();
     for( std::size_t cLocal=0;
@@ -73,12 +88,13 @@ SourceWeightRecursion
         //--------------------------------------------------------------------//
         // Step 1                                                             //
         //--------------------------------------------------------------------//
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
+        const std::size_t interactionIndex = 
+            parentInteractionOffset + cLocal*childInteractionStride;
         const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
 
         // Form the set of p points to evaluate
         {
-            R* RESTRICT pPointsBuffer = &pPoints[0][0];
+            P* RESTRICT pPointsBuffer = &pPoints[0][0];
             const R* RESTRICT sourceChildBuffer = &sourceChildGrids[c*q][0];
             for( std::size_t tPrime=0; tPrime<q; ++tPrime )
                 pPointsBuffer[tPrime] = 
@@ -86,44 +102,48 @@ SourceWeightRecursion
         }
 
         // Form the phase factors
-        phase.BatchEvaluate( xPoint, pPoints, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-
-        WeightGrid<R,1,q> scaledWeightGrid;
+        for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
         {
-            R* RESTRICT scaledRealBuffer = scaledWeightGrid.RealBuffer();
-            R* RESTRICT scaledImagBuffer = scaledWeightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT oldRealBuffer = 
-                oldWeightGridList[interactionIndex].RealBuffer();
-            const R* RESTRICT oldImagBuffer = 
-                oldWeightGridList[interactionIndex].ImagBuffer();
-            for( std::size_t tPrime=0; tPrime<q; ++tPrime )
+            StoredImagExpBatch<q>
+            ( *phases[phaseIndex], xPoint, pPoints, workspace, 
+              sinFactors, cosFactors );
+
+            for( std::size_t grid=phaseIndex*numRHS; 
+                 grid<(phaseIndex+1)*numRHS; ++grid )
             {
-                const R realWeight = oldRealBuffer[tPrime];
-                const R imagWeight = oldImagBuffer[tPrime];
-                const R realPhase = cosBuffer[tPrime];
-                const R imagPhase = sinBuffer[tPrime];
-                scaledRealBuffer[tPrime] = 
-                    realPhase*realWeight - imagPhase*imagWeight;
-                scaledImagBuffer[tPrime] =
-                    imagPhase*realWeight + realPhase*imagWeight;
+                R* RESTRICT scaledRealBuffer = 
+                    &workspace.scaledWeights[grid*2*q];
+                R* RESTRICT scaledImagBuffer = 
+                    &workspace.scaledWeights[grid*2*q+q];
+                const R* RESTRICT cosBuffer = &cosFactors[0];
+                const R* RESTRICT sinBuffer = &sinFactors[0];
+                const std::size_t oldGrid = interactionIndex*numGrids+grid;
+                const R* RESTRICT oldRealBuffer = 
+                    oldWeightGridList[oldGrid].RealBuffer();
+                const R* RESTRICT oldImagBuffer = 
+                    oldWeightGridList[oldGrid].ImagBuffer();
+                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
+                {
+                    const R realWeight = oldRealBuffer[tPrime];
+                    const R imagWeight = oldImagBuffer[tPrime];
+                    const R realPhase = cosBuffer[tPrime];
+                    const R imagPhase = sinBuffer[tPrime];
+                    scaledRealBuffer[tPrime] = 
+                        realPhase*realWeight - imagPhase*imagWeight;
+                    scaledImagBuffer[tPrime] =
+                        imagPhase*realWeight + realPhase*imagWeight;
+                }
             }
         }
 
         //--------------------------------------------------------------------//
         // Step 2                                                             //
         //--------------------------------------------------------------------//
-        // TODO: Create preprocessor flag for switching to two Gemv's, as
-        //       Gemm is probably not optimized for only 2 right-hand sides.
         {
             const R* mapBuffer = ( c&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'N', 'N', q, 2, q,
-              (R)1, mapBuffer,                 q,
-                    scaledWeightGrid.Buffer(), q,
-              (R)1,       weightGrid.Buffer(), q );
+            MapColumns<R,q>
+            ( 'N', 2*numGrids, mapBuffer, &workspace.scaledWeights[0], 
+              (R)1, weightGrid.Buffer() );
         }
     }
 
@@ -132,218 +152,106 @@ SourceWeightRecursion
     //------------------------------------------------------------------------//
     const std::vector< Array<R,1> >& chebyshevGrid = context.GetChebyshevGrid();
     {
-        R* RESTRICT pPointsBuffer = &pPoints[0][0];
+        P* RESTRICT pPointsBuffer = &pPoints[0][0];
         const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
         for( std::size_t t=0; t<q; ++t )
             pPointsBuffer[t] = p0B[0] + wB[0]*chebyshevBuffer[t];
     }
-    phase.BatchEvaluate( xPoint, pPoints, phiResults );
-    SinCosBatch( phiResults, sinResults, cosResults );
-    {
-        R* RESTRICT realBuffer = weightGrid.RealBuffer();
-        R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-        const R* RESTRICT cosBuffer = &cosResults[0];
-        const R* RESTRICT sinBuffer = &sinResults[0];
-        for( std::size_t t=0; t<q; ++t )
-        {
-            const R realPhase = cosBuffer[t];
-            const R imagPhase = -sinBuffer[t];
-            const R realWeight = realBuffer[t];
-            const R imagWeight = imagBuffer[t];
-            realBuffer[t] = realPhase*realWeight - imagPhase*imagWeight;
-            imagBuffer[t] = imagPhase*realWeight + realPhase*imagWeight;
-        }
-    }
-}
-
-// 2d specialization
-template<typename R,std::size_t q>
-void
-SourceWeightRecursion
-( const rfio::Context<R,2,q>& context,
-  const Plan<2>& plan,
-  const Phase<R,2>& phase,
-  const std::size_t level,
-  const Array<R,2>& x0A,
-  const Array<R,2>& p0B,
-  const Array<R,2>& wB,
-  const std::size_t parentInteractionOffset,
-  const WeightGridList<R,2,q>& oldWeightGridList,
-        WeightGrid<R,2,q>& weightGrid )
-{
-    std::memset( weightGrid.Buffer(), 0, 2*q*q*sizeof(R) );
-
-    const std::size_t log2NumMergingProcesses = 
-        plan.GetLog2NumMergingProcesses( level );
-    const std::vector<R>& leftMap = context.GetLeftChebyshevMap();
-    const std::vector<R>& rightMap = context.GetRightChebyshevMap();
-
-    std::vector<R> phiResults;
-    std::vector<R> sinResults;
-    std::vector<R> cosResults;
-    std::vector< Array<R,2> > xPoint( 1, x0A );
-    std::vector< Array<R,2> > pPoints( q*q );
-    const std::vector< Array<R,2> >& sourceChildGrids = 
-        context.GetSourceChildGrids();
-    for( std::size_t cLocal=0; 
-         cLocal<(1u<<(2-log2NumMergingProcesses));
-         ++cLocal )
+    for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
     {
-        //--------------------------------------------------------------------//
-        // Step 1                                                             //
-        //--------------------------------------------------------------------//
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
-        const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
-
-        // Form the set of p points to evaluate
+        StoredImagExpBatch<q>
+        ( *phases[phaseIndex], xPoint, pPoints, workspace, 
+          sinFactors, cosFactors );
+        for( std::size_t grid=phaseIndex*numRHS; 
+             grid<(phaseIndex+1)*numRHS; ++grid )
         {
-            R* RESTRICT pPointsBuffer = &pPoints[0][0];
-            const R* RESTRICT wBBuffer = &wB[0];
-            const R* RESTRICT p0Buffer = &p0B[0];
-            const R* RESTRICT sourceChildBuffer = &sourceChildGrids[c*q*q][0];
-            for( std::size_t tPrime=0; tPrime<q*q; ++tPrime )
-                for( std::size_t j=0; j<2; ++j )
-                    pPointsBuffer[tPrime*2+j] = 
-                        p0Buffer[j] + 
-                        wBBuffer[j]*sourceChildBuffer[tPrime*2+j];
-        }
-
-        // Form the phase factors
-        phase.BatchEvaluate( xPoint, pPoints, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-
-        WeightGrid<R,2,q> scaledWeightGrid;
-        {
-            R* RESTRICT scaledRealBuffer = scaledWeightGrid.RealBuffer();
-            R* RESTRICT scaledImagBuffer = scaledWeightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT oldRealBuffer = 
-                oldWeightGridList[interactionIndex].RealBuffer();
-            const R* RESTRICT oldImagBuffer =
-                oldWeightGridList[interactionIndex].ImagBuffer();
-            for( std::size_t tPrime=0; tPrime<q*q; ++tPrime )
+            R* RESTRICT realBuffer = weightGrid.Buffer() + grid*2*q;
+            R* RESTRICT imagBuffer = weightGrid.Buffer() + grid*2*q + q;
+            const R* RESTRICT cosBuffer = &cosFactors[0];
+            const R* RESTRICT sinBuffer = &sinFactors[0];
+            for( std::size_t t=0; t<q; ++t )
             {
-                const R realWeight = oldRealBuffer[tPrime];
-                const R imagWeight = oldImagBuffer[tPrime];
-                const R realPhase = cosBuffer[tPrime];
-                const R imagPhase = sinBuffer[tPrime];
-                scaledRealBuffer[tPrime] =
-                    realPhase*realWeight - imagPhase*imagWeight;
-                scaledImagBuffer[tPrime] = 
-                    imagPhase*realWeight + realPhase*imagWeight;
+                const R realPhase = cosBuffer[t];
+                const R imagPhase = -sinBuffer[t];
+                const R realWeight = realBuffer[t];
+                const R imagWeight = imagBuffer[t];
+                realBuffer[t] = realPhase*realWeight - imagPhase*imagWeight;
+                imagBuffer[t] = imagPhase*realWeight + realPhase*imagWeight;
             }
         }
-
-        //--------------------------------------------------------------------//
-        // Step 2                                                             //
-        //--------------------------------------------------------------------//
-        // Interpolate over the first dimension. We can take care of the real 
-        // and imaginary weights at once.
-        WeightGrid<R,2,q> tempWeightGrid;
-        {
-            const R* mapBuffer = ( c&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'N', 'N', q, 2*q, q,
-              (R)1, mapBuffer,                 q,
-                    scaledWeightGrid.Buffer(), q,
-              (R)0,   tempWeightGrid.Buffer(), q );
-        }
-
-        // Interpolate over the second dimension. We can get away with applying
-        // our maps with a gemm on the real and imag parts.
-        {
-            const R* mapBuffer = ( (c>>1)&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'N', 'T', q, q, q,
-              (R)1, tempWeightGrid.RealBuffer(), q,
-                    mapBuffer,                   q,
-              (R)1, weightGrid.RealBuffer(),     q );
-            Gemm
-            ( 'N', 'T', q, q, q,
-              (R)1, tempWeightGrid.ImagBuffer(), q,
-                    mapBuffer,                   q,
-              (R)1, weightGrid.ImagBuffer(),     q );
-        }
-    }
-
-    //------------------------------------------------------------------------//
-    // Step 3                                                                 //
-    //------------------------------------------------------------------------//
-    const std::vector< Array<R,2> >& chebyshevGrid = context.GetChebyshevGrid();
-    {
-        R* RESTRICT pPointsBuffer = &pPoints[0][0];
-        const R* RESTRICT wBBuffer = &wB[0];
-        const R* RESTRICT p0Buffer = &p0B[0];
-        const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
-        for( std::size_t t=0; t<q*q; ++t )
-            for( std::size_t j=0; j<2; ++j )
-                pPointsBuffer[t*2+j] = 
-                    p0Buffer[j] + wBBuffer[j]*chebyshevBuffer[t*2+j];
-    }
-    phase.BatchEvaluate( xPoint, pPoints, phiResults );
-    SinCosBatch( phiResults, sinResults, cosResults );
-    {
-        R* RESTRICT realBuffer = weightGrid.RealBuffer();
-        R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-        const R* RESTRICT cosBuffer = &cosResults[0];
-        const R* RESTRICT sinBuffer = &sinResults[0];
-        for( std::size_t t=0; t<q*q; ++t )
-        {
-            const R realPhase = cosBuffer[t];
-            const R imagPhase = -sinBuffer[t];
-            const R realWeight = realBuffer[t];
-            const R imagWeight = imagBuffer[t];
-            realBuffer[t] = realPhase*realWeight - imagPhase*imagWeight;
-            imagBuffer[t] = imagPhase*realWeight + realPhase*imagWeight;
-        }
     }
 }
 
-// Fallback for 3d and above
-template<typename R,std::size_t d,std::size_t q>
+// Fallback for 2d and above
+template<typename R,std::size_t d,std::size_t q,class PhaseT>
 void
 SourceWeightRecursion
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Phase<R,d>& phase,
+  const std::vector<const PhaseT*>& phases,
   const std::size_t level,
   const Array<R,d>& x0A,
   const Array<R,d>& p0B,
   const Array<R,d>& wB,
   const std::size_t parentInteractionOffset,
+  const std::size_t childInteractionStride,
   const WeightGridList<R,d,q>& oldWeightGridList,
-        WeightGrid<R,d,q>& weightGrid )
+        WeightGridView<R,d,q> weightGrid,
+        rfio::Workspace<R,d,q>& workspace )
 {
+    typedef typename PhaseReal<R>::Type P;
     const std::size_t q_to_d = Pow<q,d>::val;
-    std::memset( weightGrid.Buffer(), 0, 2*q_to_d*sizeof(R) );
+    const std::size_t numPhases = phases.size();
+    const std::size_t numRHS = workspace.numRHS;
+    const std::size_t numGrids = numPhases*numRHS;
+    const std::size_t childSize = 2*q_to_d*numGrids;
 
     const std::size_t log2NumMergingProcesses = 
         plan.GetLog2NumMergingProcesses( level );
+    const std::size_t numLocalChildren = 1u<<(d-log2NumMergingProcesses);
     const std::vector<R>& leftMap = context.GetLeftChebyshevMap();
     const std::vector<R>& rightMap = context.GetRightChebyshevMap();
 
-    std::vector<R> phiResults;
-    std::vector<R> sinResults;
-    std::vector<R> cosResults;
-    std::vector< Array<R,d> > xPoint( 1, x0A );
-    std::vector< Array<R,d> > pPoints( q_to_d );
+    // Order the local children so that those which use the left map in the
+    // first dimension come first. Both halves can then be interpolated in 
+    // the first dimension with a single gemm each.
+    std::vector<std::size_t>& children = workspace.children;
+    children.resize( numLocalChildren );
+    std::size_t numLeftChildren = 0;
+    for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
+        if( !(plan.LocalToClusterSourceIndex( level, cLocal )&1) )
+            ++numLeftChildren;
+    for( std::size_t cLocal=0, left=0, right=numLeftChildren; 
+         cLocal<numLocalChildren; ++cLocal )
+    {
+        const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
+        children[ c&1 ? right++ : left++ ] = cLocal;
+    }
+
+    const R* sinFactors;
+    const R* cosFactors;
+    std::vector< Array<P,d> >& xPoint = workspace.xPoints;
+    std::vector< Array<P,d> >& pPoints = workspace.pPoints;
+    xPoint.resize( 1 );
+    xPoint[0] = x0A;
+    pPoints.resize( q_to_d );
     const std::vector< Array<R,d> >& sourceChildGrids = 
         context.GetSourceChildGrids();
-    WeightGrid<R,d,q> scaledWeightGrid;
-    for( std::size_t cLocal=0;
-         cLocal<(1u<<(d-log2NumMergingProcesses));
-         ++cLocal )
+    std::vector<R>& scaledWeights = workspace.scaledWeights;
+    std::vector<R>& tempWeights = workspace.tempWeights;
+    for( std::size_t k=0; k<numLocalChildren; ++k )
     {
         //--------------------------------------------------------------------//
         // Step 1                                                             //
         //--------------------------------------------------------------------//
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
+        const std::size_t cLocal = children[k];
+        const std::size_t interactionIndex = 
+            parentInteractionOffset + cLocal*childInteractionStride;
         const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
 
         // Form the set of p points to evaluate
         {
-            R* RESTRICT pPointsBuffer = &pPoints[0][0];
+            P* RESTRICT pPointsBuffer = &pPoints[0][0];
             const R* RESTRICT wBBuffer = &wB[0];
             const R* RESTRICT p0BBuffer = &p0B[0];
             const R* RESTRICT sourceChildBuffer = 
@@ -356,144 +264,101 @@ SourceWeightRecursion
         }
 
         // Form the phase factors
-        phase.BatchEvaluate( xPoint, pPoints, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-
+        for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
         {
-            R* RESTRICT scaledRealBuffer = scaledWeightGrid.RealBuffer();
-            R* RESTRICT scaledImagBuffer = scaledWeightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT oldRealBuffer = 
-                oldWeightGridList[interactionIndex].RealBuffer();
-            const R* RESTRICT oldImagBuffer = 
-                oldWeightGridList[interactionIndex].ImagBuffer();
-            for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+            StoredImagExpBatch<q>
+            ( *phases[phaseIndex], xPoint, pPoints, workspace, 
+              sinFactors, cosFactors );
+
+            for( std::size_t grid=phaseIndex*numRHS; 
+                 grid<(phaseIndex+1)*numRHS; ++grid )
             {
-                const R realWeight = oldRealBuffer[tPrime];
-                const R imagWeight = oldImagBuffer[tPrime];
-                const R realPhase = cosBuffer[tPrime];
-                const R imagPhase = sinBuffer[tPrime];
-                scaledRealBuffer[tPrime] = 
-                    realPhase*realWeight - imagPhase*imagWeight;
-                scaledImagBuffer[tPrime] = 
-                    imagPhase*realWeight + realPhase*imagWeight;
+                R* RESTRICT scaledRealBuffer = 
+                    &scaledWeights[k*childSize+grid*2*q_to_d];
+                R* RESTRICT scaledImagBuffer = 
+                    &scaledWeights[k*childSize+grid*2*q_to_d+q_to_d];
+                const R* RESTRICT cosBuffer = &cosFactors[0];
+                const R* RESTRICT sinBuffer = &sinFactors[0];
+                const std::size_t oldGrid = interactionIndex*numGrids+grid;
+                const R* RESTRICT oldRealBuffer = 
+                    oldWeightGridList[oldGrid].RealBuffer();
+                const R* RESTRICT oldImagBuffer = 
+                    oldWeightGridList[oldGrid].ImagBuffer();
+                for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+                {
+                    const R realWeight = oldRealBuffer[tPrime];
+                    const R imagWeight = oldImagBuffer[tPrime];
+                    const R realPhase = cosBuffer[tPrime];
+                    const R imagPhase = sinBuffer[tPrime];
+                    scaledRealBuffer[tPrime] = 
+                        realPhase*realWeight - imagPhase*imagWeight;
+                    scaledImagBuffer[tPrime] = 
+                        imagPhase*realWeight + realPhase*imagWeight;
+                }
             }
         }
+    }
 
-        //--------------------------------------------------------------------//
-        // Step 2                                                             //
-        //--------------------------------------------------------------------//
-
-        // Interpolate over the first dimension. This can be performed with a 
-        // single gemm that takes care of both the real and imaginary weights.
-        WeightGrid<R,d,q> tempWeightGrid;
-        {
-            const R* mapBuffer = ( c&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'N', 'N', q, 2*Pow<q,d-1>::val, q,
-              (R)1, mapBuffer,                 q,
-                    scaledWeightGrid.Buffer(), q,
-              (R)0,   tempWeightGrid.Buffer(), q );
-        }
+    //------------------------------------------------------------------------//
+    // Step 2                                                                 //
+    //------------------------------------------------------------------------//
 
-        // Interpolate over the second dimension. We can do so by using 
-        // q^(d-2) gemms on right-hand sides of size q x q for both the real 
-        // and imaginary buffers.
+    // Interpolate over the first dimension. The real and imaginary weights of
+    // every phase and right-hand side of every child sharing a map are 
+    // handled at once. The products are only batched over the children of 
+    // this interaction: stacking every interaction of the level would need
+    // scratch space for the scaled weights of a thread's whole share of the
+    // level, whereas the caller updates the weights in place one group of 
+    // 2^d interactions at a time.
+    const std::size_t numRightChildren = numLocalChildren-numLeftChildren;
+    MapColumns<R,q>
+    ( 'N', numLeftChildren*numGrids*2*Pow<q,d-1>::val, &leftMap[0], 
+      &scaledWeights[0], (R)0, &tempWeights[0] );
+    MapColumns<R,q>
+    ( 'N', numRightChildren*numGrids*2*Pow<q,d-1>::val, &rightMap[0],
+      &scaledWeights[numLeftChildren*childSize], (R)0, 
+      &tempWeights[numLeftChildren*childSize] );
+
+    // Interpolate over the remaining dimensions. Each child is a stack of 
+    // q^j x q slices which are right-multiplied by the transpose of its map,
+    // so we handle all of the slices of consecutive children which share a 
+    // map at once.
+    std::size_t q_to_j = q;
+    for( std::size_t j=1; j<d; ++j )
+    {
+        const std::size_t numSlicesPerChild = childSize/(q_to_j*q);
+        const R* readBuffer = 
+            ( j&1 ? &tempWeights[0] : &scaledWeights[0] );
+        R* writeBuffer = 
+            ( j&1 ? &scaledWeights[0] : &tempWeights[0] );
+        for( std::size_t k=0; k<numLocalChildren; )
         {
-            R* realWriteBuffer = 
-                ( d==2 ? weightGrid.RealBuffer()
-                       : scaledWeightGrid.RealBuffer() );
-            R* imagWriteBuffer = 
-                ( d==2 ? weightGrid.ImagBuffer()
-                       : scaledWeightGrid.ImagBuffer() );
-            const R* realReadBuffer = tempWeightGrid.RealBuffer();
-            const R* imagReadBuffer = tempWeightGrid.ImagBuffer();
-            const R* mapBuffer = ( (c>>1)&1 ? &rightMap[0] : &leftMap[0] );
-            for( std::size_t w=0; w<Pow<q,d-2>::val; ++w )
-            {
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &realReadBuffer[w*q*q],  q,
-                        mapBuffer,               q,
-                  (R)0, &realWriteBuffer[w*q*q], q );
-            }
-            for( std::size_t w=0; w<Pow<q,d-2>::val; ++w )
-            {
-                Gemm
-                ( 'N', 'T', q, q, q,
-                  (R)1, &imagReadBuffer[w*q*q],  q,
-                        mapBuffer,               q,
-                  (R)0, &imagWriteBuffer[w*q*q], q );
-            }
+            const std::size_t c = 
+                plan.LocalToClusterSourceIndex( level, children[k] );
+            std::size_t kEnd = k+1;
+            while( kEnd < numLocalChildren &&
+                   !(((plan.LocalToClusterSourceIndex( level, children[kEnd] )
+                       ^ c)>>j)&1) )
+                ++kEnd;
+            const R* mapBuffer = ( (c>>j)&1 ? &rightMap[0] : &leftMap[0] );
+            MapRows<R,q>
+            ( 'T', q_to_j, (kEnd-k)*numSlicesPerChild, mapBuffer, 
+              &readBuffer[k*childSize], (R)0, &writeBuffer[k*childSize],
+              workspace.mapRowsBatch );
+            k = kEnd;
         }
+        q_to_j *= q;
+    }
 
-        // Interpolate over the remaining dimensions. These are necessarily 
-        // more expensive because we cannot make use of gemm.
-        //
-        // TODO: Compile flag for making the left and right maps transposed 
-        //       to get contiguous memory access in the summations.
-        //
-        // TODO: Check if loading discontinuous chunks is faster than repeatedly
-        //       striding over them.
-        std::size_t q_to_j = q*q;
-        for( std::size_t j=2; j<d; ++j )
-        {
-            const std::size_t stride = q_to_j;
-
-            R* realWriteBuffer = 
-                ( j==d-1 ? weightGrid.RealBuffer()
-                         : ( j&1 ? scaledWeightGrid.RealBuffer()
-                                 : tempWeightGrid.RealBuffer() ) );
-            R* imagWriteBuffer = 
-                ( j==d-1 ? weightGrid.ImagBuffer()
-                         : ( j&1 ? scaledWeightGrid.ImagBuffer()
-                                 : tempWeightGrid.ImagBuffer() ) );
-            const R* realReadBuffer = 
-                ( j&1 ? tempWeightGrid.RealBuffer() 
-                      : scaledWeightGrid.RealBuffer() );
-            const R* imagReadBuffer = 
-                ( j&1 ? tempWeightGrid.ImagBuffer()
-                      : scaledWeightGrid.ImagBuffer() );
-            const R* RESTRICT mapBuffer = 
-                ( (c>>j)&1 ? &rightMap[0] : &leftMap[0] );
-
-            if( j != d-1 )
-            {
-                std::memset( realWriteBuffer, 0, q_to_d*sizeof(R) );
-                std::memset( imagWriteBuffer, 0, q_to_d*sizeof(R) );
-            }
-            for( std::size_t p=0; p<q_to_d/(q_to_j*q); ++p )
-            {
-                const std::size_t offset = p*(q_to_j*q);
-                R* RESTRICT offsetRealWriteBuffer = &realWriteBuffer[offset];
-                R* RESTRICT offsetImagWriteBuffer = &imagWriteBuffer[offset];
-                const R* RESTRICT offsetRealReadBuffer = &realReadBuffer[offset];
-                const R* RESTRICT offsetImagReadBuffer = &imagReadBuffer[offset];
-                for( std::size_t w=0; w<q_to_j; ++w )
-                {
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                        {
-                            offsetRealWriteBuffer[w+t*stride] +=
-                                mapBuffer[t+tPrime*q] * 
-                                offsetRealReadBuffer[w+tPrime*stride];
-                        }
-                    }
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                        {
-                            offsetImagWriteBuffer[w+t*stride] +=
-                                mapBuffer[t+tPrime*q] *
-                                offsetImagReadBuffer[w+tPrime*stride];
-                        }
-                    }
-                }
-            }
-            q_to_j *= q;
-        }
+    // Sum the contributions from each of the children
+    {
+        const R* RESTRICT childBuffer = 
+            ( (d-1)&1 ? &scaledWeights[0] : &tempWeights[0] );
+        R* RESTRICT buffer = weightGrid.Buffer();
+        std::memcpy( buffer, childBuffer, childSize*sizeof(R) );
+        for( std::size_t k=1; k<numLocalChildren; ++k )
+            for( std::size_t t=0; t<childSize; ++t )
+                buffer[t] += childBuffer[k*childSize+t];
     }
 
     //------------------------------------------------------------------------//
@@ -501,7 +366,7 @@ SourceWeightRecursion
     //------------------------------------------------------------------------//
     const std::vector< Array<R,d> >& chebyshevGrid = context.GetChebyshevGrid();
     {
-        R* RESTRICT pPointsBuffer = &pPoints[0][0];
+        P* RESTRICT pPointsBuffer = &pPoints[0][0];
         const R* RESTRICT wBBuffer = &wB[0];
         const R* RESTRICT p0BBuffer = &p0B[0];
         const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
@@ -510,21 +375,28 @@ SourceWeightRecursion
                 pPointsBuffer[t*d+j] =  
                     p0BBuffer[j] + wBBuffer[j]*chebyshevBuffer[t*d+j];
     }
-    phase.BatchEvaluate( xPoint, pPoints, phiResults );
-    SinCosBatch( phiResults, sinResults, cosResults );
+    for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
     {
-        R* RESTRICT realBuffer = weightGrid.RealBuffer();
-        R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-        const R* RESTRICT cosBuffer = &cosResults[0];
-        const R* RESTRICT sinBuffer = &sinResults[0];
-        for( std::size_t t=0; t<q_to_d; ++t )
+        StoredImagExpBatch<q>
+        ( *phases[phaseIndex], xPoint, pPoints, workspace, 
+          sinFactors, cosFactors );
+        for( std::size_t grid=phaseIndex*numRHS; 
+             grid<(phaseIndex+1)*numRHS; ++grid )
         {
-            const R realPhase = cosBuffer[t];
-            const R imagPhase = -sinBuffer[t];
-            const R realWeight = realBuffer[t];
-            const R imagWeight = imagBuffer[t];
-            realBuffer[t] = realPhase*realWeight - imagPhase*imagWeight;
-            imagBuffer[t] = imagPhase*realWeight + realPhase*imagWeight;
+            R* RESTRICT realBuffer = weightGrid.Buffer() + grid*2*q_to_d;
+            R* RESTRICT imagBuffer = 
+                weightGrid.Buffer() + grid*2*q_to_d + q_to_d;
+            const R* RESTRICT cosBuffer = &cosFactors[0];
+            const R* RESTRICT sinBuffer = &sinFactors[0];
+            for( std::size_t t=0; t<q_to_d; ++t )
+            {
+                const R realPhase = cosBuffer[t];
+                const R imagPhase = -sinBuffer[t];
+                const R realWeight = realBuffer[t];
+                const R imagWeight = imagBuffer[t];
+                realBuffer[t] = realPhase*realWeight - imagPhase*imagWeight;
+                imagBuffer[t] = imagPhase*realWeight + realPhase*imagWeight;
+            }
         }
     }
 }
@@ -18,8 +18,10 @@
 #ifndef BFIO_RFIO_SWITCH_TO_TARGET_INTERP_HPP
 #define BFIO_RFIO_SWITCH_TO_TARGET_INTERP_HPP 1
 
+#include <algorithm>
 #include <cstddef>
 #include <complex>
+#include <cstring>
 #include <vector>
 
 #include "bfio/structures/array.hpp"
@@ -29,18 +31,126 @@
 #include "bfio/structures/weight_grid.hpp"
 #include "bfio/structures/weight_grid_list.hpp"
 
+#include "bfio/functors/amplitude.hpp"
+#include "bfio/functors/phase.hpp"
+
+#include "bfio/tools/reverse_constrained_htree_index.hpp"
+#include "bfio/tools/threads.hpp"
+#include "bfio/tools/unflatten_constrained_htree_index.hpp"
+
 #include "bfio/rfio/context.hpp"
+#include "bfio/rfio/phase_factor_store.hpp"
+#include "bfio/rfio/tensor_imag_exp_batch.hpp"
+#include "bfio/rfio/workspace.hpp"
 
 namespace bfio {
 namespace rfio {
 
+namespace switch_to_target_interp {
+
+// y := E x, where E is the q^d x q^d matrix of phase factors whose sines and 
+// cosines are stored in row-major order
+template<typename R,std::size_t d,std::size_t q>
+inline void
+ApplyPhaseMatrix
+( const R* RESTRICT sinBuffer, 
+  const R* RESTRICT cosBuffer,
+  const R* RESTRICT realWeights, 
+  const R* RESTRICT imagWeights,
+        R* RESTRICT realResults, 
+        R* RESTRICT imagResults )
+{
+    const std::size_t q_to_d = Pow<q,d>::val;
+    for( std::size_t t=0; t<q_to_d; ++t )
+    {
+        R realResult = 0;
+        R imagResult = 0;
+        for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+        {
+            const R realWeight = realWeights[tPrime];
+            const R imagWeight = imagWeights[tPrime];
+            const R realPhase = cosBuffer[t*q_to_d+tPrime];
+            const R imagPhase = sinBuffer[t*q_to_d+tPrime];
+            realResult += realPhase*realWeight - imagPhase*imagWeight;
+            imagResult += imagPhase*realWeight + realPhase*imagWeight;
+        }
+        realResults[t] = realResult;
+        imagResults[t] = imagResult;
+    }
+}
+
+// Same as above, but for a separable phase, whose matrix of phase factors is
+// the Kronecker product of the q x q tables of its terms (see 
+// SeparableImagExpTables). It is applied one dimension at a time, and the
+// weights are overwritten in the process.
 template<typename R,std::size_t d,std::size_t q>
+inline void
+ApplySeparablePhaseMatrix
+( const R* sinTables, 
+  const R* cosTables,
+        R* realWeights, 
+        R* imagWeights,
+        R* realResults, 
+        R* imagResults )
+{
+    const std::size_t q_to_d = Pow<q,d>::val;
+    R* readRealBuffer = realWeights;
+    R* readImagBuffer = imagWeights;
+    R* writeRealBuffer = realResults;
+    R* writeImagBuffer = imagResults;
+    std::size_t q_to_j = 1;
+    for( std::size_t j=0; j<d; ++j, q_to_j*=q )
+    {
+        const R* RESTRICT sinTable = &sinTables[j*q*q];
+        const R* RESTRICT cosTable = &cosTables[j*q*q];
+        const std::size_t numBlocks = q_to_d/(q_to_j*q);
+        std::memset( writeRealBuffer, 0, q_to_d*sizeof(R) );
+        std::memset( writeImagBuffer, 0, q_to_d*sizeof(R) );
+        for( std::size_t b=0; b<numBlocks; ++b )
+        {
+            for( std::size_t t=0; t<q; ++t )
+            {
+                R* RESTRICT realColumn = &writeRealBuffer[(b*q+t)*q_to_j];
+                R* RESTRICT imagColumn = &writeImagBuffer[(b*q+t)*q_to_j];
+                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
+                {
+                    const R realPhase = cosTable[t*q+tPrime];
+                    const R imagPhase = sinTable[t*q+tPrime];
+                    const R* RESTRICT oldRealColumn = 
+                        &readRealBuffer[(b*q+tPrime)*q_to_j];
+                    const R* RESTRICT oldImagColumn = 
+                        &readImagBuffer[(b*q+tPrime)*q_to_j];
+                    for( std::size_t w=0; w<q_to_j; ++w )
+                    {
+                        const R realWeight = oldRealColumn[w];
+                        const R imagWeight = oldImagColumn[w];
+                        realColumn[w] += 
+                            realPhase*realWeight - imagPhase*imagWeight;
+                        imagColumn[w] += 
+                            imagPhase*realWeight + realPhase*imagWeight;
+                    }
+                }
+            }
+        }
+        std::swap( readRealBuffer, writeRealBuffer );
+        std::swap( readImagBuffer, writeImagBuffer );
+    }
+    if( readRealBuffer != realResults )
+    {
+        std::memcpy( realResults, readRealBuffer, q_to_d*sizeof(R) );
+        std::memcpy( imagResults, readImagBuffer, q_to_d*sizeof(R) );
+    }
+}
+
+} // switch_to_target_interp
+
+template<typename R,std::size_t d,std::size_t q,class PhaseT,class AmplitudeT>
 void
 SwitchToTargetInterp
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Amplitude<R,d>& amplitude,
-  const Phase<R,d>& phase,
+  const std::vector<const AmplitudeT*>& amplitudes,
+  const std::vector<const PhaseT*>& phases,
   const Box<R,d>& sourceBox,
   const Box<R,d>& targetBox,
   const Box<R,d>& mySourceBox,
@@ -49,10 +159,15 @@ SwitchToTargetInterp
   const std::size_t log2LocalTargetBoxes,
   const Array<std::size_t,d>& log2LocalSourceBoxesPerDim,
   const Array<std::size_t,d>& log2LocalTargetBoxesPerDim,
-        WeightGridList<R,d,q>& weightGridList )
+        WeightGridList<R,d,q>& weightGridList,
+  const std::size_t numRHS=1,
+        PhaseFactorStore<R>* store=0 )
 {
-    typedef std::complex<R> C;
+    typedef typename PhaseReal<R>::Type P;
     const std::size_t q_to_d = Pow<q,d>::val;
+    const std::size_t numLocalSourceBoxes = 1u<<log2LocalSourceBoxes;
+    const std::size_t numPhases = phases.size();
+    const std::size_t numGrids = numPhases*numRHS;
 
     // Compute the width of the nodes at level log2N/2
     const std::size_t N = plan.GetN();
@@ -65,23 +180,56 @@ SwitchToTargetInterp
         wB[j] = sourceBox.widths[j] / (1<<(log2N-level));
     }
 
-    std::vector<R> oldRealWeights( q_to_d );
-    std::vector<R> oldImagWeights( q_to_d );
-    const bool unitAmplitude = amplitude.IsUnity();
+    // Only the interactions in our team member's share are switched, and 
+    // the caller gathers the shares
+    std::size_t shareBegin, shareEnd;
+    plan.TeamShare
+    ( numLocalSourceBoxes<<log2LocalTargetBoxes, shareBegin, shareEnd );
+
+    // The full matrix of each pair of boxes and phase, including the 
+    // amplitude, may be stored for later applications
+    const bool recordMatrices = ( store != 0 && store->Recording() );
+    std::size_t numStoredMatrices = 0;
+    R* storedMatrices = 
+        ( store != 0 ? 
+          store->NextSegment
+          ( numPhases*(shareEnd-shareBegin), 2*q_to_d*q_to_d, 
+            numStoredMatrices ) : 0 );
     const std::vector< Array<R,d> >& chebyshevGrid = context.GetChebyshevGrid();
-    ConstrainedHTreeWalker<d> AWalker( log2LocalTargetBoxesPerDim );
-    for( std::size_t i=0; i<(1u<<log2LocalTargetBoxes); ++i, AWalker.Walk() )
+
+    // Each thread switches the interactions of its own target boxes with its
+    // own scratch space
+    std::vector< Workspace<R,d,q> > workspaces( MaxThreads() );
+#ifdef HYBRID
+#pragma omp parallel for schedule(static)
+#endif
+    for( std::size_t i=0; i<(1u<<log2LocalTargetBoxes); ++i )
     {
-        const Array<std::size_t,d> A = AWalker.State();
+        Workspace<R,d,q>& workspace = workspaces[ThreadNum()];
+        std::vector< Array<P,d> >& xPoints = workspace.xPoints;
+        std::vector< Array<P,d> >& pPoints = workspace.pPoints;
+        std::vector<P>& phiResults = workspace.phiResults;
+        std::vector<R>& sinResults = workspace.sinResults;
+        std::vector<R>& cosResults = workspace.cosResults;
+        ImagExpBuffers<P,R>& imagExpBuffers = workspace.imagExpBuffers;
+        R* oldRealWeights = &workspace.scaledWeights[0];
+        R* oldImagWeights = &workspace.scaledWeights[q_to_d];
+        R* scaledRealWeights = &workspace.scaledWeights[2*q_to_d];
+        R* scaledImagWeights = &workspace.scaledWeights[3*q_to_d];
+        R* realResults = &workspace.tempWeights[0];
+        R* imagResults = &workspace.tempWeights[q_to_d];
+
+        const Array<std::size_t,d> A = 
+            UnflattenConstrainedHTreeIndex( i, log2LocalTargetBoxesPerDim );
 
         // Compute the coordinates and center of this target box
         Array<R,d> x0A;
         for( std::size_t j=0; j<d; ++j )
             x0A[j] = myTargetBox.offsets[j] + (A[j]+0.5)*wA[j];
 
-        std::vector< Array<R,d> > xPoints( q_to_d );
+        xPoints.resize( q_to_d );
         {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
+            P* RESTRICT xPointsBuffer = &xPoints[0][0];
             const R* RESTRICT x0ABuffer = &x0A[0];
             const R* RESTRICT wABuffer = &wA[0];
             const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
@@ -91,15 +239,18 @@ SwitchToTargetInterp
                         x0ABuffer[j] + wABuffer[j]*chebyshevBuffer[t*d+j];
         }
 
-        std::vector<C> ampResults;
-        std::vector<R> phiResults;
-        std::vector<R> sinResults;
-        std::vector<R> cosResults;
+        std::vector< std::complex<P> > ampResults, xFactors, pFactors;
         ConstrainedHTreeWalker<d> BWalker( log2LocalSourceBoxesPerDim );
         for( std::size_t k=0; 
              k<(1u<<log2LocalSourceBoxes); 
              ++k, BWalker.Walk() )
         {
+            const std::size_t key = 
+                ReverseConstrainedHTreeIndex<d>( k, log2LocalSourceBoxes ) + 
+                (i<<log2LocalSourceBoxes);
+            if( key < shareBegin || key >= shareEnd )
+                continue;
+
             const Array<std::size_t,d> B = BWalker.State();
 
             // Compute the coordinates and center of this source box
@@ -107,9 +258,9 @@ SwitchToTargetInterp
             for( std::size_t j=0; j<d; ++j )
                 p0B[j] = mySourceBox.offsets[j] + (B[j]+0.5)*wB[j];
 
-            std::vector< Array<R,d> > pPoints( q_to_d );
+            pPoints.resize( q_to_d );
             {
-                R* RESTRICT pPointsBuffer = &pPoints[0][0];
+                P* RESTRICT pPointsBuffer = &pPoints[0][0];
                 const R* RESTRICT p0BBuffer = &p0B[0];
                 const R* RESTRICT wBBuffer = &wB[0];
                 const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
@@ -119,62 +270,243 @@ SwitchToTargetInterp
                             p0BBuffer[j] + wBBuffer[j]*chebyshevBuffer[t*d+j];
             }
 
-            phase.BatchEvaluate( xPoints, pPoints, phiResults );
-            SinCosBatch( phiResults, sinResults, cosResults );
-            const std::size_t key = k+(i<<log2LocalSourceBoxes);
-
-            std::memcpy
-            ( &oldRealWeights[0], weightGridList[key].RealBuffer(), 
-              q_to_d*sizeof(R) );
-            std::memcpy
-            ( &oldImagWeights[0], weightGridList[key].ImagBuffer(),
-              q_to_d*sizeof(R) );
-            std::memset( weightGridList[key].Buffer(), 0, 2*q_to_d*sizeof(R) );
-            R* RESTRICT realBuffer = weightGridList[key].RealBuffer();
-            R* RESTRICT imagBuffer = weightGridList[key].ImagBuffer();
-            const R* RESTRICT oldRealBuffer = &oldRealWeights[0];
-            const R* RESTRICT oldImagBuffer = &oldImagWeights[0];
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            if( unitAmplitude )
+            // Each phase has its own matrix, which is shared by the numRHS 
+            // weight grids of the phase
+            for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
             {
-                for( std::size_t t=0; t<q_to_d; ++t )
+                const PhaseT& phase = *phases[phaseIndex];
+                const AmplitudeT& amplitude = *amplitudes[phaseIndex];
+                const bool unitAmplitude = amplitude.IsUnity();
+                const bool separablePhase = phase.IsSeparable();
+
+                // If the amplitude is a short sum of products, 
+                //   a(x,p) = sum_r a_r(x) b_r(p),
+                // then each term is applied as a diagonal scaling on either
+                // side of the matrix of phase factors rather than by 
+                // evaluating a at every pair
+                const std::size_t amplitudeRank = 
+                    ( unitAmplitude ? 0 : amplitude.GetRank() );
+                const bool factoredAmplitude = ( amplitudeRank != 0 );
+                const std::size_t numTerms = 
+                    ( factoredAmplitude ? amplitudeRank : 1 );
+
+                const std::size_t matrixIndex = 
+                    (key-shareBegin)*numPhases + phaseIndex;
+                if( matrixIndex < numStoredMatrices )
                 {
-                    for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+                    // The imaginary parts of the matrix are stored before 
+                    // the real parts, as for the sines and cosines of phase
+                    // factors
+                    R* storedMatrix = 
+                        &storedMatrices[2*matrixIndex*q_to_d*q_to_d];
+                    if( recordMatrices )
                     {
-                        const R realWeight = oldRealBuffer[tPrime];
-                        const R imagWeight = oldImagBuffer[tPrime];
-                        const R realPhase = cosBuffer[t*q_to_d+tPrime];
-                        const R imagPhase = sinBuffer[t*q_to_d+tPrime];
-                        const R realBeta = 
-                            realPhase*realWeight - imagPhase*imagWeight;
-                        const R imagBeta = 
-                            imagPhase*realWeight + realPhase*imagWeight;
-                        realBuffer[t] += realBeta;
-                        imagBuffer[t] += imagBeta;
+                        TensorImagExpBatch<q>
+                        ( phase, xPoints, pPoints, 
+                          phiResults, sinResults, cosResults, 
+                          imagExpBuffers );
+                        R* RESTRICT imagMatrix = storedMatrix;
+                        R* RESTRICT realMatrix = storedMatrix + q_to_d*q_to_d;
+                        if( unitAmplitude )
+                        {
+                            std::memcpy
+                            ( imagMatrix, &sinResults[0], 
+                              q_to_d*q_to_d*sizeof(R) );
+                            std::memcpy
+                            ( realMatrix, &cosResults[0], 
+                              q_to_d*q_to_d*sizeof(R) );
+                        }
+                        else
+                        {
+                            BatchEvaluateAmplitude
+                            ( amplitude, xPoints, pPoints, ampResults );
+                            for( std::size_t m=0; m<q_to_d*q_to_d; ++m )
+                            {
+                                const R realPhase = cosResults[m];
+                                const R imagPhase = sinResults[m];
+                                const R realAmp = real(ampResults[m]);
+                                const R imagAmp = imag(ampResults[m]);
+                                realMatrix[m] = 
+                                    realAmp*realPhase - imagAmp*imagPhase;
+                                imagMatrix[m] = 
+                                    imagAmp*realPhase + realAmp*imagPhase;
+                            }
+                        }
+                    }
+                    for( std::size_t rhs=0; rhs<numRHS; ++rhs )
+                    {
+                        WeightGridView<R,d,q> weightGrid = 
+                            weightGridList[key*numGrids+phaseIndex*numRHS+rhs];
+                        std::memcpy
+                        ( oldRealWeights, weightGrid.RealBuffer(), 
+                          q_to_d*sizeof(R) );
+                        std::memcpy
+                        ( oldImagWeights, weightGrid.ImagBuffer(),
+                          q_to_d*sizeof(R) );
+                        switch_to_target_interp::ApplyPhaseMatrix<R,d,q>
+                        ( storedMatrix, storedMatrix+q_to_d*q_to_d, 
+                          oldRealWeights, oldImagWeights,
+                          weightGrid.RealBuffer(), weightGrid.ImagBuffer() );
                     }
+                    continue;
                 }
-            }
-            else
-            {
-                amplitude.BatchEvaluate( xPoints, pPoints, ampResults );
-                const C* RESTRICT ampBuffer = &ampResults[0];
-                for( std::size_t t=0; t<q_to_d; ++t )
+
+                if( unitAmplitude || factoredAmplitude )
                 {
-                    for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+                    if( separablePhase )
+                        SeparableImagExpTables<q>
+                        ( phase, xPoints, pPoints, 
+                          phiResults, sinResults, cosResults, 
+                          imagExpBuffers );
+                    else
+                        ImagExpBatch
+                        ( phase, xPoints, pPoints, 
+                          phiResults, imagExpBuffers.reducedPhases, 
+                          sinResults, cosResults );
+                    if( factoredAmplitude )
+                        amplitude.BatchEvaluateFactors
+                        ( xPoints, pPoints, xFactors, pFactors );
+                    for( std::size_t rhs=0; rhs<numRHS; ++rhs )
                     {
-                        const R realWeight = oldRealBuffer[tPrime];
-                        const R imagWeight = oldImagBuffer[tPrime];
-                        const R realPhase = cosBuffer[t*q_to_d+tPrime];
-                        const R imagPhase = sinBuffer[t*q_to_d+tPrime];
-                        const R realBeta = 
-                            realPhase*realWeight - imagPhase*imagWeight;
-                        const R imagBeta = 
-                            imagPhase*realWeight + realPhase*imagWeight;
-                        const R realAmp = real(ampBuffer[t*q_to_d+tPrime]);
-                        const R imagAmp = imag(ampBuffer[t*q_to_d+tPrime]);
-                        realBuffer[t] += realAmp*realBeta - imagAmp*imagBeta;
-                        imagBuffer[t] += imagAmp*realBeta + realAmp*imagBeta;
+                        WeightGridView<R,d,q> weightGrid = 
+                            weightGridList[key*numGrids+phaseIndex*numRHS+rhs];
+                        std::memcpy
+                        ( oldRealWeights, weightGrid.RealBuffer(), 
+                          q_to_d*sizeof(R) );
+                        std::memcpy
+                        ( oldImagWeights, weightGrid.ImagBuffer(),
+                          q_to_d*sizeof(R) );
+                        std::memset
+                        ( weightGrid.Buffer(), 0, 2*q_to_d*sizeof(R) );
+                        R* RESTRICT realBuffer = weightGrid.RealBuffer();
+                        R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
+                        for( std::size_t r=0; r<numTerms; ++r )
+                        {
+                            // Scale the weights by b_r(p_t')
+                            R* realWeights = oldRealWeights;
+                            R* imagWeights = oldImagWeights;
+                            if( factoredAmplitude )
+                            {
+                                const std::complex<P>* RESTRICT pFactorBuffer = 
+                                    &pFactors[r*q_to_d];
+                                R* RESTRICT scaledRealBuffer = 
+                                    scaledRealWeights;
+                                R* RESTRICT scaledImagBuffer = 
+                                    scaledImagWeights;
+                                for( std::size_t tPrime=0; 
+                                     tPrime<q_to_d; ++tPrime )
+                                {
+                                    const R realFactor = 
+                                        std::real(pFactorBuffer[tPrime]);
+                                    const R imagFactor = 
+                                        std::imag(pFactorBuffer[tPrime]);
+                                    const R realWeight = oldRealWeights[tPrime];
+                                    const R imagWeight = oldImagWeights[tPrime];
+                                    scaledRealBuffer[tPrime] = 
+                                        realFactor*realWeight - 
+                                        imagFactor*imagWeight;
+                                    scaledImagBuffer[tPrime] = 
+                                        imagFactor*realWeight + 
+                                        realFactor*imagWeight;
+                                }
+                                realWeights = scaledRealBuffer;
+                                imagWeights = scaledImagBuffer;
+                            }
+
+                            // Apply the phase factors
+                            if( separablePhase )
+                                switch_to_target_interp::
+                                ApplySeparablePhaseMatrix<R,d,q>
+                                ( &sinResults[0], &cosResults[0], 
+                                  realWeights, imagWeights, 
+                                  realResults, imagResults );
+                            else
+                                switch_to_target_interp::ApplyPhaseMatrix<R,d,q>
+                                ( &sinResults[0], &cosResults[0],
+                                  realWeights, imagWeights, 
+                                  realResults, imagResults );
+
+                            // Scale the results by a_r(x_t) and accumulate them
+                            const R* RESTRICT realResultBuffer = 
+                                realResults;
+                            const R* RESTRICT imagResultBuffer = 
+                                imagResults;
+                            if( factoredAmplitude )
+                            {
+                                const std::complex<P>* RESTRICT xFactorBuffer = 
+                                    &xFactors[r*q_to_d];
+                                for( std::size_t t=0; t<q_to_d; ++t )
+                                {
+                                    const R realFactor = 
+                                        std::real(xFactorBuffer[t]);
+                                    const R imagFactor = 
+                                        std::imag(xFactorBuffer[t]);
+                                    const R realResult = realResultBuffer[t];
+                                    const R imagResult = imagResultBuffer[t];
+                                    realBuffer[t] += 
+                                        realFactor*realResult - 
+                                        imagFactor*imagResult;
+                                    imagBuffer[t] += 
+                                        imagFactor*realResult + 
+                                        realFactor*imagResult;
+                                }
+                            }
+                            else
+                            {
+                                for( std::size_t t=0; t<q_to_d; ++t )
+                                {
+                                    realBuffer[t] += realResultBuffer[t];
+                                    imagBuffer[t] += imagResultBuffer[t];
+                                }
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                // Otherwise the amplitude must be evaluated at every pair
+                TensorImagExpBatch<q>
+                ( phase, xPoints, pPoints, phiResults, sinResults, cosResults,
+                  imagExpBuffers );
+                BatchEvaluateAmplitude
+                ( amplitude, xPoints, pPoints, ampResults );
+                for( std::size_t rhs=0; rhs<numRHS; ++rhs )
+                {
+                    WeightGridView<R,d,q> weightGrid = 
+                        weightGridList[key*numGrids+phaseIndex*numRHS+rhs];
+                    std::memcpy
+                    ( oldRealWeights, weightGrid.RealBuffer(), 
+                      q_to_d*sizeof(R) );
+                    std::memcpy
+                    ( oldImagWeights, weightGrid.ImagBuffer(),
+                      q_to_d*sizeof(R) );
+                    std::memset( weightGrid.Buffer(), 0, 2*q_to_d*sizeof(R) );
+                    R* RESTRICT realBuffer = weightGrid.RealBuffer();
+                    R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
+                    const R* RESTRICT oldRealBuffer = oldRealWeights;
+                    const R* RESTRICT oldImagBuffer = oldImagWeights;
+                    const R* RESTRICT cosBuffer = &cosResults[0];
+                    const R* RESTRICT sinBuffer = &sinResults[0];
+                    const std::complex<P>* RESTRICT ampBuffer = &ampResults[0];
+                    for( std::size_t t=0; t<q_to_d; ++t )
+                    {
+                        for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+                        {
+                            const R realWeight = oldRealBuffer[tPrime];
+                            const R imagWeight = oldImagBuffer[tPrime];
+                            const R realPhase = cosBuffer[t*q_to_d+tPrime];
+                            const R imagPhase = sinBuffer[t*q_to_d+tPrime];
+                            const R realBeta = 
+                                realPhase*realWeight - imagPhase*imagWeight;
+                            const R imagBeta = 
+                                imagPhase*realWeight + realPhase*imagWeight;
+                            const R realAmp = real(ampBuffer[t*q_to_d+tPrime]);
+                            const R imagAmp = imag(ampBuffer[t*q_to_d+tPrime]);
+                            realBuffer[t] += 
+                                realAmp*realBeta - imagAmp*imagBeta;
+                            imagBuffer[t] += 
+                                imagAmp*realBeta + realAmp*imagBeta;
+                        }
                     }
                 }
             }
@@ -29,21 +29,26 @@
 
 #include "bfio/functors/phase.hpp"
 
-#include "bfio/tools/blas.hpp"
+#include "bfio/tools/map_kernels.hpp"
 #include "bfio/tools/special_functions.hpp"
 
 #include "bfio/rfio/context.hpp"
+#include "bfio/rfio/tensor_imag_exp_batch.hpp"
+#include "bfio/rfio/workspace.hpp"
 
 namespace bfio {
 namespace rfio {
 
+// Each interaction owns the weight grids of every phase in 'phases' and of
+// every right-hand side (see Workspace), and they are all updated at once.
+
 // 1d specialization
-template<typename R,std::size_t q>
+template<typename R,std::size_t q,class PhaseT>
 void
 TargetWeightRecursion
 ( const rfio::Context<R,1,q>& context,
   const Plan<1>& plan,
-  const Phase<R,1>& phase,
+  const std::vector<const PhaseT*>& phases,
   const std::size_t level,
   const std::size_t ARelativeToAp,
   const Array<R,1>& x0A,
@@ -52,21 +57,29 @@ TargetWeightRecursion
   const Array<R,1>& wA,
   const Array<R,1>& wB,
   const std::size_t parentInteractionOffset,
+  const std::size_t childInteractionStride,
   const WeightGridList<R,1,q>& oldWeightGridList,
-        WeightGrid<R,1,q>& weightGrid )
+        WeightGridView<R,1,q> weightGrid,
+        rfio::Workspace<R,1,q>& workspace )
 {
-    std::memset( weightGrid.Buffer(), 0, 2*q*sizeof(R) );
+    typedef typename PhaseReal<R>::Type P;
+    const std::size_t numPhases = phases.size();
+    const std::size_t numRHS = workspace.numRHS;
+    const std::size_t numGrids = numPhases*numRHS;
+
+    std::memset( weightGrid.Buffer(), 0, 2*q*numGrids*sizeof(R) );
 
     const std::size_t log2NumMergingProcesses = 
         plan.GetLog2NumMergingProcesses( level );
     const std::vector<R>& leftMap = context.GetLeftChebyshevMap();
     const std::vector<R>& rightMap = context.GetRightChebyshevMap();
 
-    std::vector<R> phiResults;
-    std::vector<R> sinResults;
-    std::vector<R> cosResults;
-    std::vector< Array<R,1> > pPoint( 1 );
-    std::vector< Array<R,1> > xPoints( q );
+    const R* sinFactors;
+    const R* cosFactors;
+    std::vector< Array<P,1> >& pPoint = workspace.pPoints;
+    std::vector< Array<P,1> >& xPoints = workspace.xPoints;
+    pPoint.resize( 1 );
+    xPoints.resize( q );
     const std::vector< Array<R,1> >& chebyshevGrid = context.GetChebyshevGrid();
     for( std::size_t cLocal=0; 
          cLocal<(1u<<(1-log2NumMergingProcesses)); 
@@ -75,12 +88,13 @@ TargetWeightRecursion
         //--------------------------------------------------------------------//
         // Step 1                                                             //
         //--------------------------------------------------------------------//
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
+        const std::size_t interactionIndex = 
+            parentInteractionOffset + cLocal*childInteractionStride;
         const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
 
         pPoint[0][0] = p0B[0] + ( c&1 ? wB[0]/4 : -wB[0]/4 );
         {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
+            P* RESTRICT xPointsBuffer = &xPoints[0][0];
             const R* RESTRICT wABuffer = &wA[0];
             const R* RESTRICT x0ApBuffer = &x0Ap[0];
             const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
@@ -88,53 +102,56 @@ TargetWeightRecursion
                 xPointsBuffer[tPrime] = 
                     x0ApBuffer[0] + 2*wABuffer[0]*chebyshevBuffer[tPrime];
         }
-        phase.BatchEvaluate( xPoints, pPoint, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-
-        WeightGrid<R,1,q> scaledWeightGrid;
+        for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
         {
-            R* RESTRICT scaledRealBuffer = scaledWeightGrid.RealBuffer();
-            R* RESTRICT scaledImagBuffer = scaledWeightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT oldRealBuffer = 
-                oldWeightGridList[interactionIndex].RealBuffer();
-            const R* RESTRICT oldImagBuffer = 
-                oldWeightGridList[interactionIndex].ImagBuffer();
-            for( std::size_t tPrime=0; tPrime<q; ++tPrime )
+            StoredImagExpBatch<q>
+            ( *phases[phaseIndex], xPoints, pPoint, workspace, 
+              sinFactors, cosFactors );
+
+            for( std::size_t grid=phaseIndex*numRHS; 
+                 grid<(phaseIndex+1)*numRHS; ++grid )
             {
-                const R realPhase = cosBuffer[tPrime];
-                const R imagPhase = -sinBuffer[tPrime];
-                const R realWeight = oldRealBuffer[tPrime];
-                const R imagWeight = oldImagBuffer[tPrime];
-                scaledRealBuffer[tPrime] = 
-                    realPhase*realWeight - imagPhase*imagWeight;
-                scaledImagBuffer[tPrime] = 
-                    imagPhase*realWeight + realPhase*imagWeight;
+                R* RESTRICT scaledRealBuffer = 
+                    &workspace.scaledWeights[grid*2*q];
+                R* RESTRICT scaledImagBuffer = 
+                    &workspace.scaledWeights[grid*2*q+q];
+                const R* RESTRICT cosBuffer = &cosFactors[0];
+                const R* RESTRICT sinBuffer = &sinFactors[0];
+                const std::size_t oldGrid = interactionIndex*numGrids+grid;
+                const R* RESTRICT oldRealBuffer = 
+                    oldWeightGridList[oldGrid].RealBuffer();
+                const R* RESTRICT oldImagBuffer = 
+                    oldWeightGridList[oldGrid].ImagBuffer();
+                for( std::size_t tPrime=0; tPrime<q; ++tPrime )
+                {
+                    const R realPhase = cosBuffer[tPrime];
+                    const R imagPhase = -sinBuffer[tPrime];
+                    const R realWeight = oldRealBuffer[tPrime];
+                    const R imagWeight = oldImagBuffer[tPrime];
+                    scaledRealBuffer[tPrime] = 
+                        realPhase*realWeight - imagPhase*imagWeight;
+                    scaledImagBuffer[tPrime] = 
+                        imagPhase*realWeight + realPhase*imagWeight;
+                }
             }
         }
 
         //--------------------------------------------------------------------//
         // Step 2                                                             //
         //--------------------------------------------------------------------//
-        // TODO: Create a preprocessor flag for switching to two Gemv's, as 
-        //       Gemm is probably not optimized for only 2 right-hand sides.
-        WeightGrid<R,1,q> expandedWeightGrid;
         {
             const R* mapBuffer = 
                 ( ARelativeToAp&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'T', 'N', q, 2, q,
-              (R)1, mapBuffer,                   q,
-                    scaledWeightGrid.Buffer(),   q,
-              (R)0, expandedWeightGrid.Buffer(), q );
+            MapColumns<R,q>
+            ( 'T', 2*numGrids, mapBuffer, &workspace.scaledWeights[0], 
+              (R)0, &workspace.tempWeights[0] );
         }
 
         //--------------------------------------------------------------------//
         // Step 3                                                             //
         //--------------------------------------------------------------------//
         {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
+            P* RESTRICT xPointsBuffer = &xPoints[0][0];
             const R* RESTRICT wABuffer = &wA[0];
             const R* RESTRICT x0ABuffer = &x0A[0];
             const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
@@ -142,188 +159,45 @@ TargetWeightRecursion
                 xPointsBuffer[t] = 
                     x0ABuffer[0] + wABuffer[0]*chebyshevBuffer[t];
         }
-        phase.BatchEvaluate( xPoints, pPoint, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-        {
-            R* RESTRICT realBuffer = weightGrid.RealBuffer();
-            R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT expandedRealBuffer = 
-                expandedWeightGrid.RealBuffer();
-            const R* RESTRICT expandedImagBuffer = 
-                expandedWeightGrid.ImagBuffer();
-            for( std::size_t t=0; t<q; ++t )
-            {
-                const R realPhase = cosBuffer[t];
-                const R imagPhase = sinBuffer[t];
-                const R realWeight = expandedRealBuffer[t];
-                const R imagWeight = expandedImagBuffer[t];
-                realBuffer[t] += realPhase*realWeight - imagPhase*imagWeight;
-                imagBuffer[t] += imagPhase*realWeight + realPhase*imagWeight;
-            }
-        }
-    }
-}
-
-// 2d specialization
-template<typename R,std::size_t q>
-void
-TargetWeightRecursion
-( const rfio::Context<R,2,q>& context,
-  const Plan<2>& plan,
-  const Phase<R,2>& phase,
-  const std::size_t level,
-  const std::size_t ARelativeToAp,
-  const Array<R,2>& x0A,
-  const Array<R,2>& x0Ap,
-  const Array<R,2>& p0B,
-  const Array<R,2>& wA,
-  const Array<R,2>& wB,
-  const std::size_t parentInteractionOffset,
-  const WeightGridList<R,2,q>& oldWeightGridList,
-        WeightGrid<R,2,q>& weightGrid )
-{
-    std::memset( weightGrid.Buffer(), 0, 2*q*q*sizeof(R) );
-
-    const std::size_t log2NumMergingProcesses = 
-        plan.GetLog2NumMergingProcesses( level );
-    const std::vector<R>& leftMap = context.GetLeftChebyshevMap();
-    const std::vector<R>& rightMap = context.GetRightChebyshevMap();
-
-    std::vector<R> phiResults;
-    std::vector<R> sinResults;
-    std::vector<R> cosResults;
-    std::vector< Array<R,2> > pPoint( 1 );
-    std::vector< Array<R,2> > xPoints( q*q );
-    const std::vector< Array<R,2> >& chebyshevGrid = context.GetChebyshevGrid();
-    for( std::size_t cLocal=0; 
-         cLocal<(1u<<(2-log2NumMergingProcesses)); 
-         ++cLocal )
-    {
-        //--------------------------------------------------------------------//
-        // Step 1                                                             //
-        //--------------------------------------------------------------------//
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
-        const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
-
-        for( std::size_t j=0; j<2; ++j )
-            pPoint[0][j] = p0B[j] + ( (c>>j)&1 ? wB[j]/4 : -wB[j]/4 );
-        {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
-            const R* RESTRICT wABuffer = &wA[0];
-            const R* RESTRICT x0ApBuffer = &x0Ap[0];
-            const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
-            for( std::size_t tPrime=0; tPrime<q*q; ++tPrime )
-                for( std::size_t j=0; j<2; ++j )
-                    xPointsBuffer[tPrime*2+j] = 
-                        x0ApBuffer[j] + 
-                        2*wABuffer[j]*chebyshevBuffer[tPrime*2+j];
-        }
-        phase.BatchEvaluate( xPoints, pPoint, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-
-        WeightGrid<R,2,q> scaledWeightGrid;
+        for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
         {
-            R* RESTRICT scaledRealBuffer = scaledWeightGrid.RealBuffer();
-            R* RESTRICT scaledImagBuffer = scaledWeightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT oldRealBuffer = 
-                oldWeightGridList[interactionIndex].RealBuffer();
-            const R* RESTRICT oldImagBuffer = 
-                oldWeightGridList[interactionIndex].ImagBuffer();
-            for( std::size_t tPrime=0; tPrime<q*q; ++tPrime )
+            StoredImagExpBatch<q>
+            ( *phases[phaseIndex], xPoints, pPoint, workspace, 
+              sinFactors, cosFactors );
+            for( std::size_t grid=phaseIndex*numRHS; 
+                 grid<(phaseIndex+1)*numRHS; ++grid )
             {
-                const R realPhase = cosBuffer[tPrime];
-                const R imagPhase = -sinBuffer[tPrime];
-                const R realWeight = oldRealBuffer[tPrime];
-                const R imagWeight = oldImagBuffer[tPrime];
-                scaledRealBuffer[tPrime] = 
-                    realPhase*realWeight - imagPhase*imagWeight;
-                scaledImagBuffer[tPrime] = 
-                    imagPhase*realWeight + realPhase*imagWeight;
-            }
-        }
-
-        //--------------------------------------------------------------------//
-        // Step 2                                                             //
-        //--------------------------------------------------------------------//
-        // Interpolate over the first dimension. We can take care of the real
-        // and imaginary weights at once
-        WeightGrid<R,2,q> tempWeightGrid;
-        {
-            const R* mapBuffer = 
-                ( ARelativeToAp&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'T', 'N', q, 2*q, q,
-              (R)1, mapBuffer,                 q,
-                    scaledWeightGrid.Buffer(), q,
-              (R)0, tempWeightGrid.Buffer(), q );
-        }
-
-        // Interpolate over the second dimension. We can get away with applying
-        // our maps with a gemm on the real and imag parts.
-        WeightGrid<R,2,q> expandedWeightGrid;
-        {
-            const R* mapBuffer = 
-                ( (ARelativeToAp>>1)&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'N', 'N', q, q, q,
-              (R)1, tempWeightGrid.RealBuffer(),     q,
-                    mapBuffer,                       q,
-              (R)0, expandedWeightGrid.RealBuffer(), q );
-            Gemm
-            ( 'N', 'N', q, q, q,
-              (R)1, tempWeightGrid.ImagBuffer(),     q,
-                    mapBuffer,                       q,
-              (R)0, expandedWeightGrid.ImagBuffer(), q );
-        }
-
-        //--------------------------------------------------------------------//
-        // Step 3                                                             //
-        //--------------------------------------------------------------------//
-        {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
-            const R* RESTRICT wABuffer = &wA[0];
-            const R* RESTRICT x0ABuffer = &x0A[0];
-            const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
-            for( std::size_t t=0; t<q*q; ++t )
-                for( std::size_t j=0; j<2; ++j )
-                    xPointsBuffer[t*2+j] = 
-                        x0ABuffer[j] + wABuffer[j]*chebyshevBuffer[t*2+j];
-        }
-        phase.BatchEvaluate( xPoints, pPoint, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-        {
-            R* RESTRICT realBuffer = weightGrid.RealBuffer();
-            R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT expandedRealBuffer = 
-                expandedWeightGrid.RealBuffer();
-            const R* RESTRICT expandedImagBuffer = 
-                expandedWeightGrid.ImagBuffer();
-            for( std::size_t t=0; t<q*q; ++t )
-            {
-                const R realPhase = cosBuffer[t];
-                const R imagPhase = sinBuffer[t];
-                const R realWeight = expandedRealBuffer[t];
-                const R imagWeight = expandedImagBuffer[t];
-                realBuffer[t] += realPhase*realWeight - imagPhase*imagWeight;
-                imagBuffer[t] += imagPhase*realWeight + realPhase*imagWeight;
+                R* RESTRICT realBuffer = weightGrid.Buffer() + grid*2*q;
+                R* RESTRICT imagBuffer = weightGrid.Buffer() + grid*2*q + q;
+                const R* RESTRICT cosBuffer = &cosFactors[0];
+                const R* RESTRICT sinBuffer = &sinFactors[0];
+                const R* RESTRICT expandedRealBuffer = 
+                    &workspace.tempWeights[grid*2*q];
+                const R* RESTRICT expandedImagBuffer = 
+                    &workspace.tempWeights[grid*2*q+q];
+                for( std::size_t t=0; t<q; ++t )
+                {
+                    const R realPhase = cosBuffer[t];
+                    const R imagPhase = sinBuffer[t];
+                    const R realWeight = expandedRealBuffer[t];
+                    const R imagWeight = expandedImagBuffer[t];
+                    realBuffer[t] += 
+                        realPhase*realWeight - imagPhase*imagWeight;
+                    imagBuffer[t] += 
+                        imagPhase*realWeight + realPhase*imagWeight;
+                }
             }
         }
     }
 }
 
-// Fallback for 3d and above
-template<typename R,std::size_t d,std::size_t q>
+// Fallback for 2d and above
+template<typename R,std::size_t d,std::size_t q,class PhaseT>
 void
 TargetWeightRecursion
 ( const rfio::Context<R,d,q>& context,
   const Plan<d>& plan,
-  const Phase<R,d>& phase,
+  const std::vector<const PhaseT*>& phases,
   const std::size_t level,
   const std::size_t ARelativeToAp,
   const Array<R,d>& x0A,
@@ -332,215 +206,173 @@ TargetWeightRecursion
   const Array<R,d>& wA,
   const Array<R,d>& wB,
   const std::size_t parentInteractionOffset,
+  const std::size_t childInteractionStride,
   const WeightGridList<R,d,q>& oldWeightGridList,
-        WeightGrid<R,d,q>& weightGrid )
+        WeightGridView<R,d,q> weightGrid,
+        rfio::Workspace<R,d,q>& workspace )
 {
+    typedef typename PhaseReal<R>::Type P;
     const std::size_t q_to_d = Pow<q,d>::val;
-    std::memset( weightGrid.Buffer(), 0, 2*q_to_d*sizeof(R) );
+    const std::size_t numPhases = phases.size();
+    const std::size_t numRHS = workspace.numRHS;
+    const std::size_t numGrids = numPhases*numRHS;
+    const std::size_t childSize = 2*q_to_d*numGrids;
+    std::memset( weightGrid.Buffer(), 0, childSize*sizeof(R) );
 
     const std::size_t log2NumMergingProcesses = 
         plan.GetLog2NumMergingProcesses( level );
+    const std::size_t numLocalChildren = 1u<<(d-log2NumMergingProcesses);
     const std::vector<R>& leftMap = context.GetLeftChebyshevMap();
     const std::vector<R>& rightMap = context.GetRightChebyshevMap();
 
-    std::vector<R> phiResults;
-    std::vector<R> sinResults;
-    std::vector<R> cosResults;
-    std::vector< Array<R,d> > pPoint( 1 );
-    std::vector< Array<R,d> > xPoints( q_to_d );
+    const R* sinFactors;
+    const R* cosFactors;
+    std::vector< Array<P,d> >& pPoints = workspace.pPoints;
+    std::vector< Array<P,d> >& xPoints = workspace.xPoints;
+    pPoints.resize( numLocalChildren );
+    xPoints.resize( q_to_d );
     const std::vector< Array<R,d> >& chebyshevGrid = context.GetChebyshevGrid();
-    for( std::size_t cLocal=0; 
-         cLocal<(1u<<(d-log2NumMergingProcesses)); 
-         ++cLocal )
+    for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
     {
-        //--------------------------------------------------------------------//
-        // Step 1                                                             //
-        //--------------------------------------------------------------------//
-        const std::size_t interactionIndex = parentInteractionOffset + cLocal;
         const std::size_t c = plan.LocalToClusterSourceIndex( level, cLocal );
-
         for( std::size_t j=0; j<d; ++j )
-            pPoint[0][j] = p0B[j] + ( (c>>j)&1 ? wB[j]/4 : -wB[j]/4 );
-        {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
-            const R* RESTRICT wABuffer = &wA[0];
-            const R* RESTRICT x0ApBuffer = &x0Ap[0];
-            const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
-            for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
-                for( std::size_t j=0; j<d; ++j )
-                    xPointsBuffer[tPrime*d+j] = 
-                        x0ApBuffer[j] + 
-                        2*wABuffer[j]*chebyshevBuffer[tPrime*d+j];
-        }
-        phase.BatchEvaluate( xPoints, pPoint, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
+            pPoints[cLocal][j] = p0B[j] + ( (c>>j)&1 ? wB[j]/4 : -wB[j]/4 );
+    }
 
-        WeightGrid<R,d,q> scaledWeightGrid;
+    //------------------------------------------------------------------------//
+    // Step 1                                                                 //
+    //------------------------------------------------------------------------//
+    {
+        P* RESTRICT xPointsBuffer = &xPoints[0][0];
+        const R* RESTRICT wABuffer = &wA[0];
+        const R* RESTRICT x0ApBuffer = &x0Ap[0];
+        const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
+        for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+            for( std::size_t j=0; j<d; ++j )
+                xPointsBuffer[tPrime*d+j] = 
+                    x0ApBuffer[j] + 2*wABuffer[j]*chebyshevBuffer[tPrime*d+j];
+    }
+    std::vector<R>& scaledWeights = workspace.scaledWeights;
+    std::vector<R>& tempWeights = workspace.tempWeights;
+    for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
+    {
+        StoredImagExpBatch<q>
+        ( *phases[phaseIndex], xPoints, pPoints, workspace, 
+          sinFactors, cosFactors );
+        for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
         {
-            R* RESTRICT scaledRealBuffer = scaledWeightGrid.RealBuffer();
-            R* RESTRICT scaledImagBuffer = scaledWeightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT oldRealBuffer = 
-                oldWeightGridList[interactionIndex].RealBuffer();
-            const R* RESTRICT oldImagBuffer = 
-                oldWeightGridList[interactionIndex].ImagBuffer();
-            for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+            const std::size_t interactionIndex = 
+                parentInteractionOffset + cLocal*childInteractionStride;
+            for( std::size_t grid=phaseIndex*numRHS; 
+                 grid<(phaseIndex+1)*numRHS; ++grid )
             {
-                const R realPhase = cosBuffer[tPrime];
-                const R imagPhase = -sinBuffer[tPrime];
-                const R realWeight = oldRealBuffer[tPrime];
-                const R imagWeight = oldImagBuffer[tPrime];
-                scaledRealBuffer[tPrime] = 
-                    realPhase*realWeight - imagPhase*imagWeight;
-                scaledImagBuffer[tPrime] = 
-                    imagPhase*realWeight + realPhase*imagWeight;
+                R* RESTRICT scaledRealBuffer = 
+                    &scaledWeights[cLocal*childSize+grid*2*q_to_d];
+                R* RESTRICT scaledImagBuffer = 
+                    &scaledWeights[cLocal*childSize+grid*2*q_to_d+q_to_d];
+                const R* RESTRICT cosBuffer = &cosFactors[cLocal];
+                const R* RESTRICT sinBuffer = &sinFactors[cLocal];
+                const std::size_t oldGrid = interactionIndex*numGrids+grid;
+                const R* RESTRICT oldRealBuffer = 
+                    oldWeightGridList[oldGrid].RealBuffer();
+                const R* RESTRICT oldImagBuffer = 
+                    oldWeightGridList[oldGrid].ImagBuffer();
+                for( std::size_t tPrime=0; tPrime<q_to_d; ++tPrime )
+                {
+                    const R realPhase = cosBuffer[tPrime*numLocalChildren];
+                    const R imagPhase = -sinBuffer[tPrime*numLocalChildren];
+                    const R realWeight = oldRealBuffer[tPrime];
+                    const R imagWeight = oldImagBuffer[tPrime];
+                    scaledRealBuffer[tPrime] = 
+                        realPhase*realWeight - imagPhase*imagWeight;
+                    scaledImagBuffer[tPrime] = 
+                        imagPhase*realWeight + realPhase*imagWeight;
+                }
             }
         }
+    }
 
-        //--------------------------------------------------------------------//
-        // Step 2                                                             //
-        //--------------------------------------------------------------------//
+    //------------------------------------------------------------------------//
+    // Step 2                                                                 //
+    //------------------------------------------------------------------------//
 
-        // Interpolate over the first dimension. We can take care of the real
-        // and imaginary weights at once
-        WeightGrid<R,d,q> tempWeightGrid;
-        {
-            const R* mapBuffer = 
-                ( ARelativeToAp&1 ? &rightMap[0] : &leftMap[0] );
-            Gemm
-            ( 'T', 'N', q, 2*Pow<q,d-1>::val, q,
-              (R)1, mapBuffer,                 q,
-                    scaledWeightGrid.Buffer(), q,
-              (R)0,   tempWeightGrid.Buffer(), q );
-        }
+    // Interpolate over the first dimension. Every child uses the same map, so
+    // the real and imaginary weights of all of them, for every phase and 
+    // right-hand side, are handled at once. As in SourceWeightRecursion, the
+    // batch is limited to the children of this interaction so that the 
+    // scratch space does not grow with the number of interactions.
+    {
+        const R* mapBuffer = ( ARelativeToAp&1 ? &rightMap[0] : &leftMap[0] );
+        MapColumns<R,q>
+        ( 'T', numLocalChildren*numGrids*2*Pow<q,d-1>::val, mapBuffer,
+          &scaledWeights[0], (R)0, &tempWeights[0] );
+    }
 
-        // Interpolate over the second dimension. We can do so by using
-        // q^(d-2) gemms on right-hand sides of size q x q for both the real
-        // and imaginary buffers.
-        {
-            R* realWriteBuffer = scaledWeightGrid.RealBuffer();
-            R* imagWriteBuffer = scaledWeightGrid.ImagBuffer();
-            const R* realReadBuffer = tempWeightGrid.RealBuffer();
-            const R* imagReadBuffer = tempWeightGrid.ImagBuffer();
-            const R* mapBuffer = 
-                ( (ARelativeToAp>>1)&1 ? &rightMap[0] : &leftMap[0] );
-            for( std::size_t w=0; w<Pow<q,d-2>::val; ++w )
-            {
-                Gemm
-                ( 'N', 'N', q, q, q,
-                  (R)1, &realReadBuffer[w*q*q],  q,
-                        mapBuffer,               q,
-                  (R)0, &realWriteBuffer[w*q*q], q );
-            }
-            for( std::size_t w=0; w<Pow<q,d-2>::val; ++w )
-            {
-                Gemm
-                ( 'N', 'N', q, q, q,
-                  (R)1, &imagReadBuffer[w*q*q],  q,
-                        mapBuffer,               q,
-                  (R)0, &imagWriteBuffer[w*q*q], q );
-            }
-        }
+    // Interpolate over the remaining dimensions by right-multiplying each 
+    // q^j x q slice of every child by the map.
+    std::size_t q_to_j = q;
+    for( std::size_t j=1; j<d; ++j )
+    {
+        const std::size_t numSlices = numLocalChildren*childSize/(q_to_j*q);
+        const R* readBuffer = 
+            ( j&1 ? &tempWeights[0] : &scaledWeights[0] );
+        R* writeBuffer = 
+            ( j&1 ? &scaledWeights[0] : &tempWeights[0] );
+        const R* mapBuffer = 
+            ( (ARelativeToAp>>j)&1 ? &rightMap[0] : &leftMap[0] );
+
+        MapRows<R,q>
+        ( 'N', q_to_j, numSlices, mapBuffer, readBuffer, (R)0, writeBuffer,
+          workspace.mapRowsBatch );
+        q_to_j *= q;
+    }
 
-        // Interpolate over the remaining dimensions. These are necessarily
-        // more expensive because we cannot make use of gemm.
-        //
-        // TODO: Compile flag for making the left and right maps transposed
-        //       to get contiguous memory access in the summations.
-        // 
-        // TODO: Check if loading discontinuous chunks is faster than repeatedly
-        //       striding over them.
-        std::size_t q_to_j = q*q;
-        WeightGrid<R,d,q> expandedWeightGrid;
-        for( std::size_t j=2; j<d; ++j )
+    //------------------------------------------------------------------------//
+    // Step 3                                                                 //
+    //------------------------------------------------------------------------//
+    {
+        P* RESTRICT xPointsBuffer = &xPoints[0][0];
+        const R* RESTRICT wABuffer = &wA[0];
+        const R* RESTRICT x0ABuffer = &x0A[0];
+        const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
+        for( std::size_t t=0; t<q_to_d; ++t )
+            for( std::size_t j=0; j<d; ++j )
+                xPointsBuffer[t*d+j] = 
+                    x0ABuffer[j] + wABuffer[j]*chebyshevBuffer[t*d+j];
+    }
+    const R* expandedWeights = 
+        ( (d-1)&1 ? &scaledWeights[0] : &tempWeights[0] );
+    for( std::size_t phaseIndex=0; phaseIndex<numPhases; ++phaseIndex )
+    {
+        StoredImagExpBatch<q>
+        ( *phases[phaseIndex], xPoints, pPoints, workspace, 
+          sinFactors, cosFactors );
+        for( std::size_t cLocal=0; cLocal<numLocalChildren; ++cLocal )
         {
-            const std::size_t stride = q_to_j;
-
-            R* realWriteBuffer = 
-                ( j==d-1 ? expandedWeightGrid.RealBuffer()
-                         : ( j&1 ? scaledWeightGrid.RealBuffer()
-                                 : tempWeightGrid.RealBuffer() ) );
-            R* imagWriteBuffer = 
-                ( j==d-1 ? expandedWeightGrid.ImagBuffer()
-                         : ( j&1 ? scaledWeightGrid.RealBuffer()
-                                 : tempWeightGrid.RealBuffer() ) );
-            const R* realReadBuffer = 
-                ( j&1 ? tempWeightGrid.RealBuffer()
-                      : scaledWeightGrid.RealBuffer() );
-            const R* imagReadBuffer = 
-                ( j&1 ? tempWeightGrid.ImagBuffer()
-                      : scaledWeightGrid.ImagBuffer() );
-            const R* RESTRICT mapBuffer = 
-                ( (ARelativeToAp>>j)&1 ? &rightMap[0] : &leftMap[0] );
-
-            std::memset( realWriteBuffer, 0, q_to_d*sizeof(R) );
-            std::memset( imagWriteBuffer, 0, q_to_d*sizeof(R) );
-            for( std::size_t p=0; p<q_to_d/(q_to_j*q); ++p )
+            for( std::size_t grid=phaseIndex*numRHS; 
+                 grid<(phaseIndex+1)*numRHS; ++grid )
             {
-                const std::size_t offset = p*(q_to_j*q);
-                R* RESTRICT offsetRealWriteBuffer = &realWriteBuffer[offset];
-                R* RESTRICT offsetImagWriteBuffer = &imagWriteBuffer[offset];
-                const R* RESTRICT offsetRealReadBuffer = &realReadBuffer[offset];
-                const R* RESTRICT offsetImagReadBuffer = &imagReadBuffer[offset];
-                for( std::size_t w=0; w<q_to_j; ++w )
+                R* RESTRICT realBuffer = weightGrid.Buffer() + grid*2*q_to_d;
+                R* RESTRICT imagBuffer = 
+                    weightGrid.Buffer() + grid*2*q_to_d + q_to_d;
+                const R* RESTRICT cosBuffer = &cosFactors[cLocal];
+                const R* RESTRICT sinBuffer = &sinFactors[cLocal];
+                const R* RESTRICT expandedRealBuffer = 
+                    &expandedWeights[cLocal*childSize+grid*2*q_to_d];
+                const R* RESTRICT expandedImagBuffer = 
+                    &expandedWeights[cLocal*childSize+grid*2*q_to_d+q_to_d];
+                for( std::size_t t=0; t<q_to_d; ++t )
                 {
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                        {
-                            offsetRealWriteBuffer[w+t*stride] +=
-                                mapBuffer[tPrime+t*q] *
-                                offsetRealReadBuffer[w+tPrime*stride];
-                        }
-                    }
-                    for( std::size_t t=0; t<q; ++t )
-                    {
-                        for( std::size_t tPrime=0; tPrime<q; ++tPrime )
-                        {
-                            offsetImagWriteBuffer[w+t*stride] +=
-                                mapBuffer[tPrime+t*q] *
-                                offsetImagReadBuffer[w+tPrime*stride];
-                        }
-                    }
+                    const R realPhase = cosBuffer[t*numLocalChildren];
+                    const R imagPhase = sinBuffer[t*numLocalChildren];
+                    const R realWeight = expandedRealBuffer[t];
+                    const R imagWeight = expandedImagBuffer[t];
+                    realBuffer[t] += 
+                        realPhase*realWeight - imagPhase*imagWeight;
+                    imagBuffer[t] += 
+                        imagPhase*realWeight + realPhase*imagWeight;
                 }
             }
-            q_to_j *= q;
-        }
-
-        //--------------------------------------------------------------------//
-        // Step 3                                                             //
-        //--------------------------------------------------------------------//
-        {
-            R* RESTRICT xPointsBuffer = &xPoints[0][0];
-            const R* RESTRICT wABuffer = &wA[0];
-            const R* RESTRICT x0ABuffer = &x0A[0];
-            const R* RESTRICT chebyshevBuffer = &chebyshevGrid[0][0];
-            for( std::size_t t=0; t<q_to_d; ++t )
-                for( std::size_t j=0; j<d; ++j )
-                    xPointsBuffer[t*d+j] = 
-                        x0ABuffer[j] + wABuffer[j]*chebyshevBuffer[t*d+j];
-        }
-        phase.BatchEvaluate( xPoints, pPoint, phiResults );
-        SinCosBatch( phiResults, sinResults, cosResults );
-        {
-            R* RESTRICT realBuffer = weightGrid.RealBuffer();
-            R* RESTRICT imagBuffer = weightGrid.ImagBuffer();
-            const R* RESTRICT cosBuffer = &cosResults[0];
-            const R* RESTRICT sinBuffer = &sinResults[0];
-            const R* RESTRICT expandedRealBuffer = 
-                expandedWeightGrid.RealBuffer();
-            const R* RESTRICT expandedImagBuffer = 
-                expandedWeightGrid.ImagBuffer();
-            for( std::size_t t=0; t<q_to_d; ++t )
-            {
-                const R realPhase = cosBuffer[t];
-                const R imagPhase = sinBuffer[t];
-                const R realWeight = expandedRealBuffer[t];
-                const R imagWeight = expandedImagBuffer[t];
-                realBuffer[t] += realPhase*realWeight - imagPhase*imagWeight;
-                imagBuffer[t] += imagPhase*realWeight + realPhase*imagWeight;
-            }
         }
     }
 }
@@ -549,4 +381,3 @@ TargetWeightRecursion
 } // bfio
 
 #endif // BFIO_RFIO_TARGET_WEIGHT_RECURSION_HPP
-
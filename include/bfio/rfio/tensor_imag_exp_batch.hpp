@@ -0,0 +1,380 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_RFIO_TENSOR_IMAG_EXP_BATCH_HPP
+#define BFIO_RFIO_TENSOR_IMAG_EXP_BATCH_HPP 1
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "bfio/constants.hpp"
+#include "bfio/structures/array.hpp"
+#include "bfio/functors/phase.hpp"
+#include "bfio/tools/special_functions.hpp"
+
+namespace bfio {
+namespace rfio {
+
+// Scratch space for the following routines. The buffers only ever grow, so 
+// one which is reused between calls stops touching the heap once it has 
+// reached the largest sizes of the point sets it is used with.
+template<typename P,typename R>
+struct ImagExpBuffers
+{
+    // The distinct coordinates in one dimension and the terms between them
+    std::vector<P> xCoords;
+    std::vector<P> pCoords;
+    std::vector<P> terms;
+
+    // Which of the distinct coordinates each point uses, one dimension 
+    // after another
+    std::vector<std::size_t> xIndices;
+    std::vector<std::size_t> pIndices;
+
+    // The sines and cosines of the terms, and the phases reduced by the 
+    // mixed-precision SinCosBatch
+    std::vector<R> sinTables;
+    std::vector<R> cosTables;
+    std::vector<R> reducedPhases;
+};
+
+// For a separable phase, Phi(x,p) = sum_j phi_j(x_j,p_j), forms the same 
+// results as ImagExpBatch from the sines and cosines of each term over the
+// distinct j'th coordinates of x and p, each result being the product of d 
+// of them. Returns false, without forming any results, if some dimension 
+// has more than maxCoords distinct coordinates or if the tables would not be
+// smaller than the results.
+template<std::size_t maxCoords,typename P,typename R,std::size_t d>
+bool SeparableImagExpBatch
+( const Phase<P,d>& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        std::vector<P>& phiResults,
+        std::vector<R>& sinResults,
+        std::vector<R>& cosResults,
+        ImagExpBuffers<P,R>& buffers );
+
+// Equivalent to ImagExpBatch, but SeparableImagExpBatch is used whenever the
+// phase is separable and the point sets are those of the butterfly: q^d 
+// tensor-product grids or short lists (e.g., the centers of the children of
+// a box).
+template<std::size_t q,class PhaseT,typename P,typename R,std::size_t d>
+void TensorImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        std::vector<P>& phiResults,
+        std::vector<R>& sinResults,
+        std::vector<R>& cosResults,
+        ImagExpBuffers<P,R>& buffers );
+
+// For a separable phase and q^d tensor-product grids x and p, ordered so that
+// the j'th coordinate of point t only depends upon (t/q^j) mod q, forms the 
+// sines and cosines of each term, phi_j(x_i,p_k), over the q distinct j'th 
+// coordinates of x and p. The tables for consecutive terms are stored 
+// contiguously, each in the same (x-major) ordering as the results of 
+// BatchEvaluate.
+template<std::size_t q,typename P,typename R,std::size_t d>
+void SeparableImagExpTables
+( const Phase<P,d>& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        std::vector<P>& phiResults,
+        std::vector<R>& sinTables,
+        std::vector<R>& cosTables,
+        ImagExpBuffers<P,R>& buffers );
+
+// Implementations
+
+namespace tensor_imag_exp_batch {
+
+// Returns the index of the value within the first numValues entries, 
+// appending it if it is new, or maxValues if there is no room for it
+template<typename P>
+inline std::size_t
+FindOrAppendCoordinate
+( P value, P* values, std::size_t& numValues, std::size_t maxValues )
+{
+    for( std::size_t m=0; m<numValues; ++m )
+        if( values[m] == value )
+            return m;
+    if( numValues == maxValues )
+        return maxValues;
+    values[numValues] = value;
+    return numValues++;
+}
+
+// Lists the distinct j'th coordinates of the points in values[j*maxCoords], 
+// in the order in which they first appear, and sets indices[j*n+t] to the 
+// index of that of point t. Returns false if there are too many of them.
+template<std::size_t maxCoords,typename P,std::size_t d>
+inline bool
+FindCoordinates
+( const std::vector< Array<P,d> >& points,
+  P* values, std::size_t* numValues, std::vector<std::size_t>& indices )
+{
+    const std::size_t numPoints = points.size();
+    indices.resize( d*numPoints );
+    for( std::size_t j=0; j<d; ++j )
+    {
+        P* RESTRICT jValues = &values[j*maxCoords];
+        std::size_t* RESTRICT jIndices = &indices[j*numPoints];
+
+        // Consecutive points usually share coordinates
+        numValues[j] = 0;
+        std::size_t index = 0;
+        for( std::size_t t=0; t<numPoints; ++t )
+        {
+            const P value = points[t][j];
+            if( numValues[j] == 0 || jValues[index] != value )
+            {
+                index = FindOrAppendCoordinate
+                ( value, jValues, numValues[j], maxCoords );
+                if( index == maxCoords )
+                    return false;
+            }
+            jIndices[t] = index;
+        }
+    }
+    return true;
+}
+
+// Whether the indices found by FindCoordinates describe a tensor-product 
+// grid whose j'th coordinate only depends upon (t/n_0/.../n_{j-1}) mod n_j,
+// where n_j is the number of distinct j'th coordinates
+template<std::size_t d>
+inline bool
+IsTensorGrid
+( std::size_t numPoints, const std::size_t* numValues, 
+  const std::size_t* indices )
+{
+    std::size_t gridSize = 1;
+    for( std::size_t j=0; j<d; ++j )
+        gridSize *= numValues[j];
+    if( gridSize != numPoints )
+        return false;
+
+    std::size_t stride = 1;
+    for( std::size_t j=0; j<d; ++j )
+    {
+        const std::size_t* jIndices = &indices[j*numPoints];
+        for( std::size_t t=0; t<numPoints; ++t )
+            if( jIndices[t] != (t/stride)%numValues[j] )
+                return false;
+        stride *= numValues[j];
+    }
+    return true;
+}
+
+} // tensor_imag_exp_batch
+
+template<std::size_t maxCoords,typename P,typename R,std::size_t d>
+bool
+SeparableImagExpBatch
+( const Phase<P,d>& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        std::vector<P>& phiResults,
+        std::vector<R>& sinResults,
+        std::vector<R>& cosResults,
+        ImagExpBuffers<P,R>& buffers )
+{
+    using namespace tensor_imag_exp_batch;
+    const std::size_t nxPoints = x.size();
+    const std::size_t npPoints = p.size();
+    if( nxPoints == 0 || npPoints == 0 )
+    {
+        sinResults.clear();
+        cosResults.clear();
+        return true;
+    }
+
+    P xValues[d*maxCoords], pValues[d*maxCoords];
+    std::size_t numXValues[d], numPValues[d];
+    if( !FindCoordinates<maxCoords>
+        ( x, xValues, numXValues, buffers.xIndices ) ||
+        !FindCoordinates<maxCoords>
+        ( p, pValues, numPValues, buffers.pIndices ) )
+        return false;
+
+    std::size_t offsets[d];
+    std::size_t tableSize = 0;
+    for( std::size_t j=0; j<d; ++j )
+    {
+        offsets[j] = tableSize;
+        tableSize += numXValues[j]*numPValues[j];
+    }
+    if( tableSize >= nxPoints*npPoints )
+        return false;
+
+    // Tabulate the terms one dimension after another
+    phiResults.resize( tableSize );
+    for( std::size_t j=0; j<d; ++j )
+    {
+        buffers.xCoords.assign
+        ( &xValues[j*maxCoords], &xValues[j*maxCoords]+numXValues[j] );
+        buffers.pCoords.assign
+        ( &pValues[j*maxCoords], &pValues[j*maxCoords]+numPValues[j] );
+        phase.BatchEvaluateTerm
+        ( j, buffers.xCoords, buffers.pCoords, buffers.terms );
+        std::memcpy
+        ( &phiResults[offsets[j]], &buffers.terms[0], 
+          numXValues[j]*numPValues[j]*sizeof(P) );
+    }
+    SinCosBatch
+    ( phiResults, buffers.reducedPhases, 
+      buffers.sinTables, buffers.cosTables );
+
+    const bool pIsGrid = 
+        IsTensorGrid<d>( npPoints, numPValues, &buffers.pIndices[0] );
+    const std::size_t* xIndices = &buffers.xIndices[0];
+    const std::size_t* pIndices = &buffers.pIndices[0];
+    const R* sinTables = &buffers.sinTables[0];
+    const R* cosTables = &buffers.cosTables[0];
+    sinResults.resize( nxPoints*npPoints );
+    cosResults.resize( nxPoints*npPoints );
+    for( std::size_t i=0; i<nxPoints; ++i )
+    {
+        // Point to the rows of the tables for the coordinates of x_i
+        const R* sinRows[d];
+        const R* cosRows[d];
+        for( std::size_t j=0; j<d; ++j )
+        {
+            const std::size_t row = 
+                offsets[j] + xIndices[j*nxPoints+i]*numPValues[j];
+            sinRows[j] = &sinTables[row];
+            cosRows[j] = &cosTables[row];
+        }
+
+        R* RESTRICT sinRow = &sinResults[i*npPoints];
+        R* RESTRICT cosRow = &cosResults[i*npPoints];
+        if( pIsGrid )
+        {
+            // Expand the product of the rows over the grid one dimension at
+            // a time. The first block is formed last since it is overwritten
+            // in place.
+            std::memcpy( sinRow, sinRows[0], numPValues[0]*sizeof(R) );
+            std::memcpy( cosRow, cosRows[0], numPValues[0]*sizeof(R) );
+            std::size_t numFormed = numPValues[0];
+            for( std::size_t j=1; j<d; ++j )
+            {
+                for( std::size_t m=numPValues[j]; m>0; --m )
+                {
+                    const R sinFactor = sinRows[j][m-1];
+                    const R cosFactor = cosRows[j][m-1];
+                    R* sinBlock = &sinRow[(m-1)*numFormed];
+                    R* cosBlock = &cosRow[(m-1)*numFormed];
+                    for( std::size_t k=0; k<numFormed; ++k )
+                    {
+                        const R sinValue = sinRow[k];
+                        const R cosValue = cosRow[k];
+                        sinBlock[k] = sinValue*cosFactor + cosValue*sinFactor;
+                        cosBlock[k] = cosValue*cosFactor - sinValue*sinFactor;
+                    }
+                }
+                numFormed *= numPValues[j];
+            }
+        }
+        else
+        {
+            // Multiply the entries of the rows for the coordinates of each p_k
+            for( std::size_t k=0; k<npPoints; ++k )
+            {
+                sinRow[k] = sinRows[0][pIndices[k]];
+                cosRow[k] = cosRows[0][pIndices[k]];
+            }
+            for( std::size_t j=1; j<d; ++j )
+            {
+                const std::size_t* RESTRICT jIndices = &pIndices[j*npPoints];
+                for( std::size_t k=0; k<npPoints; ++k )
+                {
+                    const R sinValue = sinRow[k];
+                    const R cosValue = cosRow[k];
+                    const R sinFactor = sinRows[j][jIndices[k]];
+                    const R cosFactor = cosRows[j][jIndices[k]];
+                    sinRow[k] = sinValue*cosFactor + cosValue*sinFactor;
+                    cosRow[k] = cosValue*cosFactor - sinValue*sinFactor;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+template<std::size_t q,class PhaseT,typename P,typename R,std::size_t d>
+inline void
+TensorImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        std::vector<P>& phiResults,
+        std::vector<R>& sinResults,
+        std::vector<R>& cosResults,
+        ImagExpBuffers<P,R>& buffers )
+{
+    const std::size_t maxCoords = ( q > (1u<<d) ? q : (1u<<d) );
+    if( !phase.IsSeparable() || 
+        !SeparableImagExpBatch<maxCoords>
+         ( (const Phase<P,d>&)phase, x, p, 
+           phiResults, sinResults, cosResults, buffers ) )
+        ImagExpBatch
+        ( phase, x, p, phiResults, buffers.reducedPhases, 
+          sinResults, cosResults );
+}
+
+template<std::size_t q,typename P,typename R,std::size_t d>
+inline void
+SeparableImagExpTables
+( const Phase<P,d>& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        std::vector<P>& phiResults,
+        std::vector<R>& sinTables,
+        std::vector<R>& cosTables,
+        ImagExpBuffers<P,R>& buffers )
+{
+#ifndef RELEASE
+    const std::size_t q_to_d = Pow<q,d>::val;
+    if( x.size() != q_to_d || p.size() != q_to_d )
+        throw std::logic_error("Point sets must be q^d grids");
+#endif
+    const std::size_t tableSize = q*q;
+    buffers.xCoords.resize( q );
+    buffers.pCoords.resize( q );
+    phiResults.resize( d*tableSize );
+    std::size_t q_to_j = 1;
+    for( std::size_t j=0; j<d; ++j, q_to_j*=q )
+    {
+        for( std::size_t m=0; m<q; ++m )
+        {
+            buffers.xCoords[m] = x[m*q_to_j][j];
+            buffers.pCoords[m] = p[m*q_to_j][j];
+        }
+        phase.BatchEvaluateTerm
+        ( j, buffers.xCoords, buffers.pCoords, buffers.terms );
+        std::memcpy
+        ( &phiResults[j*tableSize], &buffers.terms[0], tableSize*sizeof(P) );
+    }
+    SinCosBatch( phiResults, buffers.reducedPhases, sinTables, cosTables );
+}
+
+} // rfio
+} // bfio
+
+#endif // BFIO_RFIO_TENSOR_IMAG_EXP_BATCH_HPP
@@ -0,0 +1,173 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+ 
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_RFIO_WORKSPACE_HPP
+#define BFIO_RFIO_WORKSPACE_HPP 1
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "bfio/constants.hpp"
+#include "bfio/structures/array.hpp"
+#include "bfio/structures/plan.hpp"
+#include "bfio/structures/weight_grid_list.hpp"
+#include "bfio/functors/phase.hpp"
+#include "bfio/tools/map_kernels.hpp"
+#include "bfio/rfio/tensor_imag_exp_batch.hpp"
+
+namespace bfio {
+namespace rfio {
+
+// Scratch space for the source and target weight recursions. A workspace is 
+// created once per transform (and per thread) and handed to every call of 
+// the recursions so that they do not need to touch the heap. The buffers are 
+// allocated up front with their largest possible sizes, apart from those of
+// imagExpBuffers, which reach theirs within the first few calls; the 
+// recursions only resize them within their capacities. The phase functors
+// are free to allocate their own scratch space, as is the default 
+// Phase::BatchEvaluateTerm.
+template<typename R,std::size_t d,std::size_t q>
+struct Workspace
+{
+    typedef typename PhaseReal<R>::Type P;
+
+    // The number of phase functions and of right-hand sides the recursions
+    // are applied to. Each interaction then owns numPhases*numRHS 
+    // consecutive weight grids, ordered phase-major, and the grids of each 
+    // phase share their phase factors.
+    std::size_t numPhases;
+    std::size_t numRHS;
+
+    // Points at which the phase function is evaluated, and its results
+    std::vector< Array<P,d> > xPoints;
+    std::vector< Array<P,d> > pPoints;
+    std::vector<P> phiResults;
+    std::vector<R> sinResults;
+    std::vector<R> cosResults;
+    ImagExpBuffers<P,R> imagExpBuffers;
+
+    // Weights for each of the (at most 2^d) children of an interaction
+    std::vector<R> scaledWeights;
+    std::vector<R> tempWeights;
+    std::vector<std::size_t> children;
+    MapRowsBatch<R> mapRowsBatch;
+
+    // The new weights of a group of 2^d interactions, which are held here 
+    // until the old weights they are formed from are no longer needed
+    WeightGridList<R,d,q> groupWeightGridList;
+
+    // If nonzero, the sines and cosines of the phase factors of the current
+    // call are stored here, one batch after another (see PhaseFactorStore),
+    // and are read rather than evaluated unless they are being recorded
+    R* storedFactors;
+    bool recordFactors;
+
+    Workspace( std::size_t numRHS=1, std::size_t numPhases=1 );
+};
+
+// Sets sinBuffer and cosBuffer to the phase factors exp(i Phi(x,p)), which
+// are formed with TensorImagExpBatch unless they were stored in the 
+// workspace by a previous application
+template<std::size_t q,class PhaseT,typename P,typename R,std::size_t d>
+void
+StoredImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        Workspace<R,d,q>& workspace,
+  const R*& sinBuffer,
+  const R*& cosBuffer );
+
+// The number of sines and cosines of the phase factors formed by each call 
+// of the source or target weight recursion at the given level, per phase
+template<std::size_t q,std::size_t d>
+std::size_t
+NumRecursionFactors( const Plan<d>& plan, std::size_t level );
+
+// Implementations
+
+template<typename R,std::size_t d,std::size_t q>
+Workspace<R,d,q>::Workspace( std::size_t numRHS, std::size_t numPhases )
+: numPhases( numPhases ),
+  numRHS( numRHS ),
+  xPoints( Pow<q,d>::val ),
+  pPoints( Pow<q,d>::val ),
+  phiResults( (1u<<d)*Pow<q,d>::val ),
+  sinResults( (1u<<d)*Pow<q,d>::val ),
+  cosResults( (1u<<d)*Pow<q,d>::val ),
+  scaledWeights( (1u<<d)*2*Pow<q,d>::val*numPhases*numRHS ),
+  tempWeights( (1u<<d)*2*Pow<q,d>::val*numPhases*numRHS ),
+  children( 1u<<d ),
+  mapRowsBatch( (1u<<d)*2*Pow<q,d>::val*numPhases*numRHS/(q*q) ),
+  groupWeightGridList( (1u<<d)*numPhases*numRHS ),
+  storedFactors( 0 ),
+  recordFactors( false )
+{ }
+
+template<std::size_t q,class PhaseT,typename P,typename R,std::size_t d>
+inline void
+StoredImagExpBatch
+( const PhaseT& phase,
+  const std::vector< Array<P,d> >& x,
+  const std::vector< Array<P,d> >& p,
+        Workspace<R,d,q>& workspace,
+  const R*& sinBuffer,
+  const R*& cosBuffer )
+{
+    const std::size_t size = x.size()*p.size();
+    if( workspace.storedFactors != 0 && !workspace.recordFactors )
+    {
+        sinBuffer = workspace.storedFactors;
+        cosBuffer = workspace.storedFactors + size;
+        workspace.storedFactors += 2*size;
+        return;
+    }
+
+    TensorImagExpBatch<q>
+    ( phase, x, p, workspace.phiResults, 
+      workspace.sinResults, workspace.cosResults, workspace.imagExpBuffers );
+    sinBuffer = &workspace.sinResults[0];
+    cosBuffer = &workspace.cosResults[0];
+    if( workspace.storedFactors != 0 )
+    {
+        std::memcpy( workspace.storedFactors, sinBuffer, size*sizeof(R) );
+        std::memcpy
+        ( workspace.storedFactors+size, cosBuffer, size*sizeof(R) );
+        workspace.storedFactors += 2*size;
+    }
+}
+
+template<std::size_t q,std::size_t d>
+inline std::size_t
+NumRecursionFactors( const Plan<d>& plan, std::size_t level )
+{
+    // The source recursion evaluates the phase once for each child and once
+    // more for the parent, and the target recursion twice for all children
+    const std::size_t log2N = Log2( plan.GetN() );
+    const std::size_t numLocalChildren = 
+        1u<<(d-plan.GetLog2NumMergingProcesses( level ));
+    if( level <= log2N/2 )
+        return 2*(numLocalChildren+1)*Pow<q,d>::val;
+    else
+        return 2*2*numLocalChildren*Pow<q,d>::val;
+}
+
+} // rfio
+} // bfio
+
+#endif // BFIO_RFIO_WORKSPACE_HPP
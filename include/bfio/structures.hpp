@@ -23,10 +23,13 @@
 #include "bfio/structures/constrained_htree_walker.hpp"
 #include "bfio/structures/htree_walker.hpp"
 #include "bfio/structures/plan.hpp"
+#include "bfio/structures/plan_cache.hpp"
 #include "bfio/structures/point_grid.hpp"
 #include "bfio/structures/source.hpp"
+#include "bfio/structures/sum_scatter_pipeline.hpp"
 #include "bfio/structures/weight_grid.hpp"
 #include "bfio/structures/weight_grid_list.hpp"
+#include "bfio/structures/weight_grid_view.hpp"
 
 #endif // BFIO_STRUCTURES_HPP
 
@@ -35,6 +35,11 @@ public:
     Array( T alpha );
     ~Array();
 
+    // Conversion between precisions, e.g., so that single-precision points 
+    // may be handed to double-precision phase functions
+    template<typename S>
+    Array( const Array<S,d>& array );
+
     T& operator[]( std::size_t j );
     const T& operator[]( std::size_t j ) const;
 
@@ -52,6 +57,11 @@ template<typename T,std::size_t d>
 inline Array<T,d>::Array( T alpha ) 
 { for( std::size_t j=0; j<d; ++j ) _x[j] = alpha; }
 
+template<typename T,std::size_t d>
+template<typename S>
+inline Array<T,d>::Array( const Array<S,d>& array )
+{ for( std::size_t j=0; j<d; ++j ) _x[j] = array[j]; }
+
 template<typename T,std::size_t d>
 inline Array<T,d>::~Array() 
 { }
@@ -22,12 +22,16 @@
 # include <iostream>
 #endif
 
+#include <algorithm>
 #include <bitset>
+#include <cstring>
 #include <stdexcept>
 #include <vector>
 
 #include "bfio/constants.hpp"
+#include "bfio/tools/mpi.hpp"
 #include "bfio/tools/twiddle.hpp"
+#include "bfio/tools/wire_format.hpp"
 #include "mpi.h"
 #ifdef BGP
 # include "mpix.h"
@@ -46,7 +50,10 @@ protected:
     // Does not depend on the problem size
     int _rank;
     int _numProcesses;
-    std::size_t _log2NumProcesses;
+    int _teamSize;
+    int _teamRank;
+    int _team;
+    std::size_t _log2NumTeams;
     std::size_t _log2N;
     Array<std::size_t,d> _myInitialSourceBoxCoords;
     Array<std::size_t,d> _myFinalTargetBoxCoords;
@@ -55,6 +62,8 @@ protected:
 
     // Depends on the problem size
     const std::size_t _bootstrapSkip;
+    WireFormat _wireFormat;
+    MPI_Comm _teamComm;
     MPI_Comm _bootstrapClusterComm;
     std::vector<std::size_t> _bootstrapSourceDimsToMerge;
     std::vector<std::size_t> _bootstrapTargetDimsToCut;
@@ -65,13 +74,25 @@ protected:
     std::vector< std::vector<std::size_t> > _targetDimsToCut;
     std::vector< std::vector<bool       > > _rightSideOfCut;
 
+    // Copies of a generated plan share its communicators, which are only 
+    // freed along with the last copy
+    bool _generated;
+    std::size_t* _numSharers;
+
     PlanBase
     ( MPI_Comm comm, Direction direction, std::size_t N, 
       std::size_t bootstrapSkip );
 
+    PlanBase( const PlanBase<d>& plan );
+
+private:
+    const PlanBase<d>& operator=( const PlanBase<d>& plan );
+
 public:        
     virtual ~PlanBase();
 
+    bool IsGenerated() const;
+
     virtual std::size_t 
     LocalToClusterSourceIndex
     ( std::size_t level, std::size_t cLocal ) const = 0;
@@ -85,9 +106,48 @@ public:
     std::size_t GetN() const;
     std::size_t GetBootstrapSkip() const;
 
+    // Reduced-precision wire formats roughly halve (single precision) or 
+    // quarter (bfloat16) the bytes of double-precision weights sent during 
+    // each sum-scatter (of the merging levels, the bootstrap, and the team 
+    // shares), at the cost of rounding them (see PrintWireErrors)
+    WireFormat GetWireFormat() const;
+    void SetWireFormat( WireFormat wireFormat );
+
+    // A number of processes which is not a power of two, 2^k m with m odd, 
+    // is split into 2^k teams of m consecutive ranks, each of which takes 
+    // the place of a single process of the butterfly. The members of a team
+    // share its boxes, but each forms only its own share of the 
+    // interactions at every stage, and the shares are then gathered by all 
+    // of them. With a power of two number of processes, every team has a
+    // single member.
+    MPI_Comm GetTeamComm() const;
+    int GetTeamSize() const;
+    int GetTeamRank() const;
+
+    // Our contiguous share, [begin,end), of n items divided between the 
+    // members of our team
+    void TeamShare
+    ( std::size_t n, std::size_t& begin, std::size_t& end ) const;
+
+    // Given n items of unitSize entries each, sums the buffers of the 
+    // members of our team so that the entries of each member's share are 
+    // left with the sums (the rest of the buffer is left in an unspecified
+    // state)
+    template<typename R>
+    void SumTeamShares
+    ( R* buffer, std::size_t n, std::size_t unitSize ) const;
+
+    // Given n items of unitSize entries each, of which each member of our
+    // team has formed its share, gives every member all of them
+    template<typename R>
+    void GatherTeamShares
+    ( R* buffer, std::size_t n, std::size_t unitSize ) const;
+
+    // The members of a team are handed equal slabs of its source box
     template<typename R>
     Box<R,d> GetMyInitialSourceBox( const Box<R,d>& sourceBox ) const;
 
+    // The members of a team share its target box
     template<typename R>
     Box<R,d> GetMyFinalTargetBox( const Box<R,d>& targetBox ) const;
 
@@ -154,9 +214,16 @@ class Plan : public PlanBase<d>
     ( std::size_t level, std::size_t cLocal ) const;
 
 public:
+    // If generate is false, the (collective) splitting of the communicators
+    // is deferred until the first call to Generate
     Plan
     ( MPI_Comm comm, Direction direction, std::size_t N, 
-      std::size_t bootstrapSkip=0 );
+      std::size_t bootstrapSkip=0, bool generate=true );
+
+    // Cheap, as the copy shares the communicators of a generated plan
+    virtual Plan<d>* Clone() const;
+
+    void Generate();
 
     virtual std::size_t
     LocalToBootstrapClusterSourceIndex
@@ -173,19 +240,23 @@ template<std::size_t d>
 PlanBase<d>::PlanBase
 ( MPI_Comm comm, Direction direction, std::size_t N,
   std::size_t bootstrapSkip ) 
-: _comm(comm), _direction(direction), _N(N), _bootstrapSkip(bootstrapSkip)
+: _comm(comm), _direction(direction), _N(N), _bootstrapSkip(bootstrapSkip),
+  _wireFormat(FULL_PRECISION_WIRE), _generated(false), _numSharers(0)
 { 
     MPI_Comm_rank( comm, &_rank );
     MPI_Comm_size( comm, &_numProcesses );
 
     if( ! IsPowerOfTwo(N) )
         throw std::runtime_error("Must use power of 2 problem size");
-    if( ! IsPowerOfTwo(_numProcesses) )
-        throw std::runtime_error("Must use power of 2 number of processes");
+    _teamSize = _numProcesses;
+    while( _teamSize % 2 == 0 )
+        _teamSize /= 2;
+    _teamRank = _rank % _teamSize;
+    _team = _rank / _teamSize;
     _log2N = Log2( N );
-    _log2NumProcesses = Log2( _numProcesses );
-    if( _log2NumProcesses > d*_log2N )
-        throw std::runtime_error("Cannot use more than N^d processes");
+    _log2NumTeams = Log2( _numProcesses/_teamSize );
+    if( _log2NumTeams > d*_log2N )
+        throw std::runtime_error("Cannot use more than N^d teams of processes");
     if( bootstrapSkip > _log2N/2 )
         throw std::runtime_error("Cannot bootstrap past the middle switch");
 
@@ -194,16 +265,68 @@ PlanBase<d>::PlanBase
     _sourceDimsToMerge.resize( _log2N );
     _targetDimsToCut.resize( _log2N );
     _rightSideOfCut.resize( _log2N );
+    _numSharers = new std::size_t(1);
+}
+
+template<std::size_t d>
+PlanBase<d>::PlanBase( const PlanBase<d>& plan )
+: _comm(plan._comm), _direction(plan._direction), _N(plan._N),
+  _rank(plan._rank), _numProcesses(plan._numProcesses),
+  _teamSize(plan._teamSize), _teamRank(plan._teamRank), _team(plan._team),
+  _log2NumTeams(plan._log2NumTeams), _log2N(plan._log2N),
+  _myInitialSourceBoxCoords(plan._myInitialSourceBoxCoords),
+  _myFinalTargetBoxCoords(plan._myFinalTargetBoxCoords),
+  _log2InitialSourceBoxesPerDim(plan._log2InitialSourceBoxesPerDim),
+  _log2FinalTargetBoxesPerDim(plan._log2FinalTargetBoxesPerDim),
+  _bootstrapSkip(plan._bootstrapSkip),
+  _wireFormat(plan._wireFormat),
+  _teamComm(plan._teamComm),
+  _bootstrapClusterComm(plan._bootstrapClusterComm),
+  _bootstrapSourceDimsToMerge(plan._bootstrapSourceDimsToMerge),
+  _bootstrapTargetDimsToCut(plan._bootstrapTargetDimsToCut),
+  _bootstrapRightSideOfCut(plan._bootstrapRightSideOfCut),
+  _clusterComms(plan._clusterComms),
+  _log2SubclusterSizes(plan._log2SubclusterSizes),
+  _sourceDimsToMerge(plan._sourceDimsToMerge),
+  _targetDimsToCut(plan._targetDimsToCut),
+  _rightSideOfCut(plan._rightSideOfCut),
+  _generated(plan._generated)
+{
+    // An ungenerated copy will split its own communicators
+    if( _generated )
+    {
+        _numSharers = plan._numSharers;
+        ++*_numSharers;
+    }
+    else
+        _numSharers = new std::size_t(1);
 }
 
 template<std::size_t d>
 PlanBase<d>::~PlanBase()
 {
-    MPI_Comm_free( &_bootstrapClusterComm );
-    for( std::size_t level=1; level<=_log2N; ++level )
-        MPI_Comm_free( &_clusterComms[level-1] );
+    if( --*_numSharers != 0 )
+        return;
+    delete _numSharers;
+
+    // Plans held past MPI_Finalize (e.g., by a static cache) cannot free
+    // their communicators
+    int finalized;
+    MPI_Finalized( &finalized );
+    if( _generated && !finalized )
+    {
+        MPI_Comm_free( &_teamComm );
+        MPI_Comm_free( &_bootstrapClusterComm );
+        for( std::size_t level=1; level<=_log2N; ++level )
+            MPI_Comm_free( &_clusterComms[level-1] );
+    }
 }
 
+template<std::size_t d>
+inline bool
+PlanBase<d>::IsGenerated() const
+{ return _generated; }
+
 template<std::size_t d>
 inline MPI_Comm PlanBase<d>::GetComm() const 
 { return _comm; }
@@ -223,6 +346,78 @@ inline std::size_t
 PlanBase<d>::GetBootstrapSkip() const
 { return _bootstrapSkip; }
 
+template<std::size_t d>
+inline WireFormat
+PlanBase<d>::GetWireFormat() const
+{ return _wireFormat; }
+
+template<std::size_t d>
+inline void
+PlanBase<d>::SetWireFormat( WireFormat wireFormat )
+{ _wireFormat = wireFormat; }
+
+template<std::size_t d>
+inline MPI_Comm
+PlanBase<d>::GetTeamComm() const
+{ return _teamComm; }
+
+template<std::size_t d>
+inline int
+PlanBase<d>::GetTeamSize() const
+{ return _teamSize; }
+
+template<std::size_t d>
+inline int
+PlanBase<d>::GetTeamRank() const
+{ return _teamRank; }
+
+template<std::size_t d>
+inline void
+PlanBase<d>::TeamShare
+( std::size_t n, std::size_t& begin, std::size_t& end ) const
+{
+    begin = (n*_teamRank)/_teamSize;
+    end = (n*(_teamRank+1))/_teamSize;
+}
+
+template<std::size_t d> template<typename R>
+void
+PlanBase<d>::SumTeamShares
+( R* buffer, std::size_t n, std::size_t unitSize ) const
+{
+    if( _teamSize == 1 )
+        return;
+
+    std::vector<int> recvCounts( _teamSize );
+    for( int t=0; t<_teamSize; ++t )
+        recvCounts[t] = 
+            ((n*(t+1))/_teamSize-(n*t)/_teamSize)*unitSize;
+    std::size_t begin, end;
+    TeamShare( n, begin, end );
+    std::vector<R> sums( std::max((end-begin)*unitSize,(std::size_t)1) );
+    WireSumScatter( _wireFormat, buffer, &sums[0], &recvCounts[0], _teamComm );
+    std::memcpy
+    ( &buffer[begin*unitSize], &sums[0], (end-begin)*unitSize*sizeof(R) );
+}
+
+template<std::size_t d> template<typename R>
+void
+PlanBase<d>::GatherTeamShares
+( R* buffer, std::size_t n, std::size_t unitSize ) const
+{
+    if( _teamSize == 1 )
+        return;
+
+    std::vector<int> recvCounts( _teamSize );
+    std::vector<int> displs( _teamSize );
+    for( int t=0; t<_teamSize; ++t )
+    {
+        displs[t] = ((n*t)/_teamSize)*unitSize;
+        recvCounts[t] = ((n*(t+1))/_teamSize)*unitSize - displs[t];
+    }
+    AllGather( buffer, &recvCounts[0], &displs[0], _teamComm );
+}
+
 template<std::size_t d> template<typename R>
 Box<R,d> 
 PlanBase<d>::GetMyInitialSourceBox( const Box<R,d>& sourceBox ) const
@@ -236,6 +431,8 @@ PlanBase<d>::GetMyInitialSourceBox( const Box<R,d>& sourceBox ) const
             sourceBox.offsets[j] + 
             _myInitialSourceBoxCoords[j]*myInitialSourceBox.widths[j];
     }
+    myInitialSourceBox.widths[0] /= _teamSize;
+    myInitialSourceBox.offsets[0] += _teamRank*myInitialSourceBox.widths[0];
     return myInitialSourceBox;
 }
 
@@ -327,14 +524,33 @@ PlanBase<d>::GetRightSideOfCut( std::size_t level ) const
 
 template<std::size_t d>
 Plan<d>::Plan
-( MPI_Comm comm, Direction direction, std::size_t N, std::size_t bootstrapSkip )
+( MPI_Comm comm, Direction direction, std::size_t N, std::size_t bootstrapSkip,
+  bool generate )
 : PlanBase<d>( comm, direction, N, bootstrapSkip )
 { 
+    if( generate )
+        Generate();
+}
 
-    if( direction == FORWARD )
+template<std::size_t d>
+inline Plan<d>*
+Plan<d>::Clone() const
+{ return new Plan<d>(*this); }
+
+template<std::size_t d>
+void
+Plan<d>::Generate()
+{
+    if( this->_generated )
+        return;
+
+    MPI_Comm_split
+    ( this->_comm, this->_team, this->_teamRank, &this->_teamComm );
+    if( this->_direction == FORWARD )
         GenerateForwardPlan();
     else
         GenerateAdjointPlan();
+    this->_generated = true;
 }
 
 template<std::size_t d>
@@ -359,7 +575,7 @@ template<std::size_t d>
 void
 Plan<d>::GenerateForwardPlan()
 {
-    std::bitset<8*sizeof(int)> rankBits(this->_rank);
+    std::bitset<8*sizeof(int)> rankBits(this->_team);
         
     _myClusterRanks.resize( this->_log2N );
 
@@ -371,7 +587,7 @@ Plan<d>::GenerateForwardPlan()
         this->_myInitialSourceBoxCoords[j] = 0;
         this->_log2InitialSourceBoxesPerDim[j] = 0;
     }
-    for( std::size_t m=this->_log2NumProcesses; m>0; --m )
+    for( std::size_t m=this->_log2NumTeams; m>0; --m )
     {
 #ifndef RELEASE
         if( this->_rank == 0 )
@@ -444,7 +660,7 @@ Plan<d>::GenerateForwardPlan()
 #endif
 
         // Construct the communicator for the bootstrap cluster
-        const int startRank = this->_rank & ~(numMergingProcesses-1);
+        const int startRank = this->_team & ~(numMergingProcesses-1);
         std::vector<int> ranks( numMergingProcesses );
         for( std::size_t j=0; j<numMergingProcesses; ++j )
         {
@@ -454,7 +670,7 @@ Plan<d>::GenerateForwardPlan()
             for( std::size_t k=0; k<log2NumMergingProcesses; ++k )
                 jReversed |= ((j>>k)&1)<<(log2NumMergingProcesses-1-k);
             ranks[j] = startRank + jReversed;
-            if( this->_rank == ranks[j] )
+            if( this->_team == ranks[j] )
                 this->_myBootstrapClusterRank = j;
         }
 
@@ -474,9 +690,11 @@ Plan<d>::GenerateForwardPlan()
         }
 #endif
 
+        // The members of a team are only ever clustered with the members of
+        // other teams which hold the same team rank
         MPI_Comm_split
-        ( this->_comm, ranks[0], this->_myBootstrapClusterRank, 
-          &this->_bootstrapClusterComm );
+        ( this->_comm, ranks[0]*this->_teamSize+this->_teamRank, 
+          this->_myBootstrapClusterRank, &this->_bootstrapClusterComm );
 
         this->_bootstrapSourceDimsToMerge.resize( log2NumMergingProcesses );
         this->_bootstrapTargetDimsToCut.resize( log2NumMergingProcesses );
@@ -557,7 +775,7 @@ Plan<d>::GenerateForwardPlan()
             // Construct the communicator for our current cluster
             const std::size_t log2Stride = numTargetCuts;
             const int startRank = 
-                this->_rank & ~((numMergingProcesses-1)<<log2Stride);
+                this->_team & ~((numMergingProcesses-1)<<log2Stride);
             std::vector<int> ranks( numMergingProcesses );
             for( std::size_t j=0; j<numMergingProcesses; ++j )
             {
@@ -568,7 +786,7 @@ Plan<d>::GenerateForwardPlan()
                 for( std::size_t k=0; k<log2NumMergingProcesses; ++k )
                     jReversed |= ((j>>k)&1)<<(log2NumMergingProcesses-1-k);
                 ranks[j] = startRank+(jReversed<<log2Stride);
-                if( this->_rank == ranks[j] )
+                if( this->_team == ranks[j] )
                     this->_myClusterRanks[level-1] = j;
             }
 #ifndef RELEASE
@@ -586,8 +804,8 @@ Plan<d>::GenerateForwardPlan()
             }
 #endif
             MPI_Comm_split
-            ( this->_comm, ranks[0], this->_myClusterRanks[level-1],
-              &this->_clusterComms[level-1] );
+            ( this->_comm, ranks[0]*this->_teamSize+this->_teamRank, 
+              this->_myClusterRanks[level-1], &this->_clusterComms[level-1] );
 
 #ifdef BGP
 # ifdef BGP_MPIDO_USE_REDUCESCATTER
@@ -667,7 +885,7 @@ template<std::size_t d>
 void
 Plan<d>::GenerateAdjointPlan()
 {
-    std::bitset<8*sizeof(int)> rankBits(this->_rank);
+    std::bitset<8*sizeof(int)> rankBits(this->_team);
     _myMappedRanks.resize( this->_log2N );
 
     // Compute the number of source boxes per dimension and our coordinates
@@ -678,7 +896,7 @@ Plan<d>::GenerateAdjointPlan()
         this->_myInitialSourceBoxCoords[j] = 0;
         this->_log2InitialSourceBoxesPerDim[j] = 0;
     }
-    for( std::size_t m=0; m<this->_log2NumProcesses; ++m )
+    for( std::size_t m=0; m<this->_log2NumTeams; ++m )
     {
 #ifndef RELEASE
         if( this->_rank == 0 )
@@ -755,9 +973,9 @@ Plan<d>::GenerateAdjointPlan()
 
         // Construct the communicator for the bootstrap cluster
         const std::size_t log2Stride = 
-            this->_log2NumProcesses-log2NumMergingProcesses;
+            this->_log2NumTeams-log2NumMergingProcesses;
         const int startRank = 
-            this->_rank & ~((numMergingProcesses-1)<<log2Stride);
+            this->_team & ~((numMergingProcesses-1)<<log2Stride);
         std::vector<int> ranks( numMergingProcesses );
         for( std::size_t j=0; j<numMergingProcesses; ++j )
         {
@@ -768,7 +986,7 @@ Plan<d>::GenerateAdjointPlan()
             for( std::size_t k=0; k<log2NumMergingProcesses; ++k )
                 jReversed |= ((j>>k)&1)<<(log2NumMergingProcesses-1-k);
             ranks[j] = startRank + (jReversed<<log2Stride);
-            if( this->_rank == ranks[j] )
+            if( this->_team == ranks[j] )
                 this->_myBootstrapMappedRank = j;
         }
 
@@ -789,8 +1007,8 @@ Plan<d>::GenerateAdjointPlan()
 #endif
 
         MPI_Comm_split
-        ( this->_comm, ranks[0], this->_myBootstrapMappedRank, 
-          &this->_bootstrapClusterComm );
+        ( this->_comm, ranks[0]*this->_teamSize+this->_teamRank, 
+          this->_myBootstrapMappedRank, &this->_bootstrapClusterComm );
 
         this->_bootstrapSourceDimsToMerge.resize( log2NumMergingProcesses );
         this->_bootstrapTargetDimsToCut.resize( log2NumMergingProcesses );
@@ -799,7 +1017,7 @@ Plan<d>::GenerateAdjointPlan()
         std::size_t nextBootstrapTargetDimToCut = nextTargetDimToCut;
         for( std::size_t j=0; j<log2NumMergingProcesses; ++j )
         {
-            const std::size_t thisBit = (this->_log2NumProcesses-1)-j;
+            const std::size_t thisBit = (this->_log2NumTeams-1)-j;
 
             this->_bootstrapSourceDimsToMerge[j] =
                 nextBootstrapSourceDimToMerge;
@@ -874,9 +1092,9 @@ Plan<d>::GenerateAdjointPlan()
 
             // Construct the communicator for our current cluster
             const std::size_t log2Stride = 
-                this->_log2NumProcesses-numTargetCuts-log2NumMergingProcesses;
+                this->_log2NumTeams-numTargetCuts-log2NumMergingProcesses;
             const int startRank = 
-                this->_rank & ~((numMergingProcesses-1)<<log2Stride);
+                this->_team & ~((numMergingProcesses-1)<<log2Stride);
             std::vector<int> ranks( numMergingProcesses ); 
             {
                 // The bits of j must be shuffled according to the ordering 
@@ -925,7 +1143,7 @@ Plan<d>::GenerateAdjointPlan()
                 const std::size_t firstBitsetSize = 
                     log2NumMergingProcesses-lastBitsetSize;
                 // Apply the same transformation to our shifted rank
-                const std::size_t shiftedRank = this->_rank-startRank;
+                const std::size_t shiftedRank = this->_team-startRank;
                 const std::size_t scaledRank = shiftedRank >> log2Stride;
                 std::size_t wrappedRank = 0;
                 for( std::size_t k=0; k<firstBitsetSize; ++k )
@@ -943,8 +1161,8 @@ Plan<d>::GenerateAdjointPlan()
             }
 
             MPI_Comm_split
-            ( this->_comm, ranks[0], this->_myMappedRanks[level-1],
-              &this->_clusterComms[level-1] );
+            ( this->_comm, ranks[0]*this->_teamSize+this->_teamRank, 
+              this->_myMappedRanks[level-1], &this->_clusterComms[level-1] );
 #ifdef BGP
 # ifdef BGP_MPIDO_USE_REDUCESCATTER
             MPIX_Set_property
@@ -956,7 +1174,7 @@ Plan<d>::GenerateAdjointPlan()
 #endif
 
             this->_log2SubclusterSizes[level-1] = 
-                this->_log2NumProcesses % d;
+                this->_log2NumTeams % d;
 
             this->_sourceDimsToMerge[level-1].resize( log2NumMergingProcesses );
             this->_targetDimsToCut[level-1].resize( log2NumMergingProcesses );
@@ -964,7 +1182,7 @@ Plan<d>::GenerateAdjointPlan()
             for( std::size_t j=0; j<log2NumMergingProcesses; ++j )
             {
                 const std::size_t thisBit = 
-                    (this->_log2NumProcesses-1) - numTargetCuts;
+                    (this->_log2NumTeams-1) - numTargetCuts;
 
                 this->_sourceDimsToMerge[level-1][j] =  nextSourceDimToMerge;
                 this->_targetDimsToCut[level-1][j] = nextTargetDimToCut;
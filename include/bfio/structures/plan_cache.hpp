@@ -0,0 +1,214 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_STRUCTURES_PLAN_CACHE_HPP
+#define BFIO_STRUCTURES_PLAN_CACHE_HPP 1
+
+#include <map>
+
+#include "bfio/constants.hpp"
+#include "bfio/structures/plan.hpp"
+#include "mpi.h"
+
+namespace bfio {
+
+// A process-wide cache of plans keyed on (communicator, direction, N,
+// bootstrapSkip), so that repeated transforms do not pay for splitting the
+// cluster communicators each time. Like the plans themselves, Get, Erase,
+// and Clear are collective over the plan's communicator.
+//
+// Since MPI may hand the handle of a freed communicator to a new one, the 
+// cache attaches an attribute to each communicator which it holds plans 
+// for, and the attribute's delete callback erases them when the 
+// communicator is freed.
+template<std::size_t d>
+class PlanCache
+{
+    struct Key
+    {
+        MPI_Comm comm;
+        Direction direction;
+        std::size_t N;
+        std::size_t bootstrapSkip;
+
+        bool operator<( const Key& key ) const;
+    };
+    std::map< Key, Plan<d>* > _plans;
+    int _keyval;
+
+    void EraseComm( MPI_Comm comm );
+    static int 
+    DeleteCommAttribute
+    ( MPI_Comm comm, int keyval, void* attributeVal, void* extraState );
+
+    PlanCache();
+    PlanCache( const PlanCache<d>& cache );
+    const PlanCache<d>& operator=( const PlanCache<d>& cache );
+
+public:
+    ~PlanCache();
+
+    static PlanCache<d>& Instance();
+
+    // The returned reference is valid until the plan is erased, either 
+    // explicitly or by freeing comm; a Clone of it shares its communicators
+    // and may outlive the cache entry, but not comm.
+    const Plan<d>&
+    Get
+    ( MPI_Comm comm, Direction direction, std::size_t N,
+      std::size_t bootstrapSkip=0 );
+
+    void
+    Erase
+    ( MPI_Comm comm, Direction direction, std::size_t N,
+      std::size_t bootstrapSkip=0 );
+
+    // Must be called before MPI_Finalize for the communicators to be freed
+    void Clear();
+
+    std::size_t Size() const;
+};
+
+// Implementations
+
+template<std::size_t d>
+inline bool
+PlanCache<d>::Key::operator<( const Key& key ) const
+{
+    if( comm != key.comm )
+        return comm < key.comm;
+    if( direction != key.direction )
+        return direction < key.direction;
+    if( N != key.N )
+        return N < key.N;
+    return bootstrapSkip < key.bootstrapSkip;
+}
+
+template<std::size_t d>
+inline
+PlanCache<d>::PlanCache()
+: _keyval(MPI_KEYVAL_INVALID)
+{ }
+
+template<std::size_t d>
+inline
+PlanCache<d>::~PlanCache()
+{ Clear(); }
+
+template<std::size_t d>
+inline PlanCache<d>&
+PlanCache<d>::Instance()
+{
+    static PlanCache<d> cache;
+    return cache;
+}
+
+template<std::size_t d>
+const Plan<d>&
+PlanCache<d>::Get
+( MPI_Comm comm, Direction direction, std::size_t N,
+  std::size_t bootstrapSkip )
+{
+    Key key;
+    key.comm = comm;
+    key.direction = direction;
+    key.N = N;
+    key.bootstrapSkip = bootstrapSkip;
+
+    typename std::map< Key, Plan<d>* >::iterator it = _plans.find( key );
+    if( it == _plans.end() )
+    {
+        // Make sure that the plans of comm are erased when it is freed
+        if( _keyval == MPI_KEYVAL_INVALID )
+            MPI_Comm_create_keyval
+            ( MPI_COMM_NULL_COPY_FN, DeleteCommAttribute, &_keyval, 0 );
+        void* attributeVal;
+        int found;
+        MPI_Comm_get_attr( comm, _keyval, &attributeVal, &found );
+        if( !found )
+            MPI_Comm_set_attr( comm, _keyval, this );
+
+        Plan<d>* plan = new Plan<d>( comm, direction, N, bootstrapSkip );
+        it = _plans.insert( std::make_pair( key, plan ) ).first;
+    }
+    return *it->second;
+}
+
+template<std::size_t d>
+void
+PlanCache<d>::Erase
+( MPI_Comm comm, Direction direction, std::size_t N,
+  std::size_t bootstrapSkip )
+{
+    Key key;
+    key.comm = comm;
+    key.direction = direction;
+    key.N = N;
+    key.bootstrapSkip = bootstrapSkip;
+
+    typename std::map< Key, Plan<d>* >::iterator it = _plans.find( key );
+    if( it != _plans.end() )
+    {
+        delete it->second;
+        _plans.erase( it );
+    }
+}
+
+template<std::size_t d>
+void
+PlanCache<d>::EraseComm( MPI_Comm comm )
+{
+    typename std::map< Key, Plan<d>* >::iterator it = _plans.begin();
+    while( it != _plans.end() )
+    {
+        if( it->first.comm == comm )
+        {
+            delete it->second;
+            _plans.erase( it++ );
+        }
+        else
+            ++it;
+    }
+}
+
+template<std::size_t d>
+int
+PlanCache<d>::DeleteCommAttribute
+( MPI_Comm comm, int keyval, void* attributeVal, void* extraState )
+{
+    static_cast<PlanCache<d>*>(attributeVal)->EraseComm( comm );
+    return MPI_SUCCESS;
+}
+
+template<std::size_t d>
+void
+PlanCache<d>::Clear()
+{
+    typename std::map< Key, Plan<d>* >::iterator it;
+    for( it=_plans.begin(); it!=_plans.end(); ++it )
+        delete it->second;
+    _plans.clear();
+}
+
+template<std::size_t d>
+inline std::size_t
+PlanCache<d>::Size() const
+{ return _plans.size(); }
+
+} // bfio
+
+#endif // BFIO_STRUCTURES_PLAN_CACHE_HPP
@@ -0,0 +1,387 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_STRUCTURES_SUM_SCATTER_PIPELINE_HPP
+#define BFIO_STRUCTURES_SUM_SCATTER_PIPELINE_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "bfio/structures/plan.hpp"
+#include "bfio/structures/weight_grid_list.hpp"
+#include "bfio/tools/mpi.hpp"
+#include "bfio/tools/wire_format.hpp"
+
+namespace bfio {
+
+// Performs the sum-scatter of the partial weights at a merging level in
+// chunks, so that the summation of each chunk may proceed while the partial
+// weights of the next are formed. Each chunk holds the same share of every
+// merging process's target boxes, and the partial weights are stored in the
+// order in which they are sent, so that no packing is required.
+//
+// When the plan's processes form teams, each member of a team forms and 
+// sums only its own share of the target boxes which the team receives, 
+// together with the members of the other merging teams which hold the same
+// share, and the shares must be gathered by the caller after Finish.
+//
+// If RECURSIVE_HALVING is defined, or if the plan's wire format is 
+// narrower than R, each chunk is summed with log2(p) pairwise exchanges 
+// between the p merging processes rather than with MPI_Ireduce_scatter. 
+// The plan orders the ranks of each cluster so that
+// the processes which differ in one of the source dimensions being merged
+// differ in one bit of their rank, and each exchange pairs the processes 
+// across one such bit, sending the half of the remaining weights which the 
+// partner will own and summing the half which it keeps. The halves are 
+// rounded into the wire format before being sent, but are always summed in
+// full precision.
+//
+// Usage, where each target box owns numGrids consecutive weight grids:
+//
+//   for( std::size_t c=0; c<pipeline.NumChunks(); ++c )
+//   {
+//       for( std::size_t i=0; i<pipeline.ChunkSize(); ++i )
+//           form the partial weights of target box pipeline.TargetIndex(c,i)
+//           in the grids starting at pipeline.PartialWeights(c,i);
+//       pipeline.Scatter( c );
+//   }
+//   pipeline.Finish( weightGridList );
+template<typename R,std::size_t d,std::size_t q>
+class SumScatterPipeline
+{
+    const std::size_t _numGrids;
+    std::size_t _log2NumMergingProcesses;
+    std::size_t _numMergingProcesses;
+    std::size_t _boxesPerProcess;
+    std::size_t _shareBegin;
+    std::size_t _shareSize;
+    std::size_t _subclusterSize;
+    std::size_t _numChunks;
+    std::size_t _chunkBoxesPerProcess;
+    std::size_t _numScattered;
+    MPI_Comm _clusterComm;
+    std::vector<int> _recvCounts;
+    std::vector<MPI_Request> _requests;
+    WeightGridList<R,d,q> _partialWeightGridList;
+    WeightGridList<R,d,q> _weightGridList;
+
+    // For summation by recursive halving
+    enum { RequestsPerChunk = 2 };
+    bool _halving;
+    WireFormat _wireFormat;
+    std::size_t _wireSize;
+    int _clusterRank;
+    std::vector<std::size_t> _numHalvings;
+    std::vector<char> _sendWire;
+    std::vector<char> _recvWire;
+
+    // The first grid which we receive of chunk c
+    std::size_t ChunkOffset( std::size_t c ) const;
+
+    void StartHalving( std::size_t c );
+    void FinishHalving( std::size_t c );
+
+    SumScatterPipeline( const SumScatterPipeline<R,d,q>& pipeline );
+    const SumScatterPipeline<R,d,q>&
+    operator=( const SumScatterPipeline<R,d,q>& pipeline );
+
+public:
+    enum { DefaultMaxChunks = 4 };
+
+    SumScatterPipeline
+    ( const Plan<d>& plan, std::size_t level,
+      std::size_t log2NumMergingProcesses, std::size_t log2LocalTargetBoxes,
+      std::size_t numGrids=1, std::size_t maxChunks=DefaultMaxChunks );
+    ~SumScatterPipeline();
+
+    std::size_t NumChunks() const;
+
+    // The number of target boxes in each chunk
+    std::size_t ChunkSize() const;
+
+    // The index of the i'th target box of chunk c in the local target domain
+    std::size_t TargetIndex( std::size_t c, std::size_t i ) const;
+
+    // The first of the numGrids partial weight grids of the i'th target box
+    // of chunk c
+    WeightGridView<R,d,q> PartialWeights( std::size_t c, std::size_t i );
+
+    // Starts the summation of chunk c, whose partial weights are complete
+    void Scatter( std::size_t c );
+
+    // Waits for every chunk and swaps the summed weights into weightGridList,
+    // which must hold as many grids as each process receives. Only the grids
+    // of our team member's share hold their sums.
+    void Finish( WeightGridList<R,d,q>& weightGridList );
+};
+
+// Implementations
+
+template<typename R,std::size_t d,std::size_t q>
+SumScatterPipeline<R,d,q>::SumScatterPipeline
+( const Plan<d>& plan, std::size_t level,
+  std::size_t log2NumMergingProcesses, std::size_t log2LocalTargetBoxes,
+  std::size_t numGrids, std::size_t maxChunks )
+: _numGrids(numGrids),
+  _log2NumMergingProcesses(log2NumMergingProcesses),
+  _numMergingProcesses(1u<<log2NumMergingProcesses),
+  _boxesPerProcess(1u<<(log2LocalTargetBoxes-log2NumMergingProcesses)),
+  _subclusterSize(1u<<plan.GetLog2SubclusterSize( level )),
+  _numScattered(0),
+  _clusterComm(plan.GetClusterComm( level )),
+  _partialWeightGridList(0),
+  _weightGridList(_boxesPerProcess*numGrids)
+{
+#ifndef RELEASE
+    if( _boxesPerProcess % _subclusterSize != 0 )
+        throw std::logic_error("Subclusters must receive whole target boxes");
+#endif
+    std::size_t shareEnd;
+    plan.TeamShare( _boxesPerProcess, _shareBegin, shareEnd );
+    _shareSize = shareEnd - _shareBegin;
+    WeightGridList<R,d,q> 
+        partialWeightGridList( _numMergingProcesses*_shareSize*numGrids );
+    _partialWeightGridList.Swap( partialWeightGridList );
+
+    // Use as many chunks as possible, up to maxChunks, which evenly divide
+    // the share of each process
+    _numChunks = std::min( maxChunks, _shareSize );
+    while( _numChunks != 0 && _shareSize % _numChunks != 0 )
+        --_numChunks;
+    _chunkBoxesPerProcess = 
+        ( _numChunks == 0 ? 0 : _shareSize / _numChunks );
+
+    _recvCounts.resize
+    ( _numMergingProcesses, 2*Pow<q,d>::val*_chunkBoxesPerProcess*numGrids );
+    _requests.resize( _numChunks*RequestsPerChunk, MPI_REQUEST_NULL );
+
+    // Only recursive halving can sum in more precision than it sends
+    _wireFormat = plan.GetWireFormat();
+    _wireSize = WireSize<R>( _wireFormat );
+#ifdef RECURSIVE_HALVING
+    _halving = true;
+#else
+    _halving = ( _wireSize < sizeof(R) );
+#endif
+    if( _halving )
+    {
+        // Each chunk sends and receives at most half of its weights in any 
+        // exchange
+        const std::size_t halfChunkSize = 
+            (_numMergingProcesses/2)*_recvCounts[0];
+        MPI_Comm_rank( _clusterComm, &_clusterRank );
+        _numHalvings.resize( _numChunks, 0 );
+        _recvWire.resize( _numChunks*halfChunkSize*_wireSize );
+        if( _wireSize < sizeof(R) )
+            _sendWire.resize( _numChunks*halfChunkSize*_wireSize );
+    }
+}
+
+template<typename R,std::size_t d,std::size_t q>
+inline
+SumScatterPipeline<R,d,q>::~SumScatterPipeline()
+{
+    // Never leave a summation writing into freed buffers
+    if( !_requests.empty() )
+        MPI_Waitall( _requests.size(), &_requests[0], MPI_STATUSES_IGNORE );
+}
+
+template<typename R,std::size_t d,std::size_t q>
+inline std::size_t
+SumScatterPipeline<R,d,q>::NumChunks() const
+{ return _numChunks; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline std::size_t
+SumScatterPipeline<R,d,q>::ChunkSize() const
+{ return _numMergingProcesses*_chunkBoxesPerProcess; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline std::size_t
+SumScatterPipeline<R,d,q>::TargetIndex( std::size_t c, std::size_t i ) const
+{
+    // Find the process receiving the box and the box's offset in its share
+    const std::size_t process = i / _chunkBoxesPerProcess;
+    const std::size_t offset =
+        _shareBegin + c*_chunkBoxesPerProcess + i % _chunkBoxesPerProcess;
+    if( _subclusterSize == 1 )
+        return process*_boxesPerProcess + offset;
+
+    // Within each subcluster, the target boxes are dealt out to its
+    // processes in a round-robin fashion, in pieces of
+    // _boxesPerProcess/_subclusterSize boxes
+    const std::size_t pieceSize = _boxesPerProcess / _subclusterSize;
+    const std::size_t subcluster = process / _subclusterSize;
+    const std::size_t subclusterRank = process % _subclusterSize;
+    const std::size_t piece = offset / pieceSize;
+    return (subcluster*_subclusterSize*_subclusterSize +
+            subclusterRank + piece*_subclusterSize)*pieceSize +
+           offset % pieceSize;
+}
+
+template<typename R,std::size_t d,std::size_t q>
+inline WeightGridView<R,d,q>
+SumScatterPipeline<R,d,q>::PartialWeights( std::size_t c, std::size_t i )
+{ return _partialWeightGridList[(c*ChunkSize()+i)*_numGrids]; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline std::size_t
+SumScatterPipeline<R,d,q>::ChunkOffset( std::size_t c ) const
+{ return (_shareBegin+c*_chunkBoxesPerProcess)*_numGrids; }
+
+template<typename R,std::size_t d,std::size_t q>
+void
+SumScatterPipeline<R,d,q>::StartHalving( std::size_t c )
+{
+    // The weights of chunk c which are left to sum form a contiguous range 
+    // of blocks, one per process, which contains our own block 
+    const std::size_t numBlocks = _numMergingProcesses >> _numHalvings[c];
+    const std::size_t halfBlocks = numBlocks/2;
+    const std::size_t partner = _clusterRank ^ halfBlocks;
+    const std::size_t partnerHalf = partner & ~(halfBlocks-1);
+    const std::size_t blockSize = _recvCounts[0];
+    const int count = halfBlocks*blockSize;
+
+    const R* partnerBuffer = 
+        _partialWeightGridList[c*ChunkSize()*_numGrids].Buffer() + 
+        partnerHalf*blockSize;
+    const std::size_t wireOffset = 
+        c*(_numMergingProcesses/2)*blockSize*_wireSize;
+    const char* sendBuffer = 
+        reinterpret_cast<const char*>(partnerBuffer);
+    if( _wireSize < sizeof(R) )
+    {
+        EncodeWire
+        ( _wireFormat, partnerBuffer, count, &_sendWire[wireOffset] );
+        sendBuffer = &_sendWire[wireOffset];
+    }
+    ISend
+    ( sendBuffer, count*_wireSize, partner, c, _clusterComm, 
+      _requests[c*RequestsPerChunk] );
+    IRecv
+    ( &_recvWire[wireOffset], count*_wireSize, partner, c, _clusterComm,
+      _requests[c*RequestsPerChunk+1] );
+}
+
+template<typename R,std::size_t d,std::size_t q>
+void
+SumScatterPipeline<R,d,q>::FinishHalving( std::size_t c )
+{
+    const std::size_t numBlocks = _numMergingProcesses >> _numHalvings[c];
+    const std::size_t halfBlocks = numBlocks/2;
+    const std::size_t myHalf = _clusterRank & ~(halfBlocks-1);
+    const std::size_t blockSize = _recvCounts[0];
+    const std::size_t halfSize = halfBlocks*blockSize;
+
+    R* myBuffer = 
+        _partialWeightGridList[c*ChunkSize()*_numGrids].Buffer() + 
+        myHalf*blockSize;
+    const char* recvBuffer = 
+        &_recvWire[c*(_numMergingProcesses/2)*blockSize*_wireSize];
+
+    // Once only our own block is left, sum directly into its destination
+    R* sumBuffer = 
+        ( halfBlocks == 1 ? 
+          _weightGridList[ChunkOffset(c)].Buffer() : 
+          myBuffer );
+    DecodeWireAndAdd
+    ( _wireFormat, recvBuffer, halfSize, myBuffer, sumBuffer );
+
+    if( ++_numHalvings[c] < _log2NumMergingProcesses )
+        StartHalving( c );
+}
+
+template<typename R,std::size_t d,std::size_t q>
+void
+SumScatterPipeline<R,d,q>::Scatter( std::size_t c )
+{
+    if( _halving )
+    {
+        if( _numMergingProcesses == 1 )
+        {
+            std::memcpy
+            ( _weightGridList[ChunkOffset(c)].Buffer(),
+              _partialWeightGridList[c*ChunkSize()*_numGrids].Buffer(),
+              _recvCounts[0]*sizeof(R) );
+        }
+        else
+            StartHalving( c );
+
+        // Advance the exchanges of the earlier chunks which have completed
+        for( std::size_t b=0; b<c; ++b )
+        {
+            int flag = 1;
+            while( flag && _numHalvings[b] < _log2NumMergingProcesses )
+            {
+                MPI_Testall
+                ( RequestsPerChunk, &_requests[b*RequestsPerChunk], &flag, 
+                  MPI_STATUSES_IGNORE );
+                if( flag )
+                    FinishHalving( b );
+            }
+        }
+    }
+    else
+    {
+        ISumScatter
+        ( _partialWeightGridList[c*ChunkSize()*_numGrids].Buffer(),
+          _weightGridList[ChunkOffset(c)].Buffer(),
+          &_recvCounts[0], _clusterComm, _requests[c*RequestsPerChunk] );
+
+        // Give the library a chance to progress the earlier chunks
+        int flag;
+        MPI_Testall
+        ( (c+1)*RequestsPerChunk, &_requests[0], &flag, 
+          MPI_STATUSES_IGNORE );
+    }
+    ++_numScattered;
+}
+
+template<typename R,std::size_t d,std::size_t q>
+void
+SumScatterPipeline<R,d,q>::Finish( WeightGridList<R,d,q>& weightGridList )
+{
+#ifndef RELEASE
+    if( _numScattered != _numChunks )
+        throw std::logic_error("Every chunk must be scattered");
+    if( weightGridList.Length() != _weightGridList.Length() )
+        throw std::logic_error("Weight grid lists are not the same length");
+#endif
+    if( _halving )
+    {
+        for( std::size_t c=0; c<_numChunks; ++c )
+        {
+            while( _numHalvings[c] < _log2NumMergingProcesses )
+            {
+                MPI_Waitall
+                ( RequestsPerChunk, &_requests[c*RequestsPerChunk], 
+                  MPI_STATUSES_IGNORE );
+                FinishHalving( c );
+            }
+        }
+    }
+    else if( !_requests.empty() )
+        MPI_Waitall( _requests.size(), &_requests[0], MPI_STATUSES_IGNORE );
+    weightGridList.Swap( _weightGridList );
+}
+
+} // bfio
+
+#endif // BFIO_STRUCTURES_SUM_SCATTER_PIPELINE_HPP
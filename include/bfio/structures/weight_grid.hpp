@@ -21,34 +21,27 @@
 #include <cstddef>
 #include <cstring>
 #include "bfio/constants.hpp"
+#include "bfio/structures/weight_grid_view.hpp"
 
 namespace bfio {
 
+// A weight grid which owns its data. Grids which are part of a larger 
+// collection should instead be stored in a WeightGridList.
 template<typename R,std::size_t d,std::size_t q>
 class WeightGrid
 {
     // We know the size is 2*q^d, but it's a bad idea to keep this on the stack.
     // We will use this to contiguously store the real, and then imaginary, 
     // components of the weights.
-    bool _hasBuffer;
-    bool _ownsBuffer;
     R* _buffer;
-    R* _realBuffer;
-    R* _imagBuffer;
 
 public:
     WeightGrid();
-    WeightGrid( bool createBuffer );
     WeightGrid( const WeightGrid<R,d,q>& weightGrid );
     ~WeightGrid();
 
-    // This buffer must be of length 2*q^d
-    void AttachBuffer( R* buffer, bool givingBuffer );
-
-    bool HasBuffer() const;
-    bool OwnsBuffer() const;
     const R* Buffer() const;
-    R* Buffer();
+          R* Buffer();
     const R* RealBuffer() const;
           R* RealBuffer();
     const R* ImagBuffer() const;
@@ -60,91 +53,29 @@ public:
 
     const WeightGrid<R,d,q>&
     operator= ( const WeightGrid<R,d,q>& weightGrid );
+
+    const WeightGrid<R,d,q>&
+    operator= ( const ConstWeightGridView<R,d,q>& weightGrid );
 };
 
 // Implementations
 
 template<typename R,std::size_t d,std::size_t q>
+inline
 WeightGrid<R,d,q>::WeightGrid()
-: _hasBuffer(true), _ownsBuffer(true)
-{
-    const std::size_t q_to_d = Pow<q,d>::val;
-    _buffer = new R[2*q_to_d];
-    _realBuffer = &_buffer[0];
-    _imagBuffer = &_buffer[q_to_d];
-}
-
-template<typename R,std::size_t d,std::size_t q>
-WeightGrid<R,d,q>::WeightGrid( bool createBuffer ) 
-: _hasBuffer(createBuffer), _ownsBuffer(createBuffer)
-{
-    if( createBuffer )
-    {
-        const std::size_t q_to_d = Pow<q,d>::val;
-        _buffer = new R[2*q_to_d];
-        _realBuffer = &_buffer[0];
-        _imagBuffer = &_buffer[q_to_d];
-    }
-    else
-    {
-        _buffer = 0;
-        _realBuffer = 0;
-        _imagBuffer = 0;
-    }
-}
+: _buffer(new R[2*Pow<q,d>::val])
+{ }
 
 template<typename R,std::size_t d,std::size_t q>
+inline
 WeightGrid<R,d,q>::WeightGrid( const WeightGrid<R,d,q>& weightGrid )
-: _hasBuffer(weightGrid.HasBuffer()), _ownsBuffer(weightGrid.HasBuffer())
-{
-    if( weightGrid.HasBuffer() )
-    {
-        const std::size_t q_to_d = Pow<q,d>::val;
-        _buffer = new R[2*q_to_d];
-        std::memcpy( _buffer, weightGrid.Buffer(), 2*q_to_d*sizeof(R) );
-        _realBuffer = &_buffer[0];
-        _imagBuffer = &_buffer[q_to_d];
-    }
-    else
-    {
-        _buffer = 0;
-        _realBuffer = 0;
-        _imagBuffer = 0;
-    }
-}
+: _buffer(new R[2*Pow<q,d>::val])
+{ std::memcpy( _buffer, weightGrid.Buffer(), 2*Pow<q,d>::val*sizeof(R) ); }
 
 template<typename R,std::size_t d,std::size_t q>
 inline
 WeightGrid<R,d,q>::~WeightGrid() 
-{ 
-    if( _ownsBuffer ) 
-        delete[] _buffer;
-}
-
-// This buffer must be of length 2*q^d
-template<typename R,std::size_t d,std::size_t q>
-void
-WeightGrid<R,d,q>::AttachBuffer( R* buffer, bool givingBuffer )
-{ 
-    if( _ownsBuffer )
-        delete[] _buffer;
-    _buffer = buffer;
-    _realBuffer = &_buffer[0];
-    _imagBuffer = &_buffer[Pow<q,d>::val];
-
-    _hasBuffer = true;
-    _ownsBuffer = givingBuffer;
-}
-
-template<typename R,std::size_t d,std::size_t q>
-inline bool
-WeightGrid<R,d,q>::HasBuffer() const
-{ return _hasBuffer; }
-
-template<typename R,std::size_t d,std::size_t q>
-inline bool
-WeightGrid<R,d,q>::OwnsBuffer() const
-{ return _ownsBuffer; }
+{ delete[] _buffer; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline const R*
@@ -159,74 +90,61 @@ WeightGrid<R,d,q>::Buffer()
 template<typename R,std::size_t d,std::size_t q>
 inline const R*
 WeightGrid<R,d,q>::RealBuffer() const
-{ return _realBuffer; }
+{ return _buffer; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline R*
 WeightGrid<R,d,q>::RealBuffer()
-{ return _realBuffer; }
+{ return _buffer; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline const R*
 WeightGrid<R,d,q>::ImagBuffer() const
-{ return _imagBuffer; }
+{ return &_buffer[Pow<q,d>::val]; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline R*
 WeightGrid<R,d,q>::ImagBuffer()
-{ return _imagBuffer; }
+{ return &_buffer[Pow<q,d>::val]; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline const R&
 WeightGrid<R,d,q>::RealWeight( std::size_t i ) const
-{ return _realBuffer[i]; }
+{ return _buffer[i]; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline R&
 WeightGrid<R,d,q>::RealWeight( std::size_t i )
-{ return _realBuffer[i]; }
+{ return _buffer[i]; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline const R&
 WeightGrid<R,d,q>::ImagWeight( std::size_t i ) const
-{ return _imagBuffer[i]; }
+{ return _buffer[Pow<q,d>::val+i]; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline R&
 WeightGrid<R,d,q>::ImagWeight( std::size_t i ) 
-{ return _imagBuffer[i]; }
+{ return _buffer[Pow<q,d>::val+i]; }
 
 template<typename R,std::size_t d,std::size_t q>
-const WeightGrid<R,d,q>&
+inline const WeightGrid<R,d,q>&
 WeightGrid<R,d,q>::operator=( const WeightGrid<R,d,q>& weightGrid )
 { 
-    if( weightGrid.HasBuffer() )
-    {
-        if( !_hasBuffer )
-        {
-            _buffer = new R[2*Pow<q,d>::val];    
-            _hasBuffer = true;
-            _ownsBuffer = true;
-        }
+    if( &weightGrid != this )
         std::memcpy
         ( _buffer, weightGrid.Buffer(), 2*Pow<q,d>::val*sizeof(R) );
-    }
-    else
-    {
-        if( _ownsBuffer )
-        {
-            delete[] _buffer;
-            _ownsBuffer = false;
-        }
-        _hasBuffer = false;
-        _buffer = 0;
-        _realBuffer = 0;
-        _imagBuffer = 0;
-    }
+    return *this;
+}
+
+template<typename R,std::size_t d,std::size_t q>
+inline const WeightGrid<R,d,q>&
+WeightGrid<R,d,q>::operator=( const ConstWeightGridView<R,d,q>& weightGrid )
+{ 
+    std::memcpy( _buffer, weightGrid.Buffer(), 2*Pow<q,d>::val*sizeof(R) );
     return *this;
 }
 
 } // bfio
 
 #endif // BFIO_STRUCTURES_WEIGHT_GRID_HPP
-
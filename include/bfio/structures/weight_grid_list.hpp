@@ -18,21 +18,33 @@
 #ifndef BFIO_STRUCTURES_WEIGHT_GRID_LIST_HPP
 #define BFIO_STRUCTURES_WEIGHT_GRID_LIST_HPP 1
 
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
 #include <vector>
-#include "bfio/structures/weight_grid.hpp"
+#include "bfio/constants.hpp"
+#include "bfio/structures/weight_grid_view.hpp"
 
 namespace bfio {
 
 // This class provides a list of weight grids whose buffers are guaranteed to 
-// be stored contiguously
+// be stored contiguously, 2*q^d entries apart, starting from an address 
+// aligned to Alignment bytes. Since many of the kernels treat consecutive 
+// grids as a single matrix, the grids are not individually padded, and so 
+// each of them is only aligned when 2*q^d*sizeof(R) is a multiple of 
+// Alignment. The grids are accessed through lightweight views.
 template<typename R,std::size_t d,std::size_t q>
 class WeightGridList
 {
-    const std::size_t _length;
-    std::vector<R> _buffer;
-    std::vector< WeightGrid<R,d,q> > _weightGrids;
+    std::size_t _length;
+    std::vector<R> _storage;
+    R* _buffer;
+
+    void Allocate( std::size_t length );
 
 public:
+    enum { Alignment = 64 };
+
     WeightGridList( std::size_t length );
     WeightGridList( const WeightGridList<R,d,q>& weightGridList );
     ~WeightGridList();
@@ -41,54 +53,53 @@ public:
           R* Buffer();
     std::size_t Length() const;
 
-    const WeightGrid<R,d,q>& 
+    ConstWeightGridView<R,d,q>
     operator[] ( std::size_t i ) const;
 
-    WeightGrid<R,d,q>& 
+    WeightGridView<R,d,q>
     operator[] ( std::size_t i );
 
     const WeightGridList<R,d,q>&
     operator=  ( const WeightGridList<R,d,q>& weightGridList );
+
+    // Exchanges the grids of the two lists without copying them
+    void Swap( WeightGridList<R,d,q>& weightGridList );
 };
 
 // Implementations
 
 template<typename R,std::size_t d,std::size_t q>
-WeightGridList<R,d,q>::WeightGridList( std::size_t length ) 
-: _length(length)
-{ 
-    // Create space for the data
+void
+WeightGridList<R,d,q>::Allocate( std::size_t length )
+{
+    // Over-allocate so that the data can begin on an aligned address. 
+    // The storage is at least aligned to sizeof(R), so the offset is an 
+    // integer number of entries.
     const std::size_t weightGridSize = 2*Pow<q,d>::val;
-    _buffer.resize( weightGridSize*length );
-
-    // Create the views of the data
-    _weightGrids.reserve( length );
-    for( std::size_t j=0; j<length; ++j )
-    {
-        _weightGrids.push_back( WeightGrid<R,d,q>( false ) );
-        _weightGrids[j].AttachBuffer( &_buffer[j*weightGridSize], false );
-    }
+    _length = length;
+    _storage.resize( weightGridSize*length + Alignment/sizeof(R) );
+    R* storage = &_storage[0];
+    const std::size_t misalignment = 
+        reinterpret_cast<std::size_t>(storage) % Alignment;
+    _buffer = 
+        ( misalignment == 0 ? storage 
+                            : storage + (Alignment-misalignment)/sizeof(R) );
 }
 
 template<typename R,std::size_t d,std::size_t q>
+inline
+WeightGridList<R,d,q>::WeightGridList( std::size_t length ) 
+{ Allocate( length ); }
+
+template<typename R,std::size_t d,std::size_t q>
+inline
 WeightGridList<R,d,q>::WeightGridList
 ( const WeightGridList<R,d,q>& weightGridList )
-: _length(weightGridList.Length())
 {
-    // Copy the data
-    const std::size_t weightGridSize = 2*Pow<q,d>::val;
-    _buffer.resize( weightGridSize*_length );
+    Allocate( weightGridList.Length() );
     std::memcpy
-    ( &_buffer[0], weightGridList.Buffer(), 
-      _length*weightGridSize*sizeof(R) );
-
-    // Create the views of the copied data
-    _weightGrids.reserve( _length );
-    for( std::size_t j=0; j<_length; ++j )
-    {
-        _weightGrids.push_back( WeightGrid<R,d,q>( false ) );
-        _weightGrids[j].AttachBuffer( &_buffer[j*weightGridSize], false );
-    }
+    ( _buffer, weightGridList.Buffer(), 
+      _length*2*Pow<q,d>::val*sizeof(R) );
 }
 
 template<typename R,std::size_t d,std::size_t q>
@@ -99,12 +110,12 @@ WeightGridList<R,d,q>::~WeightGridList()
 template<typename R,std::size_t d,std::size_t q>
 inline const R*
 WeightGridList<R,d,q>::Buffer() const
-{ return &_buffer[0]; }
+{ return _buffer; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline R*
 WeightGridList<R,d,q>::Buffer()
-{ return &_buffer[0]; }
+{ return _buffer; }
 
 template<typename R,std::size_t d,std::size_t q>
 inline std::size_t
@@ -112,44 +123,43 @@ WeightGridList<R,d,q>::Length() const
 { return _length; }
 
 template<typename R,std::size_t d,std::size_t q>
-inline const WeightGrid<R,d,q>& 
+inline ConstWeightGridView<R,d,q>
 WeightGridList<R,d,q>::operator[]
 ( std::size_t i ) const
-{ return _weightGrids[i]; }
+{ return ConstWeightGridView<R,d,q>( &_buffer[i*2*Pow<q,d>::val] ); }
 
 template<typename R,std::size_t d,std::size_t q>
-inline WeightGrid<R,d,q>& 
+inline WeightGridView<R,d,q>
 WeightGridList<R,d,q>::operator[]
 ( std::size_t i )
-{ return _weightGrids[i]; }
+{ return WeightGridView<R,d,q>( &_buffer[i*2*Pow<q,d>::val] ); }
 
 template<typename R,std::size_t d,std::size_t q>
 const WeightGridList<R,d,q>&
 WeightGridList<R,d,q>::operator=
 ( const WeightGridList<R,d,q>& weightGridList )
 { 
-    // Ensure that we have a large enough buffer
-    const std::size_t weightGridSize = 2*Pow<q,d>::val;
-    _length = weightGridList.Length();
-    _buffer.resize( weightGridSize*_length );
-
-    // Copy the data over
-    std::memcpy
-    ( &_buffer[0], weightGridList.Buffer(), 
-      _length*weightGridSize*sizeof(R) );
-
-    // Create the views of the data
-    _weightGrids.reserve( _length );
-    for( std::size_t j=0; j<_length; ++j )
+    if( &weightGridList != this )
     {
-        _weightGrids.push_back( WeightGrid<R,d,q>( false ) );
-        _weightGrids[j].AttachBuffer( &_buffer[j*weightGridSize], false );
+        if( _length != weightGridList.Length() )
+            Allocate( weightGridList.Length() );
+        std::memcpy
+        ( _buffer, weightGridList.Buffer(), 
+          _length*2*Pow<q,d>::val*sizeof(R) );
     }
-
     return *this;
 }
 
+template<typename R,std::size_t d,std::size_t q>
+inline void
+WeightGridList<R,d,q>::Swap( WeightGridList<R,d,q>& weightGridList )
+{
+    // Swapping the storage does not move it, so the buffers remain valid
+    _storage.swap( weightGridList._storage );
+    std::swap( _buffer, weightGridList._buffer );
+    std::swap( _length, weightGridList._length );
+}
+
 } // bfio
 
 #endif // BFIO_STRUCTURES_WEIGHT_GRID_LIST_HPP
-
@@ -0,0 +1,133 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+ 
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_STRUCTURES_WEIGHT_GRID_VIEW_HPP
+#define BFIO_STRUCTURES_WEIGHT_GRID_VIEW_HPP 1
+
+#include <cstddef>
+#include "bfio/constants.hpp"
+
+namespace bfio {
+
+// Lightweight views of a weight grid stored elsewhere (e.g., within a 
+// WeightGridList): the real, and then imaginary, components of the 2*q^d 
+// weights. Views are passed by value and do not own their data.
+template<typename R,std::size_t d,std::size_t q>
+class WeightGridView
+{
+    R* _buffer;
+
+public:
+    explicit WeightGridView( R* buffer );
+
+    R* Buffer() const;
+    R* RealBuffer() const;
+    R* ImagBuffer() const;
+    R& RealWeight( std::size_t i ) const;
+    R& ImagWeight( std::size_t i ) const;
+};
+
+template<typename R,std::size_t d,std::size_t q>
+class ConstWeightGridView
+{
+    const R* _buffer;
+
+public:
+    explicit ConstWeightGridView( const R* buffer );
+    ConstWeightGridView( const WeightGridView<R,d,q>& view );
+
+    const R* Buffer() const;
+    const R* RealBuffer() const;
+    const R* ImagBuffer() const;
+    const R& RealWeight( std::size_t i ) const;
+    const R& ImagWeight( std::size_t i ) const;
+};
+
+// Implementations
+
+template<typename R,std::size_t d,std::size_t q>
+inline
+WeightGridView<R,d,q>::WeightGridView( R* buffer )
+: _buffer(buffer)
+{ }
+
+template<typename R,std::size_t d,std::size_t q>
+inline R*
+WeightGridView<R,d,q>::Buffer() const
+{ return _buffer; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline R*
+WeightGridView<R,d,q>::RealBuffer() const
+{ return _buffer; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline R*
+WeightGridView<R,d,q>::ImagBuffer() const
+{ return &_buffer[Pow<q,d>::val]; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline R&
+WeightGridView<R,d,q>::RealWeight( std::size_t i ) const
+{ return _buffer[i]; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline R&
+WeightGridView<R,d,q>::ImagWeight( std::size_t i ) const
+{ return _buffer[Pow<q,d>::val+i]; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline
+ConstWeightGridView<R,d,q>::ConstWeightGridView( const R* buffer )
+: _buffer(buffer)
+{ }
+
+template<typename R,std::size_t d,std::size_t q>
+inline
+ConstWeightGridView<R,d,q>::ConstWeightGridView
+( const WeightGridView<R,d,q>& view )
+: _buffer(view.Buffer())
+{ }
+
+template<typename R,std::size_t d,std::size_t q>
+inline const R*
+ConstWeightGridView<R,d,q>::Buffer() const
+{ return _buffer; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline const R*
+ConstWeightGridView<R,d,q>::RealBuffer() const
+{ return _buffer; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline const R*
+ConstWeightGridView<R,d,q>::ImagBuffer() const
+{ return &_buffer[Pow<q,d>::val]; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline const R&
+ConstWeightGridView<R,d,q>::RealWeight( std::size_t i ) const
+{ return _buffer[i]; }
+
+template<typename R,std::size_t d,std::size_t q>
+inline const R&
+ConstWeightGridView<R,d,q>::ImagWeight( std::size_t i ) const
+{ return _buffer[Pow<q,d>::val+i]; }
+
+} // bfio
+
+#endif // BFIO_STRUCTURES_WEIGHT_GRID_VIEW_HPP
@@ -22,11 +22,16 @@
 #include "bfio/tools/flatten_constrained_htree_index.hpp"
 #include "bfio/tools/flatten_htree_index.hpp"
 #include "bfio/tools/lapack.hpp"
+#include "bfio/tools/map_kernels.hpp"
 #include "bfio/tools/mpi.hpp"
+#include "bfio/tools/reverse_constrained_htree_index.hpp"
 #include "bfio/tools/special_functions.hpp"
+#include "bfio/tools/threads.hpp"
 #include "bfio/tools/timer.hpp"
 #include "bfio/tools/twiddle.hpp"
+#include "bfio/tools/unflatten_constrained_htree_index.hpp"
 #include "bfio/tools/uniform.hpp"
+#include "bfio/tools/wire_format.hpp"
 
 #endif // BFIO_TOOLS_HPP
 
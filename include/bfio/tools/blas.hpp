@@ -42,6 +42,16 @@ void Gemm
            const R* B, int ldb,
   R beta,        R* C, int ldc );
 
+// Apply batchSize independent products C[i] := alpha A[i] B[i] + beta C[i]
+// which all share the same dimensions, transposition and leading dimensions.
+// The output matrices must not overlap.
+template<typename R>
+void GemmBatch
+( char transa, char transb, int m, int n, int k,
+  R alpha, const R* const* A, int lda,
+           const R* const* B, int ldb,
+  R beta,        R* const* C, int ldc, int batchSize );
+
 template<typename R>
 void Ger
 ( int m, int n, 
@@ -81,6 +91,24 @@ void BLAS(dgemm)
                        const double* B, const int* ldb,
   const double* beta,        double* C, const int* ldc );
 
+#if defined(GEMM_BATCH)
+void BLAS(sgemm_batch)
+( const char* transAArray, const char* transBArray,
+  const int* mArray, const int* nArray, const int* kArray,
+  const float* alphaArray, const float** AArray, const int* ldaArray,
+                           const float** BArray, const int* ldbArray,
+  const float* betaArray,        float** CArray, const int* ldcArray,
+  const int* groupCount, const int* groupSize );
+
+void BLAS(dgemm_batch)
+( const char* transAArray, const char* transBArray,
+  const int* mArray, const int* nArray, const int* kArray,
+  const double* alphaArray, const double** AArray, const int* ldaArray,
+                            const double** BArray, const int* ldbArray,
+  const double* betaArray,        double** CArray, const int* ldcArray,
+  const int* groupCount, const int* groupSize );
+#endif // GEMM_BATCH
+
 void BLAS(sger)
 ( const int* m, const int* n,
   const float* alpha, const float* x, const int* incx,
@@ -150,6 +178,59 @@ Gemm<double>
       &alpha, A, &lda, B, &ldb, &beta, C, &ldc );
 }
 
+#if defined(GEMM_BATCH)
+template<>
+inline void
+GemmBatch<float>
+( char transa, char transb, int m, int n, int k,
+  float alpha, const float* const* A, int lda,
+               const float* const* B, int ldb,
+  float beta,        float* const* C, int ldc, int batchSize )
+{
+    if( batchSize == 0 )
+        return;
+    const int groupCount = 1;
+    BLAS(sgemm_batch)
+    ( &transa, &transb, &m, &n, &k,
+      &alpha, const_cast<const float**>(A), &lda,
+              const_cast<const float**>(B), &ldb,
+      &beta,  const_cast<float**>(C), &ldc, &groupCount, &batchSize );
+}
+
+template<>
+inline void
+GemmBatch<double>
+( char transa, char transb, int m, int n, int k,
+  double alpha, const double* const* A, int lda,
+                const double* const* B, int ldb,
+  double beta,        double* const* C, int ldc, int batchSize )
+{
+    if( batchSize == 0 )
+        return;
+    const int groupCount = 1;
+    BLAS(dgemm_batch)
+    ( &transa, &transb, &m, &n, &k,
+      &alpha, const_cast<const double**>(A), &lda,
+              const_cast<const double**>(B), &ldb,
+      &beta,  const_cast<double**>(C), &ldc, &groupCount, &batchSize );
+}
+#else
+// Without a vendor batched gemm, fall back to issuing the products one by one
+template<typename R>
+inline void
+GemmBatch
+( char transa, char transb, int m, int n, int k,
+  R alpha, const R* const* A, int lda,
+           const R* const* B, int ldb,
+  R beta,        R* const* C, int ldc, int batchSize )
+{
+    for( int i=0; i<batchSize; ++i )
+        Gemm
+        ( transa, transb, m, n, k, 
+          alpha, A[i], lda, B[i], ldb, beta, C[i], ldc );
+}
+#endif // GEMM_BATCH
+
 template<>
 inline void
 Ger<float>
@@ -0,0 +1,209 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_TOOLS_MAP_KERNELS_HPP
+#define BFIO_TOOLS_MAP_KERNELS_HPP 1
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "bfio/tools/blas.hpp"
+
+namespace bfio {
+
+// Kernels for applying a q x q map (e.g., a Chebyshev map) along one
+// dimension of a set of weight grids. When MAP_KERNELS is defined, they are
+// implemented with loops whose trip counts are known at compile time so that
+// the compiler can fully unroll and vectorize them; otherwise they are
+// forwarded to Gemm/GemmBatch.
+
+// C := op(M) B + beta C, where M is q x q and B and C are q x n matrices
+// stored with leading dimension q. op(M) is M if transM is 'N' and M^T if
+// it is 'T'.
+template<typename R,std::size_t q>
+void MapColumns
+( char transM, std::size_t n, const R* M, const R* B, R beta, R* C );
+
+// The arrays of pointers which MapRows hands to a vendor batched gemm. 
+// Callers which keep one between calls only allocate them once; they are 
+// unused unless GEMM_BATCH is defined (and MAP_KERNELS is not).
+template<typename R>
+struct MapRowsBatch
+{
+    std::vector<const R*> A;
+    std::vector<const R*> M;
+    std::vector<R*> C;
+
+    MapRowsBatch( std::size_t maxSlices=0 );
+};
+
+// C_s := A_s op(M) + beta C_s for each of the numSlices consecutive m x q
+// matrices A_s and C_s, which are stored with leading dimension m.
+template<typename R,std::size_t q>
+void MapRows
+( char transM, std::size_t m, std::size_t numSlices,
+  const R* M, const R* A, R beta, R* C, MapRowsBatch<R>& batch );
+
+template<typename R,std::size_t q>
+void MapRows
+( char transM, std::size_t m, std::size_t numSlices,
+  const R* M, const R* A, R beta, R* C );
+
+// Implementations
+
+#ifdef MAP_KERNELS
+namespace map_kernels {
+
+// Form op(M) so that the kernels can always run down its columns
+template<typename R,std::size_t q>
+inline void
+FormMap( char transM, const R* RESTRICT M, R* RESTRICT opM )
+{
+    if( transM == 'T' )
+    {
+        for( std::size_t k=0; k<q; ++k )
+            for( std::size_t i=0; i<q; ++i )
+                opM[i+k*q] = M[k+i*q];
+    }
+    else
+        std::memcpy( opM, M, q*q*sizeof(R) );
+}
+
+} // map_kernels
+#endif // MAP_KERNELS
+
+template<typename R,std::size_t q>
+inline void
+MapColumns
+( char transM, std::size_t n, const R* M, const R* B, R beta, R* C )
+{
+#ifdef MAP_KERNELS
+    R opM[q*q];
+    map_kernels::FormMap<R,q>( transM, M, opM );
+    for( std::size_t col=0; col<n; ++col )
+    {
+        const R* RESTRICT b = &B[col*q];
+        R* RESTRICT c = &C[col*q];
+
+        const R b0 = b[0];
+        if( beta == (R)0 )
+            for( std::size_t i=0; i<q; ++i )
+                c[i] = opM[i]*b0;
+        else
+            for( std::size_t i=0; i<q; ++i )
+                c[i] = beta*c[i] + opM[i]*b0;
+        for( std::size_t k=1; k<q; ++k )
+        {
+            const R bk = b[k];
+            const R* RESTRICT opMColumn = &opM[k*q];
+            for( std::size_t i=0; i<q; ++i )
+                c[i] += opMColumn[i]*bk;
+        }
+    }
+#else
+    if( n != 0 )
+        Gemm
+        ( transM, 'N', q, n, q,
+          (R)1, M, q, B, q, beta, C, q );
+#endif
+}
+
+template<typename R>
+inline
+MapRowsBatch<R>::MapRowsBatch( std::size_t maxSlices )
+{
+#if defined(GEMM_BATCH) && !defined(MAP_KERNELS)
+    A.reserve( maxSlices );
+    M.reserve( maxSlices );
+    C.reserve( maxSlices );
+#endif
+}
+
+template<typename R,std::size_t q>
+inline void
+MapRows
+( char transM, std::size_t m, std::size_t numSlices,
+  const R* M, const R* A, R beta, R* C, MapRowsBatch<R>& batch )
+{
+#ifdef MAP_KERNELS
+    R opM[q*q];
+    map_kernels::FormMap<R,q>( transM, M, opM );
+    for( std::size_t s=0; s<numSlices; ++s )
+    {
+        const R* RESTRICT a = &A[s*m*q];
+        R* RESTRICT c = &C[s*m*q];
+        for( std::size_t t=0; t<q; ++t )
+        {
+            R* RESTRICT cColumn = &c[t*m];
+            const R* RESTRICT opMColumn = &opM[t*q];
+            if( beta == (R)0 )
+            {
+                const R coefficient = opMColumn[0];
+                for( std::size_t w=0; w<m; ++w )
+                    cColumn[w] = coefficient*a[w];
+            }
+            else
+            {
+                const R coefficient = opMColumn[0];
+                for( std::size_t w=0; w<m; ++w )
+                    cColumn[w] = beta*cColumn[w] + coefficient*a[w];
+            }
+            for( std::size_t k=1; k<q; ++k )
+            {
+                const R coefficient = opMColumn[k];
+                const R* RESTRICT aColumn = &a[k*m];
+                for( std::size_t w=0; w<m; ++w )
+                    cColumn[w] += coefficient*aColumn[w];
+            }
+        }
+    }
+#elif defined(GEMM_BATCH)
+    batch.A.resize( numSlices );
+    batch.M.assign( numSlices, M );
+    batch.C.resize( numSlices );
+    for( std::size_t s=0; s<numSlices; ++s )
+    {
+        batch.A[s] = &A[s*m*q];
+        batch.C[s] = &C[s*m*q];
+    }
+    if( numSlices != 0 )
+        GemmBatch
+        ( 'N', transM, m, q, q,
+          (R)1, &batch.A[0], m, &batch.M[0], q, 
+          beta, &batch.C[0], m, numSlices );
+#else
+    for( std::size_t s=0; s<numSlices; ++s )
+        Gemm
+        ( 'N', transM, m, q, q,
+          (R)1, &A[s*m*q], m, M, q, beta, &C[s*m*q], m );
+#endif
+}
+
+template<typename R,std::size_t q>
+inline void
+MapRows
+( char transM, std::size_t m, std::size_t numSlices,
+  const R* M, const R* A, R beta, R* C )
+{
+    MapRowsBatch<R> batch;
+    MapRows<R,q>( transM, m, numSlices, M, A, beta, C, batch );
+}
+
+} // bfio
+
+#endif // BFIO_TOOLS_MAP_KERNELS_HPP
@@ -28,6 +28,34 @@ void
 SumScatter
 ( const T* sendBuf, T* recvBuf, int* recvCounts, MPI_Comm comm );
 
+// Starts a SumScatter which is complete once 'request' is. Neither buffer 
+// nor recvCounts may be modified until then. Without MPI-3, the summation 
+// is performed before returning and the request is null.
+template<typename T>
+void
+ISumScatter
+( const T* sendBuf, T* recvBuf, int* recvCounts, MPI_Comm comm, 
+  MPI_Request& request );
+
+// Process i contributes the recvCounts[i] entries of buf starting at 
+// displs[i], and every process is left with all of them
+template<typename T>
+void
+AllGather( T* buf, int* recvCounts, int* displs, MPI_Comm comm );
+
+// Nonblocking point-to-point messages of T's (raw bytes for T=char)
+template<typename T>
+void
+ISend
+( const T* buf, int count, int dest, int tag, MPI_Comm comm, 
+  MPI_Request& request );
+
+template<typename T>
+void
+IRecv
+( T* buf, int count, int source, int tag, MPI_Comm comm, 
+  MPI_Request& request );
+
 } // bfio
 
 // Implementations 
@@ -77,6 +105,225 @@ SumScatter<double>
 #endif
 }
 
+template<>
+inline void
+ISumScatter<float>
+( const float* sendBuf, float* recvBuf, int* recvCounts, MPI_Comm comm,
+  MPI_Request& request )
+{
+#if MPI_VERSION >= 3
+#ifdef RELEASE
+    MPI_Ireduce_scatter
+    ( const_cast<float*>(sendBuf), 
+      recvBuf, recvCounts, MPI_FLOAT, MPI_SUM, comm, &request );
+#else
+    int ierror = MPI_Ireduce_scatter
+    ( const_cast<float*>(sendBuf), 
+      recvBuf, recvCounts, MPI_FLOAT, MPI_SUM, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Ireduce_scatter = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+#else
+    SumScatter( sendBuf, recvBuf, recvCounts, comm );
+    request = MPI_REQUEST_NULL;
+#endif
+}
+
+template<>
+inline void
+ISumScatter<double>
+( const double* sendBuf, double* recvBuf, int* recvCounts, MPI_Comm comm,
+  MPI_Request& request )
+{
+#if MPI_VERSION >= 3
+#ifdef RELEASE
+    MPI_Ireduce_scatter
+    ( const_cast<double*>(sendBuf), 
+      recvBuf, recvCounts, MPI_DOUBLE, MPI_SUM, comm, &request );
+#else
+    int ierror = MPI_Ireduce_scatter
+    ( const_cast<double*>(sendBuf), 
+      recvBuf, recvCounts, MPI_DOUBLE, MPI_SUM, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Ireduce_scatter = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+#else
+    SumScatter( sendBuf, recvBuf, recvCounts, comm );
+    request = MPI_REQUEST_NULL;
+#endif
+}
+
+template<>
+inline void
+AllGather<float>
+( float* buf, int* recvCounts, int* displs, MPI_Comm comm )
+{
+#ifdef RELEASE
+    MPI_Allgatherv
+    ( MPI_IN_PLACE, 0, MPI_FLOAT, buf, recvCounts, displs, MPI_FLOAT, comm );
+#else
+    int ierror = MPI_Allgatherv
+    ( MPI_IN_PLACE, 0, MPI_FLOAT, buf, recvCounts, displs, MPI_FLOAT, comm );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Allgatherv = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+AllGather<double>
+( double* buf, int* recvCounts, int* displs, MPI_Comm comm )
+{
+#ifdef RELEASE
+    MPI_Allgatherv
+    ( MPI_IN_PLACE, 0, MPI_DOUBLE, buf, recvCounts, displs, MPI_DOUBLE, comm );
+#else
+    int ierror = MPI_Allgatherv
+    ( MPI_IN_PLACE, 0, MPI_DOUBLE, buf, recvCounts, displs, MPI_DOUBLE, comm );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Allgatherv = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+ISend<float>
+( const float* buf, int count, int dest, int tag, MPI_Comm comm, 
+  MPI_Request& request )
+{
+#ifdef RELEASE
+    MPI_Isend
+    ( const_cast<float*>(buf), count, MPI_FLOAT, dest, tag, comm, &request );
+#else
+    int ierror = MPI_Isend
+    ( const_cast<float*>(buf), count, MPI_FLOAT, dest, tag, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Isend = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+IRecv<float>
+( float* buf, int count, int source, int tag, MPI_Comm comm, 
+  MPI_Request& request )
+{
+#ifdef RELEASE
+    MPI_Irecv( buf, count, MPI_FLOAT, source, tag, comm, &request );
+#else
+    int ierror = MPI_Irecv
+    ( buf, count, MPI_FLOAT, source, tag, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Irecv = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+ISend<double>
+( const double* buf, int count, int dest, int tag, MPI_Comm comm, 
+  MPI_Request& request )
+{
+#ifdef RELEASE
+    MPI_Isend
+    ( const_cast<double*>(buf), count, MPI_DOUBLE, dest, tag, comm, &request );
+#else
+    int ierror = MPI_Isend
+    ( const_cast<double*>(buf), count, MPI_DOUBLE, dest, tag, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Isend = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+IRecv<double>
+( double* buf, int count, int source, int tag, MPI_Comm comm, 
+  MPI_Request& request )
+{
+#ifdef RELEASE
+    MPI_Irecv( buf, count, MPI_DOUBLE, source, tag, comm, &request );
+#else
+    int ierror = MPI_Irecv
+    ( buf, count, MPI_DOUBLE, source, tag, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Irecv = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+ISend<char>
+( const char* buf, int count, int dest, int tag, MPI_Comm comm, 
+  MPI_Request& request )
+{
+#ifdef RELEASE
+    MPI_Isend
+    ( const_cast<char*>(buf), count, MPI_BYTE, dest, tag, comm, &request );
+#else
+    int ierror = MPI_Isend
+    ( const_cast<char*>(buf), count, MPI_BYTE, dest, tag, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Isend = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
+template<>
+inline void
+IRecv<char>
+( char* buf, int count, int source, int tag, MPI_Comm comm, 
+  MPI_Request& request )
+{
+#ifdef RELEASE
+    MPI_Irecv( buf, count, MPI_BYTE, source, tag, comm, &request );
+#else
+    int ierror = MPI_Irecv
+    ( buf, count, MPI_BYTE, source, tag, comm, &request );
+    if( ierror != 0 )
+    {
+        std::ostringstream msg;
+        msg << "ierror from MPI_Irecv = " << ierror;
+        throw std::runtime_error( msg.str() );
+    }
+#endif
+}
+
 } // bfio
 
 #endif // BFIO_TOOLS_MPI_HPP
@@ -0,0 +1,71 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_TOOLS_REVERSE_CONSTRAINED_HTREE_INDEX_HPP
+#define BFIO_TOOLS_REVERSE_CONSTRAINED_HTREE_INDEX_HPP 1
+
+#include <cstddef>
+
+namespace bfio {
+
+// A constrained HTree index of log2NumBoxes bits consists of d-bit digits, 
+// one per level with the finest level in the lowest digit, and a partial 
+// top digit of log2NumBoxes % d bits if the dimensions are not equally 
+// refined. ReverseConstrainedHTreeIndex reverses the order of the full 
+// digits and moves the partial digit to the bottom, so that coarsening every 
+// dimension (dropping the finest digit) frees the top d bits of the result.
+template<std::size_t d>
+std::size_t
+ReverseConstrainedHTreeIndex
+( std::size_t index, std::size_t log2NumBoxes )
+{
+    const std::size_t numDigits = log2NumBoxes / d;
+    const std::size_t log2Remainder = log2NumBoxes - numDigits*d;
+    const std::size_t digitMask = (1u<<d)-1;
+
+    std::size_t reversed = 0;
+    for( std::size_t i=0; i<numDigits; ++i )
+    {
+        reversed = (reversed<<d) | (index&digitMask);
+        index >>= d;
+    }
+    return (reversed<<log2Remainder) | index;
+}
+
+// Inverse of ReverseConstrainedHTreeIndex
+template<std::size_t d>
+std::size_t
+UnreverseConstrainedHTreeIndex
+( std::size_t reversed, std::size_t log2NumBoxes )
+{
+    const std::size_t numDigits = log2NumBoxes / d;
+    const std::size_t log2Remainder = log2NumBoxes - numDigits*d;
+    const std::size_t digitMask = (1u<<d)-1;
+
+    std::size_t index = reversed & ((1u<<log2Remainder)-1);
+    reversed >>= log2Remainder;
+    for( std::size_t i=0; i<numDigits; ++i )
+    {
+        index = (index<<d) | (reversed&digitMask);
+        reversed >>= d;
+    }
+    return index;
+}
+
+} // bfio
+
+#endif // BFIO_TOOLS_REVERSE_CONSTRAINED_HTREE_INDEX_HPP
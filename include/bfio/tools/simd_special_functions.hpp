@@ -0,0 +1,427 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_TOOLS_SIMD_SPECIAL_FUNCTIONS_HPP
+#define BFIO_TOOLS_SIMD_SPECIAL_FUNCTIONS_HPP 1
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX512F__) || ( defined(__AVX2__) && defined(__FMA__) )
+# include <immintrin.h>
+#endif
+
+namespace bfio {
+
+// Built-in vectorized sin/cos/sqrt kernels for builds which have neither 
+// MKL's VML nor IBM's MASS. The arguments are reduced to [-pi/4,pi/4] with a 
+// three-part Cody-Waite splitting of pi/2 and then fed into minimax 
+// polynomials (those of fdlibm for doubles and Cephes for floats), which 
+// keeps the results within a few ulps of libm. Arguments too large for the 
+// splitting to be exact are handed off to libm.
+//
+// The kernels are written once in terms of a 'pack' of SIMD lanes. AVX-512 
+// or AVX2+FMA packs are used if the compiler targets them, and otherwise a 
+// single-lane portable pack is used, which the compiler is free to 
+// vectorize on its own.
+namespace simd {
+
+template<typename R>
+void SinCos
+( std::size_t n, const R* a, R* sinResults, R* cosResults );
+
+template<typename R>
+void Sin( std::size_t n, const R* a, R* sinResults );
+
+template<typename R>
+void Cos( std::size_t n, const R* a, R* cosResults );
+
+template<typename R>
+void Sqrt( std::size_t n, const R* a, R* sqrtResults );
+
+// Implementations
+
+template<typename R>
+struct ScalarPack
+{
+    typedef R Real;
+    typedef R Vec;
+    typedef bool Mask;
+    enum { Width = 1 };
+
+    static Vec Load( const R* a ) { return *a; }
+    static void Store( R* a, Vec x ) { *a = x; }
+    static Vec Set( R alpha ) { return alpha; }
+    static Vec Add( Vec x, Vec y ) { return x+y; }
+    static Vec Sub( Vec x, Vec y ) { return x-y; }
+    static Vec Mul( Vec x, Vec y ) { return x*y; }
+    static Vec MulAdd( Vec x, Vec y, Vec z ) { return x*y+z; }
+    static Vec Abs( Vec x ) { return std::abs(x); }
+    // Only called on arguments small enough to fit in a long, and cheaper 
+    // than floor() on targets without a rounding instruction
+    static Vec Floor( Vec x ) 
+    { const long i = static_cast<long>(x); return R(i-(x<R(i))); }
+    static Vec Round( Vec x ) { return Floor( x+R(0.5) ); }
+    static Vec Sqrt( Vec x ) { return std::sqrt(x); }
+    static Mask Equal( Vec x, Vec y ) { return x == y; }
+    static Mask GreaterEqual( Vec x, Vec y ) { return x >= y; }
+    static Mask Or( Mask x, Mask y ) { return x || y; }
+    // Indexing rather than branching avoids mispredictions on the quadrant
+    static Vec Select( Mask m, Vec x, Vec y ) 
+    { const R choices[2] = { y, x }; return choices[m]; }
+    static bool AnyGreater( Vec x, Vec y ) { return x > y; }
+};
+
+#if defined(__AVX512F__)
+template<typename R>
+struct Avx512Pack;
+
+template<>
+struct Avx512Pack<double>
+{
+    typedef double Real;
+    typedef __m512d Vec;
+    typedef __mmask8 Mask;
+    enum { Width = 8 };
+
+    static Vec Load( const double* a ) { return _mm512_loadu_pd( a ); }
+    static void Store( double* a, Vec x ) { _mm512_storeu_pd( a, x ); }
+    static Vec Set( double alpha ) { return _mm512_set1_pd( alpha ); }
+    static Vec Add( Vec x, Vec y ) { return _mm512_add_pd( x, y ); }
+    static Vec Sub( Vec x, Vec y ) { return _mm512_sub_pd( x, y ); }
+    static Vec Mul( Vec x, Vec y ) { return _mm512_mul_pd( x, y ); }
+    static Vec MulAdd( Vec x, Vec y, Vec z ) 
+    { return _mm512_fmadd_pd( x, y, z ); }
+    static Vec Abs( Vec x ) { return _mm512_abs_pd( x ); }
+    static Vec Floor( Vec x ) 
+    { return _mm512_roundscale_pd( x, _MM_FROUND_TO_NEG_INF ); }
+    static Vec Round( Vec x ) 
+    { return _mm512_roundscale_pd( x, _MM_FROUND_TO_NEAREST_INT ); }
+    static Vec Sqrt( Vec x ) { return _mm512_sqrt_pd( x ); }
+    static Mask Equal( Vec x, Vec y ) 
+    { return _mm512_cmp_pd_mask( x, y, _CMP_EQ_OQ ); }
+    static Mask GreaterEqual( Vec x, Vec y ) 
+    { return _mm512_cmp_pd_mask( x, y, _CMP_GE_OQ ); }
+    static Mask Or( Mask x, Mask y ) { return x | y; }
+    static Vec Select( Mask m, Vec x, Vec y ) 
+    { return _mm512_mask_blend_pd( m, y, x ); }
+    static bool AnyGreater( Vec x, Vec y ) 
+    { return _mm512_cmp_pd_mask( x, y, _CMP_GT_OQ ) != 0; }
+};
+
+template<>
+struct Avx512Pack<float>
+{
+    typedef float Real;
+    typedef __m512 Vec;
+    typedef __mmask16 Mask;
+    enum { Width = 16 };
+
+    static Vec Load( const float* a ) { return _mm512_loadu_ps( a ); }
+    static void Store( float* a, Vec x ) { _mm512_storeu_ps( a, x ); }
+    static Vec Set( float alpha ) { return _mm512_set1_ps( alpha ); }
+    static Vec Add( Vec x, Vec y ) { return _mm512_add_ps( x, y ); }
+    static Vec Sub( Vec x, Vec y ) { return _mm512_sub_ps( x, y ); }
+    static Vec Mul( Vec x, Vec y ) { return _mm512_mul_ps( x, y ); }
+    static Vec MulAdd( Vec x, Vec y, Vec z ) 
+    { return _mm512_fmadd_ps( x, y, z ); }
+    static Vec Abs( Vec x ) { return _mm512_abs_ps( x ); }
+    static Vec Floor( Vec x ) 
+    { return _mm512_roundscale_ps( x, _MM_FROUND_TO_NEG_INF ); }
+    static Vec Round( Vec x ) 
+    { return _mm512_roundscale_ps( x, _MM_FROUND_TO_NEAREST_INT ); }
+    static Vec Sqrt( Vec x ) { return _mm512_sqrt_ps( x ); }
+    static Mask Equal( Vec x, Vec y ) 
+    { return _mm512_cmp_ps_mask( x, y, _CMP_EQ_OQ ); }
+    static Mask GreaterEqual( Vec x, Vec y ) 
+    { return _mm512_cmp_ps_mask( x, y, _CMP_GE_OQ ); }
+    static Mask Or( Mask x, Mask y ) { return x | y; }
+    static Vec Select( Mask m, Vec x, Vec y ) 
+    { return _mm512_mask_blend_ps( m, y, x ); }
+    static bool AnyGreater( Vec x, Vec y ) 
+    { return _mm512_cmp_ps_mask( x, y, _CMP_GT_OQ ) != 0; }
+};
+
+template<typename R>
+struct NativePack
+{ typedef Avx512Pack<R> Type; };
+#elif defined(__AVX2__) && defined(__FMA__)
+template<typename R>
+struct Avx2Pack;
+
+template<>
+struct Avx2Pack<double>
+{
+    typedef double Real;
+    typedef __m256d Vec;
+    typedef __m256d Mask;
+    enum { Width = 4 };
+
+    static Vec Load( const double* a ) { return _mm256_loadu_pd( a ); }
+    static void Store( double* a, Vec x ) { _mm256_storeu_pd( a, x ); }
+    static Vec Set( double alpha ) { return _mm256_set1_pd( alpha ); }
+    static Vec Add( Vec x, Vec y ) { return _mm256_add_pd( x, y ); }
+    static Vec Sub( Vec x, Vec y ) { return _mm256_sub_pd( x, y ); }
+    static Vec Mul( Vec x, Vec y ) { return _mm256_mul_pd( x, y ); }
+    static Vec MulAdd( Vec x, Vec y, Vec z ) 
+    { return _mm256_fmadd_pd( x, y, z ); }
+    static Vec Abs( Vec x ) 
+    { return _mm256_andnot_pd( _mm256_set1_pd( -0.0 ), x ); }
+    static Vec Floor( Vec x ) { return _mm256_floor_pd( x ); }
+    static Vec Round( Vec x ) 
+    { return _mm256_round_pd
+             ( x, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC ); }
+    static Vec Sqrt( Vec x ) { return _mm256_sqrt_pd( x ); }
+    static Mask Equal( Vec x, Vec y ) 
+    { return _mm256_cmp_pd( x, y, _CMP_EQ_OQ ); }
+    static Mask GreaterEqual( Vec x, Vec y ) 
+    { return _mm256_cmp_pd( x, y, _CMP_GE_OQ ); }
+    static Mask Or( Mask x, Mask y ) { return _mm256_or_pd( x, y ); }
+    static Vec Select( Mask m, Vec x, Vec y ) 
+    { return _mm256_blendv_pd( y, x, m ); }
+    static bool AnyGreater( Vec x, Vec y ) 
+    { return _mm256_movemask_pd( _mm256_cmp_pd( x, y, _CMP_GT_OQ ) ) != 0; }
+};
+
+template<>
+struct Avx2Pack<float>
+{
+    typedef float Real;
+    typedef __m256 Vec;
+    typedef __m256 Mask;
+    enum { Width = 8 };
+
+    static Vec Load( const float* a ) { return _mm256_loadu_ps( a ); }
+    static void Store( float* a, Vec x ) { _mm256_storeu_ps( a, x ); }
+    static Vec Set( float alpha ) { return _mm256_set1_ps( alpha ); }
+    static Vec Add( Vec x, Vec y ) { return _mm256_add_ps( x, y ); }
+    static Vec Sub( Vec x, Vec y ) { return _mm256_sub_ps( x, y ); }
+    static Vec Mul( Vec x, Vec y ) { return _mm256_mul_ps( x, y ); }
+    static Vec MulAdd( Vec x, Vec y, Vec z ) 
+    { return _mm256_fmadd_ps( x, y, z ); }
+    static Vec Abs( Vec x ) 
+    { return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), x ); }
+    static Vec Floor( Vec x ) { return _mm256_floor_ps( x ); }
+    static Vec Round( Vec x ) 
+    { return _mm256_round_ps
+             ( x, _MM_FROUND_TO_NEAREST_INT|_MM_FROUND_NO_EXC ); }
+    static Vec Sqrt( Vec x ) { return _mm256_sqrt_ps( x ); }
+    static Mask Equal( Vec x, Vec y ) 
+    { return _mm256_cmp_ps( x, y, _CMP_EQ_OQ ); }
+    static Mask GreaterEqual( Vec x, Vec y ) 
+    { return _mm256_cmp_ps( x, y, _CMP_GE_OQ ); }
+    static Mask Or( Mask x, Mask y ) { return _mm256_or_ps( x, y ); }
+    static Vec Select( Mask m, Vec x, Vec y ) 
+    { return _mm256_blendv_ps( y, x, m ); }
+    static bool AnyGreater( Vec x, Vec y ) 
+    { return _mm256_movemask_ps( _mm256_cmp_ps( x, y, _CMP_GT_OQ ) ) != 0; }
+};
+
+template<typename R>
+struct NativePack
+{ typedef Avx2Pack<R> Type; };
+#else
+template<typename R>
+struct NativePack
+{ typedef ScalarPack<R> Type; };
+#endif
+
+// The reduction constants and the polynomial approximations of sin and cos 
+// over [-pi/4,pi/4] in terms of r and z=r^2
+template<typename R>
+struct Trig;
+
+template<>
+struct Trig<double>
+{
+    // k*PiOverTwo1 is exact as long as |k| < 2^20
+    static double Limit() { return 1.e6; }
+    static double TwoOverPi() { return 6.36619772367581382433e-01; }
+    static double PiOverTwo1() { return 1.57079632673412561417e+00; }
+    static double PiOverTwo2() { return 6.07710050630396597660e-11; }
+    static double PiOverTwo3() { return 2.02226624871116645580e-21; }
+
+    template<typename Pack>
+    static typename Pack::Vec 
+    Sin( typename Pack::Vec r, typename Pack::Vec z )
+    {
+        typename Pack::Vec p = Pack::Set( 1.58969099521155010221e-10 );
+        p = Pack::MulAdd( p, z, Pack::Set( -2.50507602534068634195e-08 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( 2.75573137070700676789e-06 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( -1.98412698298579493134e-04 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( 8.33333333332248946124e-03 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( -1.66666666666666324348e-01 ) );
+        return Pack::MulAdd( Pack::Mul( r, z ), p, r );
+    }
+
+    template<typename Pack>
+    static typename Pack::Vec 
+    Cos( typename Pack::Vec z )
+    {
+        typename Pack::Vec p = Pack::Set( -1.13596475577881948265e-11 );
+        p = Pack::MulAdd( p, z, Pack::Set( 2.08757232129817482790e-09 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( -2.75573143513906633035e-07 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( 2.48015872894767294178e-05 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( -1.38888888888741095749e-03 ) );
+        p = Pack::MulAdd( p, z, Pack::Set( 4.16666666666666019037e-02 ) );
+        const typename Pack::Vec w = 
+            Pack::MulAdd( z, Pack::Set( -0.5 ), Pack::Set( 1. ) );
+        return Pack::MulAdd( Pack::Mul( z, z ), p, w );
+    }
+};
+
+template<>
+struct Trig<float>
+{
+    // k*PiOverTwo1 is exact as long as |k| < 2^16
+    static float Limit() { return 8192.f; }
+    static float TwoOverPi() { return 0.636619772367581343f; }
+    static float PiOverTwo1() { return 1.5703125f; }
+    static float PiOverTwo2() { return 4.837512969970703125e-4f; }
+    static float PiOverTwo3() { return 7.54978995489188216e-8f; }
+
+    template<typename Pack>
+    static typename Pack::Vec 
+    Sin( typename Pack::Vec r, typename Pack::Vec z )
+    {
+        typename Pack::Vec p = Pack::Set( -1.9515295891e-4f );
+        p = Pack::MulAdd( p, z, Pack::Set( 8.3321608736e-3f ) );
+        p = Pack::MulAdd( p, z, Pack::Set( -1.6666654611e-1f ) );
+        return Pack::MulAdd( Pack::Mul( r, z ), p, r );
+    }
+
+    template<typename Pack>
+    static typename Pack::Vec 
+    Cos( typename Pack::Vec z )
+    {
+        typename Pack::Vec p = Pack::Set( 2.443315711809948e-5f );
+        p = Pack::MulAdd( p, z, Pack::Set( -1.388731625493765e-3f ) );
+        p = Pack::MulAdd( p, z, Pack::Set( 4.166664568298827e-2f ) );
+        const typename Pack::Vec w = 
+            Pack::MulAdd( z, Pack::Set( -0.5f ), Pack::Set( 1.f ) );
+        return Pack::MulAdd( Pack::Mul( z, z ), p, w );
+    }
+};
+
+// Evaluate sin and cos over one pack of arguments
+template<typename Pack>
+inline void
+SinCosPack
+( const typename Pack::Real* a, 
+  typename Pack::Real* sinResults, 
+  typename Pack::Real* cosResults )
+{
+    typedef typename Pack::Real R;
+    typedef typename Pack::Vec Vec;
+    typedef typename Pack::Mask Mask;
+
+    const Vec x = Pack::Load( a );
+    if( Pack::AnyGreater( Pack::Abs( x ), Pack::Set( Trig<R>::Limit() ) ) )
+    {
+        for( std::size_t j=0; j<Pack::Width; ++j )
+        {
+            sinResults[j] = std::sin( a[j] );
+            cosResults[j] = std::cos( a[j] );
+        }
+        return;
+    }
+
+    // Reduce x to r = x - k pi/2, where r lies in [-pi/4,pi/4]
+    const Vec k = 
+        Pack::Round( Pack::Mul( x, Pack::Set( Trig<R>::TwoOverPi() ) ) );
+    Vec r = Pack::MulAdd( k, Pack::Set( -Trig<R>::PiOverTwo1() ), x );
+    r = Pack::MulAdd( k, Pack::Set( -Trig<R>::PiOverTwo2() ), r );
+    r = Pack::MulAdd( k, Pack::Set( -Trig<R>::PiOverTwo3() ), r );
+    const Vec z = Pack::Mul( r, r );
+    const Vec sinR = Trig<R>::template Sin<Pack>( r, z );
+    const Vec cosR = Trig<R>::template Cos<Pack>( z );
+
+    // Determine the quadrant, k mod 4, from the fractional part of k/4, 
+    // which is exactly one of 0, 1/4, 1/2, and 3/4
+    Vec f = Pack::Mul( k, Pack::Set( R(0.25) ) );
+    f = Pack::Sub( f, Pack::Floor( f ) );
+    const Mask one = Pack::Equal( f, Pack::Set( R(0.25) ) );
+    const Mask two = Pack::Equal( f, Pack::Set( R(0.5) ) );
+    const Mask three = Pack::Equal( f, Pack::Set( R(0.75) ) );
+    const Mask swap = Pack::Or( one, three );
+    const Mask negateSin = Pack::Or( two, three );
+    const Mask negateCos = Pack::Or( one, two );
+
+    const Vec zero = Pack::Set( R(0) );
+    const Vec s = Pack::Select( swap, cosR, sinR );
+    const Vec c = Pack::Select( swap, sinR, cosR );
+    Pack::Store
+    ( sinResults, Pack::Select( negateSin, Pack::Sub( zero, s ), s ) );
+    Pack::Store
+    ( cosResults, Pack::Select( negateCos, Pack::Sub( zero, c ), c ) );
+}
+
+template<typename R>
+inline void
+SinCos
+( std::size_t n, const R* a, R* sinResults, R* cosResults )
+{
+    typedef typename NativePack<R>::Type Pack;
+    const std::size_t numPacked = n - n % Pack::Width;
+    for( std::size_t j=0; j<numPacked; j+=Pack::Width )
+        SinCosPack<Pack>( &a[j], &sinResults[j], &cosResults[j] );
+    for( std::size_t j=numPacked; j<n; ++j )
+        SinCosPack< ScalarPack<R> >( &a[j], &sinResults[j], &cosResults[j] );
+}
+
+template<typename R>
+inline void
+Sin( std::size_t n, const R* a, R* sinResults )
+{
+    typedef typename NativePack<R>::Type Pack;
+    R cosResults[Pack::Width];
+    const std::size_t numPacked = n - n % Pack::Width;
+    for( std::size_t j=0; j<numPacked; j+=Pack::Width )
+        SinCosPack<Pack>( &a[j], &sinResults[j], cosResults );
+    for( std::size_t j=numPacked; j<n; ++j )
+        SinCosPack< ScalarPack<R> >( &a[j], &sinResults[j], cosResults );
+}
+
+template<typename R>
+inline void
+Cos( std::size_t n, const R* a, R* cosResults )
+{
+    typedef typename NativePack<R>::Type Pack;
+    R sinResults[Pack::Width];
+    const std::size_t numPacked = n - n % Pack::Width;
+    for( std::size_t j=0; j<numPacked; j+=Pack::Width )
+        SinCosPack<Pack>( &a[j], sinResults, &cosResults[j] );
+    for( std::size_t j=numPacked; j<n; ++j )
+        SinCosPack< ScalarPack<R> >( &a[j], sinResults, &cosResults[j] );
+}
+
+template<typename R>
+inline void
+Sqrt( std::size_t n, const R* a, R* sqrtResults )
+{
+    typedef typename NativePack<R>::Type Pack;
+    const std::size_t numPacked = n - n % Pack::Width;
+    for( std::size_t j=0; j<numPacked; j+=Pack::Width )
+        Pack::Store( &sqrtResults[j], Pack::Sqrt( Pack::Load( &a[j] ) ) );
+    for( std::size_t j=numPacked; j<n; ++j )
+        sqrtResults[j] = std::sqrt( a[j] );
+}
+
+} // simd
+} // bfio
+
+#endif // BFIO_TOOLS_SIMD_SPECIAL_FUNCTIONS_HPP
@@ -19,6 +19,7 @@
 #define BFIO_TOOLS_IMAG_EXP_HPP 1
 
 #include <math.h>
+#include <complex>
 #include <vector>
 
 #if defined(MASS)
@@ -26,6 +27,8 @@
 # include "massv.h"
 #elif defined(MKL)
 # include "mkl_vml.h"
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+# include "bfio/tools/simd_special_functions.hpp"
 #endif
 
 namespace bfio {
@@ -72,6 +75,8 @@ SinBatch
     vssin( const_cast<float*>(&a[0]), &sinResults[0], &n );
 #elif defined(MKL)
     vsSin( a.size(), &a[0], &sinResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::Sin( a.size(), &a[0], &sinResults[0] );
 #else
     {
         float* sinBuffer = &sinResults[0];
@@ -94,6 +99,8 @@ SinBatch
     vsin( const_cast<double*>(&a[0]), &sinResults[0], &n );
 #elif defined(MKL)
     vdSin( a.size(), &a[0], &sinResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::Sin( a.size(), &a[0], &sinResults[0] );
 #else
     {
         double* sinBuffer = &sinResults[0];
@@ -123,6 +130,8 @@ CosBatch
     vscos( const_cast<float*>(&a[0]), &cosResults[0], &n );
 #elif defined(MKL)
     vsCos( a.size(), &a[0], &cosResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::Cos( a.size(), &a[0], &cosResults[0] );
 #else
     {
         float* cosBuffer = &cosResults[0];
@@ -145,6 +154,8 @@ CosBatch
     vcos( const_cast<double*>(&a[0]), &cosResults[0], &n );
 #elif defined(MKL)
     vdCos( a.size(), &a[0], &cosResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::Cos( a.size(), &a[0], &cosResults[0] );
 #else
     {
         double* cosBuffer = &cosResults[0];
@@ -177,6 +188,9 @@ SinCosBatch
     vssincos( const_cast<float*>(&a[0]), &sinResults[0], &cosResults[0], &n );
 #elif defined(MKL)
     vsSinCos( a.size(), &a[0], &sinResults[0], &cosResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::SinCos
+    ( a.size(), &a[0], &sinResults[0], &cosResults[0] );
 #else
     {
         float* sinBuffer = &sinResults[0];
@@ -205,6 +219,9 @@ SinCosBatch
     vsincos( const_cast<double*>(&a[0]), &sinResults[0], &cosResults[0], &n );
 #elif defined(MKL)
     vdSinCos( a.size(), &a[0], &sinResults[0], &cosResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::SinCos
+    ( a.size(), &a[0], &sinResults[0], &cosResults[0] );
 #else
     {
         double* sinBuffer = &sinResults[0];
@@ -219,6 +236,83 @@ SinCosBatch
 #endif
 }
 
+// The following overloads also take a scratch buffer for the arguments 
+// reduced by the mixed-precision overload, so that callers which reuse it 
+// between batches do not touch the heap; it is ignored otherwise.
+template<typename R>
+void
+SinCosBatch
+( const std::vector<R>& a,
+        std::vector<R>& reduced,
+        std::vector<R>& sinResults,
+        std::vector<R>& cosResults );
+
+// For performing many single-precision sin(a)/cos(a) pairs on arguments which
+// are only accurate in double precision (see PhaseReal). The arguments are 
+// reduced to [-pi,pi] in double precision before being rounded.
+inline void
+SinCosBatch
+( const std::vector<double>& a, 
+        std::vector<float>& reduced,
+        std::vector<float>& sinResults,
+        std::vector<float>& cosResults );
+
+inline void
+SinCosBatch
+( const std::vector<double>& a, 
+        std::vector<float>& sinResults,
+        std::vector<float>& cosResults );
+
+template<typename R>
+inline void
+SinCosBatch
+( const std::vector<R>& a,
+        std::vector<R>& reduced,
+        std::vector<R>& sinResults,
+        std::vector<R>& cosResults )
+{ SinCosBatch( a, sinResults, cosResults ); }
+
+inline void
+SinCosBatch
+( const std::vector<double>& a, 
+        std::vector<float>& reduced,
+        std::vector<float>& sinResults,
+        std::vector<float>& cosResults )
+{
+    // 2 pi split into its nearest double and the remainder
+    const double twoPiHigh = 6.28318530717958623200e+00;
+    const double twoPiLow = 2.44929359829470635445e-16;
+    const double oneOverTwoPi = 1.59154943091895335769e-01;
+
+    reduced.resize( a.size() );
+    if( a.empty() )
+    {
+        sinResults.clear();
+        cosResults.clear();
+        return;
+    }
+    {
+        float* reducedBuffer = &reduced[0];
+        const double* aBuffer = &a[0];
+        for( std::size_t j=0; j<a.size(); ++j )
+        {
+            const double k = floor( aBuffer[j]*oneOverTwoPi + 0.5 );
+            reducedBuffer[j] = (aBuffer[j]-k*twoPiHigh)-k*twoPiLow;
+        }
+    }
+    SinCosBatch( reduced, sinResults, cosResults );
+}
+
+inline void
+SinCosBatch
+( const std::vector<double>& a, 
+        std::vector<float>& sinResults,
+        std::vector<float>& cosResults )
+{
+    std::vector<float> reduced;
+    SinCosBatch( a, reduced, sinResults, cosResults );
+}
+
 // For performing many sqrt computations
 template<typename R>
 void
@@ -238,6 +332,8 @@ SqrtBatch
     vssqrt( const_cast<float*>(&a[0]), &sqrtResults[0], &n );
 #elif defined(MKL)
     vsSqrt( a.size(), &a[0], &sqrtResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::Sqrt( a.size(), &a[0], &sqrtResults[0] );
 #else
     {
         float* sqrtBuffer = &sqrtResults[0];
@@ -260,6 +356,8 @@ SqrtBatch
     vsqrt( const_cast<double*>(&a[0]), &sqrtResults[0], &n );
 #elif defined(MKL)
     vdSqrt( a.size(), &a[0], &sqrtResults[0] );
+#elif defined(SIMD_SPECIAL_FUNCTIONS)
+    simd::Sqrt( a.size(), &a[0], &sqrtResults[0] );
 #else
     {
         double* sqrtBuffer = &sqrtResults[0];
@@ -0,0 +1,54 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_TOOLS_THREADS_HPP
+#define BFIO_TOOLS_THREADS_HPP 1
+
+#include <cstddef>
+
+#ifdef HYBRID
+#include <omp.h>
+#endif
+
+namespace bfio {
+
+// The maximum number of threads that a parallel region can use within this
+// process (always one without HYBRID)
+inline std::size_t
+MaxThreads()
+{
+#ifdef HYBRID
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+// The index of the calling thread within the current parallel region
+inline std::size_t
+ThreadNum()
+{
+#ifdef HYBRID
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+} // bfio
+
+#endif // BFIO_TOOLS_THREADS_HPP
@@ -0,0 +1,59 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+ 
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+ 
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+ 
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_TOOLS_UNFLATTEN_CONSTRAINED_HTREE_INDEX_HPP
+#define BFIO_TOOLS_UNFLATTEN_CONSTRAINED_HTREE_INDEX_HPP 1
+
+#include <algorithm>
+#include <cstddef>
+#include "bfio/structures/array.hpp"
+
+namespace bfio {
+
+// Inverse of FlattenConstrainedHTreeIndex: returns the coordinates of the 
+// index'th box visited by a ConstrainedHTreeWalker, which allows for jumping
+// directly into the middle of a traversal
+template<std::size_t d>
+Array<std::size_t,d>
+UnflattenConstrainedHTreeIndex
+( std::size_t index, 
+  const Array<std::size_t,d>& log2BoxesPerDim )
+{
+    std::size_t maxLog2 = 0;
+    for( std::size_t j=0; j<d; ++j )
+        maxLog2 = std::max( log2BoxesPerDim[j], maxLog2 );
+
+    // Each level consumes one bit of the index for every dimension which 
+    // has not yet been fully refined
+    Array<std::size_t,d> x(0);
+    for( std::size_t i=0; i<maxLog2; ++i )
+    {
+        for( std::size_t j=0; j<d; ++j )
+        {
+            if( log2BoxesPerDim[j] > i )
+            {
+                x[j] |= (index&1)<<i;
+                index >>= 1;
+            }
+        }
+    }
+    return x;
+}
+
+} // bfio
+
+#endif // BFIO_TOOLS_UNFLATTEN_CONSTRAINED_HTREE_INDEX_HPP
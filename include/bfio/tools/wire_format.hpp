@@ -0,0 +1,284 @@
+/*
+   ButterflyFIO: a distributed-memory fast algorithm for applying FIOs.
+   Copyright (C) 2010-2011 Jack Poulson <jack.poulson@gmail.com>
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef BFIO_TOOLS_WIRE_FORMAT_HPP
+#define BFIO_TOOLS_WIRE_FORMAT_HPP 1
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "bfio/constants.hpp"
+#include "bfio/tools/mpi.hpp"
+#include "mpi.h"
+
+namespace bfio {
+
+// The number of bytes which each real occupies in the given wire format
+template<typename R>
+std::size_t WireSize( WireFormat wireFormat );
+
+// Rounds the n reals of 'values' into the wire format, accumulating the
+// squares of the rounding errors for PrintWireErrors
+template<typename R>
+void EncodeWire
+( WireFormat wireFormat, const R* values, std::size_t n, char* wire );
+
+// sums[i] = addends[i] + the i'th real of the wire, where sums may be the
+// same as addends
+template<typename R>
+void DecodeWireAndAdd
+( WireFormat wireFormat, const char* wire, std::size_t n,
+  const R* addends, R* sums );
+
+// Collective: the reduce-scatter of SumScatter, except that the entries 
+// which each process sends to the others are rounded into the wire format
+// (its own entries are summed in full precision)
+template<typename R>
+void WireSumScatter
+( WireFormat wireFormat, const R* sendBuf, R* recvBuf, int* recvCounts, 
+  MPI_Comm comm );
+
+// Collective: prints the relative 2-norm of the errors in every real which
+// was rounded into a wire format since the last reset
+static inline void PrintWireErrors( MPI_Comm comm );
+static inline void ResetWireErrors();
+
+// Implementations
+
+namespace wire_format {
+
+// The sums of the squares of the rounding errors, and of the values which
+// were rounded, since the last ResetWireErrors
+inline double&
+ErrorSquared()
+{
+    static double errorSquared = 0;
+    return errorSquared;
+}
+
+inline double&
+ValueSquared()
+{
+    static double valueSquared = 0;
+    return valueSquared;
+}
+
+// Rounds a float to the nearest bfloat16, i.e., its leading 16 bits, with
+// ties broken towards even
+inline unsigned short
+FloatToBFloat16( float value )
+{
+    unsigned bits;
+    std::memcpy( &bits, &value, sizeof(float) );
+    bits += 0x7FFFu + ((bits>>16)&1u);
+    return static_cast<unsigned short>(bits>>16);
+}
+
+inline float
+BFloat16ToFloat( unsigned short value )
+{
+    const unsigned bits = static_cast<unsigned>(value)<<16;
+    float result;
+    std::memcpy( &result, &bits, sizeof(float) );
+    return result;
+}
+
+} // wire_format
+
+template<typename R>
+inline std::size_t
+WireSize( WireFormat wireFormat )
+{
+    if( wireFormat == BFLOAT16_WIRE )
+        return sizeof(unsigned short);
+    else if( wireFormat == SINGLE_PRECISION_WIRE && sizeof(float) < sizeof(R) )
+        return sizeof(float);
+    else
+        return sizeof(R);
+}
+
+template<typename R>
+void
+EncodeWire
+( WireFormat wireFormat, const R* values, std::size_t n, char* wire )
+{
+    using namespace wire_format;
+    double errorSquared = 0;
+    double valueSquared = 0;
+    if( wireFormat == BFLOAT16_WIRE )
+    {
+        unsigned short* wireValues = reinterpret_cast<unsigned short*>(wire);
+        for( std::size_t i=0; i<n; ++i )
+        {
+            wireValues[i] = FloatToBFloat16( values[i] );
+            const double error =
+                double(values[i]) - BFloat16ToFloat( wireValues[i] );
+            errorSquared += error*error;
+            valueSquared += double(values[i])*values[i];
+        }
+    }
+    else if( WireSize<R>( wireFormat ) == sizeof(float) &&
+             sizeof(float) < sizeof(R) )
+    {
+        float* wireValues = reinterpret_cast<float*>(wire);
+        for( std::size_t i=0; i<n; ++i )
+        {
+            wireValues[i] = values[i];
+            const double error = double(values[i]) - wireValues[i];
+            errorSquared += error*error;
+            valueSquared += double(values[i])*values[i];
+        }
+    }
+    else
+    {
+        std::memcpy( wire, values, n*sizeof(R) );
+        for( std::size_t i=0; i<n; ++i )
+            valueSquared += double(values[i])*values[i];
+    }
+    ErrorSquared() += errorSquared;
+    ValueSquared() += valueSquared;
+}
+
+template<typename R>
+void
+DecodeWireAndAdd
+( WireFormat wireFormat, const char* wire, std::size_t n,
+  const R* addends, R* sums )
+{
+    using namespace wire_format;
+    if( wireFormat == BFLOAT16_WIRE )
+    {
+        const unsigned short* wireValues =
+            reinterpret_cast<const unsigned short*>(wire);
+        for( std::size_t i=0; i<n; ++i )
+            sums[i] = addends[i] + BFloat16ToFloat( wireValues[i] );
+    }
+    else if( WireSize<R>( wireFormat ) == sizeof(float) &&
+             sizeof(float) < sizeof(R) )
+    {
+        const float* wireValues = reinterpret_cast<const float*>(wire);
+        for( std::size_t i=0; i<n; ++i )
+            sums[i] = addends[i] + wireValues[i];
+    }
+    else
+    {
+        const R* wireValues = reinterpret_cast<const R*>(wire);
+        for( std::size_t i=0; i<n; ++i )
+            sums[i] = addends[i] + wireValues[i];
+    }
+}
+
+template<typename R>
+void
+WireSumScatter
+( WireFormat wireFormat, const R* sendBuf, R* recvBuf, int* recvCounts, 
+  MPI_Comm comm )
+{
+    const std::size_t wireSize = WireSize<R>( wireFormat );
+    if( wireSize == sizeof(R) )
+    {
+        SumScatter( sendBuf, recvBuf, recvCounts, comm );
+        return;
+    }
+
+    int commSize, rank;
+    MPI_Comm_size( comm, &commSize );
+    MPI_Comm_rank( comm, &rank );
+    std::vector<std::size_t> displs( commSize+1, 0 );
+    for( int p=0; p<commSize; ++p )
+        displs[p+1] = displs[p] + recvCounts[p];
+    const std::size_t myCount = recvCounts[rank];
+
+    // Round the entries of every other process into the wire and exchange
+    // them with it. Both wires skip our own entries.
+    std::vector<char> sendWire( (displs[commSize]-myCount)*wireSize );
+    std::vector<char> recvWire( (commSize-1)*myCount*wireSize );
+    std::vector<MPI_Request> requests;
+    requests.reserve( 2*(commSize-1) );
+    for( int p=0; p<commSize; ++p )
+    {
+        if( p == rank )
+            continue;
+        const std::size_t slot = ( p < rank ? p : p-1 );
+        if( myCount != 0 )
+        {
+            requests.push_back( MPI_REQUEST_NULL );
+            IRecv
+            ( &recvWire[slot*myCount*wireSize], myCount*wireSize, p, 0, comm,
+              requests.back() );
+        }
+        if( recvCounts[p] != 0 )
+        {
+            const std::size_t offset = 
+                ( p < rank ? displs[p] : displs[p]-myCount )*wireSize;
+            EncodeWire
+            ( wireFormat, &sendBuf[displs[p]], recvCounts[p], 
+              &sendWire[offset] );
+            requests.push_back( MPI_REQUEST_NULL );
+            ISend
+            ( &sendWire[offset], recvCounts[p]*wireSize, p, 0, comm, 
+              requests.back() );
+        }
+    }
+    if( recvBuf != &sendBuf[displs[rank]] )
+        std::memcpy( recvBuf, &sendBuf[displs[rank]], myCount*sizeof(R) );
+    if( !requests.empty() )
+        MPI_Waitall( requests.size(), &requests[0], MPI_STATUSES_IGNORE );
+
+    // Sum the contributions in rank order
+    for( int p=0; p<commSize; ++p )
+    {
+        if( p == rank || myCount == 0 )
+            continue;
+        const std::size_t slot = ( p < rank ? p : p-1 );
+        DecodeWireAndAdd
+        ( wireFormat, &recvWire[slot*myCount*wireSize], myCount, 
+          recvBuf, recvBuf );
+    }
+}
+
+static inline void
+PrintWireErrors( MPI_Comm comm )
+{
+    using namespace wire_format;
+    double mySquares[2] = { ErrorSquared(), ValueSquared() };
+    double squares[2];
+    MPI_Reduce( mySquares, squares, 2, MPI_DOUBLE, MPI_SUM, 0, comm );
+
+    int rank;
+    MPI_Comm_rank( comm, &rank );
+    if( rank == 0 )
+    {
+        const double relativeError =
+            ( squares[1] == 0 ? 0 : std::sqrt(squares[0]/squares[1]) );
+        std::cout << "Relative ||e||_2 of the weights on the wire: "
+                  << relativeError << std::endl;
+    }
+}
+
+static inline void
+ResetWireErrors()
+{
+    wire_format::ErrorSquared() = 0;
+    wire_format::ValueSquared() = 0;
+}
+
+} // bfio
+
+#endif // BFIO_TOOLS_WIRE_FORMAT_HPP
@@ -63,7 +63,12 @@ main
                 std::cout << i << ": ";
                 for( std::size_t j=0; j<d; ++j )
                     std::cout << A[j] << " ";
-                std::cout << "; flattened=" << k << std::endl;
+                const bfio::Array<std::size_t,d> B = 
+                    bfio::UnflattenConstrainedHTreeIndex( i, log2BoxesPerDim );
+                std::cout << "; flattened=" << k << "; unflattened=";
+                for( std::size_t j=0; j<d; ++j )
+                    std::cout << B[j] << " ";
+                std::cout << std::endl;
             }
         }
     }
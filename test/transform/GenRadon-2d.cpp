@@ -258,8 +258,10 @@ main
             }
         }
 
-        // Create our phase functor
-        GenRadon<float> genRadon;
+        // Create our phase functor. Since its type is known here, the 
+        // transform can call it directly rather than through Phase.
+        typedef GenRadon<bfio::PhaseReal<float>::Type> PhaseType;
+        PhaseType genRadon;
 
         // Create the context that takes care of all of the precomputation
         if( rank == 0 )
@@ -272,12 +274,12 @@ main
             cout << "done." << endl;
 
         // Run the algorithm to generate the potential field
-        auto_ptr< const bfio::rfio::PotentialField<float,d,q> > u;
+        auto_ptr< const bfio::rfio::PotentialField<float,d,q,PhaseType> > u;
         if( rank == 0 )
             cout << "Launching transform..." << endl;
         MPI_Barrier( comm );
         double startTime = MPI_Wtime();
-        u = bfio::ReducedFIO
+        u = bfio::ReducedFIO<PhaseType>
         ( context, plan, genRadon, sourceBox, targetBox, mySources );
         MPI_Barrier( comm );
         double stopTime = MPI_Wtime();
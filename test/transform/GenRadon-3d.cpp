@@ -150,6 +150,40 @@ void GenRadon<R>::BatchEvaluate
     }
 }
 
+// Prints the relative 2-norm of the difference between two potential fields
+// of the same plan, sampled on a regular grid of each process's target box
+void
+PrintDifference
+( MPI_Comm comm,
+  const string& label,
+  const bfio::rfio::PotentialField<double,d,q>& u,
+  const bfio::rfio::PotentialField<double,d,q>& v )
+{
+    const size_t numSamplesPerBoxDim = 2;
+    vector< complex<double> > uSamples, vSamples;
+    u.EvaluateOnGrid( numSamplesPerBoxDim, uSamples );
+    v.EvaluateOnGrid( numSamplesPerBoxDim, vSamples );
+
+    double mySquares[2] = { 0, 0 };
+    for( size_t i=0; i<uSamples.size(); ++i )
+    {
+        mySquares[0] += norm( uSamples[i]-vSamples[i] );
+        mySquares[1] += norm( vSamples[i] );
+    }
+    double squares[2];
+    MPI_Reduce( mySquares, squares, 2, MPI_DOUBLE, MPI_SUM, 0, comm );
+
+    int rank;
+    MPI_Comm_rank( comm, &rank );
+    if( rank == 0 )
+    {
+        const double relativeError = 
+            ( squares[1] == 0 ? 0 : sqrt(squares[0]/squares[1]) );
+        cout << label << ", relative ||e||_2 against ReducedFIO: " 
+             << relativeError << endl;
+    }
+}
+
 int
 main
 ( int argc, char* argv[] )
@@ -290,7 +324,71 @@ main
 #endif
 
         if( testAccuracy )
+        {
             bfio::rfio::PrintErrorEstimates( comm, *u, globalSources );
+
+            // Apply a precomputed transform twice, with new magnitudes the 
+            // second time, and check each result against a plain ReducedFIO
+            const size_t memoryBudget = 1u<<28;
+            bfio::PrecomputedFIO<double,d,q> A
+            ( context, plan, genRadon, sourceBox, targetBox, memoryBudget );
+            vector< bfio::Source<double,d> > newSources( mySources );
+            for( size_t application=0; application<2; ++application )
+            {
+                if( application > 0 )
+                    for( size_t i=0; i<newSources.size(); ++i )
+                        newSources[i].magnitude = 
+                            1.*(2*bfio::Uniform<double>()-1);
+                auto_ptr< const bfio::rfio::PotentialField<double,d,q> > v = 
+                    A.Apply( newSources );
+                auto_ptr< const bfio::rfio::PotentialField<double,d,q> > w = 
+                    bfio::ReducedFIO
+                    ( context, plan, genRadon, sourceBox, targetBox, 
+                      newSources );
+                ostringstream label;
+                label << "PrecomputedFIO application " << application;
+                PrintDifference( comm, label.str(), *v, *w );
+            }
+            if( rank == 0 )
+                cout << "Stored " << A.StoredSize() << " bytes of phase "
+                     << "factors on process 0" << endl;
+
+            // Apply the transform to two sets of sources at once, the 
+            // original ones and ones with new magnitudes, and check each 
+            // field against a transform of its set alone
+            const size_t numRHS = 2;
+            const size_t numLocalSources = mySources.size();
+            vector< bfio::Source<double,d> > 
+                rhsSources( numRHS*numLocalSources );
+            for( size_t i=0; i<numLocalSources; ++i )
+            {
+                rhsSources[i] = mySources[i];
+                rhsSources[numLocalSources+i] = newSources[i];
+            }
+            vector< const bfio::rfio::PotentialField<double,d,q>* > fields;
+            bfio::ReducedFIO
+            ( context, plan, genRadon, sourceBox, targetBox, rhsSources, 
+              numRHS, fields );
+            auto_ptr< const bfio::rfio::PotentialField<double,d,q> > 
+                field0( fields[0] ), field1( fields[1] );
+            auto_ptr< const bfio::rfio::PotentialField<double,d,q> > w = 
+                bfio::ReducedFIO
+                ( context, plan, genRadon, sourceBox, targetBox, newSources );
+            PrintDifference( comm, "Right-hand side 0", *field0, *u );
+            PrintDifference( comm, "Right-hand side 1", *field1, *w );
+
+            // Communicate the weights in single precision and check the 
+            // rounding of the wire and its effect on the field
+            plan.SetWireFormat( bfio::SINGLE_PRECISION_WIRE );
+            bfio::ResetWireErrors();
+            auto_ptr< const bfio::rfio::PotentialField<double,d,q> > 
+                singleWireField = bfio::ReducedFIO
+                ( context, plan, genRadon, sourceBox, targetBox, mySources );
+            plan.SetWireFormat( bfio::FULL_PRECISION_WIRE );
+            bfio::PrintWireErrors( comm );
+            PrintDifference
+            ( comm, "Single-precision wire", *singleWireField, *u );
+        }
         
         if( store )
         {
@@ -291,8 +291,10 @@ main
             targetBox.widths[j] = 1;
         }
 
-        // Set up the general strategy for the forward transform
-        bfio::Plan<d> plan( comm, bfio::FORWARD, N, bootstrapSkip );
+        // Set up the general strategy for the forward transform. Both waves
+        // are applied at every timestep with the same cached plan.
+        const bfio::Plan<d>& plan = bfio::PlanCache<d>::Instance().Get
+        ( comm, bfio::FORWARD, N, bootstrapSkip );
         bfio::Box<double,d> mySourceBox = 
             plan.GetMyInitialSourceBox( sourceBox );
 
@@ -349,38 +351,29 @@ main
             upWave.SetTime( t );
             downWave.SetTime( t );
 
-            std::auto_ptr
-            < const bfio::rfio::PotentialField<double,d,q> > u;
+            // Both waves share their sources, so they are computed together
+            std::vector<const bfio::Phase<double,d>*> phases( 2 );
+            phases[0] = &upWave;
+            phases[1] = &downWave;
+            std::vector<const bfio::rfio::PotentialField<double,d,q>*> fields;
             if( rank == 0 )
             {
                 std::cout << "t=" << t << "\n"
-                          << "  Starting upWave transform...";
+                          << "  Starting upWave and downWave transforms...";
                 std::cout.flush();
             }
-            u = bfio::ReducedFIO
-            ( context, plan, upWave, sourceBox, targetBox, mySources );
+            bfio::ReducedFIO
+            ( context, plan, phases, sourceBox, targetBox, mySources, fields );
             if( rank == 0 )
                 std::cout << "done" << std::endl;
 #ifdef TIMING
             if( rank == 0 )
                 bfio::rfio::PrintTimings();
 #endif
-
             std::auto_ptr
-            < const bfio::rfio::PotentialField<double,d,q> > v;
-            if( rank == 0 )
-            {
-                std::cout << "  Starting downWave transform...";
-                std::cout.flush();
-            }
-            v = bfio::ReducedFIO
-            ( context, plan, downWave, sourceBox, targetBox, mySources );
-            if( rank == 0 )
-                std::cout << "done" << std::endl;
-#ifdef TIMING
-            if( rank == 0 )
-                bfio::rfio::PrintTimings();
-#endif
+            < const bfio::rfio::PotentialField<double,d,q> > u( fields[0] );
+            std::auto_ptr
+            < const bfio::rfio::PotentialField<double,d,q> > v( fields[1] );
 
             // Store this timeslice
             std::ostringstream fileStream;
@@ -396,6 +389,7 @@ main
             << "   " << e.what();
         std::cout << msg.str() << std::endl;
     }
+    bfio::PlanCache<d>::Instance().Clear();
 
     MPI_Finalize();
     return 0;
@@ -53,6 +53,17 @@ public:
     ( const std::vector< bfio::Array<R,d> >& xPoints,
       const std::vector< bfio::Array<R,d> >& pPoints,
             std::vector< std::complex<R>  >& results ) const;
+
+    // Since the amplitude is a sum of two products, 1 + a(x) b(p), we can 
+    // also expose its factors so that they may be applied as scalings
+    virtual std::size_t GetRank() const;
+
+    virtual void
+    BatchEvaluateFactors
+    ( const std::vector< bfio::Array<R,d> >& xPoints,
+      const std::vector< bfio::Array<R,d> >& pPoints,
+            std::vector< std::complex<R>  >& xResults,
+            std::vector< std::complex<R>  >& pResults ) const;
 };
 
 template<typename R>
@@ -154,6 +165,39 @@ Oscillatory<R>::BatchEvaluate
     }
 }
 
+template<typename R>
+inline std::size_t
+Oscillatory<R>::GetRank() const
+{ return 2; }
+
+template<typename R>
+void
+Oscillatory<R>::BatchEvaluateFactors
+( const std::vector< bfio::Array<R,d> >& xPoints,
+  const std::vector< bfio::Array<R,d> >& pPoints,
+        std::vector< std::complex<R>  >& xResults,
+        std::vector< std::complex<R>  >& pResults ) const
+{
+    const std::size_t xSize = xPoints.size();
+    const std::size_t pSize = pPoints.size();
+
+    // The first term is identically one
+    xResults.resize( 2*xSize );
+    pResults.resize( 2*pSize );
+    for( std::size_t i=0; i<xSize; ++i )
+        xResults[i] = 1;
+    for( std::size_t j=0; j<pSize; ++j )
+        pResults[j] = 1;
+
+    // The second term is 0.5 sin(pi x0) sin(4 pi x1) cos(3 pi p0) cos(4 pi p1)
+    for( std::size_t i=0; i<xSize; ++i )
+        xResults[xSize+i] = 
+            0.5*sin(1*bfio::Pi*xPoints[i][0])*sin(4*bfio::Pi*xPoints[i][1]);
+    for( std::size_t j=0; j<pSize; ++j )
+        pResults[pSize+j] = 
+            cos(3*bfio::Pi*pPoints[j][0])*cos(4*bfio::Pi*pPoints[j][1]);
+}
+
 template<typename R>
 inline UpWave<R>*
 UpWave<R>::Clone() const